@@ -14,6 +14,7 @@
 #include <gio/gio.h>
 
 #include "synce-device-manager.h"
+#include "synce-device.h"
 
 #include "log.h"
 #include "utils.h"
@@ -24,6 +25,8 @@
 
 static gint log_level = 6;
 static gboolean log_to_foreground = FALSE;
+static gint pool_size = 1;
+static gint pool_idle_timeout = 60;
 
 /* globals */
 
@@ -31,6 +34,8 @@ static GOptionEntry options[] =
   {
     { "log-level", 'l', 0, G_OPTION_ARG_INT, &log_level, "Set log level 0 (none) to 6 (debug), default 3", NULL },
     { "foreground", 'f', 0, G_OPTION_ARG_NONE, &log_to_foreground, "Do not log to system log", NULL },
+    { "pool-size", 'p', 0, G_OPTION_ARG_INT, &pool_size, "Number of RAPI connections to keep open to each device, default 1, 0 to disable", NULL },
+    { "pool-idle-timeout", 't', 0, G_OPTION_ARG_INT, &pool_idle_timeout, "Seconds an unused pooled connection is kept open, default 60, 0 for no limit", NULL },
     { NULL }
   };
 
@@ -125,6 +130,8 @@ main(gint argc,
   }
   g_option_context_free(option_context);
 
+  synce_device_pool_configure (MAX (pool_size, 0), MAX (pool_idle_timeout, 0));
+
   if (!log_to_foreground) {
     openlog(g_get_prgname(), LOG_PID, LOG_DAEMON);
     g_log_set_default_handler(log_to_syslog, &log_level);
@@ -135,6 +142,9 @@ main(gint argc,
 
   g_debug("%s: starting ...", G_STRFUNC);
 
+  /* whatever a previous dccm had connected is gone */
+  synce_bump_device_generation ();
+
   mainloop = g_main_loop_new (NULL, FALSE);
 
   req_name_result = g_bus_own_name(G_BUS_TYPE_SYSTEM,
@@ -63,6 +63,13 @@ struct _SynceDevicePrivate
 
   GHashTable *requests;
   guint req_id;
+
+  /* warm connections handed out by RequestConnection */
+  GQueue *pool;
+  GHashTable *pool_requests;
+  guint pool_hits;
+  guint pool_misses;
+  guint pool_expired;
 };
 
 #define SYNCE_DEVICE_GET_PRIVATE(o) \
@@ -76,6 +83,9 @@ void synce_device_change_password_flags (SynceDevice *self, SynceDevicePasswordF
 void synce_device_conn_broker_done_cb (SynceConnectionBroker *broker, gpointer user_data);
 void synce_device_dbus_init(SynceDevice *self);
 void synce_device_conn_event_cb(GObject *istream, GAsyncResult *res, gpointer user_data);
+void synce_device_pool_fill (SynceDevice *self);
+gboolean synce_device_pool_add (SynceDevice *self, guint req_id, GSocketConnection *conn);
+void synce_device_pool_clear (SynceDevice *self);
 
 G_END_DECLS
 
@@ -130,6 +130,7 @@ synce_device_manager_remove_device(SynceDeviceManager *self, const gchar *device
     g_message("%s: emitting disconnect for object path %s", G_STRFUNC, obj_path);
     g_signal_emit (self, SYNCE_DEVICE_MANAGER_GET_CLASS(SYNCE_DEVICE_MANAGER(self))->signals[SYNCE_DEVICE_MANAGER_DEVICE_DISCONNECTED], 0, obj_path);
     synce_dbus_device_manager_emit_device_disconnected(priv->interface, obj_path);
+    synce_bump_device_generation ();
     g_free(obj_path);
   } else {
     g_message("%s: removing uninitialised device: %s", G_STRFUNC, device_path);
@@ -195,6 +196,7 @@ synce_device_manager_device_sends_disconnected_cb(SynceDevice *device,
   g_message("%s: emitting disconnect for object path %s", G_STRFUNC, obj_path);
   g_signal_emit (self, SYNCE_DEVICE_MANAGER_GET_CLASS(SYNCE_DEVICE_MANAGER(self))->signals[SYNCE_DEVICE_MANAGER_DEVICE_DISCONNECTED], 0, obj_path);
   synce_dbus_device_manager_emit_device_disconnected(priv->interface, obj_path);
+  synce_bump_device_generation ();
   g_free(obj_path);
   synce_device_manager_device_entry_free(deventry);
 
@@ -221,6 +223,7 @@ synce_device_manager_device_obj_path_changed_cb(GObject    *obj,
   g_debug("%s: sending connected signal for %s", G_STRFUNC, obj_path); 
   g_signal_emit (self, SYNCE_DEVICE_MANAGER_GET_CLASS(SYNCE_DEVICE_MANAGER(self))->signals[SYNCE_DEVICE_MANAGER_DEVICE_CONNECTED], 0, obj_path);
   synce_dbus_device_manager_emit_device_connected(priv->interface, obj_path);
+  synce_bump_device_generation ();
   g_free (obj_path);
 }
 
@@ -237,6 +237,7 @@ synce_device_rndis_info_received(SynceDeviceRndis *self, const guchar *buf, gssi
     {
       synce_device_change_password_flags (SYNCE_DEVICE(self), SYNCE_DEVICE_PASSWORD_FLAG_UNSET);
       priv->state = CTRL_STATE_CONNECTED;
+      synce_device_pool_fill (SYNCE_DEVICE(self));
     }
 
   goto OUT;
@@ -385,6 +386,7 @@ synce_device_rndis_conn_event_cb_impl(GObject *source_object,
 	  {
 	    priv->state = CTRL_STATE_CONNECTED;
 	    synce_device_change_password_flags (SYNCE_DEVICE(self), SYNCE_DEVICE_PASSWORD_FLAG_UNLOCKED);
+	    synce_device_pool_fill (SYNCE_DEVICE(self));
 	  }
 	else
 	  {
@@ -402,6 +404,7 @@ synce_device_rndis_conn_event_cb_impl(GObject *source_object,
 	  {
 	    priv->state = CTRL_STATE_CONNECTED;
 	    synce_device_change_password_flags (SYNCE_DEVICE(self), SYNCE_DEVICE_PASSWORD_FLAG_UNLOCKED);
+	    synce_device_pool_fill (SYNCE_DEVICE(self));
 
 	    guint32 extraDataForPhone ;
 	    /*
@@ -568,10 +571,40 @@ synce_device_rndis_client_event_cb(GObject *source_object,
       return;
     }
 
+  if (synce_device_pool_add (SYNCE_DEVICE(self), id, conn))
+    {
+      g_object_unref(conn);
+      g_object_unref(self);
+      return;
+    }
+
   g_warning ("%s: unhandled event", G_STRFUNC);
   g_object_unref(self);
 }
 
+static gboolean
+synce_device_rndis_request_pool_connection_impl (SynceDevice *self, guint req_id)
+{
+  SynceDevicePrivate *priv = SYNCE_DEVICE_GET_PRIVATE(self);
+  GError *error = NULL;
+  guint32 buf[3];
+  gsize written = 0;
+
+  /* the same request RequestConnection sends, only nobody waits for it yet */
+  buf[0] = GUINT32_TO_LE (5);
+  buf[1] = GUINT32_TO_LE (4);
+  buf[2] = GUINT32_TO_LE (req_id);
+
+  GOutputStream *out_stream = g_io_stream_get_output_stream(G_IO_STREAM(priv->conn));
+  if (!(g_output_stream_write_all(out_stream, (gchar *) buf, sizeof(buf), &written, NULL, &error))) {
+    g_warning("%s: failed to write out request for pooled RAPI connection: %s", G_STRFUNC, error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 void
 synce_device_rndis_client_connected (SynceDeviceRndis *self, GSocketConnection *conn)
 {
@@ -631,6 +664,7 @@ synce_device_rndis_class_init (SynceDeviceRndisClass *klass)
 
   synce_device_class->synce_device_conn_event_cb = synce_device_rndis_conn_event_cb_impl;
   synce_device_class->synce_device_request_connection = synce_device_rndis_request_connection_impl;
+  synce_device_class->synce_device_request_pool_connection = synce_device_rndis_request_pool_connection_impl;
 }
 
 SynceDeviceRndis *
@@ -43,13 +43,231 @@ enum
 };
 
 
+/* connection pool */
+
+static guint pool_size = 1;
+static guint pool_idle_timeout = 60;
+
+typedef struct _SyncePooledConnection SyncePooledConnection;
+struct _SyncePooledConnection
+{
+  SynceDevice *device;
+  GSocketConnection *conn;
+  GSource *watch;
+  guint timeout_id;
+};
+
+/*
+ * Number of connections to keep open to each device, and the seconds
+ * an unused one is kept before it is closed. An idle timeout of 0
+ * keeps them until the device closes them.
+ */
+void
+synce_device_pool_configure (guint size, guint idle_timeout)
+{
+  pool_size = size;
+  pool_idle_timeout = idle_timeout;
+}
+
+static void
+synce_device_pool_update_stats (SynceDevice *self)
+{
+  SynceDevicePrivate *priv = SYNCE_DEVICE_GET_PRIVATE (self);
+
+  if (!priv->interface)
+    return;
+
+  synce_dbus_device_set_pool_idle (priv->interface, g_queue_get_length (priv->pool));
+  synce_dbus_device_set_pool_hits (priv->interface, priv->pool_hits);
+  synce_dbus_device_set_pool_misses (priv->interface, priv->pool_misses);
+}
+
+static void
+synce_device_pool_entry_free (SyncePooledConnection *entry)
+{
+  g_source_destroy (entry->watch);
+  g_source_unref (entry->watch);
+  if (entry->timeout_id)
+    g_source_remove (entry->timeout_id);
+
+  if (entry->conn) {
+    g_io_stream_close (G_IO_STREAM (entry->conn), NULL, NULL);
+    g_object_unref (entry->conn);
+  }
+
+  g_free (entry);
+}
+
+static void
+synce_device_pool_drop (SyncePooledConnection *entry)
+{
+  SynceDevice *self = entry->device;
+  SynceDevicePrivate *priv = SYNCE_DEVICE_GET_PRIVATE (self);
+
+  g_queue_remove (priv->pool, entry);
+  synce_device_pool_entry_free (entry);
+  synce_device_pool_update_stats (self);
+}
+
+static gboolean
+synce_device_pool_conn_event_cb (G_GNUC_UNUSED GSocket *socket,
+				 G_GNUC_UNUSED GIOCondition condition,
+				 gpointer user_data)
+{
+  /* nothing is sent on a connection before it is used, so the device hung up */
+  g_debug ("%s: device closed a pooled connection", G_STRFUNC);
+  synce_device_pool_drop (user_data);
+  return FALSE;
+}
+
+static gboolean
+synce_device_pool_timeout_cb (gpointer user_data)
+{
+  SyncePooledConnection *entry = user_data;
+  SynceDevicePrivate *priv = SYNCE_DEVICE_GET_PRIVATE (entry->device);
+
+  g_debug ("%s: closing unused pooled connection", G_STRFUNC);
+
+  /* not refilled, the next miss does that */
+  entry->timeout_id = 0;
+  priv->pool_expired++;
+  synce_device_pool_drop (entry);
+  return FALSE;
+}
+
+/*
+ * Ask the device for connections until the pool, with what is already
+ * asked for, holds pool_size of them. They arrive through
+ * synce_device_pool_add().
+ */
+void
+synce_device_pool_fill (SynceDevice *self)
+{
+  SynceDevicePrivate *priv = SYNCE_DEVICE_GET_PRIVATE (self);
+  g_return_if_fail(!(priv->dispose_has_run));
+  SynceDeviceClass *klass = SYNCE_DEVICE_GET_CLASS (self);
+  guint req_id;
+
+  if (!klass->synce_device_request_pool_connection || priv->state != CTRL_STATE_CONNECTED)
+    return;
+
+  while (g_queue_get_length (priv->pool) + g_hash_table_size (priv->pool_requests) < pool_size)
+    {
+      req_id = ++(priv->req_id);
+      if (!klass->synce_device_request_pool_connection (self, req_id))
+	break;
+
+      g_hash_table_add (priv->pool_requests, GUINT_TO_POINTER (req_id));
+    }
+}
+
+/*
+ * Keep a connection the device opened for request req_id, if that was
+ * a pool request. Returns FALSE if it was not.
+ */
+gboolean
+synce_device_pool_add (SynceDevice *self, guint req_id, GSocketConnection *conn)
+{
+  SynceDevicePrivate *priv = SYNCE_DEVICE_GET_PRIVATE (self);
+  g_return_val_if_fail(!(priv->dispose_has_run), FALSE);
+  SyncePooledConnection *entry;
+
+  if (!g_hash_table_remove (priv->pool_requests, GUINT_TO_POINTER (req_id)))
+    return FALSE;
+
+  entry = g_new0 (SyncePooledConnection, 1);
+  entry->device = self;
+  entry->conn = g_object_ref (conn);
+
+  entry->watch = g_socket_create_source (g_socket_connection_get_socket (conn),
+					 G_IO_IN | G_IO_HUP | G_IO_ERR, NULL);
+  g_source_set_callback (entry->watch, (GSourceFunc) synce_device_pool_conn_event_cb, entry, NULL);
+  g_source_attach (entry->watch, NULL);
+
+  if (pool_idle_timeout > 0)
+    entry->timeout_id = g_timeout_add_seconds (pool_idle_timeout, synce_device_pool_timeout_cb, entry);
+
+  g_queue_push_tail (priv->pool, entry);
+  synce_device_pool_update_stats (self);
+
+  g_debug ("%s: pooled connection for request %u, %u idle", G_STRFUNC,
+	   req_id, g_queue_get_length (priv->pool));
+  return TRUE;
+}
+
+/* the most recent connection is the least likely to have gone stale */
+static GSocketConnection *
+synce_device_pool_take (SynceDevice *self)
+{
+  SynceDevicePrivate *priv = SYNCE_DEVICE_GET_PRIVATE (self);
+  SyncePooledConnection *entry;
+  GSocketConnection *conn;
+
+  entry = g_queue_pop_tail (priv->pool);
+  if (!entry)
+    return NULL;
+
+  conn = entry->conn;
+  entry->conn = NULL;
+  synce_device_pool_entry_free (entry);
+
+  return conn;
+}
+
+void
+synce_device_pool_clear (SynceDevice *self)
+{
+  SynceDevicePrivate *priv = SYNCE_DEVICE_GET_PRIVATE (self);
+  SyncePooledConnection *entry;
+
+  while ((entry = g_queue_pop_head (priv->pool)))
+    synce_device_pool_entry_free (entry);
+
+  g_hash_table_remove_all (priv->pool_requests);
+}
+
+
 /* method overrides */
 
 gboolean
 synce_device_request_connection (SynceDbusDevice *interface, GDBusMethodInvocation *invocation, gpointer userdata)
 {
   SynceDevice *self = SYNCE_DEVICE (userdata);
-  return (SYNCE_DEVICE_GET_CLASS(self)->synce_device_request_connection (interface, invocation, userdata));
+  SynceDevicePrivate *priv = SYNCE_DEVICE_GET_PRIVATE (self);
+  SynceConnectionBroker *broker;
+  GSocketConnection *conn;
+  gboolean result;
+
+  if (pool_size == 0 || !SYNCE_DEVICE_GET_CLASS(self)->synce_device_request_pool_connection)
+    return (SYNCE_DEVICE_GET_CLASS(self)->synce_device_request_connection (interface, invocation, userdata));
+
+  conn = synce_device_pool_take (self);
+  if (!conn)
+    {
+      if (priv->state == CTRL_STATE_CONNECTED)
+	priv->pool_misses++;
+
+      result = SYNCE_DEVICE_GET_CLASS(self)->synce_device_request_connection (interface, invocation, userdata);
+
+      synce_device_pool_fill (self);
+      synce_device_pool_update_stats (self);
+      return result;
+    }
+
+  priv->pool_hits++;
+
+  guint *req_id_local = (guint *) g_malloc (sizeof (guint));
+  *req_id_local = ++(priv->req_id);
+
+  broker = synce_connection_broker_new (*req_id_local, invocation);
+  g_hash_table_insert (priv->requests, req_id_local, broker);
+  g_signal_connect (broker, "done", (GCallback) synce_device_conn_broker_done_cb, self);
+
+  _synce_connection_broker_take_connection (broker, conn);
+
+  synce_device_pool_fill (self);
+  synce_device_pool_update_stats (self);
+  return TRUE;
 }
 
 
@@ -289,6 +507,19 @@ synce_device_get_current_partner_id(SynceDbusDevice *interface,
   return TRUE;
 }
 
+static gboolean
+synce_device_get_pool_stats(SynceDbusDevice *interface,
+			    GDBusMethodInvocation *invocation,
+			    gpointer userdata)
+{
+  SynceDevice *self = SYNCE_DEVICE (userdata);
+  SynceDevicePrivate *priv = SYNCE_DEVICE_GET_PRIVATE (self);
+
+  synce_dbus_device_complete_get_pool_stats(interface, invocation, g_queue_get_length (priv->pool),
+					    priv->pool_hits, priv->pool_misses, priv->pool_expired);
+  return TRUE;
+}
+
 static gboolean
 synce_device_get_password_flags(SynceDbusDevice *interface,
 				GDBusMethodInvocation *invocation,
@@ -424,6 +655,11 @@ synce_device_dbus_init(SynceDevice *self)
 		   G_CALLBACK (synce_device_get_password_flags),
 		   self);
 
+  g_signal_connect(priv->interface,
+		   "handle-get-pool-stats",
+		   G_CALLBACK (synce_device_get_pool_stats),
+		   self);
+
   g_signal_connect(priv->interface,
 		   "handle-provide-password",
 		   G_CALLBACK (synce_device_provide_password),
@@ -514,6 +750,12 @@ synce_device_init (SynceDevice *self)
 					 g_free,
 					 g_object_unref);
 
+  priv->pool = g_queue_new ();
+  priv->pool_requests = g_hash_table_new (g_direct_hash, g_direct_equal);
+  priv->pool_hits = 0;
+  priv->pool_misses = 0;
+  priv->pool_expired = 0;
+
   priv->conn = NULL;
   priv->iobuf = NULL;
   priv->device_path = NULL;
@@ -550,6 +792,10 @@ synce_device_dispose (GObject *obj)
 
   priv->dispose_has_run = TRUE;
 
+  synce_device_pool_clear (self);
+  g_queue_free (priv->pool);
+  g_hash_table_destroy (priv->pool_requests);
+
   if (priv->interface) {
     g_dbus_interface_skeleton_unexport(G_DBUS_INTERFACE_SKELETON(priv->interface));
     g_object_unref(priv->interface);
@@ -753,6 +999,7 @@ synce_device_class_init (SynceDeviceClass *klass)
   klass->synce_device_conn_event_cb = NULL;
   klass->synce_device_request_connection = NULL;
   klass->synce_device_provide_password = synce_device_provide_password_impl;
+  klass->synce_device_request_pool_connection = NULL;
 
   param_spec = g_param_spec_pointer ("connection", "Connection object",
                                      "GSocketConnection object.",
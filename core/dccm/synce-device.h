@@ -34,10 +34,14 @@ struct _SynceDeviceClass {
   void (*synce_device_conn_event_cb) (GObject *istream, GAsyncResult *res, gpointer user_data);
   gboolean (*synce_device_request_connection) (SynceDbusDevice *interface, GDBusMethodInvocation *invocation, gpointer userdata);
   gboolean (*synce_device_provide_password) (SynceDbusDevice *interface, GDBusMethodInvocation *invocation, const gchar *password, gpointer userdata);
+  /* ask the device for a connection to keep in the pool, NULL if unsupported */
+  gboolean (*synce_device_request_pool_connection) (SynceDevice *self, guint req_id);
 };
 
 GType synce_device_get_type (void);
 
+void synce_device_pool_configure (guint size, guint idle_timeout);
+
 #define SYNCE_TYPE_DEVICE (synce_device_get_type())
 #define SYNCE_DEVICE(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), SYNCE_TYPE_DEVICE, SynceDevice))
 #define SYNCE_DEVICE_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST((klass), SYNCE_TYPE_DEVICE, SynceDeviceClass))
@@ -165,3 +165,30 @@ synce_rapi_unicode_string_to_string_at_offset (const guchar *buf, const guchar *
   return ret;
 }
 
+/*
+ * Note that the set of connected devices changed. libsynce keeps device
+ * information between processes and drops it when the contents of this
+ * file are not what they were when the information was stored.
+ */
+void
+synce_bump_device_generation (void)
+{
+  static guint64 generation = 0;
+  gchar *filename = g_strdup_printf ("%s/run/synce-devices", LOCALSTATEDIR);
+  gchar *contents;
+  GError *error = NULL;
+
+  /* start from the clock, so a restarted dccm doesn't repeat a number */
+  if (generation == 0)
+    generation = g_get_real_time ();
+  generation++;
+
+  contents = g_strdup_printf ("%" G_GUINT64_FORMAT "\n", generation);
+  if (!g_file_set_contents (filename, contents, -1, &error)) {
+    g_warning ("%s: failed to write %s: %s", G_STRFUNC, filename, error->message);
+    g_error_free (error);
+  }
+
+  g_free (contents);
+  g_free (filename);
+}
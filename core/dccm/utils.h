@@ -18,3 +18,6 @@ synce_rapi_ascii_string_to_string (const guchar *buf, const guchar *buf_max, gui
 gchar *
 synce_rapi_unicode_string_to_string_at_offset (const guchar *buf, const guchar *offset, const guchar *buf_max);
 
+
+void
+synce_bump_device_generation (void);
@@ -196,6 +196,27 @@ CEOID _CeReadRecordProps(
         LPBYTE *lplpBuffer,
         LPDWORD lpcbBuffer);
 
+/*
+ * CeReadRecordProps in three steps, for pipelining: queue or call the
+ * command, read the property count and the size the decoded record
+ * needs, then decode the record into a buffer of that size
+ */
+bool _BeginCeReadRecordProps(
+        RapiContext *context,
+        HANDLE hDbase,
+        DWORD dwFlags);
+
+CEOID _EndCeReadRecordProps(
+        RapiContext *context,
+        LPWORD lpcPropID,
+        LPDWORD lpcbBuffer);
+
+bool _EndCeReadRecordPropsData(
+        RapiContext *context,
+        WORD cPropID,
+        LPBYTE lpBuffer,
+        DWORD cbBuffer);
+
 CEOID _CeSeekDatabase(
         RapiContext *context,
         HANDLE hDatabase,
@@ -309,47 +309,34 @@ exit:
 }/*}}}*/
 
 
-CEOID _CeReadRecordProps(/*{{{*/
+/* size of CEPROPVAL over the wire is 16 bytes, ie pointers are 32 bit */
+#define RAPI_PROPVAL_WIRE_SIZE 16
+
+bool _BeginCeReadRecordProps(/*{{{*/
                 RapiContext *context,
 		HANDLE hDbase,
-		DWORD dwFlags,
-		LPWORD lpcPropID,
-		CEPROPID *rgPropID,
-		LPBYTE *lplpBuffer,
-		LPDWORD lpcbBuffer)
+		DWORD dwFlags)
 {
-
 	/* need to do something with rgPropID */
 
+	return
+		rapi_context_begin_command(context, 0x10) &&
+		rapi_buffer_write_uint32(context->send_buffer, hDbase) &&
+		rapi_buffer_write_uint32(context->send_buffer, dwFlags) &&
+		rapi_buffer_write_uint32(context->send_buffer, 0) &&
+		rapi_buffer_write_uint32(context->send_buffer, 0) &&
+		rapi_buffer_write_uint32(context->send_buffer, 0) &&
+		rapi_buffer_write_uint16(context->send_buffer, 0);
+}/*}}}*/
+
+CEOID _EndCeReadRecordProps(/*{{{*/
+                RapiContext *context,
+		LPWORD lpcPropID,
+		LPDWORD lpcbBuffer)
+{
 	CEOID return_value = 0;
 	uint16_t prop_id_count = 0;
 	uint32_t recv_size = 0;
-	size_t out_size = 0;
-	uint32_t i;
-	unsigned char* recv_buffer = NULL;
-	unsigned char* out_buffer = NULL;
-	size_t recv_propval_size = 0;
-	size_t extra_data_size = 0;
-	size_t out_propval_size = 0;
-
-	rapi_database_trace("begin");
-
-	if (! lpcbBuffer ) {
-	  return_value = 0;
-	  context->last_error = ERROR_INVALID_PARAMETER;
-	  goto exit;
-	}
-
-	rapi_context_begin_command(context, 0x10);
-	rapi_buffer_write_uint32(context->send_buffer, hDbase);
-	rapi_buffer_write_uint32(context->send_buffer, dwFlags);
-	rapi_buffer_write_uint32(context->send_buffer, 0);
-	rapi_buffer_write_uint32(context->send_buffer, 0);
-	rapi_buffer_write_uint32(context->send_buffer, 0);
-	rapi_buffer_write_uint16(context->send_buffer, 0);
-
-	if ( !rapi_context_call(context) )
-		goto fail;
 
 	if ( !rapi_buffer_read_uint32(context->recv_buffer, &context->last_error) )
 		goto fail;
@@ -367,9 +354,31 @@ CEOID _CeReadRecordProps(/*{{{*/
 		goto fail;
 	rapi_database_trace("prop_id_count=%i", prop_id_count);
 
-	if (lpcPropID)
-		*lpcPropID = prop_id_count;
+	if (recv_size < RAPI_PROPVAL_WIRE_SIZE * prop_id_count)
+	{
+		rapi_database_error("%i properties do not fit in %i bytes", prop_id_count, recv_size);
+		goto fail;
+	}
 
+	*lpcPropID = prop_id_count;
+
+	/* the CEPROPVAL array is larger here, the data after it is the same */
+	*lpcbBuffer = recv_size - RAPI_PROPVAL_WIRE_SIZE * prop_id_count + sizeof(CEPROPVAL) * prop_id_count;
+	rapi_database_trace("out buffer size = %u", *lpcbBuffer);
+
+	return return_value;
+
+fail:
+	rapi_database_error("failed");
+	return 0;
+}/*}}}*/
+
+bool _EndCeReadRecordPropsData(/*{{{*/
+                RapiContext *context,
+		WORD cPropID,
+		LPBYTE lpBuffer,
+		DWORD cbBuffer)
+{
 	/* 
 	 *  the data buffer we recieve consists of CEPROPVAL items, followed by
 	 *  misc data eg. strings
@@ -378,171 +387,179 @@ CEOID _CeReadRecordProps(/*{{{*/
 	 *  that pointer items will be the same size on both platforms
 	 */
 
-	/* size of CEPROPVAL over the wire is 16 bytes, ie pointers are 32 bit */
-	recv_propval_size = 16 * prop_id_count;
-	rapi_database_trace("original propval size = %u", recv_propval_size);
+	size_t recv_propval_size = RAPI_PROPVAL_WIRE_SIZE * cPropID;
+	size_t out_propval_size = sizeof(CEPROPVAL) * cPropID;
+	size_t extra_data_size = cbBuffer - out_propval_size;
+	CEPROPVAL* propval = (CEPROPVAL*)lpBuffer;
+	unsigned char wire[RAPI_PROPVAL_WIRE_SIZE];
+	unsigned char* buf_pos;
+	uint32_t offset;
+	uint32_t count;
+	WORD i;
 
-	extra_data_size = recv_size - recv_propval_size;
-	rapi_database_trace("extra data size = %u", extra_data_size);
+	for (i = 0; i < cPropID; i++)
+	  {
+	    if ( !rapi_buffer_read_data(context->recv_buffer, wire, sizeof(wire)) )
+	      goto fail;
+	    buf_pos = wire;
 
-	out_propval_size = sizeof(CEPROPVAL) * prop_id_count;
-	rapi_database_trace("new provpval size = %u", out_propval_size);
+	    propval[i].propid = letoh32(*((uint32_t*)buf_pos));
+	    buf_pos = buf_pos + 4;
+	    propval[i].wLenData = letoh16(*((uint16_t*)buf_pos));
+	    buf_pos = buf_pos + 2;
+	    propval[i].wFlags = letoh16(*((uint16_t*)buf_pos));
+	    buf_pos = buf_pos + 2;
 
-	out_size = extra_data_size + out_propval_size;
-	rapi_database_trace("out buffer size = %u", out_size);
+	    rapi_database_trace("propval[%i].propid = %08x", i, propval[i].propid);
 
-	if (lplpBuffer)
-	{
-		if (*lplpBuffer != NULL) {
-		  if (*lpcbBuffer < out_size) {
-		    if  (dwFlags & CEDB_ALLOWREALLOC)
-		      *lplpBuffer = realloc(*lplpBuffer, out_size);
-		    else
-		      {
-			context->last_error = ERROR_INSUFFICIENT_BUFFER;
-			return_value = 0;
-			*lpcbBuffer = out_size;
-			goto exit;
-		      }
-		  }
-		} else
-		  *lplpBuffer = malloc(out_size);
+	    switch (propval[i].propid & 0xffff)
+	      {
 
-		if (!(*lplpBuffer)) {
-		  context->last_error = ERROR_NOT_ENOUGH_MEMORY;
-		  return_value = 0;
-		  *lpcbBuffer = out_size;
-		  goto exit;
-		}
+	      case CEVT_BLOB:
 
-		out_buffer = *lplpBuffer;
+		rapi_database_trace("CEVT_BLOB");
 
-		recv_buffer = calloc(1, recv_size);
-		if (!recv_buffer) {
-		  rapi_database_error("failed to allocate 0x%08x bytes", recv_size);
-		  context->last_error = ERROR_NOT_ENOUGH_MEMORY;
-		  return_value = 0;
-		  *lpcbBuffer = out_size;
-		  goto exit;
-		}
+		count = letoh32(*((uint32_t*)buf_pos));
+		offset = letoh32(*((uint32_t*)(buf_pos + 4)));
 
-		CEPROPVAL* propval;
-		unsigned char * buf_pos = recv_buffer;
-
-		if ( !rapi_buffer_read_data(context->recv_buffer, recv_buffer, recv_size) )
+		/* offsets count from the start of the received data */
+		if (offset < recv_propval_size || offset - recv_propval_size > extra_data_size ||
+		    count > extra_data_size - (offset - recv_propval_size))
 		  {
-		    rapi_database_error("failed to read buffer");
+		    rapi_database_error("blob of property %i is outside the record", i);
 		    goto fail;
 		  }
 
-		memcpy(out_buffer + out_propval_size, recv_buffer + recv_propval_size, extra_data_size);
-
-		propval = (CEPROPVAL*)out_buffer;
+		propval[i].val.blob.dwCount = count;
+		propval[i].val.blob.lpb = lpBuffer + out_propval_size + (offset - recv_propval_size);
 
-		rapi_database_trace("buffer = %p", recv_buffer);
-
-		for (i = 0; i < prop_id_count; i++)
-		  {
+		rapi_database_trace("propval[%i].val.blob.dwCount = %08x",
+				    i, propval[i].val.blob.dwCount);
+		break;
 
-		    propval[i].propid = letoh32(*((uint32_t*)buf_pos));
-		    buf_pos = buf_pos + 4;
-		    propval[i].wLenData = letoh16(*((uint16_t*)buf_pos));
-		    buf_pos = buf_pos + 2;
-		    propval[i].wFlags = letoh16(*((uint16_t*)buf_pos));
-		    buf_pos = buf_pos + 2;
+	      case CEVT_LPWSTR:
 
-		    rapi_database_trace("propval[%i].propid = %08x", i, propval[i].propid);
+		rapi_database_trace("CEVT_LPWSTR");
 
+		offset = letoh32(*((uint32_t*)buf_pos));
 
-		    switch (propval[i].propid & 0xffff)
-		      {
-
-		      case CEVT_BLOB:
+		if (offset < recv_propval_size || offset - recv_propval_size >= extra_data_size)
+		  {
+		    rapi_database_error("string of property %i is outside the record", i);
+		    goto fail;
+		  }
 
-			rapi_database_trace("CEVT_BLOB");
+		propval[i].val.lpwstr = (LPWSTR)(lpBuffer + out_propval_size + (offset - recv_propval_size));
+
+		rapi_database_trace("string offset = %p", propval[i].val.lpwstr);
+		break;
+
+	      case CEVT_I2:
+		rapi_database_trace("CEVT_I2");
+		propval[i].val.iVal = letoh16(*((int16_t*)buf_pos));
+		break;
+	      case CEVT_I4:
+		rapi_database_trace("CEVT_I4");
+		propval[i].val.lVal = letoh32(*((int32_t*)buf_pos));
+		break;
+	      case CEVT_R8:
+
+		/* TODO: convert endianness for this, need to set up 64 swap in synce.h */
+
+		rapi_database_trace("CEVT_R8");
+		memcpy(&(propval[i].val), buf_pos, 8);
+		break;
+	      case CEVT_BOOL:
+		rapi_database_trace("CEVT_BOOL");
+		propval[i].val.boolVal = letoh16(*((int16_t*)buf_pos));
+		break;
+	      case CEVT_UI2:
+		rapi_database_trace("CEVT_UI2");
+		propval[i].val.uiVal = letoh16(*((uint16_t*)buf_pos));
+		break;
+	      case CEVT_UI4:
+		rapi_database_trace("CEVT_UI4");
+		propval[i].val.ulVal = letoh32(*((uint32_t*)buf_pos));
+		break;
+	      case CEVT_FILETIME:
+		rapi_database_trace("CEVT_FILETIME");
+		propval[i].val.filetime.dwLowDateTime = letoh32(*((uint32_t*)buf_pos));
+		propval[i].val.filetime.dwHighDateTime = letoh32(*((uint32_t*)(buf_pos + 4)));
+		break;
+	      }
+	  }
+
+	/* the strings and blobs go straight behind the array */
+	if ( !rapi_buffer_read_data(context->recv_buffer, lpBuffer + out_propval_size, extra_data_size) )
+	  goto fail;
 
-			propval[i].val.blob.dwCount = letoh32(*((uint32_t*)buf_pos));
-			buf_pos = buf_pos + 4;
+	return true;
 
-			propval[i].val.blob.lpb = letoh32(*((uint32_t*)buf_pos)) - recv_propval_size + (sizeof(CEPROPVAL) * prop_id_count) + out_buffer;
-			buf_pos = buf_pos + 4;
+fail:
+	rapi_database_error("failed to read record data");
+	return false;
+}/*}}}*/
 
-			rapi_database_trace("propval[%i].val.blob.dwCount = %08x",
-					    i, propval[i].val.blob.dwCount);
-			rapi_database_trace("propval[%i].val.blob.lpb = %08x",
-					    i, propval[i].val.blob.lpb);
+CEOID _CeReadRecordProps(/*{{{*/
+                RapiContext *context,
+		HANDLE hDbase,
+		DWORD dwFlags,
+		LPWORD lpcPropID,
+		CEPROPID *rgPropID SYNCE_UNUSED,
+		LPBYTE *lplpBuffer,
+		LPDWORD lpcbBuffer)
+{
+	CEOID return_value = 0;
+	WORD prop_id_count = 0;
+	DWORD out_size = 0;
+	LPBYTE out_buffer = NULL;
 
-			rapi_database_trace("blob=%s",(char*)propval[i].val.blob.lpb);
-			break;
+	rapi_database_trace("begin");
 
-		      case CEVT_LPWSTR:
+	if (! lpcbBuffer ) {
+	  context->last_error = ERROR_INVALID_PARAMETER;
+	  return 0;
+	}
 
-			rapi_database_trace("CEVT_LPWSTR");
+	_BeginCeReadRecordProps(context, hDbase, dwFlags);
 
-			propval[i].val.lpwstr = (LPWSTR)(letoh32(*((uint32_t*)buf_pos)) - recv_propval_size + (sizeof(CEPROPVAL) * prop_id_count) + out_buffer);
-			buf_pos = buf_pos + 8;
+	if ( !rapi_context_call(context) )
+		return 0;
 
-			rapi_database_trace("string offset = %p", propval[i].val.lpwstr);
-			rapi_database_trace_wstr(propval[i].val.lpwstr);
-			rapi_database_trace("propval[i].val.lpwstr = %p", propval[i].val.lpwstr);
-			break;
+	if ( (return_value = _EndCeReadRecordProps(context, &prop_id_count, &out_size)) == 0 )
+		return 0;
 
-		      case CEVT_I2:
-			rapi_database_trace("CEVT_I2");
-			propval[i].val.iVal = letoh16(*((int16_t*)buf_pos));
-			buf_pos = buf_pos + 8;
-			break;
-		      case CEVT_I4:
-			rapi_database_trace("CEVT_I4");
-			propval[i].val.lVal = letoh32(*((int32_t*)buf_pos));
-			buf_pos = buf_pos + 8;
-			break;
-		      case CEVT_R8:
+	if (lpcPropID)
+		*lpcPropID = prop_id_count;
 
-			/* TODO: convert endianness for this, need to set up 64 swap in synce.h */
+	if (lplpBuffer)
+	{
+		if (*lplpBuffer != NULL && *lpcbBuffer < out_size) {
+		    if (!(dwFlags & CEDB_ALLOWREALLOC)) {
+			context->last_error = ERROR_INSUFFICIENT_BUFFER;
+			*lpcbBuffer = out_size;
+			return 0;
+		    }
+		    out_buffer = realloc(*lplpBuffer, out_size);
+		} else if (*lplpBuffer != NULL)
+		  out_buffer = *lplpBuffer;
+		else
+		  out_buffer = malloc(out_size);
 
-			rapi_database_trace("CEVT_R8");
-			memcpy(&(propval[i].val), buf_pos, 8);
-			buf_pos = buf_pos + 8;
-			break;
-		      case CEVT_BOOL:
-			rapi_database_trace("CEVT_BOOL");
-			propval[i].val.boolVal = letoh16(*((int16_t*)buf_pos));
-			buf_pos = buf_pos + 8;
-			break;
-		      case CEVT_UI2:
-			rapi_database_trace("CEVT_UI2");
-			propval[i].val.uiVal = letoh16(*((uint16_t*)buf_pos));
-			buf_pos = buf_pos + 8;
-			break;
-		      case CEVT_UI4:
-			rapi_database_trace("CEVT_UI4");
-			propval[i].val.ulVal = letoh32(*((uint32_t*)buf_pos));
-			buf_pos = buf_pos + 8;
-			break;
-		      case CEVT_FILETIME:
-			rapi_database_trace("CEVT_FILETIME");
-			propval[i].val.filetime.dwLowDateTime = letoh32(*((uint32_t*)buf_pos));
-			buf_pos += 4;
-			propval[i].val.filetime.dwHighDateTime = letoh32(*((uint32_t*)buf_pos));
-			buf_pos += 4;
-			break;
-		      }
-		  }
+		if (!out_buffer) {
+		  context->last_error = ERROR_NOT_ENOUGH_MEMORY;
+		  *lpcbBuffer = out_size;
+		  return 0;
+		}
+		*lplpBuffer = out_buffer;
 
-		free(recv_buffer);
+		if ( !_EndCeReadRecordPropsData(context, prop_id_count, out_buffer, out_size) )
+		  return 0;
 	}
 
 	*lpcbBuffer = out_size;
 
-exit:
 	return return_value;
-
-fail:
- 	rapi_database_error("failed");
-	if (recv_buffer)
-	  free(recv_buffer);
-	return 0;
 }/*}}}*/
 
 
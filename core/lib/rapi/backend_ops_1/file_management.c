@@ -66,53 +66,15 @@ BOOL _CeFindAllFiles(
 
 	if (count)
 	{
-		unsigned i;
-		uint32_t name_size;
 		CE_FIND_DATA* array = calloc(count, sizeof(CE_FIND_DATA));
 
 		if (!array)
 			return false;
 
-		for (i = 0; i < count; i++)
+		if ( !rapi_buffer_read_find_data_array(context->recv_buffer, dwFlags, sizeof(WCHAR), array, count) )
 		{
-			if (dwFlags & FAF_NAME)
-				rapi_buffer_read_uint32(context->recv_buffer, &name_size);
-
-			if (dwFlags & FAF_ATTRIBUTES)
-				rapi_buffer_read_uint32(context->recv_buffer, &array[i].dwFileAttributes);
-
-			if (dwFlags & FAF_CREATION_TIME)
-			{
-				rapi_buffer_read_uint32(context->recv_buffer, &array[i].ftCreationTime.dwLowDateTime);
-				rapi_buffer_read_uint32(context->recv_buffer, &array[i].ftCreationTime.dwHighDateTime);
-			}
-
-			if (dwFlags & FAF_LASTACCESS_TIME)
-			{
-				rapi_buffer_read_uint32(context->recv_buffer, &array[i].ftLastAccessTime.dwLowDateTime);
-				rapi_buffer_read_uint32(context->recv_buffer, &array[i].ftLastAccessTime.dwHighDateTime);
-			}
-
-			if (dwFlags & FAF_LASTWRITE_TIME)
-			{
-				rapi_buffer_read_uint32(context->recv_buffer, &array[i].ftLastWriteTime.dwLowDateTime);
-				rapi_buffer_read_uint32(context->recv_buffer, &array[i].ftLastWriteTime.dwHighDateTime);
-			}
-
-			if (dwFlags & FAF_SIZE_HIGH)
-				rapi_buffer_read_uint32(context->recv_buffer, &array[i].nFileSizeHigh);
-
-			if (dwFlags & FAF_SIZE_LOW)
-				rapi_buffer_read_uint32(context->recv_buffer, &array[i].nFileSizeLow);
-
-			if (dwFlags & FAF_OID)
-				rapi_buffer_read_uint32(context->recv_buffer, &array[i].dwOID);
-
-			if (dwFlags & FAF_NAME)
-			{
-				rapi_buffer_read_data(context->recv_buffer, array[i].cFileName, name_size * sizeof(WCHAR) );
-				synce_trace_wstr(array[i].cFileName);
-			}
+			free(array);
+			return false;
 		}
 
 		if (ppFindDataArray)
@@ -92,6 +92,7 @@ static HRESULT CeRapiInvokeStream( /*{{{*/
     goto exit;
   }
 
+  rapi_stream_ready(*ppIRAPIStream);
   return_value = S_OK;
 
 exit:
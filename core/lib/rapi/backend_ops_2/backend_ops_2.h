@@ -405,4 +405,190 @@ HRESULT _CeRapiInvoke2(
 
 #endif /* SWIG */
 
+/*
+ * Request and reply halves of calls that can be pipelined,
+ * see rapi_context_queue_command()
+ */
+
+bool _BeginCeGetFileAttributes2(
+        RapiContext *context,
+        LPCWSTR lpFileName);
+
+DWORD _EndCeGetFileAttributes2(
+        RapiContext *context);
+
+bool _BeginCeDeleteFile2(
+        RapiContext *context,
+        LPCWSTR lpFileName);
+
+BOOL _EndCeDeleteFile2(
+        RapiContext *context);
+
+bool _BeginCeSetFileTime2(
+        RapiContext *context,
+        HANDLE hFile,
+        LPFILETIME lpCreationTime,
+        LPFILETIME lpLastAccessTime,
+        LPFILETIME lpLastWriteTime);
+
+BOOL _EndCeSetFileTime2(
+        RapiContext *context);
+
+bool _BeginCeCloseHandle2(
+        RapiContext *context,
+        HANDLE hObject);
+
+BOOL _EndCeCloseHandle2(
+        RapiContext *context);
+
+bool _BeginCeCreateFile2(
+        RapiContext *context,
+        LPCWSTR lpFileName,
+        DWORD dwDesiredAccess,
+        DWORD dwShareMode,
+        DWORD dwCreationDisposition,
+        DWORD dwFlagsAndAttributes,
+        HANDLE hTemplateFile);
+
+HANDLE _EndCeCreateFile2(
+        RapiContext *context);
+
+bool _BeginCeReadFile2(
+        RapiContext *context,
+        HANDLE hFile,
+        DWORD nNumberOfBytesToRead);
+
+BOOL _EndCeReadFile2(
+        RapiContext *context,
+        LPVOID lpBuffer,
+        DWORD nNumberOfBytesToRead,
+        LPDWORD lpNumberOfBytesRead);
+
+bool _BeginCeWriteFile2(
+        RapiContext *context,
+        HANDLE hFile,
+        LPCVOID lpBuffer,
+        DWORD nNumberOfBytesToWrite);
+
+BOOL _EndCeWriteFile2(
+        RapiContext *context,
+        LPDWORD lpNumberOfBytesWritten);
+
+bool _BeginCeCreateDirectory2(
+        RapiContext *context,
+        LPCWSTR lpPathName);
+
+BOOL _EndCeCreateDirectory2(
+        RapiContext *context);
+
+bool _BeginCeRemoveDirectory2(
+        RapiContext *context,
+        LPCWSTR lpPathName);
+
+BOOL _EndCeRemoveDirectory2(
+        RapiContext *context);
+
+bool _BeginCeRegOpenKeyEx2(
+        RapiContext *context,
+        HKEY hKey,
+        LPCWSTR lpszSubKey);
+
+LONG _EndCeRegOpenKeyEx2(
+        RapiContext *context,
+        PHKEY phkResult);
+
+bool _BeginCeRegQueryValueEx2(
+        RapiContext *context,
+        HKEY hKey,
+        LPCWSTR lpValueName,
+        DWORD cbData);
+
+LONG _EndCeRegQueryValueEx2(
+        RapiContext *context,
+        LPDWORD lpType,
+        LPBYTE lpData,
+        LPDWORD lpcbData);
+
+bool _BeginCeRegSetValueEx2(
+        RapiContext *context,
+        HKEY hKey,
+        LPCWSTR lpValueName,
+        DWORD dwType,
+        const BYTE *lpData,
+        DWORD cbData);
+
+LONG _EndCeRegSetValueEx2(
+        RapiContext *context);
+
+bool _BeginCeRegCloseKey2(
+        RapiContext *context,
+        HKEY hKey);
+
+LONG _EndCeRegCloseKey2(
+        RapiContext *context);
+
+bool _BeginCeRegDeleteValue2(
+        RapiContext *context,
+        HKEY hKey,
+        LPCWSTR lpszValueName);
+
+LONG _EndCeRegDeleteValue2(
+        RapiContext *context);
+
+bool _BeginCeRegCreateKeyEx2(
+        RapiContext *context,
+        HKEY hKey,
+        LPCWSTR lpszSubKey,
+        LPCWSTR lpszClass);
+
+LONG _EndCeRegCreateKeyEx2(
+        RapiContext *context,
+        PHKEY phkResult,
+        LPDWORD lpdwDisposition);
+
+bool _BeginCeRegQueryInfoKey2(
+        RapiContext *context,
+        HKEY hKey,
+        DWORD cbClass);
+
+LONG _EndCeRegQueryInfoKey2(
+        RapiContext *context,
+        LPWSTR lpClass,
+        LPDWORD lpcbClass,
+        LPDWORD lpcSubKeys,
+        LPDWORD lpcbMaxSubKeyLen,
+        LPDWORD lpcbMaxClassLen,
+        LPDWORD lpcValues,
+        LPDWORD lpcbMaxValueNameLen,
+        LPDWORD lpcbMaxValueLen);
+
+bool _BeginCeRegEnumValue2(
+        RapiContext *context,
+        HKEY hKey,
+        DWORD dwIndex,
+        DWORD cbValueName,
+        DWORD cbData);
+
+LONG _EndCeRegEnumValue2(
+        RapiContext *context,
+        LPWSTR lpszValueName,
+        LPDWORD lpcbValueName,
+        LPDWORD lpType,
+        LPBYTE lpData,
+        LPDWORD lpcbData);
+
+bool _BeginCeRegEnumKeyEx2(
+        RapiContext *context,
+        HKEY hKey,
+        DWORD dwIndex,
+        DWORD cbName,
+        DWORD cbClass);
+
+LONG _EndCeRegEnumKeyEx2(
+        RapiContext *context,
+        LPWSTR lpName,
+        LPDWORD lpcbName,
+        LPWSTR lpClass,
+        LPDWORD lpcbClass);
+
 #endif /* __backend_ops_2_h__ */
@@ -7,35 +7,107 @@
 #include <stdlib.h>
 
 
-HANDLE _CeCreateFile2(
+bool _BeginCeCreateFile2(
         RapiContext *context,
         LPCWSTR lpFileName,
         DWORD dwDesiredAccess,
         DWORD dwShareMode,
-        LPSECURITY_ATTRIBUTES lpSecurityAttributes SYNCE_UNUSED,
         DWORD dwCreationDisposition,
         DWORD dwFlagsAndAttributes,
         HANDLE hTemplateFile)
+{
+    return
+        rapi_context_begin_command(context, 0x16) &&
+        rapi2_buffer_write_string(context->send_buffer, lpFileName) &&
+        rapi_buffer_write_uint32(context->send_buffer, dwDesiredAccess) &&
+        rapi_buffer_write_uint32(context->send_buffer, dwShareMode) &&
+        rapi_buffer_write_uint32(context->send_buffer, dwCreationDisposition) &&
+        rapi_buffer_write_uint32(context->send_buffer, dwFlagsAndAttributes) &&
+        rapi_buffer_write_uint32(context->send_buffer, hTemplateFile);
+}
+
+
+HANDLE _EndCeCreateFile2(
+        RapiContext *context)
 {
     HANDLE handle = INVALID_HANDLE_VALUE;
 
+    rapi_buffer_read_uint32(context->recv_buffer, &context->last_error);
+    rapi_buffer_read_uint32(context->recv_buffer, &handle);
+
+    return handle;
+}
+
+
+HANDLE _CeCreateFile2(
+        RapiContext *context,
+        LPCWSTR lpFileName,
+        DWORD dwDesiredAccess,
+        DWORD dwShareMode,
+        LPSECURITY_ATTRIBUTES lpSecurityAttributes SYNCE_UNUSED,
+        DWORD dwCreationDisposition,
+        DWORD dwFlagsAndAttributes,
+        HANDLE hTemplateFile)
+{
     synce_trace("begin");
 
-    rapi_context_begin_command(context, 0x16);
-    rapi2_buffer_write_string(context->send_buffer, lpFileName);
-    rapi_buffer_write_uint32(context->send_buffer, dwDesiredAccess);
-    rapi_buffer_write_uint32(context->send_buffer, dwShareMode);
-    rapi_buffer_write_uint32(context->send_buffer, dwCreationDisposition);
-    rapi_buffer_write_uint32(context->send_buffer, dwFlagsAndAttributes);
-    rapi_buffer_write_uint32(context->send_buffer, hTemplateFile);
+    _BeginCeCreateFile2(context, lpFileName, dwDesiredAccess, dwShareMode,
+            dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);
 
     if ( !rapi2_context_call(context) )
         return INVALID_HANDLE_VALUE;
 
-    rapi_buffer_read_uint32(context->recv_buffer, &context->last_error);
-    rapi_buffer_read_uint32(context->recv_buffer, &handle);
+    return _EndCeCreateFile2(context);
+}
 
-    return handle;
+
+bool _BeginCeReadFile2(
+        RapiContext *context,
+        HANDLE hFile,
+        DWORD nNumberOfBytesToRead)
+{
+    return
+        rapi_context_begin_command(context, 0x17) &&
+        rapi_buffer_write_uint32(context->send_buffer, hFile) &&
+        rapi_buffer_write_uint32(context->send_buffer, nNumberOfBytesToRead);
+}
+
+
+/*
+ * For a reply that is all in recv_buffer; _CeReadFile2() reads the
+ * data straight from the socket instead
+ */
+BOOL _EndCeReadFile2(
+        RapiContext *context,
+        LPVOID lpBuffer,
+        DWORD nNumberOfBytesToRead,
+        LPDWORD lpNumberOfBytesRead)
+{
+    BOOL return_value = 0;
+    uint32_t bytes_read = 0;
+
+    if ( !rapi_buffer_read_uint32(context->recv_buffer, &context->last_error) )
+        return false;
+
+    if ( !rapi_buffer_read_uint32(context->recv_buffer, &return_value) )
+        return false;
+
+    if ( !rapi_buffer_read_uint32(context->recv_buffer, &bytes_read) )
+        return false;
+
+    if (bytes_read > nNumberOfBytesToRead)
+    {
+        synce_warning("device returned %u bytes, only %u were requested", bytes_read, nNumberOfBytesToRead);
+        bytes_read = nNumberOfBytesToRead;
+    }
+
+    if (lpBuffer && !rapi_buffer_read_data(context->recv_buffer, lpBuffer, bytes_read))
+        return false;
+
+    if (lpNumberOfBytesRead)
+        *lpNumberOfBytesRead = bytes_read;
+
+    return return_value;
 }
 
 
@@ -52,15 +124,15 @@ BOOL _CeReadFile2(
 
     synce_trace("begin");
 
-    rapi_context_begin_command(context, 0x17);
-    rapi_buffer_write_uint32(context->send_buffer, hFile);
-    rapi_buffer_write_uint32(context->send_buffer, nNumberOfBytesToRead);
+    _BeginCeReadFile2(context, hFile, nNumberOfBytesToRead);
 /*    rapi_buffer_write_optional_out(context->send_buffer, lpBuffer, nNumberOfBytesToRead);
     rapi_buffer_write_optional_in(context->send_buffer, NULL, 0); *//* lpOverlapped */
 
-    if ( !rapi2_context_call(context) )
+    /* only the fixed part of the reply goes through recv_buffer,
+       the file data is read straight into lpBuffer */
+    if ( !rapi2_context_call_header(context, 3 * sizeof(uint32_t)) )
     {
-        synce_error("rapi2_context_call failed");
+        synce_error("rapi2_context_call_header failed");
         return false;
     }
 
@@ -75,39 +147,52 @@ BOOL _CeReadFile2(
     if ( !rapi_buffer_read_uint32(context->recv_buffer, &bytes_read) )
         return false;
 
+    if (bytes_read > nNumberOfBytesToRead)
+    {
+        synce_warning("device returned %u bytes, only %u were requested", bytes_read, nNumberOfBytesToRead);
+        bytes_read = nNumberOfBytesToRead;
+    }
+
     if (lpNumberOfBytesRead)
         *lpNumberOfBytesRead = bytes_read;
 
     if (lpBuffer)
-        if ( !rapi_buffer_read_data(context->recv_buffer, lpBuffer, bytes_read) )
+        if ( !rapi_context_recv_payload(context, lpBuffer, bytes_read) )
             return false;
 
+    if ( !rapi_context_skip_payload(context) )
+        return false;
+
     return return_value;
 }
 
 
-BOOL _CeWriteFile2(
+/*
+ * lpBuffer is only referenced, it must stay valid until the command
+ * has been sent or copied with rapi_context_queue_command()
+ */
+bool _BeginCeWriteFile2(
         RapiContext *context,
         HANDLE hFile,
         LPCVOID lpBuffer,
-        DWORD nNumberOfBytesToWrite,
-        LPDWORD lpNumberOfBytesWritten,
-        LPOVERLAPPED lpOverlapped SYNCE_UNUSED)
+        DWORD nNumberOfBytesToWrite)
 {
-    BOOL return_value = 0;
-    uint32_t bytes_written = 0;
-
-    synce_trace("begin");
-
-    rapi_context_begin_command(context, 0x18);
-    rapi_buffer_write_uint32(context->send_buffer, hFile);
-    rapi_buffer_write_uint32(context->send_buffer, nNumberOfBytesToWrite);
-    rapi_buffer_write_data(context->send_buffer, lpBuffer, nNumberOfBytesToWrite);
+    return
+        rapi_context_begin_command(context, 0x18) &&
+        rapi_buffer_write_uint32(context->send_buffer, hFile) &&
+        rapi_buffer_write_uint32(context->send_buffer, nNumberOfBytesToWrite) &&
+        rapi_buffer_write_data_ref(context->send_buffer, lpBuffer, nNumberOfBytesToWrite);
 /*    rapi_buffer_write_optional_in(context->send_buffer, lpBuffer, nNumberOfBytesToWrite);
     rapi_buffer_write_optional_in(context->send_buffer, NULL, 0);*/ /* lpOverlapped */
+}
 
-    if ( !rapi2_context_call(context) )
-        return false;
+
+BOOL _EndCeWriteFile2(
+        RapiContext *context,
+        LPDWORD lpNumberOfBytesWritten)
+{
+    BOOL return_value = 0;
+    uint32_t bytes_written = 0;
 
     rapi_buffer_read_uint32(context->recv_buffer, &context->last_error);
     rapi_buffer_read_uint32(context->recv_buffer, &return_value);
@@ -120,6 +205,25 @@ BOOL _CeWriteFile2(
 }
 
 
+BOOL _CeWriteFile2(
+        RapiContext *context,
+        HANDLE hFile,
+        LPCVOID lpBuffer,
+        DWORD nNumberOfBytesToWrite,
+        LPDWORD lpNumberOfBytesWritten,
+        LPOVERLAPPED lpOverlapped SYNCE_UNUSED)
+{
+    synce_trace("begin");
+
+    _BeginCeWriteFile2(context, hFile, lpBuffer, nNumberOfBytesToWrite);
+
+    if ( !rapi2_context_call(context) )
+        return false;
+
+    return _EndCeWriteFile2(context, lpNumberOfBytesWritten);
+}
+
+
 DWORD _CeSetFilePointer2(
         RapiContext *context,
         HANDLE hFile,
@@ -238,53 +342,84 @@ BOOL _CeGetFileTime2(
 }
 
 
-BOOL _CeSetFileTime2(
+/* a FILETIME the caller may leave out, preceded by its size */
+static bool _WriteOptionalFileTime2(
+        RapiBuffer *buffer,
+        LPFILETIME lpFileTime)
+{
+    if (!lpFileTime)
+        return rapi_buffer_write_uint32(buffer, 0);
+
+    return
+        rapi_buffer_write_uint32(buffer, sizeof(FILETIME)) &&
+        rapi_buffer_write_data(buffer, lpFileTime, sizeof(FILETIME));
+}
+
+
+bool _BeginCeSetFileTime2(
         RapiContext *context,
         HANDLE hFile,
         LPFILETIME lpCreationTime,
         LPFILETIME lpLastAccessTime,
         LPFILETIME lpLastWriteTime)
 {
-    BOOL return_value = FALSE;
+    return
+        rapi_context_begin_command(context, 0x42) &&
+        rapi_buffer_write_uint32(context->send_buffer, hFile) &&
+        _WriteOptionalFileTime2(context->send_buffer, lpCreationTime) &&
+        _WriteOptionalFileTime2(context->send_buffer, lpLastAccessTime) &&
+        _WriteOptionalFileTime2(context->send_buffer, lpLastWriteTime);
+}
 
-    rapi_context_begin_command(context, 0x42);
-    rapi_buffer_write_uint32(context->send_buffer, hFile);
 
-    rapi_buffer_write_uint32(context->send_buffer,
-            (lpCreationTime) ? sizeof(FILETIME) : 0);
+BOOL _EndCeSetFileTime2(
+        RapiContext *context)
+{
+    BOOL return_value = FALSE;
 
-    if (lpCreationTime)
-    {
-        rapi_buffer_write_data(context->send_buffer, lpCreationTime,
-                sizeof(FILETIME));
-    }
+    if (!rapi_buffer_read_uint32(context->recv_buffer, &context->last_error))
+        return FALSE;
 
-    rapi_buffer_write_uint32(context->send_buffer,
-            (lpLastAccessTime) ? sizeof(FILETIME) : 0);
+    if (!rapi_buffer_read_uint32(context->recv_buffer, &return_value))
+        return FALSE;
 
-    if (lpLastAccessTime)
-    {
-        rapi_buffer_write_data(context->send_buffer, lpLastAccessTime,
-                sizeof(FILETIME));
-    }
+    return return_value;
+}
 
-    rapi_buffer_write_uint32(context->send_buffer,
-            (lpLastWriteTime) ? sizeof(FILETIME) : 0);
 
-    if (lpLastWriteTime)
-    {
-        rapi_buffer_write_data(context->send_buffer, lpLastWriteTime,
-                sizeof(FILETIME));
-    }
+BOOL _CeSetFileTime2(
+        RapiContext *context,
+        HANDLE hFile,
+        LPFILETIME lpCreationTime,
+        LPFILETIME lpLastAccessTime,
+        LPFILETIME lpLastWriteTime)
+{
+    _BeginCeSetFileTime2(context, hFile, lpCreationTime, lpLastAccessTime, lpLastWriteTime);
 
     if (!rapi2_context_call(context))
         return FALSE;
 
-    if (!rapi_buffer_read_uint32(context->recv_buffer, &context->last_error))
-        return FALSE;
+    return _EndCeSetFileTime2(context);
+}
 
-    if (!rapi_buffer_read_uint32(context->recv_buffer, &return_value))
-        return FALSE;
+
+bool _BeginCeCloseHandle2(
+        RapiContext *context,
+        HANDLE hObject)
+{
+    return
+        rapi_context_begin_command(context, 0x19) &&
+        rapi_buffer_write_uint32(context->send_buffer, hObject);
+}
+
+
+BOOL _EndCeCloseHandle2(
+        RapiContext *context)
+{
+    BOOL return_value = 0;
+
+    rapi_buffer_read_uint32(context->recv_buffer, &context->last_error);
+    rapi_buffer_read_uint32(context->recv_buffer, &return_value);
 
     return return_value;
 }
@@ -294,18 +429,12 @@ BOOL _CeCloseHandle2(
         RapiContext *context,
         HANDLE hObject)
 {
-    BOOL return_value = 0;
-
     synce_trace("begin");
 
-    rapi_context_begin_command(context, 0x19);
-    rapi_buffer_write_uint32(context->send_buffer, hObject);
+    _BeginCeCloseHandle2(context, hObject);
 
     if ( !rapi2_context_call(context) )
         return false;
 
-    rapi_buffer_read_uint32(context->recv_buffer, &context->last_error);
-    rapi_buffer_read_uint32(context->recv_buffer, &return_value);
-
-    return return_value;
+    return _EndCeCloseHandle2(context);
 }
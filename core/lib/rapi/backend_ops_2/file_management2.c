@@ -59,53 +59,16 @@ BOOL _CeFindAllFiles2(
 
     if (count)
     {
-        unsigned i;
-        uint32_t name_size;
         CE_FIND_DATA* array = calloc(count, sizeof(CE_FIND_DATA));
 
         if (!array)
             return false;
 
-        for (i = 0; i < count; i++)
+        /* name sizes are in bytes */
+        if ( !rapi_buffer_read_find_data_array(context->recv_buffer, dwFlags, 1, array, count) )
         {
-            if (dwFlags & FAF_NAME)
-                rapi_buffer_read_uint32(context->recv_buffer, &name_size);
-
-            if (dwFlags & FAF_ATTRIBUTES)
-                rapi_buffer_read_uint32(context->recv_buffer, &array[i].dwFileAttributes);
-
-            if (dwFlags & FAF_CREATION_TIME)
-            {
-                rapi_buffer_read_uint32(context->recv_buffer, &array[i].ftCreationTime.dwLowDateTime);
-                rapi_buffer_read_uint32(context->recv_buffer, &array[i].ftCreationTime.dwHighDateTime);
-            }
-
-            if (dwFlags & FAF_LASTACCESS_TIME)
-            {
-                rapi_buffer_read_uint32(context->recv_buffer, &array[i].ftLastAccessTime.dwLowDateTime);
-                rapi_buffer_read_uint32(context->recv_buffer, &array[i].ftLastAccessTime.dwHighDateTime);
-            }
-
-            if (dwFlags & FAF_LASTWRITE_TIME)
-            {
-                rapi_buffer_read_uint32(context->recv_buffer, &array[i].ftLastWriteTime.dwLowDateTime);
-                rapi_buffer_read_uint32(context->recv_buffer, &array[i].ftLastWriteTime.dwHighDateTime);
-            }
-
-            if (dwFlags & FAF_SIZE_HIGH)
-                rapi_buffer_read_uint32(context->recv_buffer, &array[i].nFileSizeHigh);
-
-            if (dwFlags & FAF_SIZE_LOW)
-                rapi_buffer_read_uint32(context->recv_buffer, &array[i].nFileSizeLow);
-
-            if (dwFlags & FAF_OID)
-                rapi_buffer_read_uint32(context->recv_buffer, &array[i].dwOID);
-
-            if (dwFlags & FAF_NAME)
-            {
-                rapi_buffer_read_data(context->recv_buffer, array[i].cFileName, name_size );
-                synce_trace_wstr(array[i].cFileName);
-            }
+            free(array);
+            return false;
         }
 
         if (ppFindDataArray)
@@ -186,22 +149,60 @@ BOOL _CeFindClose2(
 }
 
 
-DWORD _CeGetFileAttributes2(
+bool _BeginCeGetFileAttributes2(
         RapiContext *context,
         LPCWSTR lpFileName)
+{
+    return
+        rapi_context_begin_command(context, 0x14) &&
+        rapi2_buffer_write_string(context->send_buffer, lpFileName);
+}
+
+
+DWORD _EndCeGetFileAttributes2(
+        RapiContext *context)
 {
     DWORD return_value = 0xFFFFFFFF;
 
-    rapi_context_begin_command(context, 0x14);
-    rapi2_buffer_write_string(context->send_buffer, lpFileName);
+    rapi_buffer_read_uint32(context->recv_buffer, &context->last_error);
+    rapi_buffer_read_uint32(context->recv_buffer, &return_value);
+
+    return return_value;
+}
+
+
+DWORD _CeGetFileAttributes2(
+        RapiContext *context,
+        LPCWSTR lpFileName)
+{
+    _BeginCeGetFileAttributes2(context, lpFileName);
 
     if ( !rapi2_context_call(context) )
-        goto exit;
+        return 0xFFFFFFFF;
+
+    return _EndCeGetFileAttributes2(context);
+}
+
+
+bool _BeginCeDeleteFile2(
+        RapiContext *context,
+        LPCWSTR lpFileName)
+{
+    /*    rapi_buffer_write_optional_string(context->send_buffer, lpFileName);*/
+    return
+        rapi_context_begin_command(context, 0x2d) &&
+        rapi2_buffer_write_string(context->send_buffer, lpFileName);
+}
+
+
+BOOL _EndCeDeleteFile2(
+        RapiContext *context)
+{
+    BOOL return_value = 0;
 
     rapi_buffer_read_uint32(context->recv_buffer, &context->last_error);
     rapi_buffer_read_uint32(context->recv_buffer, &return_value);
 
-exit:
     return return_value;
 }
 
@@ -210,15 +211,33 @@ BOOL _CeDeleteFile2(
         RapiContext *context,
         LPCWSTR lpFileName)
 {
-    BOOL return_value = 0;
-
-    rapi_context_begin_command(context, 0x2d);
-    /*    rapi_buffer_write_optional_string(context->send_buffer, lpFileName);*/
-    rapi2_buffer_write_string(context->send_buffer, lpFileName);
+    _BeginCeDeleteFile2(context, lpFileName);
 
     if ( !rapi2_context_call(context) )
         return 0;
 
+    return _EndCeDeleteFile2(context);
+}
+
+
+bool _BeginCeCreateDirectory2(
+        RapiContext *context,
+        LPCWSTR lpPathName)
+{
+    /*
+    rapi_buffer_write_optional_string(context->send_buffer, lpPathName);
+    rapi_buffer_write_optional_in(context->send_buffer, NULL, 0); */ /* lpSecurityAttributes */
+    return
+        rapi_context_begin_command(context, 0x28) &&
+        rapi2_buffer_write_string(context->send_buffer, lpPathName);
+}
+
+
+BOOL _EndCeCreateDirectory2(
+        RapiContext *context)
+{
+    BOOL return_value = 0;
+
     rapi_buffer_read_uint32(context->recv_buffer, &context->last_error);
     rapi_buffer_read_uint32(context->recv_buffer, &return_value);
 
@@ -231,17 +250,31 @@ BOOL _CeCreateDirectory2(
         LPCWSTR lpPathName,
         LPSECURITY_ATTRIBUTES lpSecurityAttributes SYNCE_UNUSED)
 {
-    BOOL return_value = 0;
-
-    rapi_context_begin_command(context, 0x28);
-    rapi2_buffer_write_string(context->send_buffer, lpPathName);
-    /*
-    rapi_buffer_write_optional_string(context->send_buffer, lpPathName);
-    rapi_buffer_write_optional_in(context->send_buffer, NULL, 0); */ /* lpSecurityAttributes */
+    _BeginCeCreateDirectory2(context, lpPathName);
 
     if ( !rapi2_context_call(context) )
         return 0;
 
+    return _EndCeCreateDirectory2(context);
+}
+
+
+bool _BeginCeRemoveDirectory2(
+        RapiContext *context,
+        LPCWSTR lpPathName)
+{
+    /*    rapi_buffer_write_optional_string(context->send_buffer, lpPathName); */
+    return
+        rapi_context_begin_command(context, 0x29) &&
+        rapi2_buffer_write_string(context->send_buffer, lpPathName);
+}
+
+
+BOOL _EndCeRemoveDirectory2(
+        RapiContext *context)
+{
+    BOOL return_value = 0;
+
     rapi_buffer_read_uint32(context->recv_buffer, &context->last_error);
     rapi_buffer_read_uint32(context->recv_buffer, &return_value);
 
@@ -253,19 +286,12 @@ BOOL _CeRemoveDirectory2(
         RapiContext *context,
         LPCWSTR lpPathName)
 {
-    BOOL return_value = 0;
-
-    rapi_context_begin_command(context, 0x29);
-    rapi2_buffer_write_string(context->send_buffer, lpPathName);
-    /*    rapi_buffer_write_optional_string(context->send_buffer, lpPathName); */
+    _BeginCeRemoveDirectory2(context, lpPathName);
 
     if ( !rapi2_context_call(context) )
         return 0;
 
-    rapi_buffer_read_uint32(context->recv_buffer, &context->last_error);
-    rapi_buffer_read_uint32(context->recv_buffer, &return_value);
-
-    return return_value;
+    return _EndCeRemoveDirectory2(context);
 }
 
 
@@ -88,6 +88,7 @@ static HRESULT CeRapiInvokeStream2( /*{{{*/
     goto exit;
   }
 
+  rapi_stream_ready(*ppIRAPIStream);
   return_value = S_OK;
 
 exit:
@@ -5,15 +5,22 @@
 #include <stdio.h>
 
 
-LONG _CeRegCreateKeyEx2(
+bool _BeginCeRegCreateKeyEx2(
 		RapiContext *context,
 		HKEY hKey,
 		LPCWSTR lpszSubKey,
-		DWORD Reserved SYNCE_UNUSED,
-		LPWSTR lpszClass,
-		DWORD ulOptions SYNCE_UNUSED,
-		REGSAM samDesired SYNCE_UNUSED,
-		LPSECURITY_ATTRIBUTES lpSecurityAttributes SYNCE_UNUSED,
+		LPCWSTR lpszClass)
+{
+	return
+		rapi_context_begin_command(context, 0x31) &&
+		rapi_buffer_write_uint32(context->send_buffer, hKey) &&
+		rapi2_buffer_write_string(context->send_buffer, lpszSubKey) &&
+		rapi2_buffer_write_string(context->send_buffer, lpszClass);
+}
+
+
+LONG _EndCeRegCreateKeyEx2(
+		RapiContext *context,
 		PHKEY phkResult,
 		LPDWORD lpdwDisposition)
 {
@@ -21,14 +28,6 @@ LONG _CeRegCreateKeyEx2(
 	HKEY result = 0;
 	DWORD disposition = 0;
 
-	rapi_context_begin_command(context, 0x31);
-	rapi_buffer_write_uint32(context->send_buffer, hKey);
-	rapi2_buffer_write_string(context->send_buffer, lpszSubKey);
-	rapi2_buffer_write_string(context->send_buffer, lpszClass);
-
-	if ( !rapi2_context_call(context) )
-		return ERROR_GEN_FAILURE;
-
 	rapi_buffer_read_uint32(context->recv_buffer, &context->last_error);
 	rapi_buffer_read_int32(context->recv_buffer, &return_value);
 
@@ -47,23 +46,45 @@ LONG _CeRegCreateKeyEx2(
 	return return_value;
 }
 
-LONG _CeRegOpenKeyEx2(
+
+LONG _CeRegCreateKeyEx2(
 		RapiContext *context,
 		HKEY hKey,
 		LPCWSTR lpszSubKey,
+		DWORD Reserved SYNCE_UNUSED,
+		LPWSTR lpszClass,
 		DWORD ulOptions SYNCE_UNUSED,
 		REGSAM samDesired SYNCE_UNUSED,
-		PHKEY phkResult)
+		LPSECURITY_ATTRIBUTES lpSecurityAttributes SYNCE_UNUSED,
+		PHKEY phkResult,
+		LPDWORD lpdwDisposition)
 {
-	LONG return_value = ERROR_GEN_FAILURE;
-
-	rapi_context_begin_command(context, 0x2f);
-	rapi_buffer_write_uint32(context->send_buffer, hKey);
-	rapi2_buffer_write_string(context->send_buffer, lpszSubKey);
+	_BeginCeRegCreateKeyEx2(context, hKey, lpszSubKey, lpszClass);
 
 	if ( !rapi2_context_call(context) )
 		return ERROR_GEN_FAILURE;
 
+	return _EndCeRegCreateKeyEx2(context, phkResult, lpdwDisposition);
+}
+
+bool _BeginCeRegOpenKeyEx2(
+		RapiContext *context,
+		HKEY hKey,
+		LPCWSTR lpszSubKey)
+{
+	return
+		rapi_context_begin_command(context, 0x2f) &&
+		rapi_buffer_write_uint32(context->send_buffer, hKey) &&
+		rapi2_buffer_write_string(context->send_buffer, lpszSubKey);
+}
+
+
+LONG _EndCeRegOpenKeyEx2(
+		RapiContext *context,
+		PHKEY phkResult)
+{
+	LONG return_value = ERROR_GEN_FAILURE;
+
 	rapi_buffer_read_uint32(context->recv_buffer, &context->last_error);
 	rapi_buffer_read_int32(context->recv_buffer, &return_value);
 
@@ -77,31 +98,45 @@ LONG _CeRegOpenKeyEx2(
 }
 
 
-LONG _CeRegQueryValueEx2(
+LONG _CeRegOpenKeyEx2(
+		RapiContext *context,
+		HKEY hKey,
+		LPCWSTR lpszSubKey,
+		DWORD ulOptions SYNCE_UNUSED,
+		REGSAM samDesired SYNCE_UNUSED,
+		PHKEY phkResult)
+{
+	_BeginCeRegOpenKeyEx2(context, hKey, lpszSubKey);
+
+	if ( !rapi2_context_call(context) )
+		return ERROR_GEN_FAILURE;
+
+	return _EndCeRegOpenKeyEx2(context, phkResult);
+}
+
+
+bool _BeginCeRegQueryValueEx2(
 		RapiContext *context,
 		HKEY hKey,
 		LPCWSTR lpValueName,
-		LPDWORD lpReserved SYNCE_UNUSED,
+		DWORD cbData)
+{
+	return
+		rapi_context_begin_command(context, 0x37) &&
+		rapi_buffer_write_uint32(context->send_buffer, hKey) &&
+		rapi2_buffer_write_string(context->send_buffer, lpValueName) &&
+		rapi_buffer_write_uint32(context->send_buffer, cbData);
+}
+
+
+LONG _EndCeRegQueryValueEx2(
+		RapiContext *context,
 		LPDWORD lpType,
 		LPBYTE lpData,
 		LPDWORD lpcbData)
 {
 	LONG return_value = ERROR_GEN_FAILURE;
 
-        if (lpData && (!lpcbData))
-                return ERROR_INVALID_PARAMETER;
-
-	rapi_context_begin_command(context, 0x37);
-	rapi_buffer_write_uint32(context->send_buffer, hKey);
-	rapi2_buffer_write_string(context->send_buffer, lpValueName);
-    rapi_buffer_write_uint32(context->send_buffer, *lpcbData);
-
-	if ( !rapi2_context_call(context) )
-	{
-		synce_trace("rapi2_context_call failed");
-		return return_value;
-	}
-
 	if (!rapi_buffer_read_uint32(context->recv_buffer, &context->last_error))
 	{
 		synce_trace("rapi_buffer_read_uint32 failed");
@@ -138,17 +173,44 @@ LONG _CeRegQueryValueEx2(
 }
 
 
-LONG _CeRegCloseKey2(
+LONG _CeRegQueryValueEx2(
 		RapiContext *context,
-		HKEY hKey)
+		HKEY hKey,
+		LPCWSTR lpValueName,
+		LPDWORD lpReserved SYNCE_UNUSED,
+		LPDWORD lpType,
+		LPBYTE lpData,
+		LPDWORD lpcbData)
 {
-	LONG return_value = ERROR_GEN_FAILURE;
+        if (lpData && (!lpcbData))
+                return ERROR_INVALID_PARAMETER;
 
-	rapi_context_begin_command(context, 0x32);
-	rapi_buffer_write_uint32(context->send_buffer, hKey);
+	_BeginCeRegQueryValueEx2(context, hKey, lpValueName, *lpcbData);
 
 	if ( !rapi2_context_call(context) )
+	{
+		synce_trace("rapi2_context_call failed");
 		return ERROR_GEN_FAILURE;
+	}
+
+	return _EndCeRegQueryValueEx2(context, lpType, lpData, lpcbData);
+}
+
+
+bool _BeginCeRegCloseKey2(
+		RapiContext *context,
+		HKEY hKey)
+{
+	return
+		rapi_context_begin_command(context, 0x32) &&
+		rapi_buffer_write_uint32(context->send_buffer, hKey);
+}
+
+
+LONG _EndCeRegCloseKey2(
+		RapiContext *context)
+{
+	LONG return_value = ERROR_GEN_FAILURE;
 
 	rapi_buffer_read_uint32(context->recv_buffer, &context->last_error);
 	rapi_buffer_read_int32(context->recv_buffer, &return_value);
@@ -157,6 +219,19 @@ LONG _CeRegCloseKey2(
 }
 
 
+LONG _CeRegCloseKey2(
+		RapiContext *context,
+		HKEY hKey)
+{
+	_BeginCeRegCloseKey2(context, hKey);
+
+	if ( !rapi2_context_call(context) )
+		return ERROR_GEN_FAILURE;
+
+	return _EndCeRegCloseKey2(context);
+}
+
+
 LONG _CeRegDeleteKey2(
         RapiContext *context,
         HKEY hKey,
@@ -178,19 +253,22 @@ LONG _CeRegDeleteKey2(
 }
 
 
-LONG _CeRegDeleteValue2(
+bool _BeginCeRegDeleteValue2(
         RapiContext *context,
         HKEY hKey,
         LPCWSTR lpszValueName)
 {
-    LONG return_value = ERROR_GEN_FAILURE;
+    return
+      rapi_context_begin_command(context, 0x35) &&
+      rapi_buffer_write_uint32(context->send_buffer, hKey) &&
+      rapi2_buffer_write_string(context->send_buffer, lpszValueName);
+}
 
-    rapi_context_begin_command(context, 0x35);
-    rapi_buffer_write_uint32(context->send_buffer, hKey);
-    rapi2_buffer_write_string(context->send_buffer, lpszValueName);
 
-    if ( !rapi2_context_call(context) )
-      return ERROR_GEN_FAILURE;
+LONG _EndCeRegDeleteValue2(
+        RapiContext *context)
+{
+    LONG return_value = ERROR_GEN_FAILURE;
 
     rapi_buffer_read_uint32(context->recv_buffer, &context->last_error);
     rapi_buffer_read_int32(context->recv_buffer, &return_value);
@@ -199,37 +277,48 @@ LONG _CeRegDeleteValue2(
 }
 
 
+LONG _CeRegDeleteValue2(
+        RapiContext *context,
+        HKEY hKey,
+        LPCWSTR lpszValueName)
+{
+    _BeginCeRegDeleteValue2(context, hKey, lpszValueName);
+
+    if ( !rapi2_context_call(context) )
+      return ERROR_GEN_FAILURE;
+
+    return _EndCeRegDeleteValue2(context);
+}
+
+
 
-LONG _CeRegQueryInfoKey2(
+bool _BeginCeRegQueryInfoKey2(
 		RapiContext *context,
 		HKEY hKey,
+		DWORD cbClass)
+{
+	return
+		rapi_context_begin_command(context, 0x36) &&
+		rapi_buffer_write_uint32(context->send_buffer, hKey) &&
+		rapi_buffer_write_uint32(context->send_buffer, cbClass) &&
+		/* lpftLastWriteTime, this should be put to 0 */
+		rapi_buffer_write_uint32(context->send_buffer, 0);
+}
+
+
+LONG _EndCeRegQueryInfoKey2(
+		RapiContext *context,
 		LPWSTR lpClass,
 		LPDWORD lpcbClass,
-		LPDWORD lpReserved SYNCE_UNUSED,
 		LPDWORD lpcSubKeys,
 		LPDWORD lpcbMaxSubKeyLen,
 		LPDWORD lpcbMaxClassLen,
 		LPDWORD lpcValues,
 		LPDWORD lpcbMaxValueNameLen,
-		LPDWORD lpcbMaxValueLen,
-		LPDWORD lpcbSecurityDescriptor SYNCE_UNUSED,
-		PFILETIME lpftLastWriteTime SYNCE_UNUSED)
+		LPDWORD lpcbMaxValueLen)
 {
 	LONG return_value = ERROR_GEN_FAILURE;
 
-        if (lpClass && (!lpcbClass))
-                return ERROR_INVALID_PARAMETER;
-
-	rapi_context_begin_command(context, 0x36);
-	rapi_buffer_write_uint32        (context->send_buffer, hKey);
-	rapi_buffer_write_uint32        (context->send_buffer, lpcbClass ? *lpcbClass : 0 );
-
-	//lpftLastWriteTime, this should be put to 0
-	rapi_buffer_write_uint32        (context->send_buffer, 0);
-
-	if ( !rapi2_context_call(context) )
-		return ERROR_GEN_FAILURE;
-
 	rapi_buffer_read_uint32(context->recv_buffer, &context->last_error);
 	rapi_buffer_read_int32(context->recv_buffer, &return_value);
 
@@ -268,42 +357,62 @@ LONG _CeRegQueryInfoKey2(
 }
 
 
-LONG _CeRegEnumValue2(
+LONG _CeRegQueryInfoKey2(
 		RapiContext *context,
 		HKEY hKey,
-		DWORD dwIndex,
-		LPWSTR lpszValueName,
-		LPDWORD lpcbValueName,
+		LPWSTR lpClass,
+		LPDWORD lpcbClass,
 		LPDWORD lpReserved SYNCE_UNUSED,
-		LPDWORD lpType,
-		LPBYTE lpData,
-		LPDWORD lpcbData)
+		LPDWORD lpcSubKeys,
+		LPDWORD lpcbMaxSubKeyLen,
+		LPDWORD lpcbMaxClassLen,
+		LPDWORD lpcValues,
+		LPDWORD lpcbMaxValueNameLen,
+		LPDWORD lpcbMaxValueLen,
+		LPDWORD lpcbSecurityDescriptor SYNCE_UNUSED,
+		PFILETIME lpftLastWriteTime SYNCE_UNUSED)
 {
-	LONG return_value = ERROR_GEN_FAILURE;
+        if (lpClass && (!lpcbClass))
+                return ERROR_INVALID_PARAMETER;
 
-	rapi_context_begin_command(context, 0x34);
-	//These two values are NOT allowed to be NULL, therefore, just send them
-	//right away
-	rapi_buffer_write_uint32         (context->send_buffer, hKey);
-	rapi_buffer_write_uint32         (context->send_buffer, dwIndex);
+	_BeginCeRegQueryInfoKey2(context, hKey, lpcbClass ? *lpcbClass : 0);
 
-        /* a NULL lpszValueName is an error */
-        if (!lpszValueName)
-                return ERROR_INVALID_PARAMETER;
+	if ( !rapi2_context_call(context) )
+		return ERROR_GEN_FAILURE;
 
-        /* The value name buffer is not optional, if we are given zero as the size let the device flag the error */
-	rapi_buffer_write_uint32(context->send_buffer, lpcbValueName ? *lpcbValueName : 0);
+	return _EndCeRegQueryInfoKey2(context, lpClass, lpcbClass,
+			lpcSubKeys, lpcbMaxSubKeyLen, lpcbMaxClassLen,
+			lpcValues, lpcbMaxValueNameLen, lpcbMaxValueLen);
+}
 
-	//Furthermore, DON'T use the write_optional, for some reason 
-	//that does not work, at writes too many things to the send buffer
 
-        if (lpData && (!lpcbData))
-                return ERROR_INVALID_PARAMETER;
+bool _BeginCeRegEnumValue2(
+		RapiContext *context,
+		HKEY hKey,
+		DWORD dwIndex,
+		DWORD cbValueName,
+		DWORD cbData)
+{
+	//Don't use the write_optional, for some reason that does not
+	//work, at writes too many things to the send buffer
+	return
+		rapi_context_begin_command(context, 0x34) &&
+		rapi_buffer_write_uint32(context->send_buffer, hKey) &&
+		rapi_buffer_write_uint32(context->send_buffer, dwIndex) &&
+		rapi_buffer_write_uint32(context->send_buffer, cbValueName) &&
+		rapi_buffer_write_uint32(context->send_buffer, cbData);
+}
 
-	rapi_buffer_write_uint32(context->send_buffer, lpcbData ? *lpcbData : 0 );
 
-	if ( !rapi2_context_call(context) )
-		return false;
+LONG _EndCeRegEnumValue2(
+		RapiContext *context,
+		LPWSTR lpszValueName,
+		LPDWORD lpcbValueName,
+		LPDWORD lpType,
+		LPBYTE lpData,
+		LPDWORD lpcbData)
+{
+	LONG return_value = ERROR_GEN_FAILURE;
 
 	rapi_buffer_read_uint32(context->recv_buffer, &context->last_error);
 	rapi_buffer_read_int32(context->recv_buffer, &return_value);
@@ -343,34 +452,63 @@ LONG _CeRegEnumValue2(
 }
 
 
-LONG _CeRegEnumKeyEx2(
+LONG _CeRegEnumValue2(
 		RapiContext *context,
 		HKEY hKey,
 		DWORD dwIndex,
-		LPWSTR lpName,
-		LPDWORD lpcbName,
+		LPWSTR lpszValueName,
+		LPDWORD lpcbValueName,
 		LPDWORD lpReserved SYNCE_UNUSED,
-		LPWSTR lpClass,
-		LPDWORD lpcbClass,
-		PFILETIME lpftLastWriteTime SYNCE_UNUSED)
+		LPDWORD lpType,
+		LPBYTE lpData,
+		LPDWORD lpcbData)
 {
-	LONG return_value = ERROR_GEN_FAILURE;
+        /* a NULL lpszValueName is an error */
+        if (!lpszValueName)
+                return ERROR_INVALID_PARAMETER;
 
-        if (lpClass && (!lpcbClass))
+        if (lpData && (!lpcbData))
                 return ERROR_INVALID_PARAMETER;
 
-	rapi_context_begin_command(context, 0x30);
-	rapi_buffer_write_uint32         (context->send_buffer, hKey);
-	rapi_buffer_write_uint32         (context->send_buffer, dwIndex);
+        /* The value name buffer is not optional, if we are given zero as the size let the device flag the error */
+	_BeginCeRegEnumValue2(context, hKey, dwIndex,
+			lpcbValueName ? *lpcbValueName : 0,
+			lpcbData ? *lpcbData : 0);
 
-        /* lpcbName is not optional, but let the device catch the problem */
-        rapi_buffer_write_uint32(context->send_buffer, lpcbName ? *lpcbName : 0);
-	rapi_buffer_write_uint32(context->send_buffer, lpcbClass ? *lpcbClass : 0 );
-	rapi_buffer_write_uint32(context->send_buffer, 0);
+	if ( !rapi2_context_call(context) )
+		return false;
 
+	return _EndCeRegEnumValue2(context, lpszValueName, lpcbValueName,
+			lpType, lpData, lpcbData);
+}
 
-	if ( !rapi2_context_call(context) )
-		return ERROR_GEN_FAILURE;
+
+bool _BeginCeRegEnumKeyEx2(
+		RapiContext *context,
+		HKEY hKey,
+		DWORD dwIndex,
+		DWORD cbName,
+		DWORD cbClass)
+{
+	/* lpcbName is not optional, but let the device catch the problem */
+	return
+		rapi_context_begin_command(context, 0x30) &&
+		rapi_buffer_write_uint32(context->send_buffer, hKey) &&
+		rapi_buffer_write_uint32(context->send_buffer, dwIndex) &&
+		rapi_buffer_write_uint32(context->send_buffer, cbName) &&
+		rapi_buffer_write_uint32(context->send_buffer, cbClass) &&
+		rapi_buffer_write_uint32(context->send_buffer, 0);
+}
+
+
+LONG _EndCeRegEnumKeyEx2(
+		RapiContext *context,
+		LPWSTR lpName,
+		LPDWORD lpcbName,
+		LPWSTR lpClass,
+		LPDWORD lpcbClass)
+{
+	LONG return_value = ERROR_GEN_FAILURE;
 
 	rapi_buffer_read_uint32(context->recv_buffer, &context->last_error);
 	rapi_buffer_read_int32(context->recv_buffer, &return_value);
@@ -390,26 +528,53 @@ LONG _CeRegEnumKeyEx2(
 	return return_value;
 }
 
-LONG _CeRegSetValueEx2(
+
+LONG _CeRegEnumKeyEx2(
+		RapiContext *context,
+		HKEY hKey,
+		DWORD dwIndex,
+		LPWSTR lpName,
+		LPDWORD lpcbName,
+		LPDWORD lpReserved SYNCE_UNUSED,
+		LPWSTR lpClass,
+		LPDWORD lpcbClass,
+		PFILETIME lpftLastWriteTime SYNCE_UNUSED)
+{
+        if (lpClass && (!lpcbClass))
+                return ERROR_INVALID_PARAMETER;
+
+	_BeginCeRegEnumKeyEx2(context, hKey, dwIndex,
+			lpcbName ? *lpcbName : 0,
+			lpcbClass ? *lpcbClass : 0);
+
+	if ( !rapi2_context_call(context) )
+		return ERROR_GEN_FAILURE;
+
+	return _EndCeRegEnumKeyEx2(context, lpName, lpcbName, lpClass, lpcbClass);
+}
+
+bool _BeginCeRegSetValueEx2(
 		RapiContext *context,
 		HKEY hKey,
 		LPCWSTR lpValueName,
-		DWORD Reserved SYNCE_UNUSED,
 		DWORD dwType,
 		const BYTE *lpData,
 		DWORD cbData)
 {
-	LONG return_value = ERROR_GEN_FAILURE;
+	return
+		rapi_context_begin_command(context, 0x38) &&
+		rapi_buffer_write_uint32(context->send_buffer, hKey) &&
+		rapi2_buffer_write_string(context->send_buffer, lpValueName) &&
+		rapi_buffer_write_uint32(context->send_buffer, dwType) &&
+		rapi_buffer_write_uint32(context->send_buffer, cbData) &&
+		rapi_buffer_write_data(context->send_buffer, lpData, cbData);
+}
 
-	rapi_context_begin_command(context, 0x38);
-	rapi_buffer_write_uint32(context->send_buffer, hKey);
-	rapi2_buffer_write_string(context->send_buffer, lpValueName);
-	rapi_buffer_write_uint32(context->send_buffer, dwType);
-        rapi_buffer_write_uint32(context->send_buffer, cbData);
-        rapi_buffer_write_data(context->send_buffer, lpData, cbData);
 
-	if ( !rapi2_context_call(context) )
-		return ERROR_GEN_FAILURE;
+LONG _EndCeRegSetValueEx2(
+		RapiContext *context)
+{
+	LONG return_value = ERROR_GEN_FAILURE;
 
 	if (!rapi_buffer_read_uint32(context->recv_buffer, &context->last_error))
 		return ERROR_GEN_FAILURE;
@@ -419,3 +584,21 @@ LONG _CeRegSetValueEx2(
 	return return_value;
 }
 
+
+LONG _CeRegSetValueEx2(
+		RapiContext *context,
+		HKEY hKey,
+		LPCWSTR lpValueName,
+		DWORD Reserved SYNCE_UNUSED,
+		DWORD dwType,
+		const BYTE *lpData,
+		DWORD cbData)
+{
+	_BeginCeRegSetValueEx2(context, hKey, lpValueName, dwType, lpData, cbData);
+
+	if ( !rapi2_context_call(context) )
+		return ERROR_GEN_FAILURE;
+
+	return _EndCeRegSetValueEx2(context);
+}
+
@@ -1,7 +1,12 @@
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <synce_log.h>
 
 #include "irapistream.h"
 #include "irapistream_internal.h"
+#include "rapi2_async.h"
 
 IRAPIStream* rapi_stream_new()/*{{{*/
 {
@@ -10,11 +15,24 @@ IRAPIStream* rapi_stream_new()/*{{{*/
   if (stream)
   {
     stream->context = rapi_context_new();
+
+    /* the raw socket is handed out, keep it blocking */
+    if (stream->context)
+      synce_socket_set_nonblocking(stream->context->socket, false);
   }
 
   return stream;
 }/*}}}*/
 
+/*
+ * Called once the stream is set up and given to the caller, who may
+ * wait on it for as long as they like
+ */
+void rapi_stream_ready(IRAPIStream* stream)/*{{{*/
+{
+  rapi_context_set_timeout(stream->context, SYNCE_SOCKET_NO_TIMEOUT);
+}/*}}}*/
+
 void rapi_stream_destroy(IRAPIStream* stream)/*{{{*/
 {
   if (stream)
@@ -67,8 +85,136 @@ HRESULT IRAPIStream_Write( /*{{{*/
 
   return hr;
 }/*}}}*/
+HRESULT IRAPIStream_ReadSome( /*{{{*/
+    IRAPIStream* stream,
+    void *pv,
+    ULONG cb,
+    ULONG *pcbRead)
+{
+  ssize_t result;
+
+  if (pcbRead)
+    *pcbRead = 0;
+
+  if (!pv)
+    return E_INVALIDARG;
+
+  if (0 == cb)
+    return S_OK;
+
+  /*
+   * Not synce_socket_read_some(), which cannot tell the end of the
+   * stream from a failure
+   */
+  do
+    result = recv(IRAPIStream_GetRawSocket(stream), pv, cb, MSG_DONTWAIT);
+  while (result < 0 && EINTR == errno);
+
+  if (result < 0)
+  {
+    if (EAGAIN == errno || EWOULDBLOCK == errno)
+      return E_PENDING;
+
+    synce_error("recv failed, error: %i \"%s\"", errno, strerror(errno));
+    return E_FAIL;
+  }
+
+  if (0 == result)
+    return S_FALSE;
+
+  if (pcbRead)
+    *pcbRead = result;
+
+  return S_OK;
+}/*}}}*/
+
+HRESULT IRAPIStream_WriteSome( /*{{{*/
+    IRAPIStream* stream,
+    void const *pv,
+    ULONG cb,
+    ULONG *pcbWritten)
+{
+  size_t written = 0;
+
+  if (pcbWritten)
+    *pcbWritten = 0;
+
+  if (!pv)
+    return E_INVALIDARG;
+
+  if (0 == cb)
+    return S_OK;
+
+  if (!synce_socket_write_some(stream->context->socket, pv, cb, &written))
+    return E_FAIL;
+
+  if (0 == written)
+    return E_PENDING;
+
+  if (pcbWritten)
+    *pcbWritten = written;
+
+  return S_OK;
+}/*}}}*/
+
+int IRAPIStream_GetRawSocket(IRAPIStream* stream)/*{{{*/
+{
+  return synce_socket_get_descriptor(stream->context->socket);
+}/*}}}*/
 
 
 /*
-int (*IRAPIStream_GetRawSocket)(IRAPIStream* stream);
-*/
+ * Readiness notification from the GLib main loop
+ */
+
+typedef struct _IRAPIStreamSource
+{
+  GSource source;
+  IRAPIStream* stream;
+  GIOCondition condition;
+  gpointer fd_tag;
+} IRAPIStreamSource;
+
+static gboolean irapi_stream_source_dispatch(/*{{{*/
+    GSource* source,
+    GSourceFunc callback,
+    gpointer user_data)
+{
+  IRAPIStreamSource* stream_source = (IRAPIStreamSource*)source;
+  IRAPIStreamSourceFunc func = (IRAPIStreamSourceFunc)callback;
+  GIOCondition revents = g_source_query_unix_fd(source, stream_source->fd_tag);
+
+  if (!func)
+  {
+    synce_warning("IRAPIStream source dispatched without a callback");
+    return G_SOURCE_REMOVE;
+  }
+
+  return func(stream_source->stream, revents & stream_source->condition, user_data);
+}/*}}}*/
+
+static GSourceFuncs irapi_stream_source_funcs = {
+  NULL,
+  NULL,
+  irapi_stream_source_dispatch,
+  NULL,
+  NULL,
+  NULL
+};
+
+GSource* IRAPIStream_CreateSource(/*{{{*/
+    IRAPIStream* stream,
+    GIOCondition condition)
+{
+  IRAPIStreamSource* stream_source;
+
+  stream_source = (IRAPIStreamSource*)g_source_new(&irapi_stream_source_funcs, sizeof(IRAPIStreamSource));
+  g_source_set_name(&stream_source->source, "IRAPIStream");
+
+  stream_source->stream = stream;
+  stream_source->condition = condition | G_IO_ERR | G_IO_HUP;
+  stream_source->fd_tag = g_source_add_unix_fd(&stream_source->source,
+      IRAPIStream_GetRawSocket(stream), stream_source->condition);
+
+  return &stream_source->source;
+}/*}}}*/
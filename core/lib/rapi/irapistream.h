@@ -30,6 +30,29 @@ HRESULT IRAPIStream_Write(
 		ULONG cb,
 		ULONG *pcbWritten);
 
+/*
+ * Non-blocking variants for servicing many streams from one thread:
+ * they transfer what the socket takes or has right now, which may be
+ * less than cb. Both return E_PENDING when nothing could be done, the
+ * cue to wait for the raw socket to become readable or writable.
+ * IRAPIStream_ReadSome() returns S_FALSE once the device has ended the
+ * stream. The blocking calls can still be mixed with these.
+ */
+HRESULT IRAPIStream_ReadSome(
+		IRAPIStream* stream,
+		void *pv,
+		ULONG cb,
+		ULONG *pcbRead);
+
+HRESULT IRAPIStream_WriteSome(
+		IRAPIStream* stream,
+		void const *pv,
+		ULONG cb,
+		ULONG *pcbWritten);
+
+/*
+ * Descriptor to poll() for readiness, owned by the stream
+ */
 int IRAPIStream_GetRawSocket(IRAPIStream* stream);
 
 
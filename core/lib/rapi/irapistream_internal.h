@@ -7,4 +7,5 @@ struct _IRAPIStream
 
 IRAPIStream* rapi_stream_new();
 void rapi_stream_destroy(IRAPIStream* stream);
+void rapi_stream_ready(IRAPIStream* stream);
 
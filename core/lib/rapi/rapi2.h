@@ -44,6 +44,19 @@ HRESULT IRAPISession_CeRapiGetError(IRAPISession *session);
 
 DWORD IRAPISession_CeGetLastError(IRAPISession *session);
 
+HRESULT IRAPISession_GetBufferStats(IRAPISession *session,
+                                    RAPI_BUFFERSTATS *pStats);
+
+HRESULT IRAPISession_SetTimeout(IRAPISession *session,
+                                DWORD dwMilliseconds);
+
+HRESULT IRAPISession_GetCallStats(IRAPISession *session,
+                                  RAPI_CALLSTATS *pStats);
+
+HRESULT IRAPISession_SetCallSpanCallback(IRAPISession *session,
+                                         RAPI_CALLSPAN_CALLBACK pfnCallback,
+                                         LPVOID pUserData);
+
 
 /*
  * File access functions
@@ -391,6 +404,159 @@ HRESULT IRAPISession_CeRapiInvoke(IRAPISession *session,
 
 
 
+/* IRAPIBatch */
+
+struct _IRAPIBatch;
+typedef struct _IRAPIBatch IRAPIBatch;
+
+HRESULT IRAPISession_CreateBatch(IRAPISession *session,
+		IRAPIBatch **ppBatch);
+
+void IRAPIBatch_Release(IRAPIBatch *batch);
+
+HRESULT IRAPIBatch_CeGetFileAttributes(IRAPIBatch *batch,
+		LPCWSTR lpFileName,
+		LPDWORD lpdwResult);
+
+HRESULT IRAPIBatch_CeDeleteFile(IRAPIBatch *batch,
+		LPCWSTR lpFileName,
+		BOOL *lpbResult);
+
+HRESULT IRAPIBatch_CeSetFileTime(IRAPIBatch *batch,
+		HANDLE hFile,
+		LPFILETIME lpCreationTime,
+		LPFILETIME lpLastAccessTime,
+		LPFILETIME lpLastWriteTime,
+		BOOL *lpbResult);
+
+HRESULT IRAPIBatch_CeCloseHandle(IRAPIBatch *batch,
+		HANDLE hObject,
+		BOOL *lpbResult);
+
+HRESULT IRAPIBatch_Execute(IRAPIBatch *batch);
+
+ULONG IRAPIBatch_GetCount(IRAPIBatch *batch);
+
+HRESULT IRAPIBatch_GetError(IRAPIBatch *batch,
+		ULONG index,
+		HRESULT *phrRapiError,
+		DWORD *pdwLastError);
+
+
+/* Registry export and import */
+
+HRESULT IRAPISession_RegExport(IRAPISession *session,
+		HKEY hKey,
+		LPCWSTR lpszSubKey,
+		RAPI_REGEXPORT_CALLBACK pfnCallback,
+		LPVOID pUserData);
+
+struct _IRAPIRegImport;
+typedef struct _IRAPIRegImport IRAPIRegImport;
+
+HRESULT IRAPISession_CreateRegImport(IRAPISession *session,
+		HKEY hKey,
+		LPCWSTR lpszSubKey,
+		IRAPIRegImport **ppImport);
+
+void IRAPIRegImport_Release(IRAPIRegImport *import);
+
+HRESULT IRAPIRegImport_CreateKey(IRAPIRegImport *import,
+		LPCWSTR pszKey);
+
+HRESULT IRAPIRegImport_SetValue(IRAPIRegImport *import,
+		LPCWSTR pszKey,
+		LPCWSTR pszValueName,
+		DWORD dwType,
+		const BYTE *pData,
+		DWORD cbData);
+
+HRESULT IRAPIRegImport_Flush(IRAPIRegImport *import);
+
+
+/* Database cursor */
+
+/* A record returned by IRAPIDatabaseCursor_Next() */
+typedef struct _RAPI_DBRECORD {
+	CEOID oid;
+	WORD cPropID;
+	CEPROPVAL *rgPropVal;
+} RAPI_DBRECORD;
+
+struct _IRAPIDatabaseCursor;
+typedef struct _IRAPIDatabaseCursor IRAPIDatabaseCursor;
+
+HRESULT IRAPISession_CreateDatabaseCursor(IRAPISession *session,
+		CEOID oidDbase,
+		LPCWSTR lpszName,
+		CEPROPID propid,
+		WORD cRecordsPerBatch,
+		IRAPIDatabaseCursor **ppCursor);
+
+void IRAPIDatabaseCursor_Release(IRAPIDatabaseCursor *cursor);
+
+HRESULT IRAPIDatabaseCursor_Next(IRAPIDatabaseCursor *cursor,
+		LPBYTE *lplpBuffer,
+		LPDWORD lpcbBuffer,
+		LPDWORD lpcRecords);
+
+HRESULT IRAPIDatabaseCursor_GetOid(IRAPIDatabaseCursor *cursor,
+		PCEOID poidDbase);
+
+
+/* IRAPITransfer */
+
+struct _IRAPITransfer;
+typedef struct _IRAPITransfer IRAPITransfer;
+
+HRESULT IRAPISession_CreateTransfer(IRAPISession *session,
+		HANDLE hFile,
+		IRAPITransfer **ppTransfer);
+
+void IRAPITransfer_Release(IRAPITransfer *transfer);
+
+BOOL IRAPITransfer_Read(IRAPITransfer *transfer,
+		LPVOID lpBuffer,
+		DWORD nNumberOfBytesToRead,
+		LPDWORD lpNumberOfBytesRead);
+
+BOOL IRAPITransfer_Write(IRAPITransfer *transfer,
+		LPCVOID lpBuffer,
+		DWORD nNumberOfBytesToWrite,
+		LPDWORD lpNumberOfBytesWritten);
+
+DWORD IRAPITransfer_GetChunkSize(IRAPITransfer *transfer);
+
+HRESULT IRAPITransfer_GetStats(IRAPITransfer *transfer,
+		RAPI_TRANSFERSTATS *pStats);
+
+
+/* IRAPICopyEngine */
+
+struct _IRAPICopyEngine;
+typedef struct _IRAPICopyEngine IRAPICopyEngine;
+
+HRESULT IRAPIDevice_CreateCopyEngine(IRAPIDevice *self,
+		DWORD dwSessions,
+		IRAPICopyEngine **ppEngine);
+
+void IRAPICopyEngine_Release(IRAPICopyEngine *engine);
+
+void IRAPICopyEngine_SetCallback(IRAPICopyEngine *engine,
+		RAPI_COPYCALLBACK pfnCallback,
+		void *pUserData);
+
+HRESULT IRAPICopyEngine_AddFile(IRAPICopyEngine *engine,
+		RAPI_COPYDIRECTION direction,
+		const char *pszLocalPath,
+		LPCWSTR pszRemotePath);
+
+HRESULT IRAPICopyEngine_Run(IRAPICopyEngine *engine);
+
+HRESULT IRAPICopyEngine_GetStats(IRAPICopyEngine *engine,
+		RAPI_COPYSTATS *pStats);
+
+
 /* IRAPIDevice */
 
 void IRAPIDevice_AddRef(IRAPIDevice *self);
@@ -18,9 +18,13 @@
 #include "rapi_ops.h"
 #include "rapi_context.h"
 #include "rapi2.h"
+#include "rapi2_async.h"
+#include "backend_ops_1/backend_ops_1.h"
+#include "backend_ops_2/backend_ops_2.h"
 
 #include <string.h>
 #include <stdio.h>
+#include <limits.h>
 #include <glib-object.h>
 #include <gio/gio.h>
 
@@ -104,8 +108,13 @@ struct _IRAPISession {
         IRAPIDevice *device;
         RapiContext *context;
         int refcount;
+        struct _IRAPIAsync *async;
+        RAPI_CALLSPAN_CALLBACK span_callback;
+        LPVOID span_data;
 };
 
+static HRESULT irapi_async_close(IRAPISession *session, bool disconnect);
+
 
 /** @brief Add a reference to the IRAPISession object
  * 
@@ -135,6 +144,7 @@ IRAPISession_Release(IRAPISession *session)
         if (session->refcount > 0)
                 return;
 
+        irapi_async_close(session, false);
         IRAPIDevice_Release(session->device);
         rapi_context_disconnect(session->context);
         rapi_context_unref(session->context);
@@ -203,6 +213,8 @@ IRAPISession_CeRapiInit(IRAPISession *session)
 HRESULT
 IRAPISession_CeRapiUninit(IRAPISession *session)
 {
+  if (session->async)
+    return irapi_async_close(session, true);
   return rapi_context_disconnect(session->context);
 }
 
@@ -238,6 +250,144 @@ IRAPISession_CeGetLastError(IRAPISession *session)
   return session->context->last_error;
 }
 
+/** @brief Get buffer memory statistics
+ * 
+ * Get the number of heap allocations made by the session's
+ * send and receive buffers, and the memory they currently hold.
+ * In steady state the allocation count should not increase
+ * from call to call.
+ * 
+ * @param[in] self address of the session object
+ * @param[out] pStats address of a struct to receive the statistics
+ * @return an HRESULT indicating success or an error
+ */ 
+HRESULT
+IRAPISession_GetBufferStats(IRAPISession *session,
+                            RAPI_BUFFERSTATS *pStats)
+{
+  RapiBufferStats stats;
+
+  if (!pStats)
+    return E_INVALIDARG;
+
+  rapi_context_get_buffer_stats(session->context, &stats);
+
+  pStats->dwAllocations = stats.allocations;
+  pStats->dwShrinks = stats.shrinks;
+  pStats->cbCapacity = stats.capacity;
+
+  return S_OK;
+}
+
+
+/** @brief Get call statistics
+ * 
+ * Get the number of calls made on the session since it was
+ * created, by command and in total, the bytes they moved and
+ * the time spent sending, waiting for replies and receiving
+ * them. Comparing two snapshots gives the link utilisation.
+ * Only the calls of this session are counted, not those other
+ * sessions or processes make on the same device.
+ * 
+ * @param[in] self address of the session object
+ * @param[out] pStats address of a struct to receive the statistics
+ * @return an HRESULT indicating success or an error
+ */ 
+HRESULT
+IRAPISession_GetCallStats(IRAPISession *session,
+                          RAPI_CALLSTATS *pStats)
+{
+  RapiContextStats stats;
+  int i;
+
+  if (!pStats)
+    return E_INVALIDARG;
+
+  rapi_context_get_stats(session->context, &stats);
+
+  pStats->dwCalls = stats.calls;
+  pStats->dwErrors = stats.errors;
+  pStats->dwDeviceErrors = stats.device_errors;
+  pStats->cbSent = stats.bytes_sent;
+  pStats->cbReceived = stats.bytes_received;
+  pStats->usSend = stats.send_us;
+  pStats->usWait = stats.wait_us;
+  pStats->usReceive = stats.recv_us;
+  for (i = 0; i < RAPI_CALLSTATS_COMMANDS; i++)
+    pStats->rgdwCommandCalls[i] = stats.command_calls[i];
+
+  return S_OK;
+}
+
+
+static void
+irapi_session_span(const RapiContextSpan *span, void *user_data)
+{
+  IRAPISession *session = user_data;
+  RAPI_CALLSPAN call;
+
+  call.dwCommand = span->command;
+  call.hr = span->result;
+  call.cbSent = span->bytes_sent;
+  call.cbReceived = span->bytes_received;
+  call.usSend = span->send_us;
+  call.usWait = span->wait_us;
+  call.usReceive = span->recv_us;
+
+  session->span_callback(&call, session->span_data);
+}
+
+/** @brief Set a callback for each call
+ * 
+ * Have pfnCallback called with the timings of every call made
+ * on the session once its reply has arrived or the call failed.
+ * It runs on the thread making the call and should return
+ * quickly.
+ * 
+ * @param[in] self address of the session object
+ * @param[in] pfnCallback function to call, or NULL to stop
+ * @param[in] pUserData passed on to pfnCallback
+ * @return an HRESULT indicating success or an error
+ */ 
+HRESULT
+IRAPISession_SetCallSpanCallback(IRAPISession *session,
+                                 RAPI_CALLSPAN_CALLBACK pfnCallback,
+                                 LPVOID pUserData)
+{
+  session->span_callback = pfnCallback;
+  session->span_data = pUserData;
+
+  if (pfnCallback)
+    rapi_context_set_span_hook(session->context, irapi_session_span, session);
+  else
+    rapi_context_set_span_hook(session->context, NULL, NULL);
+
+  return S_OK;
+}
+
+
+/** @brief Set the deadline for device calls
+ * 
+ * Set how long sending a call or receiving its reply may take
+ * before the call fails and the connection is closed. The default
+ * is two minutes.
+ * 
+ * @param[in] self address of the session object
+ * @param[in] dwMilliseconds deadline, or 0 to wait indefinitely
+ * @return an HRESULT indicating success or an error
+ */ 
+HRESULT
+IRAPISession_SetTimeout(IRAPISession *session,
+                        DWORD dwMilliseconds)
+{
+  if (0 == dwMilliseconds || dwMilliseconds > INT_MAX)
+    rapi_context_set_timeout(session->context, SYNCE_SOCKET_NO_TIMEOUT);
+  else
+    rapi_context_set_timeout(session->context, (int)dwMilliseconds);
+
+  return S_OK;
+}
+
 
 /*
  * Implementation of calls that differ on WM5 and pre-WM5
@@ -1700,6 +1850,2736 @@ IRAPISession_CeRapiInvoke(IRAPISession *session,
 /** @} */
 
 
+/*
+ * IRAPIBatch
+ */
+
+/**
+ * @defgroup IRAPIBatch IRAPIBatch public API
+ * @ingroup RAPI2
+ *
+ * Pipelined execution of a series of calls on a session.
+ *
+ * Calls added to a batch are encoded and queued, then sent to the
+ * device together, and the replies are collected in order. This avoids
+ * paying the link round trip for every call. Only devices using the
+ * RAPI2 protocol (WM5 and later) support batches.
+ *
+ * While a batch has calls waiting for a reply the normal
+ * IRAPISession_* calls on the same session fail.
+ *
+ *@{
+ */
+
+extern struct rapi_ops_s rapi2_ops;
+
+/** Number of calls sent before their replies are collected, bounds
+ *  the amount of unread data either end has to buffer */
+#define IRAPI_BATCH_WINDOW 64
+
+typedef enum _IRAPIBatchCommand
+{
+        IRAPI_BATCH_CE_GET_FILE_ATTRIBUTES,
+        IRAPI_BATCH_CE_DELETE_FILE,
+        IRAPI_BATCH_CE_SET_FILE_TIME,
+        IRAPI_BATCH_CE_CLOSE_HANDLE
+} IRAPIBatchCommand;
+
+typedef struct _IRAPIBatchEntry
+{
+        IRAPIBatchCommand command;
+        void *result;
+        HRESULT rapi_error;
+        DWORD last_error;
+} IRAPIBatchEntry;
+
+/** @typedef struct _IRAPIBatch IRAPIBatch
+ * @brief A series of pipelined calls on a session
+ *
+ * This is an opaque structure, created with IRAPISession_CreateBatch().
+ * It's contents should be accessed via the IRAPIBatch_*
+ * series of functions.
+ */
+struct _IRAPIBatch {
+        IRAPISession *session;
+        IRAPIBatchEntry *entries;
+        ULONG count;
+        ULONG completed;
+        ULONG capacity;
+};
+
+
+/** @brief Create a batch of pipelined calls
+ *
+ * This function creates an empty IRAPIBatch object for the session.
+ * The batch holds a reference to the session until it is released.
+ *
+ * @param[in] session address of the session object
+ * @param[out] ppBatch address of the pointer to receive the batch
+ * @return an HRESULT indicating success or an error
+ */
+HRESULT
+IRAPISession_CreateBatch(IRAPISession *session, IRAPIBatch **ppBatch)
+{
+        RapiContext * context = session->context;
+        IRAPIBatch *batch = NULL;
+
+        if (!ppBatch)
+                return E_INVALIDARG;
+
+        if (!context->is_initialized)
+                return E_UNEXPECTED;
+
+        if (context->rapi_ops != &rapi2_ops)
+                return E_NOTIMPL;
+
+        batch = calloc(1, sizeof(IRAPIBatch));
+        if (!batch)
+                return E_OUTOFMEMORY;
+
+        IRAPISession_AddRef(session);
+        batch->session = session;
+
+        *ppBatch = batch;
+        return S_OK;
+}
+
+static void
+irapi_batch_finish_entry(IRAPIBatch *batch, IRAPIBatchEntry *entry)
+{
+        RapiContext *context = batch->session->context;
+        DWORD dword_result = 0;
+        BOOL bool_result = FALSE;
+
+        switch (entry->command)
+        {
+        case IRAPI_BATCH_CE_GET_FILE_ATTRIBUTES:
+                dword_result = _EndCeGetFileAttributes2(context);
+                break;
+        case IRAPI_BATCH_CE_DELETE_FILE:
+                bool_result = _EndCeDeleteFile2(context);
+                break;
+        case IRAPI_BATCH_CE_SET_FILE_TIME:
+                bool_result = _EndCeSetFileTime2(context);
+                break;
+        case IRAPI_BATCH_CE_CLOSE_HANDLE:
+                bool_result = _EndCeCloseHandle2(context);
+                break;
+        }
+
+        if (entry->result)
+        {
+                if (entry->command == IRAPI_BATCH_CE_GET_FILE_ATTRIBUTES)
+                        *(DWORD*)entry->result = dword_result;
+                else
+                        *(BOOL*)entry->result = bool_result;
+        }
+
+        entry->rapi_error = context->rapi_error;
+        entry->last_error = context->last_error;
+}
+
+/*
+ * Receive the replies for all calls sent so far
+ */
+static HRESULT
+irapi_batch_collect(IRAPIBatch *batch)
+{
+        RapiContext *context = batch->session->context;
+
+        while (batch->completed < batch->count)
+        {
+                IRAPIBatchEntry *entry = &batch->entries[batch->completed];
+
+                if (!rapi2_context_recv_reply(context)) {
+                        HRESULT hr = context->rapi_error;
+
+                        /* the connection is gone, fail everything left */
+                        for (; batch->completed < batch->count; batch->completed++) {
+                                batch->entries[batch->completed].rapi_error = hr;
+                                batch->entries[batch->completed].last_error = ERROR_NOT_CONNECTED;
+                        }
+                        return hr;
+                }
+
+                irapi_batch_finish_entry(batch, entry);
+                batch->completed++;
+        }
+
+        return S_OK;
+}
+
+/*
+ * Queue the command encoded in the session's send buffer
+ */
+static HRESULT
+irapi_batch_queue(IRAPIBatch *batch, IRAPIBatchCommand command, void *result)
+{
+        RapiContext *context = batch->session->context;
+        IRAPIBatchEntry *entry = NULL;
+
+        if (batch->count == batch->capacity) {
+                ULONG new_capacity = batch->capacity ? batch->capacity * 2 : IRAPI_BATCH_WINDOW;
+                IRAPIBatchEntry *new_entries = realloc(batch->entries, new_capacity * sizeof(IRAPIBatchEntry));
+                if (!new_entries)
+                        return E_OUTOFMEMORY;
+
+                batch->entries = new_entries;
+                batch->capacity = new_capacity;
+        }
+
+        /* asynchronous calls are outstanding on the session */
+        if (rapi_context_get_pending(context) != batch->count - batch->completed)
+                return E_PENDING;
+
+        if (!rapi_context_queue_command(context))
+                return context->rapi_error;
+
+        entry = &batch->entries[batch->count++];
+        entry->command = command;
+        entry->result = result;
+        entry->rapi_error = E_PENDING;
+        entry->last_error = ERROR_SUCCESS;
+
+        if (rapi_context_get_pending(context) >= IRAPI_BATCH_WINDOW)
+                return irapi_batch_collect(batch);
+
+        return S_OK;
+}
+
+static HRESULT
+irapi_batch_check(IRAPIBatch *batch)
+{
+        if (!batch)
+                return E_INVALIDARG;
+
+        if (!batch->session->context->is_initialized)
+                return E_UNEXPECTED;
+
+        return S_OK;
+}
+
+/** @brief Queue a CeGetFileAttributes call
+ *
+ * @param[in] batch address of the batch object
+ * @param[in] lpFileName name of the file or directory
+ * @param[out] lpdwResult address of a location to receive the attributes when the call completes, or NULL
+ * @return an HRESULT indicating success or an error
+ */
+HRESULT
+IRAPIBatch_CeGetFileAttributes(IRAPIBatch *batch,
+                               LPCWSTR lpFileName,
+                               LPDWORD lpdwResult)
+{
+        HRESULT hr = irapi_batch_check(batch);
+        if (FAILED(hr))
+                return hr;
+
+        if (!_BeginCeGetFileAttributes2(batch->session->context, lpFileName))
+                return E_OUTOFMEMORY;
+
+        return irapi_batch_queue(batch, IRAPI_BATCH_CE_GET_FILE_ATTRIBUTES, lpdwResult);
+}
+
+/** @brief Queue a CeDeleteFile call
+ *
+ * @param[in] batch address of the batch object
+ * @param[in] lpFileName name of the file to delete
+ * @param[out] lpbResult address of a location to receive the result when the call completes, or NULL
+ * @return an HRESULT indicating success or an error
+ */
+HRESULT
+IRAPIBatch_CeDeleteFile(IRAPIBatch *batch,
+                        LPCWSTR lpFileName,
+                        BOOL *lpbResult)
+{
+        HRESULT hr = irapi_batch_check(batch);
+        if (FAILED(hr))
+                return hr;
+
+        if (!_BeginCeDeleteFile2(batch->session->context, lpFileName))
+                return E_OUTOFMEMORY;
+
+        return irapi_batch_queue(batch, IRAPI_BATCH_CE_DELETE_FILE, lpbResult);
+}
+
+/** @brief Queue a CeSetFileTime call
+ *
+ * The FILETIME values are copied when the call is queued.
+ *
+ * @param[in] batch address of the batch object
+ * @param[in] hFile handle to the file
+ * @param[in] lpCreationTime new creation time, or NULL
+ * @param[in] lpLastAccessTime new last access time, or NULL
+ * @param[in] lpLastWriteTime new last write time, or NULL
+ * @param[out] lpbResult address of a location to receive the result when the call completes, or NULL
+ * @return an HRESULT indicating success or an error
+ */
+HRESULT
+IRAPIBatch_CeSetFileTime(IRAPIBatch *batch,
+                         HANDLE hFile,
+                         LPFILETIME lpCreationTime,
+                         LPFILETIME lpLastAccessTime,
+                         LPFILETIME lpLastWriteTime,
+                         BOOL *lpbResult)
+{
+        HRESULT hr = irapi_batch_check(batch);
+        if (FAILED(hr))
+                return hr;
+
+        if (!_BeginCeSetFileTime2(batch->session->context, hFile,
+                                  lpCreationTime, lpLastAccessTime, lpLastWriteTime))
+                return E_OUTOFMEMORY;
+
+        return irapi_batch_queue(batch, IRAPI_BATCH_CE_SET_FILE_TIME, lpbResult);
+}
+
+/** @brief Queue a CeCloseHandle call
+ *
+ * @param[in] batch address of the batch object
+ * @param[in] hObject handle to close
+ * @param[out] lpbResult address of a location to receive the result when the call completes, or NULL
+ * @return an HRESULT indicating success or an error
+ */
+HRESULT
+IRAPIBatch_CeCloseHandle(IRAPIBatch *batch,
+                         HANDLE hObject,
+                         BOOL *lpbResult)
+{
+        HRESULT hr = irapi_batch_check(batch);
+        if (FAILED(hr))
+                return hr;
+
+        if (!_BeginCeCloseHandle2(batch->session->context, hObject))
+                return E_OUTOFMEMORY;
+
+        return irapi_batch_queue(batch, IRAPI_BATCH_CE_CLOSE_HANDLE, lpbResult);
+}
+
+/** @brief Complete all queued calls
+ *
+ * Sends any calls not yet sent and waits for all outstanding replies,
+ * storing the results in the locations given when the calls were queued.
+ * More calls may be queued on the batch afterwards.
+ *
+ * @param[in] batch address of the batch object
+ * @return S_OK if every reply was received, otherwise the error that broke the connection
+ */
+HRESULT
+IRAPIBatch_Execute(IRAPIBatch *batch)
+{
+        HRESULT hr = irapi_batch_check(batch);
+        if (FAILED(hr))
+                return hr;
+
+        return irapi_batch_collect(batch);
+}
+
+/** @brief Get the number of calls queued on the batch
+ *
+ * @param[in] batch address of the batch object
+ * @return the number of calls queued since the batch was created
+ */
+ULONG
+IRAPIBatch_GetCount(IRAPIBatch *batch)
+{
+        return batch->count;
+}
+
+/** @brief Get the errors of a call in the batch
+ *
+ * Calls are numbered from 0 in the order they were queued.
+ * The RAPI error is E_PENDING until the reply has been received.
+ *
+ * @param[in] batch address of the batch object
+ * @param[in] index index of the call
+ * @param[out] phrRapiError address of a location to receive the RAPI error, or NULL
+ * @param[out] pdwLastError address of a location to receive the device's last error, or NULL
+ * @return S_OK, or E_INVALIDARG if index is out of range
+ */
+HRESULT
+IRAPIBatch_GetError(IRAPIBatch *batch,
+                    ULONG index,
+                    HRESULT *phrRapiError,
+                    DWORD *pdwLastError)
+{
+        if (!batch || index >= batch->count)
+                return E_INVALIDARG;
+
+        if (phrRapiError)
+                *phrRapiError = batch->entries[index].rapi_error;
+        if (pdwLastError)
+                *pdwLastError = batch->entries[index].last_error;
+
+        return S_OK;
+}
+
+/** @brief Release the batch
+ *
+ * Any outstanding replies are collected first, so that the
+ * session can be used for normal calls again.
+ *
+ * @param[in] batch address of the batch object
+ */
+void
+IRAPIBatch_Release(IRAPIBatch *batch)
+{
+        if (!batch)
+                return;
+
+        if (batch->session->context->is_initialized)
+                irapi_batch_collect(batch);
+
+        IRAPISession_Release(batch->session);
+        free(batch->entries);
+        free(batch);
+}
+
+/** @} */
+
+
+/*
+ * Registry export and import
+ */
+
+/**
+ * @defgroup IRAPIRegistry Registry export and import
+ * @ingroup RAPI2
+ *
+ * Copying a registry tree with the normal calls costs a link round
+ * trip for every key and every value. IRAPISession_RegExport() walks
+ * a tree with pipelined calls instead: the keys of one level are
+ * opened, queried and enumerated in groups of up to
+ * IRAPI_REG_GROUP, with the enumeration buffers sized from what
+ * CeRegQueryInfoKey() reported, so a group takes three round trips
+ * however many values it holds. IRAPIRegImport queues keys and values
+ * and writes them to the device the same way.
+ *
+ * Only devices using the RAPI2 protocol (WM5 and later) support this,
+ * and like batches it fails while asynchronous calls are outstanding.
+ *
+ *@{
+ */
+
+/** Keys opened and enumerated together */
+#define IRAPI_REG_GROUP IRAPI_BATCH_WINDOW
+
+/** Value data an import holds before writing it to the device */
+#define IRAPI_REG_IMPORT_BUFFER (256 * 1024)
+
+/* the path of the exported or imported key itself */
+static const WCHAR irapi_reg_empty[1] = { 0 };
+
+typedef enum _IRAPIRegCommand
+{
+        IRAPI_REG_OPEN_KEY,
+        IRAPI_REG_QUERY_INFO_KEY,
+        IRAPI_REG_ENUM_VALUE,
+        IRAPI_REG_ENUM_KEY,
+        IRAPI_REG_CLOSE_KEY,
+        IRAPI_REG_CREATE_KEY,
+        IRAPI_REG_SET_VALUE
+} IRAPIRegCommand;
+
+/*
+ * Calls queued on the session, with what to do with each reply. At
+ * most IRAPI_BATCH_WINDOW are outstanding, half of them are collected
+ * when the window is full.
+ */
+typedef struct _IRAPIRegPipe
+{
+        RapiContext *context;
+        void (*finish)(void *owner, IRAPIRegCommand command, ULONG index);
+        void *owner;
+        IRAPIRegCommand commands[IRAPI_BATCH_WINDOW];
+        ULONG indexes[IRAPI_BATCH_WINDOW];
+        ULONG first;
+        ULONG count;
+} IRAPIRegPipe;
+
+static HRESULT
+irapi_reg_pipe_recv(IRAPIRegPipe *pipe)
+{
+        ULONG slot = pipe->first;
+
+        if (!rapi2_context_recv_reply(pipe->context)) {
+                /* the connection is gone with all the replies */
+                pipe->count = 0;
+                return pipe->context->rapi_error;
+        }
+
+        pipe->first = (pipe->first + 1) % IRAPI_BATCH_WINDOW;
+        pipe->count--;
+
+        pipe->finish(pipe->owner, pipe->commands[slot], pipe->indexes[slot]);
+        return S_OK;
+}
+
+static HRESULT
+irapi_reg_pipe_drain(IRAPIRegPipe *pipe)
+{
+        HRESULT hr = S_OK;
+
+        while (pipe->count && SUCCEEDED(hr))
+                hr = irapi_reg_pipe_recv(pipe);
+
+        return hr;
+}
+
+/*
+ * Collect the replies still due after a call could not be queued, so
+ * that the session takes calls again. False if the connection went
+ * away with them, and with the keys opened on it.
+ */
+static bool
+irapi_reg_pipe_abort(IRAPIRegPipe *pipe)
+{
+        return SUCCEEDED(irapi_reg_pipe_drain(pipe)) &&
+                synce_socket_get_descriptor(pipe->context->socket) != SYNCE_SOCKET_INVALID_DESCRIPTOR;
+}
+
+/*
+ * Queue the command encoded in the session's send buffer, encoded
+ * is what the _Begin function returned
+ */
+static HRESULT
+irapi_reg_pipe_queue(IRAPIRegPipe *pipe, bool encoded, IRAPIRegCommand command, ULONG index)
+{
+        HRESULT hr = S_OK;
+        ULONG slot;
+
+        if (!encoded)
+                return E_OUTOFMEMORY;
+
+        if (pipe->count == IRAPI_BATCH_WINDOW) {
+                while (pipe->count > IRAPI_BATCH_WINDOW / 2)
+                        if (FAILED(hr = irapi_reg_pipe_recv(pipe)))
+                                return hr;
+        }
+
+        if (!rapi_context_queue_command(pipe->context))
+                return pipe->context->rapi_error;
+
+        slot = (pipe->first + pipe->count) % IRAPI_BATCH_WINDOW;
+        pipe->commands[slot] = command;
+        pipe->indexes[slot] = index;
+        pipe->count++;
+
+        return S_OK;
+}
+
+static HRESULT
+irapi_reg_check(IRAPISession *session)
+{
+        RapiContext *context = session->context;
+
+        if (!context->is_initialized)
+                return E_UNEXPECTED;
+
+        if (context->rapi_ops != &rapi2_ops)
+                return E_NOTIMPL;
+
+        /* asynchronous calls or a batch are outstanding */
+        if (rapi_context_get_pending(context))
+                return E_PENDING;
+
+        return S_OK;
+}
+
+/*
+ * parent\name, or a copy of name at the top
+ */
+static LPWSTR
+irapi_reg_join(LPCWSTR parent, LPCWSTR name)
+{
+        size_t parent_length = wstrlen(parent);
+        size_t name_length = wstrlen(name);
+        LPWSTR path = malloc((parent_length + name_length + 2) * sizeof(WCHAR));
+
+        if (!path)
+                return NULL;
+
+        if (parent_length) {
+                memcpy(path, parent, parent_length * sizeof(WCHAR));
+                path[parent_length++] = htole16('\\');
+        }
+        memcpy(path + parent_length, name, (name_length + 1) * sizeof(WCHAR));
+
+        return path;
+}
+
+
+typedef struct _IRAPIRegExportKey
+{
+        LPWSTR path;
+        HKEY handle;
+        LONG result;
+        DWORD subkey_count;
+        DWORD max_subkey;
+        DWORD value_count;
+        DWORD max_value_name;
+        DWORD max_value;
+        LPWSTR *subkeys;
+        DWORD subkeys_found;
+} IRAPIRegExportKey;
+
+typedef struct _IRAPIRegExport
+{
+        IRAPIRegPipe pipe;
+        HKEY root;
+        RAPI_REGEXPORT_CALLBACK callback;
+        LPVOID user_data;
+        HRESULT hr;
+
+        IRAPIRegExportKey *group;
+        ULONG reported;
+
+        /* enumeration buffers, shared by the keys of a group */
+        LPWSTR name;
+        DWORD name_size;
+        LPBYTE data;
+        DWORD data_size;
+} IRAPIRegExport;
+
+static void
+irapi_reg_export_skip(IRAPIRegExport *export, IRAPIRegExportKey *key, const char *what, LONG result)
+{
+        char *path = wstr_to_utf8(key->path);
+
+        synce_warning("failed to %s registry key '%s', skipping: %s",
+                      what, path ? path : "", synce_strerror(result));
+        wstr_free_string(path);
+
+        if (SUCCEEDED(export->hr))
+                export->hr = S_FALSE;
+}
+
+/*
+ * Report the keys of the group up to index that have not been
+ * reported yet, so that each key comes right before its values
+ */
+static void
+irapi_reg_export_report(IRAPIRegExport *export, ULONG index)
+{
+        for (; export->reported <= index; export->reported++) {
+                IRAPIRegExportKey *key = &export->group[export->reported];
+                HRESULT hr;
+
+                if (FAILED(export->hr) || ERROR_SUCCESS != key->result)
+                        continue;
+
+                hr = export->callback(key->path, NULL, REG_NONE, NULL, 0, export->user_data);
+                if (FAILED(hr))
+                        export->hr = hr;
+        }
+}
+
+static void
+irapi_reg_export_finish(void *owner, IRAPIRegCommand command, ULONG index)
+{
+        IRAPIRegExport *export = owner;
+        RapiContext *context = export->pipe.context;
+        IRAPIRegExportKey *key = &export->group[index];
+        DWORD name_size = export->name_size;
+        DWORD data_size = export->data_size;
+        DWORD type = REG_NONE;
+        LONG result;
+        HRESULT hr;
+
+        switch (command)
+        {
+        case IRAPI_REG_OPEN_KEY:
+                key->result = _EndCeRegOpenKeyEx2(context, &key->handle);
+                if (ERROR_SUCCESS != key->result)
+                        irapi_reg_export_skip(export, key, "open", key->result);
+                break;
+
+        case IRAPI_REG_QUERY_INFO_KEY:
+                key->result = _EndCeRegQueryInfoKey2(context, NULL, NULL,
+                                &key->subkey_count, &key->max_subkey, NULL,
+                                &key->value_count, &key->max_value_name, &key->max_value);
+                if (ERROR_SUCCESS != key->result)
+                        irapi_reg_export_skip(export, key, "query", key->result);
+                break;
+
+        case IRAPI_REG_ENUM_VALUE:
+                irapi_reg_export_report(export, index);
+
+                result = _EndCeRegEnumValue2(context, export->name, &name_size,
+                                &type, export->data, &data_size);
+                if (ERROR_NO_MORE_ITEMS == result || FAILED(export->hr))
+                        break;
+
+                /* the value grew since the key was queried */
+                if (ERROR_SUCCESS == result && data_size > export->data_size)
+                        result = ERROR_MORE_DATA;
+
+                if (ERROR_SUCCESS != result) {
+                        irapi_reg_export_skip(export, key, "read a value of", result);
+                        break;
+                }
+
+                hr = export->callback(key->path, export->name, type,
+                                export->data, data_size, export->user_data);
+                if (FAILED(hr))
+                        export->hr = hr;
+                break;
+
+        case IRAPI_REG_ENUM_KEY:
+                irapi_reg_export_report(export, index);
+
+                result = _EndCeRegEnumKeyEx2(context, export->name, &name_size, NULL, NULL);
+                if (ERROR_NO_MORE_ITEMS == result)
+                        break;
+
+                if (ERROR_SUCCESS != result) {
+                        irapi_reg_export_skip(export, key, "list a subkey of", result);
+                        break;
+                }
+
+                if (key->subkeys_found < key->subkey_count &&
+                    (key->subkeys[key->subkeys_found] = irapi_reg_join(key->path, export->name)) != NULL)
+                        key->subkeys_found++;
+                break;
+
+        case IRAPI_REG_CLOSE_KEY:
+                _EndCeRegCloseKey2(context);
+                key->handle = 0;
+                break;
+
+        default:
+                break;
+        }
+}
+
+/*
+ * Give up on the group after hr: collect what is outstanding without
+ * reporting it, and close the keys that are still open
+ */
+static void
+irapi_reg_export_abort(IRAPIRegExport *export, ULONG count, HRESULT hr)
+{
+        ULONG i;
+
+        if (SUCCEEDED(export->hr))
+                export->hr = hr;
+
+        if (!irapi_reg_pipe_abort(&export->pipe))
+                return;
+
+        for (i = 0; i < count; i++) {
+                HKEY handle = export->group[i].handle;
+
+                if (handle && handle != export->root)
+                        _CeRegCloseKey2(export->pipe.context, handle);
+        }
+}
+
+/*
+ * Make the enumeration buffers big enough for every key of the group
+ */
+static HRESULT
+irapi_reg_export_grow(IRAPIRegExport *export, ULONG count)
+{
+        DWORD name_size = 0;
+        DWORD data_size = 0;
+        ULONG i;
+
+        for (i = 0; i < count; i++) {
+                IRAPIRegExportKey *key = &export->group[i];
+
+                if (ERROR_SUCCESS != key->result)
+                        continue;
+
+                /* the lengths do not include the terminator */
+                if (key->max_value_name + 1 > name_size)
+                        name_size = key->max_value_name + 1;
+                if (key->max_subkey + 1 > name_size)
+                        name_size = key->max_subkey + 1;
+                if (key->max_value > data_size)
+                        data_size = key->max_value;
+        }
+
+        if (name_size > export->name_size) {
+                LPWSTR name = realloc(export->name, name_size * sizeof(WCHAR));
+                if (!name)
+                        return E_OUTOFMEMORY;
+                export->name = name;
+                export->name_size = name_size;
+        }
+
+        if (data_size > export->data_size) {
+                LPBYTE data = realloc(export->data, data_size);
+                if (!data)
+                        return E_OUTOFMEMORY;
+                export->data = data;
+                export->data_size = data_size;
+        }
+
+        return S_OK;
+}
+
+/*
+ * Export the keys at paths and everything below them, taking
+ * ownership of the paths
+ */
+static HRESULT
+irapi_reg_export_keys(IRAPIRegExport *export, LPWSTR *paths, ULONG count)
+{
+        RapiContext *context = export->pipe.context;
+        IRAPIRegExportKey *group = NULL;
+        HRESULT hr = S_OK;
+        ULONG done = 0;
+        ULONG n = 0;
+        ULONG i, j;
+
+        group = calloc(IRAPI_REG_GROUP, sizeof(IRAPIRegExportKey));
+        if (!group)
+                hr = E_OUTOFMEMORY;
+
+        for (; done < count && SUCCEEDED(hr) && SUCCEEDED(export->hr); done += n)
+        {
+                n = count - done < IRAPI_REG_GROUP ? count - done : IRAPI_REG_GROUP;
+
+                memset(group, 0, n * sizeof(IRAPIRegExportKey));
+                for (i = 0; i < n; i++) {
+                        group[i].path = paths[done + i];
+                        paths[done + i] = NULL;
+                }
+                export->group = group;
+                export->reported = 0;
+
+                /* open */
+                for (i = 0; i < n && SUCCEEDED(hr); i++) {
+                        if (*group[i].path)
+                                hr = irapi_reg_pipe_queue(&export->pipe,
+                                                _BeginCeRegOpenKeyEx2(context, export->root, group[i].path),
+                                                IRAPI_REG_OPEN_KEY, i);
+                        else
+                                group[i].handle = export->root;
+                }
+                if (SUCCEEDED(hr))
+                        hr = irapi_reg_pipe_drain(&export->pipe);
+
+                /* query */
+                for (i = 0; i < n && SUCCEEDED(hr); i++) {
+                        if (ERROR_SUCCESS == group[i].result)
+                                hr = irapi_reg_pipe_queue(&export->pipe,
+                                                _BeginCeRegQueryInfoKey2(context, group[i].handle, 0),
+                                                IRAPI_REG_QUERY_INFO_KEY, i);
+                }
+                if (SUCCEEDED(hr))
+                        hr = irapi_reg_pipe_drain(&export->pipe);
+                if (SUCCEEDED(hr))
+                        hr = irapi_reg_export_grow(export, n);
+
+                /* enumerate and close */
+                for (i = 0; i < n && SUCCEEDED(hr); i++) {
+                        IRAPIRegExportKey *key = &group[i];
+
+                        if (ERROR_SUCCESS == key->result && SUCCEEDED(export->hr)) {
+                                if (key->subkey_count &&
+                                    (key->subkeys = calloc(key->subkey_count, sizeof(LPWSTR))) == NULL)
+                                        hr = E_OUTOFMEMORY;
+
+                                for (j = 0; j < key->value_count && SUCCEEDED(hr); j++)
+                                        hr = irapi_reg_pipe_queue(&export->pipe,
+                                                        _BeginCeRegEnumValue2(context, key->handle, j,
+                                                                export->name_size, export->data_size),
+                                                        IRAPI_REG_ENUM_VALUE, i);
+
+                                for (j = 0; j < key->subkey_count && SUCCEEDED(hr); j++)
+                                        hr = irapi_reg_pipe_queue(&export->pipe,
+                                                        _BeginCeRegEnumKeyEx2(context, key->handle, j,
+                                                                export->name_size, 0),
+                                                        IRAPI_REG_ENUM_KEY, i);
+                        }
+
+                        if (key->handle && key->handle != export->root && SUCCEEDED(hr))
+                                hr = irapi_reg_pipe_queue(&export->pipe,
+                                                _BeginCeRegCloseKey2(context, key->handle),
+                                                IRAPI_REG_CLOSE_KEY, i);
+                }
+                if (SUCCEEDED(hr))
+                        hr = irapi_reg_pipe_drain(&export->pipe);
+                if (SUCCEEDED(hr))
+                        irapi_reg_export_report(export, n - 1);
+                else
+                        irapi_reg_export_abort(export, n, hr);
+
+                /* then what is below, key by key */
+                for (i = 0; i < n; i++) {
+                        if (SUCCEEDED(hr) && SUCCEEDED(export->hr) && group[i].subkeys_found)
+                                hr = irapi_reg_export_keys(export, group[i].subkeys, group[i].subkeys_found);
+
+                        for (j = 0; j < group[i].subkeys_found; j++)
+                                free(group[i].subkeys[j]);
+                        free(group[i].subkeys);
+                        free(group[i].path);
+                }
+        }
+
+        for (i = done; i < count; i++)
+                free(paths[i]);
+        free(group);
+
+        return hr;
+}
+
+/** @brief Export a registry key and all its subkeys
+ *
+ * Walk the tree below hKey\\lpszSubKey with pipelined calls, passing
+ * every key and value found to pfnCallback. A key is reported with
+ * a NULL value name after its parent and right before its values.
+ * Key paths are relative to the exported key, which is reported
+ * with an empty path.
+ *
+ * Keys and values that cannot be read are skipped with a warning.
+ * A callback that returns a failure stops the export, which then
+ * returns that failure. The callback must not make calls on session,
+ * since replies of the export are still outstanding while it runs.
+ *
+ * @param[in] session address of the session object
+ * @param[in] hKey open key or predefined root key
+ * @param[in] lpszSubKey subkey of hKey to export, or NULL for hKey
+ * @param[in] pfnCallback function receiving keys and values
+ * @param[in] pUserData passed on to pfnCallback
+ * @return S_OK, S_FALSE if something was skipped, or an error
+ */
+HRESULT
+IRAPISession_RegExport(IRAPISession *session,
+                       HKEY hKey,
+                       LPCWSTR lpszSubKey,
+                       RAPI_REGEXPORT_CALLBACK pfnCallback,
+                       LPVOID pUserData)
+{
+        IRAPIRegExport export;
+        LPWSTR path = NULL;
+        LONG result;
+        HRESULT hr;
+
+        if (!pfnCallback)
+                return E_INVALIDARG;
+
+        if (FAILED(hr = irapi_reg_check(session)))
+                return hr;
+
+        memset(&export, 0, sizeof(export));
+        export.pipe.context = session->context;
+        export.pipe.finish = irapi_reg_export_finish;
+        export.pipe.owner = &export;
+        export.root = hKey;
+        export.callback = pfnCallback;
+        export.user_data = pUserData;
+
+        if (lpszSubKey && *lpszSubKey) {
+                result = _CeRegOpenKeyEx2(session->context, hKey, lpszSubKey, 0, 0, &export.root);
+                if (ERROR_SUCCESS != result)
+                        return HRESULT_FROM_WIN32(result);
+        }
+
+        if ((path = wstrdup(irapi_reg_empty)) == NULL)
+                hr = E_OUTOFMEMORY;
+        else
+                hr = irapi_reg_export_keys(&export, &path, 1);
+
+        if (export.root != hKey)
+                _CeRegCloseKey2(session->context, export.root);
+
+        free(export.name);
+        free(export.data);
+
+        return FAILED(hr) ? hr : export.hr;
+}
+
+
+typedef struct _IRAPIRegImportKey
+{
+        LPWSTR path;
+        HKEY handle;
+        LONG result;
+        ULONG first_value;
+        ULONG value_count;
+} IRAPIRegImportKey;
+
+typedef struct _IRAPIRegImportValue
+{
+        LPWSTR name;
+        DWORD type;
+        LPBYTE data;
+        DWORD size;
+} IRAPIRegImportValue;
+
+/** @typedef struct _IRAPIRegImport IRAPIRegImport
+ * @brief Keys and values on their way to the device registry
+ *
+ * This is an opaque structure, created with IRAPISession_CreateRegImport().
+ * It's contents should be accessed via the IRAPIRegImport_*
+ * series of functions.
+ */
+struct _IRAPIRegImport {
+        IRAPISession *session;
+        IRAPIRegPipe pipe;
+        HKEY root;
+        HKEY parent;
+        HRESULT hr;
+
+        IRAPIRegImportKey *keys;
+        ULONG key_count;
+        IRAPIRegImportValue *values;
+        ULONG value_count;
+        ULONG value_capacity;
+        size_t buffered;
+};
+
+static void
+irapi_reg_import_fail(IRAPIRegImport *import, LPCWSTR path, LPCWSTR name, LONG result)
+{
+        char *path_utf8 = wstr_to_utf8(path);
+        char *name_utf8 = name ? wstr_to_utf8(name) : NULL;
+
+        if (name)
+                synce_warning("failed to set registry value '%s' of '%s': %s",
+                              name_utf8 ? name_utf8 : "", path_utf8 ? path_utf8 : "",
+                              synce_strerror(result));
+        else
+                synce_warning("failed to create registry key '%s': %s",
+                              path_utf8 ? path_utf8 : "", synce_strerror(result));
+
+        wstr_free_string(path_utf8);
+        wstr_free_string(name_utf8);
+
+        if (SUCCEEDED(import->hr))
+                import->hr = HRESULT_FROM_WIN32(result);
+}
+
+static void
+irapi_reg_import_finish(void *owner, IRAPIRegCommand command, ULONG index)
+{
+        IRAPIRegImport *import = owner;
+        RapiContext *context = import->pipe.context;
+        IRAPIRegImportKey *key;
+        LONG result;
+
+        switch (command)
+        {
+        case IRAPI_REG_CREATE_KEY:
+                key = &import->keys[index];
+                key->result = _EndCeRegCreateKeyEx2(context, &key->handle, NULL);
+                if (ERROR_SUCCESS != key->result)
+                        irapi_reg_import_fail(import, key->path, NULL, key->result);
+                break;
+
+        case IRAPI_REG_SET_VALUE:
+                result = _EndCeRegSetValueEx2(context);
+                if (ERROR_SUCCESS != result) {
+                        for (key = import->keys; index >= key->first_value + key->value_count; key++)
+                                ;
+                        irapi_reg_import_fail(import, key->path, import->values[index].name, result);
+                }
+                break;
+
+        case IRAPI_REG_CLOSE_KEY:
+                _EndCeRegCloseKey2(context);
+                import->keys[index].handle = 0;
+                break;
+
+        default:
+                break;
+        }
+}
+
+static void
+irapi_reg_import_clear(IRAPIRegImport *import)
+{
+        ULONG i;
+
+        for (i = 0; i < import->key_count; i++)
+                free(import->keys[i].path);
+        for (i = 0; i < import->value_count; i++) {
+                free(import->values[i].name);
+                free(import->values[i].data);
+        }
+
+        import->key_count = 0;
+        import->value_count = 0;
+        import->buffered = 0;
+}
+
+/*
+ * Write what is held to the device: create the keys, then set their
+ * values and close them
+ */
+static HRESULT
+irapi_reg_import_write(IRAPIRegImport *import)
+{
+        RapiContext *context = import->pipe.context;
+        HRESULT hr = S_OK;
+        ULONG i, j;
+
+        for (i = 0; i < import->key_count && SUCCEEDED(hr); i++) {
+                IRAPIRegImportKey *key = &import->keys[i];
+
+                if (*key->path)
+                        hr = irapi_reg_pipe_queue(&import->pipe,
+                                        _BeginCeRegCreateKeyEx2(context, import->root, key->path, NULL),
+                                        IRAPI_REG_CREATE_KEY, i);
+                else
+                        key->handle = import->root;
+        }
+        if (SUCCEEDED(hr))
+                hr = irapi_reg_pipe_drain(&import->pipe);
+
+        for (i = 0; i < import->key_count && SUCCEEDED(hr); i++) {
+                IRAPIRegImportKey *key = &import->keys[i];
+
+                if (ERROR_SUCCESS != key->result)
+                        continue;
+
+                for (j = key->first_value; j < key->first_value + key->value_count && SUCCEEDED(hr); j++) {
+                        IRAPIRegImportValue *value = &import->values[j];
+
+                        hr = irapi_reg_pipe_queue(&import->pipe,
+                                        _BeginCeRegSetValueEx2(context, key->handle, value->name,
+                                                value->type, value->data, value->size),
+                                        IRAPI_REG_SET_VALUE, j);
+                }
+
+                if (key->handle != import->root && SUCCEEDED(hr))
+                        hr = irapi_reg_pipe_queue(&import->pipe,
+                                        _BeginCeRegCloseKey2(context, key->handle),
+                                        IRAPI_REG_CLOSE_KEY, i);
+        }
+        if (SUCCEEDED(hr))
+                hr = irapi_reg_pipe_drain(&import->pipe);
+
+        /* as after a failed export, leave nothing queued or open */
+        if (FAILED(hr) && irapi_reg_pipe_abort(&import->pipe)) {
+                for (i = 0; i < import->key_count; i++) {
+                        HKEY handle = import->keys[i].handle;
+
+                        if (handle && handle != import->root)
+                                _CeRegCloseKey2(context, handle);
+                }
+        }
+
+        irapi_reg_import_clear(import);
+
+        if (FAILED(hr) && SUCCEEDED(import->hr))
+                import->hr = hr;
+
+        return hr;
+}
+
+/*
+ * The key values for path are added to, writing what is held first
+ * when the group is full
+ */
+static IRAPIRegImportKey *
+irapi_reg_import_key(IRAPIRegImport *import, LPCWSTR path)
+{
+        IRAPIRegImportKey *key;
+
+        if (!path)
+                path = irapi_reg_empty;
+
+        if (import->key_count) {
+                key = &import->keys[import->key_count - 1];
+                if (wstr_equal(key->path, (LPWSTR)path))
+                        return key;
+        }
+
+        if (import->key_count == IRAPI_REG_GROUP && FAILED(irapi_reg_import_write(import)))
+                return NULL;
+
+        key = &import->keys[import->key_count];
+        memset(key, 0, sizeof(IRAPIRegImportKey));
+        if ((key->path = wstrdup(path)) == NULL)
+                return NULL;
+        key->first_value = import->value_count;
+
+        import->key_count++;
+        return key;
+}
+
+/** @brief Start importing into the device registry
+ *
+ * This function creates an IRAPIRegImport object that writes keys
+ * and values below hKey\\lpszSubKey, creating that key if needed.
+ * The import holds a reference to the session until it is released.
+ *
+ * @param[in] session address of the session object
+ * @param[in] hKey open key or predefined root key
+ * @param[in] lpszSubKey subkey of hKey to import into, or NULL for hKey
+ * @param[out] ppImport address of the pointer to receive the import
+ * @return an HRESULT indicating success or an error
+ */
+HRESULT
+IRAPISession_CreateRegImport(IRAPISession *session,
+                             HKEY hKey,
+                             LPCWSTR lpszSubKey,
+                             IRAPIRegImport **ppImport)
+{
+        IRAPIRegImport *import = NULL;
+        LONG result;
+        HRESULT hr;
+
+        if (!ppImport)
+                return E_INVALIDARG;
+
+        if (FAILED(hr = irapi_reg_check(session)))
+                return hr;
+
+        import = calloc(1, sizeof(IRAPIRegImport));
+        if (!import)
+                return E_OUTOFMEMORY;
+
+        import->keys = calloc(IRAPI_REG_GROUP, sizeof(IRAPIRegImportKey));
+        if (!import->keys) {
+                free(import);
+                return E_OUTOFMEMORY;
+        }
+
+        import->root = import->parent = hKey;
+        if (lpszSubKey && *lpszSubKey) {
+                result = _CeRegCreateKeyEx2(session->context, hKey, lpszSubKey,
+                                0, NULL, 0, 0, NULL, &import->root, NULL);
+                if (ERROR_SUCCESS != result) {
+                        free(import->keys);
+                        free(import);
+                        return HRESULT_FROM_WIN32(result);
+                }
+        }
+
+        IRAPISession_AddRef(session);
+        import->session = session;
+        import->pipe.context = session->context;
+        import->pipe.finish = irapi_reg_import_finish;
+        import->pipe.owner = import;
+
+        *ppImport = import;
+        return S_OK;
+}
+
+/** @brief Create a key
+ *
+ * Queue the creation of a key, in case it has no values.
+ *
+ * @param[in] import address of the import object
+ * @param[in] pszKey path of the key below the import's key
+ * @return an HRESULT indicating success or an error
+ */
+HRESULT
+IRAPIRegImport_CreateKey(IRAPIRegImport *import,
+                         LPCWSTR pszKey)
+{
+        if (!import)
+                return E_INVALIDARG;
+
+        if (!irapi_reg_import_key(import, pszKey))
+                return FAILED(import->hr) ? import->hr : E_OUTOFMEMORY;
+
+        return S_OK;
+}
+
+/** @brief Set a value
+ *
+ * Queue setting a value, creating its key if needed. The data is
+ * copied. Values are written when enough are held, when the import
+ * is flushed and when it is released.
+ *
+ * @param[in] import address of the import object
+ * @param[in] pszKey path of the key below the import's key
+ * @param[in] pszValueName name of the value, NULL or empty for the default value
+ * @param[in] dwType type of the value
+ * @param[in] pData data of the value
+ * @param[in] cbData size of the data
+ * @return an HRESULT indicating success or an error
+ */
+HRESULT
+IRAPIRegImport_SetValue(IRAPIRegImport *import,
+                        LPCWSTR pszKey,
+                        LPCWSTR pszValueName,
+                        DWORD dwType,
+                        const BYTE *pData,
+                        DWORD cbData)
+{
+        IRAPIRegImportKey *key = NULL;
+        IRAPIRegImportValue *value = NULL;
+
+        if (!import || (cbData && !pData))
+                return E_INVALIDARG;
+
+        if (import->buffered + cbData > IRAPI_REG_IMPORT_BUFFER && import->value_count &&
+            FAILED(irapi_reg_import_write(import)))
+                return import->hr;
+
+        if ((key = irapi_reg_import_key(import, pszKey)) == NULL)
+                return FAILED(import->hr) ? import->hr : E_OUTOFMEMORY;
+
+        if (import->value_count == import->value_capacity) {
+                ULONG new_capacity = import->value_capacity ? import->value_capacity * 2 : IRAPI_BATCH_WINDOW;
+                IRAPIRegImportValue *new_values = realloc(import->values, new_capacity * sizeof(IRAPIRegImportValue));
+                if (!new_values)
+                        return E_OUTOFMEMORY;
+
+                import->values = new_values;
+                import->value_capacity = new_capacity;
+        }
+
+        value = &import->values[import->value_count];
+        value->name = wstrdup(pszValueName ? pszValueName : irapi_reg_empty);
+        value->type = dwType;
+        value->size = cbData;
+        value->data = cbData ? malloc(cbData) : NULL;
+
+        if (!value->name || (cbData && !value->data)) {
+                free(value->name);
+                free(value->data);
+                return E_OUTOFMEMORY;
+        }
+        if (cbData)
+                memcpy(value->data, pData, cbData);
+
+        import->value_count++;
+        import->buffered += cbData;
+        key->value_count++;
+
+        return S_OK;
+}
+
+/** @brief Write everything queued to the device
+ *
+ * Keys or values that could not be written are logged as warnings.
+ *
+ * @param[in] import address of the import object
+ * @return S_OK, or the error of the first key or value since the
+ * import was created that could not be written
+ */
+HRESULT
+IRAPIRegImport_Flush(IRAPIRegImport *import)
+{
+        if (!import)
+                return E_INVALIDARG;
+
+        if (import->key_count)
+                irapi_reg_import_write(import);
+
+        return import->hr;
+}
+
+/** @brief Release the import
+ *
+ * Anything still queued is written first.
+ *
+ * @param[in] import address of the import object
+ */
+void
+IRAPIRegImport_Release(IRAPIRegImport *import)
+{
+        if (!import)
+                return;
+
+        if (import->session->context->is_initialized) {
+                IRAPIRegImport_Flush(import);
+                if (import->root != import->parent)
+                        _CeRegCloseKey2(import->session->context, import->root);
+        }
+
+        irapi_reg_import_clear(import);
+        IRAPISession_Release(import->session);
+        free(import->keys);
+        free(import->values);
+        free(import);
+}
+
+/** @} */
+
+
+/*
+ * Database cursor
+ */
+
+/**
+ * @defgroup IRAPIDatabaseCursor Database cursor
+ * @ingroup RAPI2
+ *
+ * Reading a CEDB database with IRAPISession_CeReadRecordProps() costs
+ * a link round trip and two allocations for every record. A cursor
+ * pipelines the reads instead, a batch of records takes one round
+ * trip, and decodes the records of a batch into one buffer the caller
+ * keeps and passes again for the next batch, so a database is read
+ * with a handful of allocations.
+ *
+ * Only devices using the RAPI1 protocol (before WM5) have the
+ * database calls.
+ *
+ *@{
+ */
+
+extern struct rapi_ops_s rapi_ops;
+
+/** Records read together when the caller does not say */
+#define IRAPI_DB_BATCH IRAPI_BATCH_WINDOW
+
+/* records in the buffer start at multiples of this */
+#define IRAPI_DB_ALIGN 8
+#define IRAPI_DB_ALIGNED(size) (((size) + IRAPI_DB_ALIGN - 1) & ~(DWORD)(IRAPI_DB_ALIGN - 1))
+
+struct _IRAPIDatabaseCursor
+{
+        IRAPISession *session;
+        HANDLE handle;
+        CEOID oid;
+        WORD batch;
+        /* no more records to read */
+        bool done;
+        /* why the reading stopped early */
+        HRESULT hr;
+};
+
+/*
+ * Point the records decoded so far into the buffer at its new place
+ */
+static void
+irapi_db_relocate(LPBYTE old_buffer, LPBYTE new_buffer, RAPI_DBRECORD *records, DWORD count)
+{
+        DWORD i;
+        WORD j;
+
+#define IRAPI_DB_MOVE(type, p) ((type)((uintptr_t)(p) - (uintptr_t)old_buffer + (uintptr_t)new_buffer))
+
+        for (i = 0; i < count; i++) {
+                CEPROPVAL *propval = IRAPI_DB_MOVE(CEPROPVAL *, records[i].rgPropVal);
+
+                records[i].rgPropVal = propval;
+                for (j = 0; j < records[i].cPropID; j++) {
+                        switch (propval[j].propid & 0xffff) {
+                        case CEVT_LPWSTR:
+                                propval[j].val.lpwstr = IRAPI_DB_MOVE(LPWSTR, propval[j].val.lpwstr);
+                                break;
+                        case CEVT_BLOB:
+                                propval[j].val.blob.lpb = IRAPI_DB_MOVE(LPBYTE, propval[j].val.blob.lpb);
+                                break;
+                        }
+                }
+        }
+
+#undef IRAPI_DB_MOVE
+}
+
+/*
+ * Make the buffer hold at least size bytes, keeping the records
+ * decoded so far valid
+ */
+static bool
+irapi_db_grow(LPBYTE *lplpBuffer, LPDWORD lpcbBuffer, DWORD size, DWORD count)
+{
+        LPBYTE buffer;
+        DWORD new_size;
+
+        if (*lplpBuffer && *lpcbBuffer >= size)
+                return true;
+
+        new_size = *lpcbBuffer > size / 2 ? *lpcbBuffer * 2 : size;
+        buffer = realloc(*lplpBuffer, new_size);
+        if (!buffer)
+                return false;
+
+        if (*lplpBuffer && buffer != *lplpBuffer)
+                irapi_db_relocate(*lplpBuffer, buffer, (RAPI_DBRECORD *)buffer, count);
+
+        *lplpBuffer = buffer;
+        *lpcbBuffer = new_size;
+        return true;
+}
+
+/** @brief Open a database for reading its records in batches
+ *
+ * This function opens a database by object identifier, or by name if
+ * oidDbase is 0, and creates an IRAPIDatabaseCursor positioned on its
+ * first record. The cursor holds a reference to the session until it
+ * is released, and no other calls may be made on the session while
+ * IRAPIDatabaseCursor_Next() runs.
+ *
+ * @param[in] session address of the session object
+ * @param[in] oidDbase object identifier of the database, or 0
+ * @param[in] lpszName name of the database if oidDbase is 0
+ * @param[in] propid property of the sort order to read in, or 0
+ * @param[in] cRecordsPerBatch records read per round trip, or 0 for the default
+ * @param[out] ppCursor address of the pointer to receive the cursor
+ * @return an HRESULT indicating success or an error
+ */
+HRESULT
+IRAPISession_CreateDatabaseCursor(IRAPISession *session,
+                                  CEOID oidDbase,
+                                  LPCWSTR lpszName,
+                                  CEPROPID propid,
+                                  WORD cRecordsPerBatch,
+                                  IRAPIDatabaseCursor **ppCursor)
+{
+        RapiContext *context = session->context;
+        IRAPIDatabaseCursor *cursor = NULL;
+        HANDLE handle;
+
+        if (!ppCursor || (!oidDbase && !lpszName))
+                return E_INVALIDARG;
+
+        if (!context->is_initialized)
+                return E_UNEXPECTED;
+
+        if (context->rapi_ops != &rapi_ops)
+                return E_NOTIMPL;
+
+        /* asynchronous calls or a batch are outstanding */
+        if (rapi_context_get_pending(context))
+                return E_PENDING;
+
+        cursor = calloc(1, sizeof(IRAPIDatabaseCursor));
+        if (!cursor)
+                return E_OUTOFMEMORY;
+
+        handle = ( *context->rapi_ops->CeOpenDatabase ) (context, &oidDbase,
+                                                         (LPWSTR)lpszName, propid,
+                                                         CEDB_AUTOINCREMENT, 0);
+        if (INVALID_HANDLE_VALUE == handle) {
+                free(cursor);
+                if (FAILED(context->rapi_error))
+                        return context->rapi_error;
+                return HRESULT_FROM_WIN32(context->last_error);
+        }
+
+        IRAPISession_AddRef(session);
+        cursor->session = session;
+        cursor->handle = handle;
+        cursor->oid = oidDbase;
+        cursor->batch = cRecordsPerBatch ? cRecordsPerBatch : IRAPI_DB_BATCH;
+        cursor->hr = S_OK;
+
+        *ppCursor = cursor;
+        return S_OK;
+}
+
+/** @brief Close the database of a cursor and free the cursor
+ *
+ * @param[in] cursor address of the cursor object
+ */
+void
+IRAPIDatabaseCursor_Release(IRAPIDatabaseCursor *cursor)
+{
+        RapiContext *context;
+
+        if (!cursor)
+                return;
+
+        context = cursor->session->context;
+        if (context->is_initialized)
+                ( *context->rapi_ops->CeCloseHandle ) (context, cursor->handle);
+
+        IRAPISession_Release(cursor->session);
+        free(cursor);
+}
+
+/** @brief Read the next batch of records
+ *
+ * This function reads up to the cursor's batch size of records with
+ * pipelined calls, at most IRAPI_BATCH_WINDOW at a time, and decodes
+ * them into *lplpBuffer, which starts with an array of *lpcRecords
+ * RAPI_DBRECORD, each pointing to the properties of one record further
+ * on in the buffer.
+ *
+ * The buffer belongs to the caller, who passes it again for the next
+ * batch so that it is reused; it is reallocated as needed, so it must
+ * come from malloc() or be NULL with *lpcbBuffer 0. Free it with
+ * IRAPISession_CeRapiFreeBuffer() or free(). The records of a batch
+ * are valid until the buffer is passed again.
+ *
+ * @param[in] cursor address of the cursor object
+ * @param[in,out] lplpBuffer address of the buffer, reallocated as needed
+ * @param[in,out] lpcbBuffer address of the size of the buffer
+ * @param[out] lpcRecords address of the number of records read
+ * @return S_OK if records were read, S_FALSE at the end of the
+ * database, or an error
+ */
+HRESULT
+IRAPIDatabaseCursor_Next(IRAPIDatabaseCursor *cursor,
+                         LPBYTE *lplpBuffer,
+                         LPDWORD lpcbBuffer,
+                         LPDWORD lpcRecords)
+{
+        RapiContext *context;
+        RAPI_DBRECORD *records;
+        DWORD count = 0;
+        DWORD used;
+        DWORD offset;
+        DWORD size;
+        WORD cPropID;
+        CEOID oid;
+        WORD queued = 0;
+
+        if (!cursor || !lplpBuffer || !lpcbBuffer || !lpcRecords)
+                return E_INVALIDARG;
+
+        *lpcRecords = 0;
+        context = cursor->session->context;
+
+        if (cursor->done)
+                return FAILED(cursor->hr) ? cursor->hr : S_FALSE;
+
+        if (!context->is_initialized)
+                return E_UNEXPECTED;
+
+        if (rapi_context_get_pending(context))
+                return E_PENDING;
+
+        used = IRAPI_DB_ALIGNED(cursor->batch * sizeof(RAPI_DBRECORD));
+        if (!irapi_db_grow(lplpBuffer, lpcbBuffer, used, 0))
+                return E_OUTOFMEMORY;
+
+        for (;;) {
+                /* keep a window of reads outstanding, replies would
+                   otherwise pile up on both ends of the link */
+                while (!cursor->done && queued < cursor->batch &&
+                       rapi_context_get_pending(context) < IRAPI_BATCH_WINDOW) {
+                        if (!_BeginCeReadRecordProps(context, cursor->handle, 0) ||
+                            !rapi_context_queue_command(context)) {
+                                cursor->hr = E_OUTOFMEMORY;
+                                cursor->done = true;
+                                break;
+                        }
+                        queued++;
+                }
+
+                if (!rapi_context_get_pending(context))
+                        break;
+
+                if (!rapi_context_recv_reply(context)) {
+                        /* all replies are lost if the connection is gone */
+                        if (SUCCEEDED(cursor->hr))
+                                cursor->hr = context->rapi_error;
+                        cursor->done = true;
+                        continue;
+                }
+
+                /* replies to reads past the end */
+                if (cursor->done)
+                        continue;
+
+                if ((oid = _EndCeReadRecordProps(context, &cPropID, &size)) == 0) {
+                        if (ERROR_NO_MORE_ITEMS != context->last_error && SUCCEEDED(cursor->hr))
+                                cursor->hr = HRESULT_FROM_WIN32(context->last_error);
+                        cursor->done = true;
+                        continue;
+                }
+
+                offset = IRAPI_DB_ALIGNED(used);
+                if (!irapi_db_grow(lplpBuffer, lpcbBuffer, offset + size, count)) {
+                        cursor->hr = E_OUTOFMEMORY;
+                        cursor->done = true;
+                        continue;
+                }
+
+                if (!_EndCeReadRecordPropsData(context, cPropID, *lplpBuffer + offset, size)) {
+                        cursor->hr = E_FAIL;
+                        cursor->done = true;
+                        continue;
+                }
+
+                records = (RAPI_DBRECORD *)*lplpBuffer;
+                records[count].oid = oid;
+                records[count].cPropID = cPropID;
+                records[count].rgPropVal = (CEPROPVAL *)(*lplpBuffer + offset);
+                count++;
+                used = offset + size;
+        }
+
+        *lpcRecords = count;
+
+        if (count)
+                return S_OK;
+
+        return FAILED(cursor->hr) ? cursor->hr : S_FALSE;
+}
+
+/** @brief Get the object identifier of the cursor's database
+ *
+ * @param[in] cursor address of the cursor object
+ * @param[out] poidDbase address receiving the identifier
+ * @return an HRESULT indicating success or an error
+ */
+HRESULT
+IRAPIDatabaseCursor_GetOid(IRAPIDatabaseCursor *cursor,
+                           PCEOID poidDbase)
+{
+        if (!cursor || !poidDbase)
+                return E_INVALIDARG;
+
+        *poidDbase = cursor->oid;
+        return S_OK;
+}
+
+/** @} */
+
+
+/*
+ * Asynchronous calls
+ */
+
+/**
+ * @defgroup IRAPIAsync Asynchronous IRAPISession calls
+ * @ingroup RAPI2
+ *
+ * Calls completed from the GLib main loop, declared in rapi2_async.h.
+ *
+ * Each IRAPISession_*_async() call is encoded and queued on the session,
+ * and sent as soon as the socket takes it. A GSource watching the
+ * session's socket in the thread-default main context of the first
+ * call sends what is left of the queue and parses the replies as they
+ * arrive, completing the calls in the order they were made. Any number
+ * of calls can be outstanding, so a caller never waits on the link
+ * round trip.
+ *
+ * Only devices using the RAPI2 protocol (WM5 and later) support
+ * asynchronous calls. While calls are outstanding the normal
+ * IRAPISession_* calls and batches on the same session fail.
+ *
+ * Cancelling a call only affects how it is reported; the request has
+ * usually reached the device already and its reply is still consumed.
+ * Buffers passed to a read stay in use until the call completes, all
+ * other arguments are copied before the _async function returns.
+ *
+ *@{
+ */
+
+typedef enum _IRAPIAsyncCommand
+{
+        IRAPI_ASYNC_CE_CREATE_FILE,
+        IRAPI_ASYNC_CE_READ_FILE,
+        IRAPI_ASYNC_CE_WRITE_FILE,
+        IRAPI_ASYNC_CE_CLOSE_HANDLE,
+        IRAPI_ASYNC_CE_SET_FILE_TIME,
+        IRAPI_ASYNC_CE_GET_FILE_ATTRIBUTES,
+        IRAPI_ASYNC_CE_DELETE_FILE,
+        IRAPI_ASYNC_CE_CREATE_DIRECTORY,
+        IRAPI_ASYNC_CE_REMOVE_DIRECTORY,
+        IRAPI_ASYNC_CE_REG_OPEN_KEY_EX,
+        IRAPI_ASYNC_CE_REG_CLOSE_KEY,
+        IRAPI_ASYNC_CE_REG_QUERY_VALUE_EX,
+        IRAPI_ASYNC_CE_REG_SET_VALUE_EX,
+        IRAPI_ASYNC_CE_REG_DELETE_VALUE
+} IRAPIAsyncCommand;
+
+/* task data of every asynchronous call */
+typedef struct _IRAPIAsyncCall
+{
+        IRAPIAsyncCommand command;
+        IRAPISession *session;
+        LPVOID buffer;          /* reads only */
+        DWORD size;
+        DWORD type;             /* CeRegQueryValueEx only */
+} IRAPIAsyncCall;
+
+typedef struct _IRAPIAsync
+{
+        GSource source;
+        IRAPISession *session;
+        gpointer fd_tag;
+        GQueue calls;           /* GTask, oldest first */
+} IRAPIAsync;
+
+
+GQuark
+synce_rapi_error_quark(void)
+{
+        return g_quark_from_static_string("synce-rapi-error-quark");
+}
+
+static void
+irapi_async_call_free(gpointer data)
+{
+        IRAPIAsyncCall *call = data;
+
+        IRAPISession_Release(call->session);
+        g_free(call);
+}
+
+static void
+irapi_async_return_device_error(GTask *task, DWORD code)
+{
+        g_task_return_new_error(task, SYNCE_RAPI_ERROR, code,
+                                "Device call failed with error %u", code);
+}
+
+/*
+ * Parse the reply now in recv_buffer and complete the oldest call
+ */
+static void
+irapi_async_complete(RapiContext *context, GTask *task)
+{
+        IRAPIAsyncCall *call = g_task_get_task_data(task);
+        BOOL bool_result = FALSE;
+        LONG reg_result = ERROR_SUCCESS;
+        DWORD dword_result = 0;
+        HKEY key = 0;
+
+        switch (call->command)
+        {
+        case IRAPI_ASYNC_CE_CREATE_FILE:
+                dword_result = _EndCeCreateFile2(context);
+                if (dword_result == INVALID_HANDLE_VALUE)
+                        irapi_async_return_device_error(task, context->last_error);
+                else
+                        g_task_return_int(task, dword_result);
+                return;
+
+        case IRAPI_ASYNC_CE_READ_FILE:
+                bool_result = _EndCeReadFile2(context, call->buffer, call->size, &dword_result);
+                break;
+        case IRAPI_ASYNC_CE_WRITE_FILE:
+                bool_result = _EndCeWriteFile2(context, &dword_result);
+                break;
+        case IRAPI_ASYNC_CE_CLOSE_HANDLE:
+                bool_result = _EndCeCloseHandle2(context);
+                break;
+        case IRAPI_ASYNC_CE_SET_FILE_TIME:
+                bool_result = _EndCeSetFileTime2(context);
+                break;
+        case IRAPI_ASYNC_CE_DELETE_FILE:
+                bool_result = _EndCeDeleteFile2(context);
+                break;
+        case IRAPI_ASYNC_CE_CREATE_DIRECTORY:
+                bool_result = _EndCeCreateDirectory2(context);
+                break;
+        case IRAPI_ASYNC_CE_REMOVE_DIRECTORY:
+                bool_result = _EndCeRemoveDirectory2(context);
+                break;
+
+        case IRAPI_ASYNC_CE_GET_FILE_ATTRIBUTES:
+                dword_result = _EndCeGetFileAttributes2(context);
+                if (dword_result == 0xFFFFFFFF)
+                        irapi_async_return_device_error(task, context->last_error);
+                else
+                        g_task_return_int(task, dword_result);
+                return;
+
+        case IRAPI_ASYNC_CE_REG_OPEN_KEY_EX:
+                reg_result = _EndCeRegOpenKeyEx2(context, &key);
+                dword_result = key;
+                goto reg_done;
+        case IRAPI_ASYNC_CE_REG_CLOSE_KEY:
+                reg_result = _EndCeRegCloseKey2(context);
+                goto reg_done;
+        case IRAPI_ASYNC_CE_REG_QUERY_VALUE_EX:
+                dword_result = call->size;
+                reg_result = _EndCeRegQueryValueEx2(context, &call->type, call->buffer, &dword_result);
+                goto reg_done;
+        case IRAPI_ASYNC_CE_REG_SET_VALUE_EX:
+                reg_result = _EndCeRegSetValueEx2(context);
+                goto reg_done;
+        case IRAPI_ASYNC_CE_REG_DELETE_VALUE:
+                reg_result = _EndCeRegDeleteValue2(context);
+                goto reg_done;
+        }
+
+        if (bool_result)
+                g_task_return_int(task, dword_result);
+        else
+                irapi_async_return_device_error(task, context->last_error);
+        return;
+
+reg_done:
+        if (reg_result == ERROR_SUCCESS)
+                g_task_return_int(task, dword_result);
+        else
+                irapi_async_return_device_error(task, reg_result);
+}
+
+/*
+ * Take the calls and the source away from the session, disconnecting
+ * it if asked, then fail the calls. The session may be used from the
+ * callbacks, so it must be consistent before any of them run.
+ */
+static HRESULT
+irapi_async_close(IRAPISession *session, bool disconnect)
+{
+        IRAPIAsync *async = session->async;
+        GQueue calls = G_QUEUE_INIT;
+        HRESULT hr = S_OK;
+        GTask *task = NULL;
+
+        if (async) {
+                calls = async->calls;
+                g_queue_init(&async->calls);
+                session->async = NULL;
+                g_source_destroy(&async->source);
+                g_source_unref(&async->source);
+        }
+
+        if (disconnect)
+                hr = rapi_context_disconnect(session->context);
+
+        while ((task = g_queue_pop_head(&calls))) {
+                g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_CLOSED,
+                                        "Connection to device closed");
+                g_object_unref(task);
+        }
+
+        return hr;
+}
+
+static gboolean
+irapi_async_dispatch(GSource *source,
+                     GSourceFunc callback G_GNUC_UNUSED,
+                     gpointer user_data G_GNUC_UNUSED)
+{
+        IRAPIAsync *async = (IRAPIAsync *)source;
+        IRAPISession *session = async->session;
+        RapiContext *context = session->context;
+        GIOCondition revents = g_source_query_unix_fd(source, async->fd_tag);
+        bool flushed = true;
+        bool complete = false;
+        bool failed = false;
+        GTask *task = NULL;
+
+        if (revents & G_IO_OUT) {
+                if (!rapi_context_flush_some(context, &flushed)) {
+                        synce_warning("lost connection to device, failing outstanding calls");
+                        irapi_async_close(session, true);
+                        return G_SOURCE_REMOVE;
+                }
+                if (flushed)
+                        g_source_modify_unix_fd(source, async->fd_tag, G_IO_IN);
+        }
+
+        if (!(revents & (G_IO_IN | G_IO_ERR | G_IO_HUP)))
+                return G_SOURCE_CONTINUE;
+
+        /*
+         * The device never speaks unasked, so an idle session waking up
+         * has been hung up on (or is out of step); left alone the
+         * condition would keep firing
+         */
+        if (g_queue_is_empty(&async->calls)) {
+                synce_warning("connection to device closed while idle");
+                irapi_async_close(session, true);
+                return G_SOURCE_REMOVE;
+        }
+
+        /* callbacks may queue calls, close the session or drop the last reference */
+        IRAPISession_AddRef(session);
+
+        while (session->async == async && !g_queue_is_empty(&async->calls)) {
+                if (!rapi2_context_recv_reply_some(context, &complete)) {
+                        failed = true;
+                        break;
+                }
+                if (!complete)
+                        break;
+
+                task = g_queue_pop_head(&async->calls);
+                irapi_async_complete(context, task);
+                g_object_unref(task);
+        }
+
+        if (failed) {
+                synce_warning("lost connection to device, failing outstanding calls");
+                irapi_async_close(session, true);
+        }
+
+        IRAPISession_Release(session);
+        return failed ? G_SOURCE_REMOVE : G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs irapi_async_source_funcs = {
+        NULL,
+        NULL,
+        irapi_async_dispatch,
+        NULL,
+        NULL,
+        NULL
+};
+
+static IRAPIAsync *
+irapi_async_get(IRAPISession *session)
+{
+        IRAPIAsync *async = session->async;
+
+        if (async)
+                return async;
+
+        async = (IRAPIAsync *)g_source_new(&irapi_async_source_funcs, sizeof(IRAPIAsync));
+        g_source_set_name(&async->source, "IRAPISession");
+        async->session = session;
+        g_queue_init(&async->calls);
+        async->fd_tag = g_source_add_unix_fd(&async->source,
+                                             synce_socket_get_descriptor(session->context->socket),
+                                             G_IO_IN);
+        g_source_attach(&async->source, g_main_context_get_thread_default());
+
+        session->async = async;
+        return async;
+}
+
+/*
+ * Create the task of a call, or complete it with an error straight
+ * away if the session cannot take asynchronous calls now
+ */
+static GTask *
+irapi_async_task_new(IRAPISession *session,
+                     IRAPIAsyncCommand command,
+                     gpointer source_tag,
+                     GCancellable *cancellable,
+                     GAsyncReadyCallback callback,
+                     gpointer user_data)
+{
+        RapiContext *context = session->context;
+        GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+        IRAPIAsyncCall *call = g_new0(IRAPIAsyncCall, 1);
+        unsigned outstanding = session->async ? g_queue_get_length(&session->async->calls) : 0;
+
+        g_task_set_source_tag(task, source_tag);
+
+        IRAPISession_AddRef(session);
+        call->session = session;
+        call->command = command;
+        g_task_set_task_data(task, call, irapi_async_call_free);
+
+        if (!context->is_initialized)
+                g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED,
+                                        "Session is not initialised");
+        else if (context->rapi_ops != &rapi2_ops)
+                g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                                        "Device does not support asynchronous calls");
+        else if (rapi_context_get_pending(context) != outstanding)
+                g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_BUSY,
+                                        "Session has a batch outstanding");
+        else
+                return task;
+
+        g_object_unref(task);
+        return NULL;
+}
+
+/*
+ * Queue the command encoded in the session's send buffer and send as
+ * much of it as the socket takes
+ */
+static void
+irapi_async_queue(IRAPISession *session, GTask *task, bool encoded)
+{
+        RapiContext *context = session->context;
+        IRAPIAsync *async = NULL;
+        bool flushed = false;
+
+        if (!encoded || !rapi_context_queue_command(context)) {
+                g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                                        "Failed to queue call");
+                g_object_unref(task);
+                return;
+        }
+
+        async = irapi_async_get(session);
+        g_queue_push_tail(&async->calls, task);
+
+        if (!rapi_context_flush_some(context, &flushed)) {
+                synce_warning("lost connection to device, failing outstanding calls");
+                irapi_async_close(session, true);
+                return;
+        }
+
+        if (!flushed)
+                g_source_modify_unix_fd(&async->source, async->fd_tag, G_IO_IN | G_IO_OUT);
+}
+
+static gboolean
+irapi_async_finish(GAsyncResult *result, gpointer source_tag, gssize *value, GError **error)
+{
+        gssize result_value;
+
+        g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+        g_return_val_if_fail(g_task_get_source_tag(G_TASK(result)) == source_tag, FALSE);
+
+        result_value = g_task_propagate_int(G_TASK(result), error);
+        if (result_value == -1 && g_task_had_error(G_TASK(result)))
+                return FALSE;
+
+        if (value)
+                *value = result_value;
+        return TRUE;
+}
+
+
+/** @brief Start opening a file on device
+ *
+ * See IRAPISession_CeCreateFile(), security attributes and template
+ * files are not supported on the device.
+ *
+ * @param[in] session address of the session object
+ * @param[in] lpFileName name of the file
+ * @param[in] dwDesiredAccess access required
+ * @param[in] dwShareMode sharing mode
+ * @param[in] dwCreationDisposition action to take on existing or missing files
+ * @param[in] dwFlagsAndAttributes file attributes and flags
+ * @param[in] cancellable optional GCancellable object, NULL to ignore
+ * @param[in] callback callback to call when the call completes
+ * @param[in] user_data data to pass to the callback
+ */
+void
+IRAPISession_CeCreateFile_async(IRAPISession *session,
+                                LPCWSTR lpFileName,
+                                DWORD dwDesiredAccess,
+                                DWORD dwShareMode,
+                                DWORD dwCreationDisposition,
+                                DWORD dwFlagsAndAttributes,
+                                GCancellable *cancellable,
+                                GAsyncReadyCallback callback,
+                                gpointer user_data)
+{
+        GTask *task = irapi_async_task_new(session, IRAPI_ASYNC_CE_CREATE_FILE,
+                                           IRAPISession_CeCreateFile_async,
+                                           cancellable, callback, user_data);
+        if (!task)
+                return;
+
+        irapi_async_queue(session, task,
+                          _BeginCeCreateFile2(session->context, lpFileName,
+                                              dwDesiredAccess, dwShareMode,
+                                              dwCreationDisposition, dwFlagsAndAttributes, 0));
+}
+
+/** @brief Finish opening a file on device
+ *
+ * @param[in] session address of the session object
+ * @param[in] result the GAsyncResult passed to the callback
+ * @param[out] error location to store an error, or NULL
+ * @return the handle of the file, or INVALID_HANDLE_VALUE on failure
+ */
+HANDLE
+IRAPISession_CeCreateFile_finish(IRAPISession *session G_GNUC_UNUSED,
+                                 GAsyncResult *result,
+                                 GError **error)
+{
+        gssize value = 0;
+
+        if (!irapi_async_finish(result, IRAPISession_CeCreateFile_async, &value, error))
+                return INVALID_HANDLE_VALUE;
+        return (HANDLE)value;
+}
+
+/** @brief Start reading from a file
+ *
+ * The data is stored in lpBuffer when the reply arrives, it must
+ * stay valid until the callback has been called.
+ *
+ * @param[in] session address of the session object
+ * @param[in] hFile handle to the file
+ * @param[out] lpBuffer buffer to receive the data
+ * @param[in] nNumberOfBytesToRead maximum number of bytes to read
+ * @param[in] cancellable optional GCancellable object, NULL to ignore
+ * @param[in] callback callback to call when the call completes
+ * @param[in] user_data data to pass to the callback
+ */
+void
+IRAPISession_CeReadFile_async(IRAPISession *session,
+                              HANDLE hFile,
+                              LPVOID lpBuffer,
+                              DWORD nNumberOfBytesToRead,
+                              GCancellable *cancellable,
+                              GAsyncReadyCallback callback,
+                              gpointer user_data)
+{
+        IRAPIAsyncCall *call = NULL;
+        GTask *task = irapi_async_task_new(session, IRAPI_ASYNC_CE_READ_FILE,
+                                           IRAPISession_CeReadFile_async,
+                                           cancellable, callback, user_data);
+        if (!task)
+                return;
+
+        call = g_task_get_task_data(task);
+        call->buffer = lpBuffer;
+        call->size = nNumberOfBytesToRead;
+
+        irapi_async_queue(session, task,
+                          _BeginCeReadFile2(session->context, hFile, nNumberOfBytesToRead));
+}
+
+/** @brief Finish reading from a file
+ *
+ * @param[in] session address of the session object
+ * @param[in] result the GAsyncResult passed to the callback
+ * @param[out] lpNumberOfBytesRead location to receive the number of bytes read, or NULL
+ * @param[out] error location to store an error, or NULL
+ * @return TRUE on success
+ */
+gboolean
+IRAPISession_CeReadFile_finish(IRAPISession *session G_GNUC_UNUSED,
+                               GAsyncResult *result,
+                               LPDWORD lpNumberOfBytesRead,
+                               GError **error)
+{
+        gssize value = 0;
+
+        if (!irapi_async_finish(result, IRAPISession_CeReadFile_async, &value, error))
+                return FALSE;
+        if (lpNumberOfBytesRead)
+                *lpNumberOfBytesRead = value;
+        return TRUE;
+}
+
+/** @brief Start writing to a file
+ *
+ * The data is copied before this function returns.
+ *
+ * @param[in] session address of the session object
+ * @param[in] hFile handle to the file
+ * @param[in] lpBuffer data to write
+ * @param[in] nNumberOfBytesToWrite number of bytes to write
+ * @param[in] cancellable optional GCancellable object, NULL to ignore
+ * @param[in] callback callback to call when the call completes
+ * @param[in] user_data data to pass to the callback
+ */
+void
+IRAPISession_CeWriteFile_async(IRAPISession *session,
+                               HANDLE hFile,
+                               LPCVOID lpBuffer,
+                               DWORD nNumberOfBytesToWrite,
+                               GCancellable *cancellable,
+                               GAsyncReadyCallback callback,
+                               gpointer user_data)
+{
+        GTask *task = irapi_async_task_new(session, IRAPI_ASYNC_CE_WRITE_FILE,
+                                           IRAPISession_CeWriteFile_async,
+                                           cancellable, callback, user_data);
+        if (!task)
+                return;
+
+        irapi_async_queue(session, task,
+                          _BeginCeWriteFile2(session->context, hFile, lpBuffer, nNumberOfBytesToWrite));
+}
+
+/** @brief Finish writing to a file
+ *
+ * @param[in] session address of the session object
+ * @param[in] result the GAsyncResult passed to the callback
+ * @param[out] lpNumberOfBytesWritten location to receive the number of bytes written, or NULL
+ * @param[out] error location to store an error, or NULL
+ * @return TRUE on success
+ */
+gboolean
+IRAPISession_CeWriteFile_finish(IRAPISession *session G_GNUC_UNUSED,
+                                GAsyncResult *result,
+                                LPDWORD lpNumberOfBytesWritten,
+                                GError **error)
+{
+        gssize value = 0;
+
+        if (!irapi_async_finish(result, IRAPISession_CeWriteFile_async, &value, error))
+                return FALSE;
+        if (lpNumberOfBytesWritten)
+                *lpNumberOfBytesWritten = value;
+        return TRUE;
+}
+
+/** @brief Start closing a file handle on device
+ *
+ * @param[in] session address of the session object
+ * @param[in] hObject handle to close
+ * @param[in] cancellable optional GCancellable object, NULL to ignore
+ * @param[in] callback callback to call when the call completes
+ * @param[in] user_data data to pass to the callback
+ */
+void
+IRAPISession_CeCloseHandle_async(IRAPISession *session,
+                                 HANDLE hObject,
+                                 GCancellable *cancellable,
+                                 GAsyncReadyCallback callback,
+                                 gpointer user_data)
+{
+        GTask *task = irapi_async_task_new(session, IRAPI_ASYNC_CE_CLOSE_HANDLE,
+                                           IRAPISession_CeCloseHandle_async,
+                                           cancellable, callback, user_data);
+        if (!task)
+                return;
+
+        irapi_async_queue(session, task, _BeginCeCloseHandle2(session->context, hObject));
+}
+
+/** @brief Finish closing a file handle on device
+ *
+ * @param[in] session address of the session object
+ * @param[in] result the GAsyncResult passed to the callback
+ * @param[out] error location to store an error, or NULL
+ * @return TRUE on success
+ */
+gboolean
+IRAPISession_CeCloseHandle_finish(IRAPISession *session G_GNUC_UNUSED,
+                                  GAsyncResult *result,
+                                  GError **error)
+{
+        return irapi_async_finish(result, IRAPISession_CeCloseHandle_async, NULL, error);
+}
+
+/** @brief Start setting file time stamps
+ *
+ * The FILETIME values are copied before this function returns.
+ *
+ * @param[in] session address of the session object
+ * @param[in] hFile handle to the file
+ * @param[in] lpCreationTime new creation time, or NULL
+ * @param[in] lpLastAccessTime new last access time, or NULL
+ * @param[in] lpLastWriteTime new last write time, or NULL
+ * @param[in] cancellable optional GCancellable object, NULL to ignore
+ * @param[in] callback callback to call when the call completes
+ * @param[in] user_data data to pass to the callback
+ */
+void
+IRAPISession_CeSetFileTime_async(IRAPISession *session,
+                                 HANDLE hFile,
+                                 LPFILETIME lpCreationTime,
+                                 LPFILETIME lpLastAccessTime,
+                                 LPFILETIME lpLastWriteTime,
+                                 GCancellable *cancellable,
+                                 GAsyncReadyCallback callback,
+                                 gpointer user_data)
+{
+        GTask *task = irapi_async_task_new(session, IRAPI_ASYNC_CE_SET_FILE_TIME,
+                                           IRAPISession_CeSetFileTime_async,
+                                           cancellable, callback, user_data);
+        if (!task)
+                return;
+
+        irapi_async_queue(session, task,
+                          _BeginCeSetFileTime2(session->context, hFile,
+                                               lpCreationTime, lpLastAccessTime, lpLastWriteTime));
+}
+
+/** @brief Finish setting file time stamps
+ *
+ * @param[in] session address of the session object
+ * @param[in] result the GAsyncResult passed to the callback
+ * @param[out] error location to store an error, or NULL
+ * @return TRUE on success
+ */
+gboolean
+IRAPISession_CeSetFileTime_finish(IRAPISession *session G_GNUC_UNUSED,
+                                  GAsyncResult *result,
+                                  GError **error)
+{
+        return irapi_async_finish(result, IRAPISession_CeSetFileTime_async, NULL, error);
+}
+
+/** @brief Start getting the attributes of a file or directory
+ *
+ * @param[in] session address of the session object
+ * @param[in] lpFileName name of the file or directory
+ * @param[in] cancellable optional GCancellable object, NULL to ignore
+ * @param[in] callback callback to call when the call completes
+ * @param[in] user_data data to pass to the callback
+ */
+void
+IRAPISession_CeGetFileAttributes_async(IRAPISession *session,
+                                       LPCWSTR lpFileName,
+                                       GCancellable *cancellable,
+                                       GAsyncReadyCallback callback,
+                                       gpointer user_data)
+{
+        GTask *task = irapi_async_task_new(session, IRAPI_ASYNC_CE_GET_FILE_ATTRIBUTES,
+                                           IRAPISession_CeGetFileAttributes_async,
+                                           cancellable, callback, user_data);
+        if (!task)
+                return;
+
+        irapi_async_queue(session, task, _BeginCeGetFileAttributes2(session->context, lpFileName));
+}
+
+/** @brief Finish getting the attributes of a file or directory
+ *
+ * @param[in] session address of the session object
+ * @param[in] result the GAsyncResult passed to the callback
+ * @param[out] error location to store an error, or NULL
+ * @return the attributes, or 0xFFFFFFFF on failure
+ */
+DWORD
+IRAPISession_CeGetFileAttributes_finish(IRAPISession *session G_GNUC_UNUSED,
+                                        GAsyncResult *result,
+                                        GError **error)
+{
+        gssize value = 0;
+
+        if (!irapi_async_finish(result, IRAPISession_CeGetFileAttributes_async, &value, error))
+                return 0xFFFFFFFF;
+        return value;
+}
+
+/** @brief Start deleting a remote file
+ *
+ * @param[in] session address of the session object
+ * @param[in] lpFileName name of the file to delete
+ * @param[in] cancellable optional GCancellable object, NULL to ignore
+ * @param[in] callback callback to call when the call completes
+ * @param[in] user_data data to pass to the callback
+ */
+void
+IRAPISession_CeDeleteFile_async(IRAPISession *session,
+                                LPCWSTR lpFileName,
+                                GCancellable *cancellable,
+                                GAsyncReadyCallback callback,
+                                gpointer user_data)
+{
+        GTask *task = irapi_async_task_new(session, IRAPI_ASYNC_CE_DELETE_FILE,
+                                           IRAPISession_CeDeleteFile_async,
+                                           cancellable, callback, user_data);
+        if (!task)
+                return;
+
+        irapi_async_queue(session, task, _BeginCeDeleteFile2(session->context, lpFileName));
+}
+
+/** @brief Finish deleting a remote file
+ *
+ * @param[in] session address of the session object
+ * @param[in] result the GAsyncResult passed to the callback
+ * @param[out] error location to store an error, or NULL
+ * @return TRUE on success
+ */
+gboolean
+IRAPISession_CeDeleteFile_finish(IRAPISession *session G_GNUC_UNUSED,
+                                 GAsyncResult *result,
+                                 GError **error)
+{
+        return irapi_async_finish(result, IRAPISession_CeDeleteFile_async, NULL, error);
+}
+
+/** @brief Start creating a remote directory
+ *
+ * @param[in] session address of the session object
+ * @param[in] lpPathName name of the directory
+ * @param[in] cancellable optional GCancellable object, NULL to ignore
+ * @param[in] callback callback to call when the call completes
+ * @param[in] user_data data to pass to the callback
+ */
+void
+IRAPISession_CeCreateDirectory_async(IRAPISession *session,
+                                     LPCWSTR lpPathName,
+                                     GCancellable *cancellable,
+                                     GAsyncReadyCallback callback,
+                                     gpointer user_data)
+{
+        GTask *task = irapi_async_task_new(session, IRAPI_ASYNC_CE_CREATE_DIRECTORY,
+                                           IRAPISession_CeCreateDirectory_async,
+                                           cancellable, callback, user_data);
+        if (!task)
+                return;
+
+        irapi_async_queue(session, task, _BeginCeCreateDirectory2(session->context, lpPathName));
+}
+
+/** @brief Finish creating a remote directory
+ *
+ * @param[in] session address of the session object
+ * @param[in] result the GAsyncResult passed to the callback
+ * @param[out] error location to store an error, or NULL
+ * @return TRUE on success
+ */
+gboolean
+IRAPISession_CeCreateDirectory_finish(IRAPISession *session G_GNUC_UNUSED,
+                                      GAsyncResult *result,
+                                      GError **error)
+{
+        return irapi_async_finish(result, IRAPISession_CeCreateDirectory_async, NULL, error);
+}
+
+/** @brief Start removing a remote directory
+ *
+ * @param[in] session address of the session object
+ * @param[in] lpPathName name of the directory
+ * @param[in] cancellable optional GCancellable object, NULL to ignore
+ * @param[in] callback callback to call when the call completes
+ * @param[in] user_data data to pass to the callback
+ */
+void
+IRAPISession_CeRemoveDirectory_async(IRAPISession *session,
+                                     LPCWSTR lpPathName,
+                                     GCancellable *cancellable,
+                                     GAsyncReadyCallback callback,
+                                     gpointer user_data)
+{
+        GTask *task = irapi_async_task_new(session, IRAPI_ASYNC_CE_REMOVE_DIRECTORY,
+                                           IRAPISession_CeRemoveDirectory_async,
+                                           cancellable, callback, user_data);
+        if (!task)
+                return;
+
+        irapi_async_queue(session, task, _BeginCeRemoveDirectory2(session->context, lpPathName));
+}
+
+/** @brief Finish removing a remote directory
+ *
+ * @param[in] session address of the session object
+ * @param[in] result the GAsyncResult passed to the callback
+ * @param[out] error location to store an error, or NULL
+ * @return TRUE on success
+ */
+gboolean
+IRAPISession_CeRemoveDirectory_finish(IRAPISession *session G_GNUC_UNUSED,
+                                      GAsyncResult *result,
+                                      GError **error)
+{
+        return irapi_async_finish(result, IRAPISession_CeRemoveDirectory_async, NULL, error);
+}
+
+/** @brief Start opening a registry key
+ *
+ * @param[in] session address of the session object
+ * @param[in] hKey handle to an open key
+ * @param[in] lpszSubKey name of the subkey to open
+ * @param[in] cancellable optional GCancellable object, NULL to ignore
+ * @param[in] callback callback to call when the call completes
+ * @param[in] user_data data to pass to the callback
+ */
+void
+IRAPISession_CeRegOpenKeyEx_async(IRAPISession *session,
+                                  HKEY hKey,
+                                  LPCWSTR lpszSubKey,
+                                  GCancellable *cancellable,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data)
+{
+        GTask *task = irapi_async_task_new(session, IRAPI_ASYNC_CE_REG_OPEN_KEY_EX,
+                                           IRAPISession_CeRegOpenKeyEx_async,
+                                           cancellable, callback, user_data);
+        if (!task)
+                return;
+
+        irapi_async_queue(session, task, _BeginCeRegOpenKeyEx2(session->context, hKey, lpszSubKey));
+}
+
+/** @brief Finish opening a registry key
+ *
+ * @param[in] session address of the session object
+ * @param[in] result the GAsyncResult passed to the callback
+ * @param[out] phkResult location to receive the handle of the key, or NULL
+ * @param[out] error location to store an error, or NULL
+ * @return TRUE on success
+ */
+gboolean
+IRAPISession_CeRegOpenKeyEx_finish(IRAPISession *session G_GNUC_UNUSED,
+                                   GAsyncResult *result,
+                                   PHKEY phkResult,
+                                   GError **error)
+{
+        gssize value = 0;
+
+        if (!irapi_async_finish(result, IRAPISession_CeRegOpenKeyEx_async, &value, error))
+                return FALSE;
+        if (phkResult)
+                *phkResult = (HKEY)value;
+        return TRUE;
+}
+
+/** @brief Start closing a registry key
+ *
+ * @param[in] session address of the session object
+ * @param[in] hKey handle to the key
+ * @param[in] cancellable optional GCancellable object, NULL to ignore
+ * @param[in] callback callback to call when the call completes
+ * @param[in] user_data data to pass to the callback
+ */
+void
+IRAPISession_CeRegCloseKey_async(IRAPISession *session,
+                                 HKEY hKey,
+                                 GCancellable *cancellable,
+                                 GAsyncReadyCallback callback,
+                                 gpointer user_data)
+{
+        GTask *task = irapi_async_task_new(session, IRAPI_ASYNC_CE_REG_CLOSE_KEY,
+                                           IRAPISession_CeRegCloseKey_async,
+                                           cancellable, callback, user_data);
+        if (!task)
+                return;
+
+        irapi_async_queue(session, task, _BeginCeRegCloseKey2(session->context, hKey));
+}
+
+/** @brief Finish closing a registry key
+ *
+ * @param[in] session address of the session object
+ * @param[in] result the GAsyncResult passed to the callback
+ * @param[out] error location to store an error, or NULL
+ * @return TRUE on success
+ */
+gboolean
+IRAPISession_CeRegCloseKey_finish(IRAPISession *session G_GNUC_UNUSED,
+                                  GAsyncResult *result,
+                                  GError **error)
+{
+        return irapi_async_finish(result, IRAPISession_CeRegCloseKey_async, NULL, error);
+}
+
+/** @brief Start reading a registry value
+ *
+ * The data is stored in lpData when the reply arrives, it must stay
+ * valid until the callback has been called.
+ *
+ * @param[in] session address of the session object
+ * @param[in] hKey handle to an open key
+ * @param[in] lpValueName name of the value
+ * @param[out] lpData buffer to receive the data, or NULL
+ * @param[in] cbData size of lpData
+ * @param[in] cancellable optional GCancellable object, NULL to ignore
+ * @param[in] callback callback to call when the call completes
+ * @param[in] user_data data to pass to the callback
+ */
+void
+IRAPISession_CeRegQueryValueEx_async(IRAPISession *session,
+                                     HKEY hKey,
+                                     LPCWSTR lpValueName,
+                                     LPBYTE lpData,
+                                     DWORD cbData,
+                                     GCancellable *cancellable,
+                                     GAsyncReadyCallback callback,
+                                     gpointer user_data)
+{
+        IRAPIAsyncCall *call = NULL;
+        GTask *task = irapi_async_task_new(session, IRAPI_ASYNC_CE_REG_QUERY_VALUE_EX,
+                                           IRAPISession_CeRegQueryValueEx_async,
+                                           cancellable, callback, user_data);
+        if (!task)
+                return;
+
+        call = g_task_get_task_data(task);
+        call->buffer = lpData;
+        call->size = lpData ? cbData : 0;
+
+        irapi_async_queue(session, task,
+                          _BeginCeRegQueryValueEx2(session->context, hKey, lpValueName, call->size));
+}
+
+/** @brief Finish reading a registry value
+ *
+ * @param[in] session address of the session object
+ * @param[in] result the GAsyncResult passed to the callback
+ * @param[out] lpType location to receive the type of the value, or NULL
+ * @param[out] lpcbData location to receive the size of the value, or NULL
+ * @param[out] error location to store an error, or NULL
+ * @return TRUE on success
+ */
+gboolean
+IRAPISession_CeRegQueryValueEx_finish(IRAPISession *session G_GNUC_UNUSED,
+                                      GAsyncResult *result,
+                                      LPDWORD lpType,
+                                      LPDWORD lpcbData,
+                                      GError **error)
+{
+        gssize value = 0;
+        IRAPIAsyncCall *call = NULL;
+
+        if (!irapi_async_finish(result, IRAPISession_CeRegQueryValueEx_async, &value, error))
+                return FALSE;
+
+        call = g_task_get_task_data(G_TASK(result));
+        if (lpType)
+                *lpType = call->type;
+        if (lpcbData)
+                *lpcbData = value;
+        return TRUE;
+}
+
+/** @brief Start writing a registry value
+ *
+ * The data is copied before this function returns.
+ *
+ * @param[in] session address of the session object
+ * @param[in] hKey handle to an open key
+ * @param[in] lpValueName name of the value
+ * @param[in] dwType type of the value
+ * @param[in] lpData the data
+ * @param[in] cbData size of the data
+ * @param[in] cancellable optional GCancellable object, NULL to ignore
+ * @param[in] callback callback to call when the call completes
+ * @param[in] user_data data to pass to the callback
+ */
+void
+IRAPISession_CeRegSetValueEx_async(IRAPISession *session,
+                                   HKEY hKey,
+                                   LPCWSTR lpValueName,
+                                   DWORD dwType,
+                                   const BYTE *lpData,
+                                   DWORD cbData,
+                                   GCancellable *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer user_data)
+{
+        GTask *task = irapi_async_task_new(session, IRAPI_ASYNC_CE_REG_SET_VALUE_EX,
+                                           IRAPISession_CeRegSetValueEx_async,
+                                           cancellable, callback, user_data);
+        if (!task)
+                return;
+
+        irapi_async_queue(session, task,
+                          _BeginCeRegSetValueEx2(session->context, hKey, lpValueName,
+                                                 dwType, lpData, cbData));
+}
+
+/** @brief Finish writing a registry value
+ *
+ * @param[in] session address of the session object
+ * @param[in] result the GAsyncResult passed to the callback
+ * @param[out] error location to store an error, or NULL
+ * @return TRUE on success
+ */
+gboolean
+IRAPISession_CeRegSetValueEx_finish(IRAPISession *session G_GNUC_UNUSED,
+                                    GAsyncResult *result,
+                                    GError **error)
+{
+        return irapi_async_finish(result, IRAPISession_CeRegSetValueEx_async, NULL, error);
+}
+
+/** @brief Start deleting a registry value
+ *
+ * @param[in] session address of the session object
+ * @param[in] hKey handle to an open key
+ * @param[in] lpszValueName name of the value
+ * @param[in] cancellable optional GCancellable object, NULL to ignore
+ * @param[in] callback callback to call when the call completes
+ * @param[in] user_data data to pass to the callback
+ */
+void
+IRAPISession_CeRegDeleteValue_async(IRAPISession *session,
+                                    HKEY hKey,
+                                    LPCWSTR lpszValueName,
+                                    GCancellable *cancellable,
+                                    GAsyncReadyCallback callback,
+                                    gpointer user_data)
+{
+        GTask *task = irapi_async_task_new(session, IRAPI_ASYNC_CE_REG_DELETE_VALUE,
+                                           IRAPISession_CeRegDeleteValue_async,
+                                           cancellable, callback, user_data);
+        if (!task)
+                return;
+
+        irapi_async_queue(session, task, _BeginCeRegDeleteValue2(session->context, hKey, lpszValueName));
+}
+
+/** @brief Finish deleting a registry value
+ *
+ * @param[in] session address of the session object
+ * @param[in] result the GAsyncResult passed to the callback
+ * @param[out] error location to store an error, or NULL
+ * @return TRUE on success
+ */
+gboolean
+IRAPISession_CeRegDeleteValue_finish(IRAPISession *session G_GNUC_UNUSED,
+                                     GAsyncResult *result,
+                                     GError **error)
+{
+        return irapi_async_finish(result, IRAPISession_CeRegDeleteValue_async, NULL, error);
+}
+
+/** @} */
+
+
 /*
  * IRAPIDevice
  */
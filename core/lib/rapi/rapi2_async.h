@@ -0,0 +1,225 @@
+/* $Id$ */
+#ifndef __rapi2_async_h__
+#define __rapi2_async_h__
+
+/*
+ * Asynchronous versions of IRAPISession calls, completed from the
+ * GLib main loop, and main loop sources for IRAPIStream. Kept apart
+ * from rapi2.h so that users of the synchronous API do not need GLib.
+ */
+
+#include <rapi2.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/** Error domain for calls the device completed with a failure. The
+ *  error code is the Win32 error, or the LONG returned by registry
+ *  calls. Errors of the connection itself use G_IO_ERROR. */
+#define SYNCE_RAPI_ERROR synce_rapi_error_quark ()
+GQuark synce_rapi_error_quark (void);
+
+
+/*
+ * File access functions
+ */
+
+void IRAPISession_CeCreateFile_async(IRAPISession *session,
+		LPCWSTR lpFileName,
+		DWORD dwDesiredAccess,
+		DWORD dwShareMode,
+		DWORD dwCreationDisposition,
+		DWORD dwFlagsAndAttributes,
+		GCancellable *cancellable,
+		GAsyncReadyCallback callback,
+		gpointer user_data);
+
+HANDLE IRAPISession_CeCreateFile_finish(IRAPISession *session,
+		GAsyncResult *result,
+		GError **error);
+
+void IRAPISession_CeReadFile_async(IRAPISession *session,
+		HANDLE hFile,
+		LPVOID lpBuffer,
+		DWORD nNumberOfBytesToRead,
+		GCancellable *cancellable,
+		GAsyncReadyCallback callback,
+		gpointer user_data);
+
+gboolean IRAPISession_CeReadFile_finish(IRAPISession *session,
+		GAsyncResult *result,
+		LPDWORD lpNumberOfBytesRead,
+		GError **error);
+
+void IRAPISession_CeWriteFile_async(IRAPISession *session,
+		HANDLE hFile,
+		LPCVOID lpBuffer,
+		DWORD nNumberOfBytesToWrite,
+		GCancellable *cancellable,
+		GAsyncReadyCallback callback,
+		gpointer user_data);
+
+gboolean IRAPISession_CeWriteFile_finish(IRAPISession *session,
+		GAsyncResult *result,
+		LPDWORD lpNumberOfBytesWritten,
+		GError **error);
+
+void IRAPISession_CeCloseHandle_async(IRAPISession *session,
+		HANDLE hObject,
+		GCancellable *cancellable,
+		GAsyncReadyCallback callback,
+		gpointer user_data);
+
+gboolean IRAPISession_CeCloseHandle_finish(IRAPISession *session,
+		GAsyncResult *result,
+		GError **error);
+
+void IRAPISession_CeSetFileTime_async(IRAPISession *session,
+		HANDLE hFile,
+		LPFILETIME lpCreationTime,
+		LPFILETIME lpLastAccessTime,
+		LPFILETIME lpLastWriteTime,
+		GCancellable *cancellable,
+		GAsyncReadyCallback callback,
+		gpointer user_data);
+
+gboolean IRAPISession_CeSetFileTime_finish(IRAPISession *session,
+		GAsyncResult *result,
+		GError **error);
+
+
+/*
+ * File management functions
+ */
+
+void IRAPISession_CeGetFileAttributes_async(IRAPISession *session,
+		LPCWSTR lpFileName,
+		GCancellable *cancellable,
+		GAsyncReadyCallback callback,
+		gpointer user_data);
+
+DWORD IRAPISession_CeGetFileAttributes_finish(IRAPISession *session,
+		GAsyncResult *result,
+		GError **error);
+
+void IRAPISession_CeDeleteFile_async(IRAPISession *session,
+		LPCWSTR lpFileName,
+		GCancellable *cancellable,
+		GAsyncReadyCallback callback,
+		gpointer user_data);
+
+gboolean IRAPISession_CeDeleteFile_finish(IRAPISession *session,
+		GAsyncResult *result,
+		GError **error);
+
+void IRAPISession_CeCreateDirectory_async(IRAPISession *session,
+		LPCWSTR lpPathName,
+		GCancellable *cancellable,
+		GAsyncReadyCallback callback,
+		gpointer user_data);
+
+gboolean IRAPISession_CeCreateDirectory_finish(IRAPISession *session,
+		GAsyncResult *result,
+		GError **error);
+
+void IRAPISession_CeRemoveDirectory_async(IRAPISession *session,
+		LPCWSTR lpPathName,
+		GCancellable *cancellable,
+		GAsyncReadyCallback callback,
+		gpointer user_data);
+
+gboolean IRAPISession_CeRemoveDirectory_finish(IRAPISession *session,
+		GAsyncResult *result,
+		GError **error);
+
+
+/*
+ * Registry functions
+ */
+
+void IRAPISession_CeRegOpenKeyEx_async(IRAPISession *session,
+		HKEY hKey,
+		LPCWSTR lpszSubKey,
+		GCancellable *cancellable,
+		GAsyncReadyCallback callback,
+		gpointer user_data);
+
+gboolean IRAPISession_CeRegOpenKeyEx_finish(IRAPISession *session,
+		GAsyncResult *result,
+		PHKEY phkResult,
+		GError **error);
+
+void IRAPISession_CeRegCloseKey_async(IRAPISession *session,
+		HKEY hKey,
+		GCancellable *cancellable,
+		GAsyncReadyCallback callback,
+		gpointer user_data);
+
+gboolean IRAPISession_CeRegCloseKey_finish(IRAPISession *session,
+		GAsyncResult *result,
+		GError **error);
+
+void IRAPISession_CeRegQueryValueEx_async(IRAPISession *session,
+		HKEY hKey,
+		LPCWSTR lpValueName,
+		LPBYTE lpData,
+		DWORD cbData,
+		GCancellable *cancellable,
+		GAsyncReadyCallback callback,
+		gpointer user_data);
+
+gboolean IRAPISession_CeRegQueryValueEx_finish(IRAPISession *session,
+		GAsyncResult *result,
+		LPDWORD lpType,
+		LPDWORD lpcbData,
+		GError **error);
+
+void IRAPISession_CeRegSetValueEx_async(IRAPISession *session,
+		HKEY hKey,
+		LPCWSTR lpValueName,
+		DWORD dwType,
+		const BYTE *lpData,
+		DWORD cbData,
+		GCancellable *cancellable,
+		GAsyncReadyCallback callback,
+		gpointer user_data);
+
+gboolean IRAPISession_CeRegSetValueEx_finish(IRAPISession *session,
+		GAsyncResult *result,
+		GError **error);
+
+void IRAPISession_CeRegDeleteValue_async(IRAPISession *session,
+		HKEY hKey,
+		LPCWSTR lpszValueName,
+		GCancellable *cancellable,
+		GAsyncReadyCallback callback,
+		gpointer user_data);
+
+gboolean IRAPISession_CeRegDeleteValue_finish(IRAPISession *session,
+		GAsyncResult *result,
+		GError **error);
+
+
+/*
+ * Streams
+ */
+
+/** Callback of a source from IRAPIStream_CreateSource(); condition
+ *  holds the events that fired. Return G_SOURCE_REMOVE to stop
+ *  watching the stream. */
+typedef gboolean (*IRAPIStreamSourceFunc)(IRAPIStream *stream,
+		GIOCondition condition,
+		gpointer user_data);
+
+/** Create a source dispatched when stream is ready for condition
+ *  (G_IO_IN and/or G_IO_OUT), or has failed or been closed. Set its
+ *  callback, an IRAPIStreamSourceFunc, with g_source_set_callback(),
+ *  attach it, and move data with IRAPIStream_ReadSome() and
+ *  IRAPIStream_WriteSome() until they return E_PENDING. Destroy the
+ *  source before releasing the stream. */
+GSource *IRAPIStream_CreateSource(IRAPIStream *stream,
+		GIOCondition condition);
+
+G_END_DECLS
+
+#endif /* __rapi2_async_h__ */
@@ -0,0 +1,672 @@
+/* $Id$ */
+#undef __STRICT_ANSI__
+#define _GNU_SOURCE
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/**
+ * @defgroup RAPI2CopyEngine RAPI2 copy engine
+ * @ingroup RAPI2
+ * @brief Copy many files between the desktop and a device in parallel
+ *
+ * The engine opens several sessions to one device and spreads the
+ * queued files across them, one worker thread per session. Within a
+ * file the local disk I/O runs on a helper thread with two buffers, so
+ * reading the next chunk from disk overlaps sending the previous one
+ * to the device, and the other way round. Device calls go through
+ * IRAPITransfer, so each session tunes its own chunk size.
+ *
+ * @{
+ */
+
+#include "rapi2.h"
+#include <synce_log.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+/* device calls within a chunk are sized by IRAPITransfer */
+#define RAPI_COPY_CHUNK_SIZE   RAPI_TRANSFER_MAX_CHUNK
+#define RAPI_COPY_MAX_SESSIONS 16
+
+typedef struct _CopyJob CopyJob;
+typedef struct _CopyPipe CopyPipe;
+
+struct _CopyJob
+{
+  RAPI_COPYDIRECTION direction;
+  char *local_path;
+  LPWSTR remote_path;
+  CopyJob *next;
+};
+
+typedef struct _CopyWorker
+{
+  IRAPICopyEngine *engine;
+  IRAPISession *session;
+  pthread_t thread;
+  unsigned char *buffers[2];
+} CopyWorker;
+
+struct _IRAPICopyEngine
+{
+  CopyWorker workers[RAPI_COPY_MAX_SESSIONS];
+  DWORD worker_count;
+
+  pthread_mutex_t lock;
+  CopyJob *head;
+  CopyJob *tail;
+  bool running;
+
+  RAPI_COPYCALLBACK callback;
+  void *user_data;
+
+  RAPI_COPYSTATS stats;
+  uint64_t total_file_ms;
+};
+
+typedef bool (*CopyReadFunc)(CopyPipe *pipe, unsigned char *data, size_t size, size_t *got);
+typedef bool (*CopyWriteFunc)(CopyPipe *pipe, const unsigned char *data, size_t size);
+
+/*
+ * Two chunk slots handed back and forth between the producer (whoever
+ * reads the source) and the consumer (whoever writes the destination).
+ * A filled slot of size 0 marks the end of the file.
+ */
+struct _CopyPipe
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  unsigned char *data[2];
+  size_t size[2];
+  bool full[2];
+  bool failed;
+
+  CopyReadFunc read;
+  CopyWriteFunc write;
+
+  int fd;
+  IRAPISession *session;
+  HANDLE handle;
+  IRAPITransfer *transfer;
+  uint64_t bytes;
+
+  HRESULT hr;
+  int local_errno;
+};
+
+static uint64_t copy_now_ms()/*{{{*/
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}/*}}}*/
+
+static void copy_job_free(CopyJob *job)/*{{{*/
+{
+  free(job->local_path);
+  wstr_free_string(job->remote_path);
+  free(job);
+}/*}}}*/
+
+
+/*
+ * Pipe
+ */
+
+static void copy_pipe_fail(CopyPipe *pipe)/*{{{*/
+{
+  pthread_mutex_lock(&pipe->lock);
+  pipe->failed = true;
+  pthread_cond_broadcast(&pipe->cond);
+  pthread_mutex_unlock(&pipe->lock);
+}/*}}}*/
+
+/** Wait until slot index is full (or empty); false if the other side gave up */
+static bool copy_pipe_wait(CopyPipe *pipe, int index, bool full)/*{{{*/
+{
+  bool ok;
+
+  pthread_mutex_lock(&pipe->lock);
+  while (pipe->full[index] != full && !pipe->failed)
+    pthread_cond_wait(&pipe->cond, &pipe->lock);
+  ok = !pipe->failed;
+  pthread_mutex_unlock(&pipe->lock);
+
+  return ok;
+}/*}}}*/
+
+static void copy_pipe_set(CopyPipe *pipe, int index, bool full)/*{{{*/
+{
+  pthread_mutex_lock(&pipe->lock);
+  pipe->full[index] = full;
+  pthread_cond_broadcast(&pipe->cond);
+  pthread_mutex_unlock(&pipe->lock);
+}/*}}}*/
+
+static void *copy_pipe_produce(void *data)/*{{{*/
+{
+  CopyPipe *pipe = data;
+  int index = 0;
+  size_t got;
+
+  for (;;)
+  {
+    if (!copy_pipe_wait(pipe, index, false))
+      break;
+
+    if (!pipe->read(pipe, pipe->data[index], RAPI_COPY_CHUNK_SIZE, &got))
+    {
+      copy_pipe_fail(pipe);
+      break;
+    }
+
+    pipe->size[index] = got;
+    copy_pipe_set(pipe, index, true);
+
+    if (0 == got)
+      break;
+
+    index ^= 1;
+  }
+
+  return NULL;
+}/*}}}*/
+
+static void *copy_pipe_consume(void *data)/*{{{*/
+{
+  CopyPipe *pipe = data;
+  int index = 0;
+
+  for (;;)
+  {
+    if (!copy_pipe_wait(pipe, index, true))
+      break;
+
+    if (0 == pipe->size[index])
+      break;
+
+    if (!pipe->write(pipe, pipe->data[index], pipe->size[index]))
+    {
+      copy_pipe_fail(pipe);
+      break;
+    }
+
+    pipe->bytes += pipe->size[index];
+    copy_pipe_set(pipe, index, false);
+    index ^= 1;
+  }
+
+  return NULL;
+}/*}}}*/
+
+
+/*
+ * Both ends of a transfer
+ */
+
+static bool copy_local_read(CopyPipe *pipe, unsigned char *data, size_t size, size_t *got)/*{{{*/
+{
+  ssize_t result;
+
+  /* fill the chunk unless we hit the end of the file */
+  *got = 0;
+  while (*got < size)
+  {
+    result = read(pipe->fd, data + *got, size - *got);
+    if (result < 0)
+    {
+      if (EINTR == errno)
+        continue;
+      pipe->local_errno = errno;
+      return false;
+    }
+    if (0 == result)
+      break;
+    *got += result;
+  }
+
+  return true;
+}/*}}}*/
+
+static bool copy_local_write(CopyPipe *pipe, const unsigned char *data, size_t size)/*{{{*/
+{
+  ssize_t result;
+
+  while (size)
+  {
+    result = write(pipe->fd, data, size);
+    if (result < 0)
+    {
+      if (EINTR == errno)
+        continue;
+      pipe->local_errno = errno;
+      return false;
+    }
+    data += result;
+    size -= result;
+  }
+
+  return true;
+}/*}}}*/
+
+static void copy_remote_error(CopyPipe *pipe)/*{{{*/
+{
+  if (FAILED(pipe->hr = IRAPISession_CeRapiGetError(pipe->session)))
+    return;
+
+  pipe->hr = HRESULT_FROM_WIN32(IRAPISession_CeGetLastError(pipe->session));
+  if (SUCCEEDED(pipe->hr))
+    pipe->hr = E_FAIL;
+}/*}}}*/
+
+static bool copy_remote_read(CopyPipe *pipe, unsigned char *data, size_t size, size_t *got)/*{{{*/
+{
+  DWORD bytes_read = 0;
+
+  if (!IRAPITransfer_Read(pipe->transfer, data, size, &bytes_read))
+  {
+    copy_remote_error(pipe);
+    return false;
+  }
+
+  *got = bytes_read;
+  return true;
+}/*}}}*/
+
+static bool copy_remote_write(CopyPipe *pipe, const unsigned char *data, size_t size)/*{{{*/
+{
+  DWORD bytes_written = 0;
+
+  if (!IRAPITransfer_Write(pipe->transfer, data, size, &bytes_written))
+  {
+    copy_remote_error(pipe);
+    return false;
+  }
+
+  if (bytes_written != size)
+  {
+    synce_warning("Only wrote %u bytes of %zu", bytes_written, size);
+    pipe->hr = E_FAIL;
+    return false;
+  }
+
+  return true;
+}/*}}}*/
+
+
+/*
+ * Workers
+ */
+
+/** Copy one file; the device side runs on this thread, the local side on a helper */
+static void copy_worker_transfer(CopyWorker *worker, CopyJob *job, CopyPipe *pipe)/*{{{*/
+{
+  bool to_device = (RAPI_COPY_TO_DEVICE == job->direction);
+  pthread_t helper;
+
+  pipe->session = worker->session;
+  pipe->data[0] = worker->buffers[0];
+  pipe->data[1] = worker->buffers[1];
+
+  pipe->fd = -1;
+
+  /* the source is opened first, so a missing one leaves no empty destination behind */
+  if (to_device)
+  {
+    pipe->fd = open(job->local_path, O_RDONLY);
+    if (pipe->fd < 0)
+    {
+      pipe->local_errno = errno;
+      return;
+    }
+  }
+
+  pipe->handle = IRAPISession_CeCreateFile(worker->session, job->remote_path,
+      to_device ? GENERIC_WRITE : GENERIC_READ, 0, NULL,
+      to_device ? CREATE_ALWAYS : OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL, 0);
+
+  if (INVALID_HANDLE_VALUE == pipe->handle)
+  {
+    copy_remote_error(pipe);
+    goto exit;
+  }
+
+  if (!to_device)
+  {
+    pipe->fd = open(job->local_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (pipe->fd < 0)
+    {
+      pipe->local_errno = errno;
+      IRAPISession_CeCloseHandle(worker->session, pipe->handle);
+      return;
+    }
+  }
+
+  if (FAILED(pipe->hr = IRAPISession_CreateTransfer(worker->session, pipe->handle, &pipe->transfer)))
+  {
+    IRAPISession_CeCloseHandle(worker->session, pipe->handle);
+    goto exit;
+  }
+
+  pipe->read  = to_device ? copy_local_read   : copy_remote_read;
+  pipe->write = to_device ? copy_remote_write : copy_local_write;
+
+  if (0 != pthread_create(&helper, NULL,
+        to_device ? copy_pipe_produce : copy_pipe_consume, pipe))
+  {
+    synce_error("Failed to start local I/O thread");
+    pipe->hr = E_FAIL;
+    IRAPITransfer_Release(pipe->transfer);
+    IRAPISession_CeCloseHandle(worker->session, pipe->handle);
+    goto exit;
+  }
+
+  if (to_device)
+    copy_pipe_consume(pipe);
+  else
+    copy_pipe_produce(pipe);
+
+  pthread_join(helper, NULL);
+  IRAPITransfer_Release(pipe->transfer);
+
+  if (!IRAPISession_CeCloseHandle(worker->session, pipe->handle) && !pipe->failed)
+    copy_remote_error(pipe);
+
+exit:
+  if (pipe->fd >= 0 && close(pipe->fd) < 0 && !pipe->failed && SUCCEEDED(pipe->hr))
+    pipe->local_errno = errno;
+}/*}}}*/
+
+static CopyJob *copy_engine_next_job(IRAPICopyEngine *engine)/*{{{*/
+{
+  CopyJob *job;
+
+  pthread_mutex_lock(&engine->lock);
+  job = engine->head;
+  if (job)
+  {
+    engine->head = job->next;
+    if (!engine->head)
+      engine->tail = NULL;
+  }
+  pthread_mutex_unlock(&engine->lock);
+
+  return job;
+}/*}}}*/
+
+static void copy_engine_finish_job(IRAPICopyEngine *engine, CopyJob *job, CopyPipe *pipe, DWORD ms)/*{{{*/
+{
+  HRESULT hr = pipe->hr;
+
+  if (SUCCEEDED(hr) && (pipe->failed || pipe->local_errno))
+    hr = E_FAIL;
+
+  pthread_mutex_lock(&engine->lock);
+
+  if (SUCCEEDED(hr))
+  {
+    engine->stats.dwFilesCopied++;
+    engine->stats.cbCopied += pipe->bytes;
+    engine->total_file_ms += ms;
+
+    if (1 == engine->stats.dwFilesCopied || ms < engine->stats.dwMinFileMs)
+      engine->stats.dwMinFileMs = ms;
+    if (ms > engine->stats.dwMaxFileMs)
+      engine->stats.dwMaxFileMs = ms;
+  }
+  else
+  {
+    engine->stats.dwFilesFailed++;
+  }
+
+  /* serialized, so callers need no locking of their own */
+  if (engine->callback)
+    engine->callback(job->local_path, job->remote_path, job->direction,
+        hr, pipe->local_errno, engine->user_data);
+
+  pthread_mutex_unlock(&engine->lock);
+}/*}}}*/
+
+static void *copy_worker_run(void *data)/*{{{*/
+{
+  CopyWorker *worker = data;
+  IRAPICopyEngine *engine = worker->engine;
+  CopyJob *job;
+  CopyPipe pipe;
+  uint64_t start;
+
+  while ((job = copy_engine_next_job(engine)))
+  {
+    memset(&pipe, 0, sizeof(pipe));
+    pthread_mutex_init(&pipe.lock, NULL);
+    pthread_cond_init(&pipe.cond, NULL);
+    pipe.hr = S_OK;
+
+    start = copy_now_ms();
+    copy_worker_transfer(worker, job, &pipe);
+    copy_engine_finish_job(engine, job, &pipe, (DWORD)(copy_now_ms() - start));
+
+    pthread_cond_destroy(&pipe.cond);
+    pthread_mutex_destroy(&pipe.lock);
+    copy_job_free(job);
+  }
+
+  return NULL;
+}/*}}}*/
+
+
+/*
+ * Public API
+ */
+
+/**
+ * Create a copy engine with up to dwSessions sessions to the device.
+ *
+ * Each session is a separate connection requested from dccm. If the
+ * device refuses some of them the engine carries on with fewer; it
+ * only fails if not even one can be opened.
+ */
+HRESULT IRAPIDevice_CreateCopyEngine(IRAPIDevice *self,/*{{{*/
+    DWORD dwSessions,
+    IRAPICopyEngine **ppEngine)
+{
+  IRAPICopyEngine *engine;
+  IRAPISession *session;
+  HRESULT hr = E_FAIL;
+  DWORD i;
+
+  if (!self || !ppEngine)
+    return E_INVALIDARG;
+
+  if (0 == dwSessions)
+    dwSessions = 1;
+  if (dwSessions > RAPI_COPY_MAX_SESSIONS)
+    dwSessions = RAPI_COPY_MAX_SESSIONS;
+
+  if (!(engine = calloc(1, sizeof(IRAPICopyEngine))))
+    return E_OUTOFMEMORY;
+
+  pthread_mutex_init(&engine->lock, NULL);
+
+  for (i = 0; i < dwSessions; i++)
+  {
+    CopyWorker *worker = &engine->workers[engine->worker_count];
+
+    if (FAILED(hr = IRAPIDevice_CreateSession(self, &session)))
+      break;
+
+    if (FAILED(hr = IRAPISession_CeRapiInit(session)))
+    {
+      IRAPISession_Release(session);
+      break;
+    }
+
+    worker->engine = engine;
+    worker->session = session;
+    worker->buffers[0] = malloc(RAPI_COPY_CHUNK_SIZE);
+    worker->buffers[1] = malloc(RAPI_COPY_CHUNK_SIZE);
+    engine->worker_count++;
+
+    if (!worker->buffers[0] || !worker->buffers[1])
+    {
+      hr = E_OUTOFMEMORY;
+      break;
+    }
+  }
+
+  if (engine->worker_count < dwSessions)
+  {
+    synce_warning("Opened %u of %u sessions: %08x: %s", engine->worker_count,
+        dwSessions, hr, synce_strerror_from_hresult(hr));
+
+    if (E_OUTOFMEMORY == hr || 0 == engine->worker_count)
+    {
+      IRAPICopyEngine_Release(engine);
+      return hr;
+    }
+  }
+
+  *ppEngine = engine;
+  return S_OK;
+}/*}}}*/
+
+void IRAPICopyEngine_Release(IRAPICopyEngine *engine)/*{{{*/
+{
+  CopyJob *job;
+  DWORD i;
+
+  if (!engine)
+    return;
+
+  while ((job = copy_engine_next_job(engine)))
+    copy_job_free(job);
+
+  for (i = 0; i < engine->worker_count; i++)
+  {
+    IRAPISession_CeRapiUninit(engine->workers[i].session);
+    IRAPISession_Release(engine->workers[i].session);
+    free(engine->workers[i].buffers[0]);
+    free(engine->workers[i].buffers[1]);
+  }
+
+  pthread_mutex_destroy(&engine->lock);
+  free(engine);
+}/*}}}*/
+
+/**
+ * Set a function to be called as each file finishes. Calls are made
+ * from the worker threads, one at a time.
+ */
+void IRAPICopyEngine_SetCallback(IRAPICopyEngine *engine,/*{{{*/
+    RAPI_COPYCALLBACK pfnCallback,
+    void *pUserData)
+{
+  engine->callback = pfnCallback;
+  engine->user_data = pUserData;
+}/*}}}*/
+
+/**
+ * Queue a file for the next IRAPICopyEngine_Run(). The destination is
+ * created or truncated; directories must already exist.
+ */
+HRESULT IRAPICopyEngine_AddFile(IRAPICopyEngine *engine,/*{{{*/
+    RAPI_COPYDIRECTION direction,
+    const char *pszLocalPath,
+    LPCWSTR pszRemotePath)
+{
+  CopyJob *job;
+
+  if (!engine || !pszLocalPath || !pszRemotePath)
+    return E_INVALIDARG;
+
+  if (engine->running)
+    return E_UNEXPECTED;
+
+  if (!(job = calloc(1, sizeof(CopyJob))))
+    return E_OUTOFMEMORY;
+
+  job->direction = direction;
+  job->local_path = strdup(pszLocalPath);
+  job->remote_path = wstrdup(pszRemotePath);
+
+  if (!job->local_path || !job->remote_path)
+  {
+    copy_job_free(job);
+    return E_OUTOFMEMORY;
+  }
+
+  if (engine->tail)
+    engine->tail->next = job;
+  else
+    engine->head = job;
+  engine->tail = job;
+
+  return S_OK;
+}/*}}}*/
+
+/**
+ * Copy all queued files and wait for them to finish.
+ *
+ * @return S_OK if every file was copied, S_FALSE if some failed (see
+ * the callback and IRAPICopyEngine_GetStats()), or an error if the
+ * workers could not be started
+ */
+HRESULT IRAPICopyEngine_Run(IRAPICopyEngine *engine)/*{{{*/
+{
+  DWORD started = 0;
+  uint64_t start;
+  DWORD i;
+
+  if (!engine)
+    return E_INVALIDARG;
+
+  memset(&engine->stats, 0, sizeof(engine->stats));
+  engine->total_file_ms = 0;
+  engine->running = true;
+  start = copy_now_ms();
+
+  for (i = 0; i < engine->worker_count; i++)
+  {
+    if (0 != pthread_create(&engine->workers[i].thread, NULL, copy_worker_run, &engine->workers[i]))
+    {
+      synce_warning("Failed to start copy worker %u", i);
+      break;
+    }
+    started++;
+  }
+
+  /* whatever was started drains the queue, so one worker is enough */
+  for (i = 0; i < started; i++)
+    pthread_join(engine->workers[i].thread, NULL);
+
+  engine->running = false;
+  engine->stats.dwSessions = started;
+  engine->stats.dwElapsedMs = (DWORD)(copy_now_ms() - start);
+  if (engine->stats.dwFilesCopied)
+    engine->stats.dwAvgFileMs = (DWORD)(engine->total_file_ms / engine->stats.dwFilesCopied);
+
+  if (0 == started)
+    return E_FAIL;
+
+  return engine->stats.dwFilesFailed ? S_FALSE : S_OK;
+}/*}}}*/
+
+HRESULT IRAPICopyEngine_GetStats(IRAPICopyEngine *engine,/*{{{*/
+    RAPI_COPYSTATS *pStats)
+{
+  if (!engine || !pStats)
+    return E_INVALIDARG;
+
+  *pStats = engine->stats;
+  return S_OK;
+}/*}}}*/
+
+/** @} */
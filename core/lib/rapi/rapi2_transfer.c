@@ -0,0 +1,341 @@
+/* $Id$ */
+#undef __STRICT_ANSI__
+#define _GNU_SOURCE
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/**
+ * @defgroup RAPI2Transfer RAPI2 file transfer
+ * @ingroup RAPI2
+ * @brief Stream a remote file with a chunk size tuned to the link
+ *
+ * IRAPITransfer wraps an open remote file handle. Reads and writes of
+ * any size are split into CeReadFile/CeWriteFile calls of the current
+ * chunk size, and the time of each call is measured. The chunk size
+ * climbs through powers of two while throughput keeps improving, falls
+ * back when it stops, and is probed again from time to time in case
+ * the link changed. A serial link settles on small chunks, USB on
+ * large ones.
+ *
+ * @{
+ */
+
+#include "rapi2.h"
+#include <synce_log.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TRANSFER_LEVELS         7     /* 4 KiB .. 256 KiB */
+#define TRANSFER_START_LEVEL    4     /* 64 KiB, the old fixed size */
+#define TRANSFER_WINDOW         4     /* full chunk calls per measurement */
+#define TRANSFER_PROBE_INTERVAL 64    /* settled calls between probes */
+
+struct _IRAPITransfer
+{
+  IRAPISession *session;
+  HANDLE handle;
+
+  int level;
+  int max_level;
+  int prev_level;      /* level we are probing from, -1 if settled */
+  int direction;
+  unsigned samples;
+  unsigned settled_calls;
+
+  uint64_t rate[TRANSFER_LEVELS];     /* smoothed bytes/s per level */
+  uint64_t latency_us;
+
+  DWORD calls;
+  ULARGE_INTEGER transferred;
+};
+
+static uint64_t transfer_now_us()/*{{{*/
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}/*}}}*/
+
+static DWORD transfer_chunk(IRAPITransfer *transfer)/*{{{*/
+{
+  return RAPI_TRANSFER_MIN_CHUNK << transfer->level;
+}/*}}}*/
+
+static void transfer_move(IRAPITransfer *transfer, int level)/*{{{*/
+{
+  synce_trace("chunk size %u -> %u",
+      transfer_chunk(transfer), RAPI_TRANSFER_MIN_CHUNK << level);
+
+  transfer->level = level;
+  transfer->samples = 0;
+}/*}}}*/
+
+static void transfer_settle(IRAPITransfer *transfer, int level)/*{{{*/
+{
+  transfer->prev_level = -1;
+  transfer->settled_calls = 0;
+  transfer_move(transfer, level);
+}/*}}}*/
+
+/** Decide where to go once a measurement window is complete */
+static void transfer_adapt(IRAPITransfer *transfer)/*{{{*/
+{
+  int level = transfer->level;
+  int prev = transfer->prev_level;
+
+  if (prev >= 0)
+  {
+    /* keep climbing only for a clear (>5%) gain, or we flap on noise */
+    if (transfer->rate[level] > transfer->rate[prev] + transfer->rate[prev] / 20)
+    {
+      if (level + transfer->direction >= 0 &&
+          level + transfer->direction <= transfer->max_level)
+      {
+        transfer->prev_level = level;
+        transfer_move(transfer, level + transfer->direction);
+      }
+      else
+        transfer_settle(transfer, level);
+    }
+    else
+    {
+      transfer->direction = -transfer->direction;
+      transfer_settle(transfer, prev);
+    }
+    return;
+  }
+
+  if (transfer->settled_calls < TRANSFER_PROBE_INTERVAL)
+    return;
+
+  if (level + transfer->direction < 0 || level + transfer->direction > transfer->max_level)
+    transfer->direction = -transfer->direction;
+
+  if (level + transfer->direction < 0 || level + transfer->direction > transfer->max_level)
+  {
+    transfer->settled_calls = 0;
+    return;
+  }
+
+  transfer->prev_level = level;
+  transfer_move(transfer, level + transfer->direction);
+}/*}}}*/
+
+/** Account for one call of bytes that took elapsed_us */
+static void transfer_sample(IRAPITransfer *transfer, DWORD bytes, uint64_t elapsed_us)/*{{{*/
+{
+  uint64_t rate;
+  uint64_t *slot = &transfer->rate[transfer->level];
+
+  transfer->calls++;
+  transfer->transferred += bytes;
+
+  /* short calls happen at the end of a file and say little about the link */
+  if (bytes < transfer_chunk(transfer))
+    return;
+
+  if (0 == elapsed_us)
+    elapsed_us = 1;
+  rate = (uint64_t)bytes * 1000000 / elapsed_us;
+
+  /* the first sample after a move replaces the stale average */
+  if (0 == *slot || 0 == transfer->samples)
+    *slot = rate;
+  else
+    *slot = (*slot * 3 + rate) / 4;
+
+  if (0 == transfer->latency_us || 0 == transfer->samples)
+    transfer->latency_us = elapsed_us;
+  else
+    transfer->latency_us = (transfer->latency_us * 3 + elapsed_us) / 4;
+
+  transfer->settled_calls++;
+  if (++transfer->samples >= TRANSFER_WINDOW)
+  {
+    transfer->samples = TRANSFER_WINDOW;
+    transfer_adapt(transfer);
+  }
+}/*}}}*/
+
+/*
+ * The device has turned down a chunk this big; never offer it again.
+ */
+static void transfer_limit(IRAPITransfer *transfer, DWORD accepted)/*{{{*/
+{
+  int level = 0;
+
+  while (level < transfer->max_level && ((DWORD)RAPI_TRANSFER_MIN_CHUNK << (level + 1)) <= accepted)
+    level++;
+
+  if (level >= transfer->max_level)
+    return;
+
+  synce_info("device accepted %u of %u bytes, limiting chunk size to %u",
+      accepted, transfer_chunk(transfer), RAPI_TRANSFER_MIN_CHUNK << level);
+
+  transfer->max_level = level;
+  transfer_settle(transfer, level < transfer->level ? level : transfer->level);
+}/*}}}*/
+
+
+/**
+ * Wrap an open remote file for tuned reading and writing.
+ *
+ * The transfer holds a reference to the session but does not own the
+ * file handle; close it with IRAPISession_CeCloseHandle() as usual
+ * after releasing the transfer.
+ */
+HRESULT IRAPISession_CreateTransfer(IRAPISession *session,/*{{{*/
+    HANDLE hFile,
+    IRAPITransfer **ppTransfer)
+{
+  IRAPITransfer *transfer;
+
+  if (!session || !ppTransfer || INVALID_HANDLE_VALUE == hFile)
+    return E_INVALIDARG;
+
+  if (!(transfer = calloc(1, sizeof(IRAPITransfer))))
+    return E_OUTOFMEMORY;
+
+  transfer->session = session;
+  transfer->handle = hFile;
+  transfer->level = TRANSFER_START_LEVEL;
+  transfer->max_level = TRANSFER_LEVELS - 1;
+  transfer->prev_level = -1;
+  transfer->direction = 1;
+  /* first probe right after the first window */
+  transfer->settled_calls = TRANSFER_PROBE_INTERVAL;
+  IRAPISession_AddRef(session);
+
+  *ppTransfer = transfer;
+  return S_OK;
+}/*}}}*/
+
+void IRAPITransfer_Release(IRAPITransfer *transfer)/*{{{*/
+{
+  if (!transfer)
+    return;
+
+  IRAPISession_Release(transfer->session);
+  free(transfer);
+}/*}}}*/
+
+/**
+ * Read up to nNumberOfBytesToRead bytes. Fewer are only returned at the
+ * end of the file. On failure use IRAPISession_CeRapiGetError() and
+ * IRAPISession_CeGetLastError() as for CeReadFile.
+ */
+BOOL IRAPITransfer_Read(IRAPITransfer *transfer,/*{{{*/
+    LPVOID lpBuffer,
+    DWORD nNumberOfBytesToRead,
+    LPDWORD lpNumberOfBytesRead)
+{
+  unsigned char *buffer = lpBuffer;
+  DWORD total = 0;
+  DWORD wanted;
+  DWORD got;
+  uint64_t start;
+  BOOL result = true;
+
+  while (total < nNumberOfBytesToRead)
+  {
+    wanted = transfer_chunk(transfer);
+    if (wanted > nNumberOfBytesToRead - total)
+      wanted = nNumberOfBytesToRead - total;
+
+    got = 0;
+    start = transfer_now_us();
+    if (!(result = IRAPISession_CeReadFile(transfer->session, transfer->handle,
+            buffer + total, wanted, &got, NULL)))
+      break;
+
+    transfer_sample(transfer, got, transfer_now_us() - start);
+    total += got;
+
+    if (got < wanted)
+      break;
+  }
+
+  if (lpNumberOfBytesRead)
+    *lpNumberOfBytesRead = total;
+
+  return result;
+}/*}}}*/
+
+/**
+ * Write nNumberOfBytesToWrite bytes. On failure use
+ * IRAPISession_CeRapiGetError() and IRAPISession_CeGetLastError() as
+ * for CeWriteFile.
+ */
+BOOL IRAPITransfer_Write(IRAPITransfer *transfer,/*{{{*/
+    LPCVOID lpBuffer,
+    DWORD nNumberOfBytesToWrite,
+    LPDWORD lpNumberOfBytesWritten)
+{
+  const unsigned char *buffer = lpBuffer;
+  DWORD total = 0;
+  DWORD wanted;
+  DWORD written;
+  uint64_t start;
+  BOOL result = true;
+
+  while (total < nNumberOfBytesToWrite)
+  {
+    wanted = transfer_chunk(transfer);
+    if (wanted > nNumberOfBytesToWrite - total)
+      wanted = nNumberOfBytesToWrite - total;
+
+    written = 0;
+    start = transfer_now_us();
+    if (!(result = IRAPISession_CeWriteFile(transfer->session, transfer->handle,
+            buffer + total, wanted, &written, NULL)))
+      break;
+
+    transfer_sample(transfer, written, transfer_now_us() - start);
+    total += written;
+
+    if (0 == written)
+    {
+      synce_warning("device accepted no data");
+      break;
+    }
+
+    if (written < wanted)
+      transfer_limit(transfer, written);
+  }
+
+  if (lpNumberOfBytesWritten)
+    *lpNumberOfBytesWritten = total;
+
+  return result;
+}/*}}}*/
+
+/**
+ * Bytes per device call at the moment. Callers can size their buffers
+ * to a multiple of this, or simply to RAPI_TRANSFER_MAX_CHUNK.
+ */
+DWORD IRAPITransfer_GetChunkSize(IRAPITransfer *transfer)/*{{{*/
+{
+  return transfer_chunk(transfer);
+}/*}}}*/
+
+HRESULT IRAPITransfer_GetStats(IRAPITransfer *transfer,/*{{{*/
+    RAPI_TRANSFERSTATS *pStats)
+{
+  if (!transfer || !pStats)
+    return E_INVALIDARG;
+
+  pStats->cbChunk = transfer_chunk(transfer);
+  pStats->cbMaxChunk = RAPI_TRANSFER_MIN_CHUNK << transfer->max_level;
+  pStats->dwBytesPerSec = (DWORD)transfer->rate[transfer->level];
+  pStats->dwLatencyUs = (DWORD)transfer->latency_us;
+  pStats->dwCalls = transfer->calls;
+  pStats->cbTransferred = transfer->transferred;
+
+  return S_OK;
+}/*}}}*/
+
+/** @} */
@@ -67,6 +67,101 @@ typedef struct {
         RAPI_CONNECTIONTYPE connectionType;
 } RAPI_CONNECTIONINFO;
 
+/*
+ * Memory used by a session's send and receive buffers. Once a
+ * session has warmed up, allocations should stop increasing.
+ */
+typedef struct {
+        DWORD dwAllocations;  /* number of heap (re)allocations */
+        DWORD dwShrinks;      /* number of those that released memory */
+        DWORD cbCapacity;     /* bytes currently held */
+} RAPI_BUFFERSTATS;
+
+/*
+ * Calls made on a session and the time they spent on the link.
+ * Sizes include the length of each message.
+ */
+#define RAPI_CALLSTATS_COMMANDS 128
+
+typedef struct {
+        DWORD dwCalls;
+        DWORD dwErrors;         /* calls that failed sending or receiving */
+        DWORD dwDeviceErrors;   /* calls the device failed */
+        ULARGE_INTEGER cbSent;
+        ULARGE_INTEGER cbReceived;
+        ULARGE_INTEGER usSend;  /* microseconds writing commands */
+        ULARGE_INTEGER usWait;  /* waiting for replies to start */
+        ULARGE_INTEGER usReceive;
+        DWORD rgdwCommandCalls[RAPI_CALLSTATS_COMMANDS]; /* by command id */
+} RAPI_CALLSTATS;
+
+/*
+ * One call, passed to a RAPI_CALLSPAN_CALLBACK when its reply arrives
+ */
+typedef struct {
+        DWORD dwCommand;
+        HRESULT hr;             /* S_OK, or why the call failed */
+        DWORD cbSent;           /* 0 for pipelined calls */
+        DWORD cbReceived;
+        DWORD usSend;
+        DWORD usWait;
+        DWORD usReceive;
+} RAPI_CALLSPAN;
+
+typedef void (*RAPI_CALLSPAN_CALLBACK)(const RAPI_CALLSPAN *pSpan, LPVOID pUserData);
+
+/*
+ * Receives the keys and values of IRAPISession_RegExport(), a key
+ * with pszValueName NULL. A failure stops the export.
+ */
+typedef HRESULT (*RAPI_REGEXPORT_CALLBACK)(LPCWSTR pszKey, LPCWSTR pszValueName,
+                DWORD dwType, const BYTE *pData, DWORD cbData, LPVOID pUserData);
+
+/*
+ * IRAPITransfer
+ */
+#define RAPI_TRANSFER_MIN_CHUNK (4*1024)
+#define RAPI_TRANSFER_MAX_CHUNK (256*1024)
+
+typedef struct {
+        DWORD cbChunk;          /* bytes per CeReadFile/CeWriteFile call now */
+        DWORD cbMaxChunk;       /* largest chunk the device has accepted */
+        DWORD dwBytesPerSec;    /* smoothed throughput at cbChunk */
+        DWORD dwLatencyUs;      /* smoothed time of one call at cbChunk */
+        DWORD dwCalls;
+        ULARGE_INTEGER cbTransferred;
+} RAPI_TRANSFERSTATS;
+
+/*
+ * IRAPICopyEngine
+ */
+typedef enum {
+        RAPI_COPY_TO_DEVICE = 0,
+        RAPI_COPY_FROM_DEVICE = 1
+} RAPI_COPYDIRECTION;
+
+typedef struct {
+        DWORD dwSessions;       /* sessions the files were spread across */
+        DWORD dwFilesCopied;
+        DWORD dwFilesFailed;
+        ULARGE_INTEGER cbCopied;
+        DWORD dwElapsedMs;      /* wall clock time of the whole run */
+        DWORD dwMinFileMs;      /* per file latency, open to close */
+        DWORD dwMaxFileMs;
+        DWORD dwAvgFileMs;
+} RAPI_COPYSTATS;
+
+/*
+ * Called once per file as it finishes. hr is S_OK on success; a
+ * failure on the local side is reported as E_FAIL with iErrno set.
+ */
+typedef void (*RAPI_COPYCALLBACK)(const char *pszLocalPath,
+                LPCWSTR pszRemotePath,
+                RAPI_COPYDIRECTION direction,
+                HRESULT hr,
+                int iErrno,
+                void *pUserData);
+
 
 #ifdef __cplusplus
 }
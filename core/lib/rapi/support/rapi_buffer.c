@@ -2,6 +2,7 @@
 #include "rapi_internal.h"
 #include "rapi_buffer.h"
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
@@ -15,11 +16,10 @@
 
 #if RAPI_BUFFER_DEBUG
 #define rapi_buffer_trace(args...)    synce_trace(args)
-#define rapi_buffer_warning(args...)  synce_warning(args)
 #else
-#define rapi_buffer_trace(args...)    synce_trace(args)
-#define rapi_buffer_warning(args...)  synce_warning(args)
+#define rapi_buffer_trace(args...)    ((void)0)
 #endif
+#define rapi_buffer_warning(args...)  synce_warning(args)
 #define rapi_buffer_error(args...)    synce_error(args)
 
 #if HAVE_DMALLOC_H
@@ -28,46 +28,68 @@
 
 #define RAPI_BUFFER_INITIAL_SIZE 16
 
+/* Number of rapi_buffer_clear() calls between checks whether the
+ * buffer has become much larger than it needs to be */
+#define RAPI_BUFFER_SHRINK_INTERVAL 64
+
 struct _RapiBuffer
 {
 	unsigned char* data;
 	size_t max_size;
 	size_t bytes_used;
 	size_t read_index;
+	/* caller owned data sent after the contents of data */
+	const void* ref_data;
+	size_t ref_size;
+	/* capacity management */
+	size_t initial_size;
+	size_t high_water;
+	unsigned clear_count;
+	RapiBufferStats stats;
+	/* a buffer being received piecemeal by rapi_buffer_recv_some() */
+	uint32_t recv_size_le;
+	size_t recv_header_got;
+	size_t recv_size;
 };
 
 /**
- * Enlarge buffer to at least a specified size
+ * Reallocate buffer data to exactly new_size bytes
  */
-static bool rapi_buffer_enlarge(RapiBuffer* buffer, size_t bytes_needed)/*{{{*/
+static bool rapi_buffer_resize(RapiBuffer* buffer, size_t new_size)/*{{{*/
 {
-	size_t new_size = buffer->max_size;
 	unsigned char* new_data = NULL;
-	bool success = false;
-
-	if (new_size == 0)
-		new_size = RAPI_BUFFER_INITIAL_SIZE;
-
-	while (new_size < bytes_needed) {
-                rapi_buffer_trace("new_size=%d, bytes_needed=%d", new_size, bytes_needed);
-		new_size <<= 1;
-        }
 
 	rapi_buffer_trace("trying to realloc %i bytes, buffer->data=%p", new_size, buffer->data);
 
 	new_data = realloc(buffer->data, new_size);
-	if (new_data)
-	{
-		buffer->data = new_data;
-		buffer->max_size = new_size;
-		success = true;
-	}
-	else
+	if (!new_data)
 	{
 		rapi_buffer_error("realloc %i bytes failed: %s", new_size, strerror(errno));
+		return false;
 	}
 
-	return success;
+	buffer->data = new_data;
+	buffer->max_size = new_size;
+	buffer->stats.allocations++;
+	buffer->stats.capacity = new_size;
+
+	return true;
+}/*}}}*/
+
+/**
+ * Enlarge buffer to at least a specified size
+ */
+static bool rapi_buffer_enlarge(RapiBuffer* buffer, size_t bytes_needed)/*{{{*/
+{
+	size_t new_size = buffer->max_size;
+
+	if (new_size == 0)
+		new_size = buffer->initial_size;
+
+	while (new_size < bytes_needed)
+		new_size <<= 1;
+
+	return rapi_buffer_resize(buffer, new_size);
 }/*}}}*/
 
 /**
@@ -94,21 +116,105 @@ static bool rapi_buffer_assure_size(RapiBuffer* buffer, size_t extra_size)/*{{{*
 	return success;
 }/*}}}*/
 
+/**
+ * Give memory back if the buffer has stayed well below its capacity
+ * for a while, so one huge reply does not pin memory for good
+ */
+static void rapi_buffer_check_shrink(RapiBuffer* buffer)/*{{{*/
+{
+	size_t new_size;
+
+	if (buffer->bytes_used > buffer->high_water)
+		buffer->high_water = buffer->bytes_used;
+
+	if (++buffer->clear_count < RAPI_BUFFER_SHRINK_INTERVAL)
+		return;
+
+	if (buffer->max_size > buffer->initial_size &&
+	    buffer->high_water * 4 <= buffer->max_size)
+	{
+		new_size = buffer->initial_size;
+		while (new_size < buffer->high_water * 2)
+			new_size <<= 1;
+
+		if (new_size < buffer->max_size && rapi_buffer_resize(buffer, new_size))
+			buffer->stats.shrinks++;
+	}
+
+	buffer->clear_count = 0;
+	buffer->high_water = 0;
+}/*}}}*/
+
 
 RapiBuffer* rapi_buffer_new()
+{
+	return rapi_buffer_new_sized(RAPI_BUFFER_INITIAL_SIZE);
+}
+
+RapiBuffer* rapi_buffer_new_sized(size_t initial_size)
 {
 	RapiBuffer* buffer = calloc(1, sizeof(RapiBuffer));
-	memset(buffer, 0, sizeof(RapiBuffer));
+
+	if (buffer)
+	{
+		buffer->initial_size = initial_size ? initial_size : RAPI_BUFFER_INITIAL_SIZE;
+	}
 
 	return buffer;
 }
 
+void rapi_buffer_clear(RapiBuffer* buffer)
+{
+	if (buffer)
+	{
+		rapi_buffer_check_shrink(buffer);
+
+		buffer->bytes_used = 0;
+		buffer->read_index = 0;
+		buffer->ref_data   = NULL;
+		buffer->ref_size   = 0;
+	}
+}
+
+void rapi_buffer_compact(RapiBuffer* buffer)
+{
+	size_t unread;
+
+	if (!buffer || buffer->ref_data)
+		return;
+
+	unread = buffer->bytes_used - buffer->read_index;
+
+	/* moving the unread bytes is paid for by as many bytes read since */
+	if (unread > buffer->read_index)
+		return;
+
+	if (unread == 0)
+	{
+		rapi_buffer_clear(buffer);
+		return;
+	}
+
+	memmove(buffer->data, buffer->data + buffer->read_index, unread);
+	buffer->bytes_used = unread;
+	buffer->read_index = 0;
+}
+
 void rapi_buffer_free_data(RapiBuffer* buffer)
 {
-	if (buffer && buffer->data)
+	if (buffer)
 	{
 		free(buffer->data);
-		memset(buffer, 0, sizeof(RapiBuffer));
+		buffer->data        = NULL;
+		buffer->max_size    = 0;
+		buffer->bytes_used  = 0;
+		buffer->read_index  = 0;
+		buffer->ref_data    = NULL;
+		buffer->ref_size    = 0;
+		buffer->high_water  = 0;
+		buffer->clear_count = 0;
+		buffer->stats.capacity = 0;
+		buffer->recv_header_got = 0;
 	}
 }
 
@@ -121,6 +227,11 @@ void rapi_buffer_free(RapiBuffer* buffer)
 	}
 }
 
+void rapi_buffer_get_stats(RapiBuffer* buffer, RapiBufferStats* stats)
+{
+	*stats = buffer->stats;
+}
+
 bool rapi_buffer_reset(RapiBuffer* buffer, unsigned char* data, size_t size)
 {
 	rapi_buffer_trace("size=0x%08x", size);
@@ -136,17 +247,35 @@ bool rapi_buffer_reset(RapiBuffer* buffer, unsigned char* data, size_t size)
 	buffer->data = data;
 	buffer->max_size = buffer->bytes_used = size;
 	buffer->read_index = 0;
+	buffer->stats.capacity = size;
 
 	return true;
 }
 
+/**
+ * Copy referenced data into the buffer, so that data holds everything
+ */
+static bool rapi_buffer_take_ref(RapiBuffer* buffer)/*{{{*/
+{
+	const void* ref_data = buffer->ref_data;
+
+	if (!ref_data)
+		return true;
+
+	buffer->ref_data = NULL;
+	return rapi_buffer_write_data(buffer, ref_data, buffer->ref_size);
+}/*}}}*/
+
 size_t rapi_buffer_get_size(RapiBuffer* buffer)
 {
-	return buffer->bytes_used;
+	return buffer->bytes_used + (buffer->ref_data ? buffer->ref_size : 0);
 }
 
 unsigned char* rapi_buffer_get_raw(RapiBuffer* buffer)
 {
+	if (!rapi_buffer_take_ref(buffer))
+		return NULL;
+
 	return buffer->data;
 }
 
@@ -164,6 +293,9 @@ bool rapi_buffer_write_data(RapiBuffer* buffer, const void* data, size_t size)
 		return false;
 	}
 
+	if (!rapi_buffer_take_ref(buffer))
+		return false;
+
         synce_trace("need %d bytes of additional data", size);
 
 	if (!rapi_buffer_assure_size(buffer, size))
@@ -178,6 +310,30 @@ bool rapi_buffer_write_data(RapiBuffer* buffer, const void* data, size_t size)
 	return true;
 }
 
+bool rapi_buffer_write_data_ref(RapiBuffer* buffer, const void* data, size_t size)
+{
+	if (!buffer)
+	{
+		rapi_buffer_error("NULL buffer\n");
+		return false;
+	}
+
+	if (!data)
+	{
+		rapi_buffer_error("NULL data\n");
+		return false;
+	}
+
+	/* only one reference at a time, an earlier one is copied */
+	if (!rapi_buffer_take_ref(buffer))
+		return false;
+
+	buffer->ref_data = data;
+	buffer->ref_size = size;
+
+	return true;
+}
+
 bool rapi_buffer_write_uint16(RapiBuffer* buffer, uint16_t value)
 {
 	uint16_t little_endian_value = htole16(value);
@@ -537,28 +693,22 @@ bool rapi_buffer_send(RapiBuffer* buffer, SynceSocket* socket)
 {
   bool success = false;
   uint32_t size_le = htole32(rapi_buffer_get_size(buffer));
+  struct iovec iov[3];
 
-  size_t total_size = sizeof(size_le) + rapi_buffer_get_size(buffer);
+  /* length prefix, contents and referenced data in a single write */
 
-  /* send everything as a single buffer */
+  iov[0].iov_base = &size_le;
+  iov[0].iov_len  = sizeof(size_le);
+  iov[1].iov_base = buffer->data;
+  iov[1].iov_len  = buffer->bytes_used;
+  iov[2].iov_base = (void*)buffer->ref_data;
+  iov[2].iov_len  = buffer->ref_data ? buffer->ref_size : 0;
 
-  void* tmp = malloc(total_size);
-  if (!tmp)
-  {
-    rapi_buffer_error("Failed to allocate %i bytes", total_size);
-    return false;
-  }
-
-  memcpy(tmp, &size_le, sizeof(size_le));
-  memcpy(tmp + sizeof(size_le), rapi_buffer_get_raw(buffer), rapi_buffer_get_size(buffer));
-
-  success = synce_socket_write(socket, tmp, total_size);
-
-  free(tmp);
+  success = synce_socket_writev(socket, iov, 3);
 
   if (!success)
   {
-    synce_error("synce_socket_write failed");
+    synce_error("synce_socket_writev failed");
     /* XXX: is it wise to close the connection here? */
     synce_socket_close(socket);
   }
@@ -568,53 +718,61 @@ bool rapi_buffer_send(RapiBuffer* buffer, SynceSocket* socket)
 
 bool rapi_buffer_recv(RapiBuffer* buffer, SynceSocket* socket)
 {
-	uint32_t      size_le = 0;
-	size_t         size    = 0;
-	unsigned char* data    = NULL;
-  short         events = EVENT_READ;
+	size_t remaining = 0;
 
-  if (!synce_socket_wait(socket, 120, &events))
-  {
-    rapi_buffer_error("Failed to wait for event");
-    goto fail;
-  }
+	/* the whole reply, into the memory the buffer already has */
+	return rapi_buffer_recv_header(buffer, socket, (size_t)-1, &remaining);
+}
 
-  if ((events & EVENT_READ) != EVENT_READ)
-  {
-    rapi_buffer_error("Nothing to read. Events = %i", events);
-    goto fail;
-  }
+bool rapi_buffer_recv_header(RapiBuffer* buffer, SynceSocket* socket, size_t max_size, size_t* remaining)
+{
+	size_t size = 0;
+
+	return rapi_buffer_recv_size(socket, &size) &&
+		rapi_buffer_recv_data(buffer, socket, size, max_size, remaining);
+}
 
+bool rapi_buffer_recv_size(SynceSocket* socket, size_t* size)
+{
+	uint32_t size_le = 0;
+
+	/* how long to wait for the reply is up to the socket's timeout */
 	if ( !synce_socket_read(socket, &size_le, sizeof(size_le)) )
 	{
 		rapi_buffer_error("Failed to read size");
-		goto fail;
+		/* XXX: is it wise to close the connection here? */
+		synce_socket_close(socket);
+		return false;
 	}
 
-	size = letoh32(size_le);
+	*size = letoh32(size_le);
+	return true;
+}
+
+bool rapi_buffer_recv_data(RapiBuffer* buffer, SynceSocket* socket, size_t size, size_t max_size, size_t* remaining)
+{
+	size_t header = MIN(size, max_size);
 
-	rapi_buffer_trace("Size = 0x%08x", size);
+	rapi_buffer_trace("Size = 0x%08x, reading 0x%08x", size, header);
 
-	data = malloc(size);
-	if (!data)
-	{
-		rapi_buffer_error("Failed to allocate 0x%08x bytes", size);
-		goto fail;
-	}
+	/* keep the existing allocation if it is large enough */
+	rapi_buffer_clear(buffer);
 
-	if ( !synce_socket_read(socket, data, size) )
+	if ( !rapi_buffer_assure_size(buffer, header) )
 	{
-		rapi_buffer_error("Failed to read 0x%08x bytes", size);
+		rapi_buffer_error("Failed to allocate 0x%08x bytes", header);
 		goto fail;
 	}
 
-	if ( !rapi_buffer_reset(buffer, data, size) )
+	if ( !synce_socket_read(socket, buffer->data, header) )
 	{
-		rapi_buffer_error("Failed to reset buffer with 0x%08x bytes", size);
-		free(data);
+		rapi_buffer_error("Failed to read 0x%08x bytes", header);
 		goto fail;
 	}
 
+	buffer->bytes_used = header;
+	*remaining = size - header;
+
 	return true;
 
 fail:
@@ -623,8 +781,61 @@ fail:
 	return false;
 }
 
+bool rapi_buffer_recv_some(RapiBuffer* buffer, SynceSocket* socket, bool* complete)
+{
+	size_t got = 0;
+
+	*complete = false;
+
+	if (buffer->recv_header_got < sizeof(buffer->recv_size_le))
+	{
+		if ( !synce_socket_read_some(socket,
+					(unsigned char*)&buffer->recv_size_le + buffer->recv_header_got,
+					sizeof(buffer->recv_size_le) - buffer->recv_header_got, &got) )
+		{
+			rapi_buffer_error("Failed to read size");
+			goto fail;
+		}
 
+		buffer->recv_header_got += got;
+		if (buffer->recv_header_got < sizeof(buffer->recv_size_le))
+			return true;
 
+		buffer->recv_size = letoh32(buffer->recv_size_le);
+		rapi_buffer_trace("Size = 0x%08x", buffer->recv_size);
+
+		rapi_buffer_clear(buffer);
+
+		if ( !rapi_buffer_assure_size(buffer, buffer->recv_size) )
+		{
+			rapi_buffer_error("Failed to allocate 0x%08x bytes", buffer->recv_size);
+			goto fail;
+		}
+	}
+
+	if (buffer->bytes_used < buffer->recv_size)
+	{
+		if ( !synce_socket_read_some(socket, buffer->data + buffer->bytes_used,
+					buffer->recv_size - buffer->bytes_used, &got) )
+		{
+			rapi_buffer_error("Failed to read 0x%08x bytes", buffer->recv_size - buffer->bytes_used);
+			goto fail;
+		}
+
+		buffer->bytes_used += got;
+		if (buffer->bytes_used < buffer->recv_size)
+			return true;
+	}
+
+	buffer->recv_header_got = 0;
+	*complete = true;
+	return true;
+
+fail:
+	buffer->recv_header_got = 0;
+	synce_socket_close(socket);
+	return false;
+}
 
 void rapi_buffer_debug_dump_buffer_from_current_point( char* desc, RapiBuffer* buffer)
 {
@@ -699,6 +910,46 @@ void rapi_buffer_debug_dump_buffer( char* desc, RapiBuffer* buffer)
 
 
 
+/* the fixed size CE_FIND_DATA members, in the order they are sent */
+static const struct
+{
+    uint32_t flag;
+    size_t offset;
+    size_t size;
+} find_data_fields[] =
+{
+    { FAF_ATTRIBUTES,      offsetof(CE_FIND_DATA, dwFileAttributes), sizeof(DWORD) },
+    { FAF_CREATION_TIME,   offsetof(CE_FIND_DATA, ftCreationTime),   sizeof(FILETIME) },
+    { FAF_LASTACCESS_TIME, offsetof(CE_FIND_DATA, ftLastAccessTime), sizeof(FILETIME) },
+    { FAF_LASTWRITE_TIME,  offsetof(CE_FIND_DATA, ftLastWriteTime),  sizeof(FILETIME) },
+    { FAF_SIZE_HIGH,       offsetof(CE_FIND_DATA, nFileSizeHigh),    sizeof(DWORD) },
+    { FAF_SIZE_LOW,        offsetof(CE_FIND_DATA, nFileSizeLow),     sizeof(DWORD) },
+    { FAF_OID,             offsetof(CE_FIND_DATA, dwOID),            sizeof(DWORD) },
+};
+
+#define FIND_DATA_FIELD_COUNT (sizeof(find_data_fields) / sizeof(find_data_fields[0]))
+
+/* the members before cFileName are all DWORDs */
+#define FIND_DATA_FIXED_SIZE offsetof(CE_FIND_DATA, cFileName)
+
+static void find_data_from_le(LPCE_FIND_DATA find_data, size_t offset, size_t size)
+{
+    uint32_t* word = (uint32_t*)((unsigned char*)find_data + offset);
+    uint32_t* end = (uint32_t*)((unsigned char*)find_data + offset + size);
+
+    for (; word < end; word++)
+        *word = letoh32(*word);
+}
+
+static void find_data_copy_name(LPCE_FIND_DATA find_data, const unsigned char* name, size_t size)
+{
+    size_t length = MIN(size, sizeof(find_data->cFileName) - sizeof(WCHAR)) / sizeof(WCHAR);
+
+    /* names stay little endian, like every other WCHAR string */
+    memcpy(find_data->cFileName, name, length * sizeof(WCHAR));
+    find_data->cFileName[length] = 0;
+}
+
 bool rapi_buffer_read_find_data(
         RapiBuffer* buffer,
         LPCE_FIND_DATA lpFindFileData)
@@ -706,29 +957,133 @@ bool rapi_buffer_read_find_data(
     if (lpFindFileData)
     {
         uint32_t size = 0;
+        size_t copy;
+
+        if ( !rapi_buffer_read_uint32(buffer, &size) )
+            return false;
+
+        copy = MIN(size, sizeof(CE_FIND_DATA));
+
+        memset(lpFindFileData, 0, sizeof(CE_FIND_DATA));
+        if ( !rapi_buffer_read_data(buffer, lpFindFileData, copy) )
+            return false;
+
+        if (copy < size)
+        {
+            rapi_buffer_warning("ignoring %u bytes past the end of CE_FIND_DATA", size - copy);
+            if (buffer->read_index + (size - copy) > buffer->bytes_used)
+            {
+                rapi_buffer_error("CE_FIND_DATA is truncated");
+                return false;
+            }
+            buffer->read_index += size - copy;
+        }
+
+        /* a no-op the compiler drops on little endian hosts */
+        if (letoh32(1) != 1)
+            find_data_from_le(lpFindFileData, 0, FIND_DATA_FIXED_SIZE);
 
-        rapi_buffer_read_uint32(buffer, &size);
-
-        memset(&lpFindFileData->cFileName, 0, sizeof(lpFindFileData->cFileName));
-        rapi_buffer_read_data(buffer, lpFindFileData, size);
-
-        /* convert fields from little endian */
-        lpFindFileData->dwFileAttributes                = letoh32(lpFindFileData->dwFileAttributes);
-        lpFindFileData->ftCreationTime.dwLowDateTime    = letoh32(lpFindFileData->ftCreationTime.dwLowDateTime);
-        lpFindFileData->ftCreationTime.dwHighDateTime   = letoh32(lpFindFileData->ftCreationTime.dwHighDateTime);
-        lpFindFileData->ftLastAccessTime.dwLowDateTime  = letoh32(lpFindFileData->ftLastAccessTime.dwLowDateTime);
-        lpFindFileData->ftLastAccessTime.dwHighDateTime = letoh32(lpFindFileData->ftLastAccessTime.dwHighDateTime);
-        lpFindFileData->ftLastWriteTime.dwLowDateTime   = letoh32(lpFindFileData->ftLastWriteTime.dwLowDateTime);
-        lpFindFileData->ftLastWriteTime.dwHighDateTime  = letoh32(lpFindFileData->ftLastWriteTime.dwHighDateTime);
-        lpFindFileData->nFileSizeHigh                   = letoh32(lpFindFileData->nFileSizeHigh);
-        lpFindFileData->nFileSizeLow                    = letoh32(lpFindFileData->nFileSizeLow);
-        lpFindFileData->dwOID                           = letoh32(lpFindFileData->dwOID);
-
-        synce_trace("dwFileAttributes=0x%08x", lpFindFileData->dwFileAttributes);
-        synce_trace("nFileSizeLow=0x%08x",     lpFindFileData->nFileSizeLow);
-        synce_trace("dwOID=0x%08x",            lpFindFileData->dwOID);
+        synce_trace("dwFileAttributes=0x%08x nFileSizeLow=0x%08x dwOID=0x%08x",
+                lpFindFileData->dwFileAttributes, lpFindFileData->nFileSizeLow, lpFindFileData->dwOID);
     }
 
     return true;
 }
 
+bool rapi_buffer_read_find_data_array(
+        RapiBuffer* buffer,
+        uint32_t flags,
+        size_t name_unit,
+        LPCE_FIND_DATA array,
+        uint32_t count)
+{
+    struct { size_t offset; size_t size; } runs[FIND_DATA_FIELD_COUNT];
+    unsigned run_count = 0;
+    size_t header = (flags & FAF_NAME) ? sizeof(uint32_t) : 0;
+    const unsigned char* p;
+    const unsigned char* end;
+    uint32_t i;
+    unsigned j;
+
+    /* merge the selected fields that sit next to each other in
+       CE_FIND_DATA, with all of them selected this is a single copy */
+    for (j = 0; j < FIND_DATA_FIELD_COUNT; j++)
+    {
+        if ( !(flags & find_data_fields[j].flag) )
+            continue;
+
+        if (run_count && runs[run_count-1].offset + runs[run_count-1].size == find_data_fields[j].offset)
+            runs[run_count-1].size += find_data_fields[j].size;
+        else
+        {
+            runs[run_count].offset = find_data_fields[j].offset;
+            runs[run_count].size = find_data_fields[j].size;
+            run_count++;
+        }
+
+        header += find_data_fields[j].size;
+    }
+
+    p = buffer->data + buffer->read_index;
+    end = buffer->data + buffer->bytes_used;
+
+    for (i = 0; i < count; i++)
+    {
+        LPCE_FIND_DATA entry = &array[i];
+        size_t name_size = 0;
+
+        if ((size_t)(end - p) < header)
+        {
+            rapi_buffer_error("entry %u of %u is truncated", i, count);
+            return false;
+        }
+
+        if (flags & FAF_NAME)
+        {
+            uint32_t wire_size;
+
+            memcpy(&wire_size, p, sizeof(wire_size));
+            name_size = (size_t)letoh32(wire_size) * name_unit;
+            p += sizeof(wire_size);
+        }
+
+        if (run_count == 1 && runs[0].size == FIND_DATA_FIXED_SIZE)
+        {
+            /* the usual request, a constant size copy the compiler inlines */
+            memcpy(entry, p, FIND_DATA_FIXED_SIZE);
+            p += FIND_DATA_FIXED_SIZE;
+        }
+        else for (j = 0; j < run_count; j++)
+        {
+            unsigned char* field = (unsigned char*)entry + runs[j].offset;
+            size_t k;
+
+            /* fields are a few DWORDs, word copies beat calling memcpy() */
+            for (k = 0; k < runs[j].size; k += sizeof(uint32_t))
+                memcpy(field + k, p + k, sizeof(uint32_t));
+            p += runs[j].size;
+        }
+
+        if (letoh32(1) != 1)
+            for (j = 0; j < run_count; j++)
+                find_data_from_le(entry, runs[j].offset, runs[j].size);
+
+        if (flags & FAF_NAME)
+        {
+            if ((size_t)(end - p) < name_size)
+            {
+                rapi_buffer_error("name of entry %u of %u is truncated", i, count);
+                return false;
+            }
+
+            find_data_copy_name(entry, p, name_size);
+            p += name_size;
+        }
+    }
+
+    buffer->read_index = p - buffer->data;
+
+    rapi_buffer_trace("decoded %u entries", count);
+    return true;
+}
+
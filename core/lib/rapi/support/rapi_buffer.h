@@ -10,16 +10,53 @@
 struct _RapiBuffer;
 typedef struct _RapiBuffer RapiBuffer;
 
+/**
+ * Memory use of a buffer
+ */
+typedef struct _RapiBufferStats
+{
+	/** number of times memory was (re)allocated */
+	unsigned allocations;
+	/** number of those that gave memory back */
+	unsigned shrinks;
+	/** bytes currently allocated */
+	size_t capacity;
+} RapiBufferStats;
+
 /**
  * Allocate new buffer
  */
 RapiBuffer* rapi_buffer_new();
 
+/**
+ * Allocate new buffer that starts with initial_size bytes of memory
+ * when first written to
+ */
+RapiBuffer* rapi_buffer_new_sized(size_t initial_size);
+
+/**
+ * Empty the buffer but keep its memory for reuse. Memory is
+ * given back if only a small part of it has been used recently.
+ */
+void rapi_buffer_clear(RapiBuffer* buffer);
+
+/**
+ * Drop the bytes already read from a buffer that is written to and
+ * read from at the same time, once they are at least as many as the
+ * bytes still to be read
+ */
+void rapi_buffer_compact(RapiBuffer* buffer);
+
 /**
  * Free the contents of a buffer, but keep the buffer object
  */
 void rapi_buffer_free_data(RapiBuffer* buffer);
 
+/**
+ * Get memory statistics of buffer
+ */
+void rapi_buffer_get_stats(RapiBuffer* buffer, RapiBufferStats* stats);
+
 /**
  * Free an allocated buffer
  */
@@ -45,6 +82,13 @@ unsigned char* rapi_buffer_get_raw(RapiBuffer* buffer);
  */
 bool rapi_buffer_write_data(RapiBuffer* buffer, const void* data, size_t size);
 
+/**
+ * Append raw data to buffer by reference, without copying it.
+ * The data must stay valid until the buffer is sent or freed.
+ * Anything written after it causes it to be copied after all.
+ */
+bool rapi_buffer_write_data_ref(RapiBuffer* buffer, const void* data, size_t size);
+
 /**
  * Append a WORD parameter to buffer, with adjustment for endianness
  */
@@ -152,6 +196,28 @@ bool rapi_buffer_send(RapiBuffer* buffer, SynceSocket* socket);
  */
 bool rapi_buffer_recv(RapiBuffer* buffer, SynceSocket* socket);
 
+/**
+ * Receive only the first max_size bytes of a buffer on the socket,
+ * reusing the buffer's memory. The number of bytes of the buffer still
+ * to be read from the socket is stored in remaining.
+ */
+bool rapi_buffer_recv_header(RapiBuffer* buffer, SynceSocket* socket, size_t max_size, size_t* remaining);
+
+/**
+ * The two halves of rapi_buffer_recv_header(): read the size that starts
+ * a buffer, waiting for it to arrive, then the first max_size bytes of
+ * the size bytes that follow it.
+ */
+bool rapi_buffer_recv_size(SynceSocket* socket, size_t* size);
+bool rapi_buffer_recv_data(RapiBuffer* buffer, SynceSocket* socket, size_t size, size_t max_size, size_t* remaining);
+
+/**
+ * Receive whatever part of a buffer is available on the socket without
+ * waiting. complete is set once the whole buffer has arrived; until then
+ * the partial buffer is kept between calls.
+ */
+bool rapi_buffer_recv_some(RapiBuffer* buffer, SynceSocket* socket, bool* complete);
+
 /**
  * Read a CE_FIND_DATA struct
  */
@@ -159,6 +225,19 @@ bool rapi_buffer_read_find_data(
         RapiBuffer* buffer,
         LPCE_FIND_DATA lpFindFileData);
 
+/**
+ * Read count entries of a CeFindAllFiles reply into array. Only the
+ * fields selected by the FAF_* flags are sent and written. name_unit
+ * is the size of the unit file name lengths are counted in, it is
+ * sizeof(WCHAR) for RAPI and 1 for RAPI2.
+ */
+bool rapi_buffer_read_find_data_array(
+        RapiBuffer* buffer,
+        uint32_t flags,
+        size_t name_unit,
+        LPCE_FIND_DATA array,
+        uint32_t count);
+
 
 /**
  * Dump the complete buffer that is supplied as parameter
@@ -6,11 +6,13 @@
 #endif
 #include "rapi_context.h"
 #include "synce.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <signal.h>
 #include <errno.h>
+#include <time.h>
 
 #if ENABLE_UDEV_SUPPORT
 #include <glib-object.h>
@@ -27,6 +29,10 @@
 
 #define RAPI_PORT  990
 
+/* Initial buffer sizes, most commands and replies fit without growing */
+#define RAPI_CONTEXT_BUFFER_SIZE    256
+#define RAPI_CONTEXT_PIPELINE_SIZE  4096
+
 #define RAPI_CONTEXT_DEBUG 0
 
 #if ENABLE_UDEV_SUPPORT
@@ -41,11 +47,10 @@ static const char* const DCCM_DEV_IFACE    = "org.synce.dccm.Device";
 
 #if RAPI_CONTEXT_DEBUG
 #define rapi_context_trace(args...)    synce_trace(args)
-#define rapi_context_warning(args...)  synce_warning(args)
 #else
-#define rapi_context_trace(args...)    synce_trace(args)
-#define rapi_context_warning(args...)  synce_warning(args)
+#define rapi_context_trace(args...)    ((void)0)
 #endif
+#define rapi_context_warning(args...)  synce_warning(args)
 #define rapi_context_error(args...)    synce_error(args)
 
 
@@ -164,6 +169,8 @@ static void rapi_context_free(RapiContext* context)/*{{{*/
 
 	rapi_buffer_free(context->send_buffer);
 	rapi_buffer_free(context->recv_buffer);
+	rapi_buffer_free(context->pipeline_buffer);
+	rapi_buffer_free(context->pipeline_commands);
 	synce_socket_free(context->socket);
 	if (context->own_info && context->info)
 		synce_info_destroy(context->info);
@@ -178,14 +185,20 @@ RapiContext* rapi_context_new()/*{{{*/
 	if (context)
 	{
 		memset(context, 0, sizeof(RapiContext));
-		if (!((context->send_buffer  = rapi_buffer_new()) &&
-		      (context->recv_buffer = rapi_buffer_new()) &&
+		if (!((context->send_buffer  = rapi_buffer_new_sized(RAPI_CONTEXT_BUFFER_SIZE)) &&
+		      (context->recv_buffer = rapi_buffer_new_sized(RAPI_CONTEXT_BUFFER_SIZE)) &&
+		      (context->pipeline_buffer = rapi_buffer_new_sized(RAPI_CONTEXT_PIPELINE_SIZE)) &&
+		      (context->pipeline_commands = rapi_buffer_new()) &&
 		      (context->socket = synce_socket_new())
 		      ))
 		{
 			rapi_context_free(context);
 			return NULL;
 		}
+
+		/* wait for replies with poll() and a deadline, never in read() */
+		synce_socket_set_nonblocking(context->socket, true);
+		synce_socket_set_timeout(context->socket, RAPI_CONTEXT_DEFAULT_TIMEOUT);
 	}
 
 	context->info = NULL;
@@ -385,6 +398,39 @@ OUT:
 
 #endif /* ENABLE_UDEV_SUPPORT */
 
+/*
+ * The device emulator is at HOST:PORT, a Unix domain socket path, or
+ * fd:N for a descriptor that is already connected and is taken over
+ */
+static bool connect_to_emulator(RapiContext* context, const char* address)
+{
+    const char* colon;
+    char* host;
+    int fd;
+    bool success;
+
+    if (sscanf(address, "fd:%d", &fd) == 1)
+    {
+        synce_socket_take_descriptor(context->socket, fd);
+        return true;
+    }
+
+    if (address[0] == '/')
+        return synce_socket_connect_local(context->socket, address);
+
+    if (!(colon = strrchr(address, ':')))
+    {
+        synce_error("no port in emulator address %s", address);
+        return false;
+    }
+
+    host = strndup(address, colon - address);
+    success = synce_socket_connect(context->socket, host, atoi(colon + 1));
+    free(host);
+
+    return success;
+}
+
 
 HRESULT rapi_context_connect(RapiContext* context)
 {
@@ -411,7 +457,7 @@ HRESULT rapi_context_connect(RapiContext* context)
     /*
      *  original dccm or vdccm, sanity checking
      */
-    if (transport == NULL || ( strcmp(transport, "udev") != 0 ) ) {
+    if (transport == NULL || ( strcmp(transport, "udev") != 0 && strcmp(transport, "emulator") != 0 ) ) {
         pid_t dccm_pid = 0;
         if (!(dccm_pid = synce_info_get_dccm_pid(info)))
         {
@@ -477,12 +523,27 @@ HRESULT rapi_context_connect(RapiContext* context)
         context->rapi_ops = &rapi_ops;
     } else {
         /*
-         *  udev, or proxy ?
+         *  udev, emulator, or proxy ?
          */
 #if ENABLE_UDEV_SUPPORT
         if (strcmp(transport, "udev") == 0) {
 	  int fd = -1;
 	  HRESULT fd_result = get_connection_from_udev(info, &fd);
+	  if (fd_result != S_OK && fd_result != HRESULT_FROM_WIN32(ERROR_INVALID_PASSWORD) && !context->info)
+	  {
+	    /* the cached information may be out of date, look again */
+	    SynceInfo *fresh;
+
+	    synce_info_cache_invalidate();
+	    if ((fresh = synce_info_new(NULL)) != NULL)
+	    {
+	      synce_info_destroy(info);
+	      info = fresh;
+	      transport = synce_info_get_transport(info);
+	      if (transport && strcmp(transport, "udev") == 0)
+	        fd_result = get_connection_from_udev(info, &fd);
+	    }
+	  }
 	  if (fd_result != S_OK)
 	  {
 	    synce_error("failed to get context fd from udev: %08x: %s", fd_result, synce_strerror(HRESULT_CODE(fd_result)));
@@ -493,6 +554,14 @@ HRESULT rapi_context_connect(RapiContext* context)
         }
         else
 #endif
+        if (strcmp(transport, "emulator") == 0) {
+            if ( !connect_to_emulator(context, synce_info_get_device_ip(info)) )
+            {
+                synce_error("failed to connect to emulator at %s", synce_info_get_device_ip(info));
+                goto fail;
+            }
+        }
+        else
 	if ( !synce_socket_connect_proxy(context->socket, synce_info_get_device_ip(info)) )
         {
             synce_error("failed to connect to proxy for %s", synce_info_get_device_ip(info));
@@ -537,47 +606,160 @@ STDAPI rapi_context_disconnect(RapiContext* context)
     }
 
     synce_socket_close(context->socket);
+    rapi_buffer_free_data(context->pipeline_buffer);
+    rapi_buffer_free_data(context->pipeline_commands);
+    rapi_buffer_free_data(context->recv_buffer);
+    context->pipeline_pending = 0;
+    context->pipeline_receiving = false;
+    context->pipeline_sent = 0;
+    context->recv_remaining = 0;
     context->is_initialized = false;
 
     return S_OK;
 }
 
-bool rapi_context_begin_command(RapiContext* context, uint32_t command)/*{{{*/
+static uint64_t rapi_context_now_us()/*{{{*/
 {
-	rapi_context_trace("command=0x%02x", command);
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}/*}}}*/
 
-	rapi_buffer_free_data(context->send_buffer);
+static void rapi_context_begin_span(RapiContext* context, uint32_t command)/*{{{*/
+{
+	memset(&context->span, 0, sizeof(RapiContextSpan));
+	context->span.command = command;
+	context->span.result = E_UNEXPECTED;
+}/*}}}*/
 
-	if ( !rapi_buffer_write_uint32(context->send_buffer, command) )
+static void rapi_context_end_span(RapiContext* context, HRESULT result)/*{{{*/
+{
+	context->span.result = result;
+	if (context->span_hook)
+		context->span_hook(&context->span, context->span_data);
+}/*}}}*/
+
+/*
+ * Send send_buffer, counting the time and bytes
+ */
+static bool rapi_context_send(RapiContext* context)/*{{{*/
+{
+	size_t size = rapi_buffer_get_size(context->send_buffer) + sizeof(uint32_t);
+	uint64_t start = rapi_context_now_us();
+	bool success = rapi_buffer_send(context->send_buffer, context->socket);
+
+	context->span.send_us = rapi_context_now_us() - start;
+	context->stats.send_us += context->span.send_us;
+
+	if (!success)
+	{
+		rapi_context_error("rapi_buffer_send failed");
+		context->stats.errors++;
 		return false;
+	}
 
+	context->span.bytes_sent = size;
+	context->stats.bytes_sent += size;
 	return true;
 }/*}}}*/
 
-bool rapi_context_call(RapiContext* context)/*{{{*/
+/*
+ * Wait for the reply to start arriving and read the first header_size
+ * bytes of it. Waiting lasts until the reply's size has been read, so
+ * waiting and reading are counted apart without polling first.
+ */
+static bool rapi_context_recv(RapiContext* context, size_t header_size)/*{{{*/
+{
+	uint64_t start = rapi_context_now_us();
+	uint64_t arrived;
+	size_t size = 0;
+	bool success;
+
+	success = rapi_buffer_recv_size(context->socket, &size);
+
+	arrived = rapi_context_now_us();
+	context->span.wait_us = arrived - start;
+	context->stats.wait_us += context->span.wait_us;
+
+	success = success &&
+		rapi_buffer_recv_data(context->recv_buffer, context->socket, size, header_size, &context->recv_remaining);
+
+	context->span.recv_us = rapi_context_now_us() - arrived;
+	context->stats.recv_us += context->span.recv_us;
+
+	if (!success)
+	{
+		rapi_context_error("rapi_buffer_recv failed");
+		context->recv_remaining = 0;
+		context->stats.errors++;
+		return false;
+	}
+
+	context->span.bytes_received = rapi_buffer_get_size(context->recv_buffer) + sizeof(uint32_t);
+	context->stats.bytes_received += context->span.bytes_received;
+	return true;
+}/*}}}*/
+
+/*
+ * Send the command and receive its reply, or the first header_size
+ * bytes of it
+ */
+static bool rapi_context_exchange(RapiContext* context, size_t header_size)/*{{{*/
 {
 	context->rapi_error = E_UNEXPECTED;
 
-	if ( !rapi_buffer_send(context->send_buffer, context->socket) )
+	if (context->pipeline_pending)
+	{
+		rapi_context_error("%u queued commands are still waiting for a reply", context->pipeline_pending);
+		return false;
+	}
+
+	if ( !rapi_context_skip_payload(context) )
 	{
-		rapi_context_error("rapi_buffer_send failed");
 		context->rapi_error = E_FAIL;
 		return false;
 	}
 
-	if ( !rapi_buffer_recv(context->recv_buffer, context->socket) )
+	rapi_context_begin_span(context, context->command);
+
+	if ( !rapi_context_send(context) || !rapi_context_recv(context, header_size) )
 	{
-		rapi_context_error("rapi_buffer_recv failed");
 		context->rapi_error = E_FAIL;
+		rapi_context_end_span(context, E_FAIL);
 		return false;
 	}
 
+	return true;
+}/*}}}*/
+
+bool rapi_context_begin_command(RapiContext* context, uint32_t command)/*{{{*/
+{
+	rapi_context_trace("command=0x%02x", command);
+
+	context->command = command;
+	context->stats.calls++;
+	if (command < RAPI_CONTEXT_COMMAND_COUNT)
+		context->stats.command_calls[command]++;
+
+	rapi_buffer_clear(context->send_buffer);
+
+	if ( !rapi_buffer_write_uint32(context->send_buffer, command) )
+		return false;
+
+	return true;
+}/*}}}*/
+
+/*
+ * Read the result RAPI1 puts before every reply and end the span
+ */
+static bool rapi_context_read_result(RapiContext* context)/*{{{*/
+{
 	/* this is a boolean? */
 	if ( !rapi_buffer_read_uint32(context->recv_buffer, &context->result_1) )
 	{
 		rapi_context_error("reading result_1 failed");
 		context->rapi_error = E_FAIL;
-		return false;
+		goto exit;
 	}
 
 	rapi_context_trace("result 1 = 0x%08x", context->result_1);
@@ -589,39 +771,363 @@ bool rapi_context_call(RapiContext* context)/*{{{*/
 		{
 			rapi_context_error("reading result_2 failed");
 			context->rapi_error = E_FAIL;
-			return false;
+			goto exit;
 		}
 
 		rapi_context_error("result 2 = 0x%08x", context->result_2);
 
 		context->rapi_error = context->result_2;
 		if (context->result_2 != 0)
-		  return false;
+		{
+			context->stats.device_errors++;
+			goto exit;
+		}
 	}
 
 	context->rapi_error = S_OK;
-	return true;
+
+exit:
+	rapi_context_end_span(context, context->rapi_error);
+	return S_OK == context->rapi_error;
+}/*}}}*/
+
+bool rapi_context_call(RapiContext* context)/*{{{*/
+{
+	if ( !rapi_context_exchange(context, (size_t)-1) )
+		return false;
+
+	return rapi_context_read_result(context);
 }/*}}}*/
 
 bool rapi2_context_call(RapiContext* context)/*{{{*/
 {
-    context->rapi_error = E_UNEXPECTED;
+    if ( !rapi_context_exchange(context, (size_t)-1) )
+        return false;
+
+    context->rapi_error = S_OK;
+    rapi_context_end_span(context, S_OK);
+    return true;
+}/*}}}*/
+
+bool rapi2_context_call_header(RapiContext* context, size_t header_size)/*{{{*/
+{
+    if ( !rapi_context_exchange(context, header_size) )
+        return false;
 
-    if ( !rapi_buffer_send(context->send_buffer, context->socket) )
+    /* the payload is counted in the stats as it is read */
+    context->rapi_error = S_OK;
+    rapi_context_end_span(context, S_OK);
+    return true;
+}/*}}}*/
+
+bool rapi_context_recv_payload(RapiContext* context, void* data, size_t size)/*{{{*/
+{
+    uint64_t start;
+    bool success;
+
+    if (size > context->recv_remaining)
     {
-        rapi_context_error("rapi_buffer_send failed");
-        context->rapi_error = E_FAIL;
+        rapi_context_error("unable to read %i bytes, only %i bytes left in reply",
+                size, context->recv_remaining);
         return false;
     }
 
-    if ( !rapi_buffer_recv(context->recv_buffer, context->socket) )
+    start = rapi_context_now_us();
+    success = synce_socket_read(context->socket, data, size);
+    context->stats.recv_us += rapi_context_now_us() - start;
+
+    if (!success)
     {
-        rapi_context_error("rapi_buffer_recv failed");
+        rapi_context_error("failed to read %i bytes of reply", size);
+        synce_socket_close(context->socket);
+        context->recv_remaining = 0;
+        context->stats.errors++;
         context->rapi_error = E_FAIL;
         return false;
     }
 
-    context->rapi_error = S_OK;
+    context->recv_remaining -= size;
+    context->stats.bytes_received += size;
     return true;
 }/*}}}*/
 
+bool rapi_context_skip_payload(RapiContext* context)/*{{{*/
+{
+    unsigned char scratch[512];
+
+    while (context->recv_remaining > 0)
+    {
+        size_t size = context->recv_remaining;
+        if (size > sizeof(scratch))
+            size = sizeof(scratch);
+
+        if ( !rapi_context_recv_payload(context, scratch, size) )
+            return false;
+    }
+
+    return true;
+}/*}}}*/
+
+/*
+ * Forget the queued commands after the connection failed
+ */
+static void rapi_context_drop_pipeline(RapiContext* context)/*{{{*/
+{
+	rapi_buffer_clear(context->pipeline_commands);
+	context->pipeline_pending = 0;
+	context->pipeline_receiving = false;
+}/*}}}*/
+
+/*
+ * Start the span of the oldest queued command
+ */
+static void rapi_context_begin_queued_span(RapiContext* context)/*{{{*/
+{
+	uint32_t command = 0;
+
+	rapi_buffer_read_uint32(context->pipeline_commands, &command);
+	rapi_context_begin_span(context, command);
+	context->pipeline_receiving = true;
+
+	/* asynchronous calls may keep commands queued for as long as the session is busy */
+	rapi_buffer_compact(context->pipeline_commands);
+}/*}}}*/
+
+bool rapi_context_queue_command(RapiContext* context)/*{{{*/
+{
+	size_t size = rapi_buffer_get_size(context->send_buffer);
+
+	/* same framing as rapi_buffer_send(), the pipeline is sent as is */
+	if ( !rapi_buffer_write_uint32(context->pipeline_buffer, size) ||
+	     !rapi_buffer_write_data(context->pipeline_buffer, rapi_buffer_get_raw(context->send_buffer), size) ||
+	     !rapi_buffer_write_uint32(context->pipeline_commands, context->command) )
+	{
+		rapi_context_error("failed to queue command");
+		context->rapi_error = E_OUTOFMEMORY;
+		return false;
+	}
+
+	context->pipeline_pending++;
+	rapi_context_trace("%u commands pending", context->pipeline_pending);
+
+	return true;
+}/*}}}*/
+
+bool rapi_context_flush(RapiContext* context)/*{{{*/
+{
+	size_t size = rapi_buffer_get_size(context->pipeline_buffer);
+	uint64_t start;
+	bool success;
+
+	if (size == 0)
+		return true;
+
+	rapi_context_trace("sending %i bytes of queued commands", size - context->pipeline_sent);
+
+	start = rapi_context_now_us();
+	success = synce_socket_write(context->socket,
+			rapi_buffer_get_raw(context->pipeline_buffer) + context->pipeline_sent,
+			size - context->pipeline_sent);
+	context->stats.send_us += rapi_context_now_us() - start;
+
+	if (!success)
+	{
+		rapi_context_error("synce_socket_write failed");
+		synce_socket_close(context->socket);
+		rapi_buffer_clear(context->pipeline_buffer);
+		context->pipeline_sent = 0;
+		rapi_context_drop_pipeline(context);
+		context->stats.errors++;
+		context->rapi_error = E_FAIL;
+		return false;
+	}
+
+	context->stats.bytes_sent += size - context->pipeline_sent;
+	rapi_buffer_clear(context->pipeline_buffer);
+	context->pipeline_sent = 0;
+	return true;
+}/*}}}*/
+
+bool rapi_context_flush_some(RapiContext* context, bool* done)/*{{{*/
+{
+	size_t size = rapi_buffer_get_size(context->pipeline_buffer);
+	size_t sent = 0;
+	uint64_t start;
+	bool success;
+
+	*done = true;
+
+	if (size == 0)
+		return true;
+
+	start = rapi_context_now_us();
+	success = synce_socket_write_some(context->socket,
+			rapi_buffer_get_raw(context->pipeline_buffer) + context->pipeline_sent,
+			size - context->pipeline_sent, &sent);
+	context->stats.send_us += rapi_context_now_us() - start;
+
+	if (!success)
+	{
+		rapi_context_error("synce_socket_write_some failed");
+		synce_socket_close(context->socket);
+		rapi_buffer_clear(context->pipeline_buffer);
+		context->pipeline_sent = 0;
+		rapi_context_drop_pipeline(context);
+		context->stats.errors++;
+		context->rapi_error = E_FAIL;
+		return false;
+	}
+
+	context->stats.bytes_sent += sent;
+	context->pipeline_sent += sent;
+	if (context->pipeline_sent < size)
+	{
+		*done = false;
+		return true;
+	}
+
+	rapi_buffer_clear(context->pipeline_buffer);
+	context->pipeline_sent = 0;
+	return true;
+}/*}}}*/
+
+bool rapi2_context_recv_reply_some(RapiContext* context, bool* complete)/*{{{*/
+{
+	uint64_t start;
+	uint64_t elapsed;
+	bool success;
+
+	*complete = false;
+
+	if (context->pipeline_pending == 0)
+	{
+		rapi_context_error("no queued command is waiting for a reply");
+		context->rapi_error = E_UNEXPECTED;
+		return false;
+	}
+
+	if (!context->pipeline_receiving)
+		rapi_context_begin_queued_span(context);
+
+	start = rapi_context_now_us();
+	success = rapi_buffer_recv_some(context->recv_buffer, context->socket, complete);
+	elapsed = rapi_context_now_us() - start;
+	context->span.recv_us += elapsed;
+	context->stats.recv_us += elapsed;
+
+	if (!success)
+	{
+		rapi_context_error("rapi_buffer_recv_some failed");
+		rapi_context_end_span(context, E_FAIL);
+		rapi_context_drop_pipeline(context);
+		context->stats.errors++;
+		context->rapi_error = E_FAIL;
+		return false;
+	}
+
+	if (*complete)
+	{
+		context->span.bytes_received = rapi_buffer_get_size(context->recv_buffer) + sizeof(uint32_t);
+		context->stats.bytes_received += context->span.bytes_received;
+		context->pipeline_pending--;
+		context->pipeline_receiving = false;
+		context->rapi_error = S_OK;
+		rapi_context_end_span(context, S_OK);
+	}
+
+	return true;
+}/*}}}*/
+
+/*
+ * Receive the next queued reply, leaving its span open
+ */
+static bool rapi_context_recv_queued(RapiContext* context)/*{{{*/
+{
+	context->rapi_error = E_UNEXPECTED;
+
+	if (context->pipeline_pending == 0)
+	{
+		rapi_context_error("no queued command is waiting for a reply");
+		return false;
+	}
+
+	if ( !rapi_context_flush(context) || !rapi_context_skip_payload(context) )
+		return false;
+
+	rapi_context_begin_queued_span(context);
+	context->pipeline_pending--;
+	context->pipeline_receiving = false;
+
+	if ( !rapi_context_recv(context, (size_t)-1) )
+	{
+		/* the socket is closed, none of the other replies will arrive */
+		rapi_context_end_span(context, E_FAIL);
+		rapi_context_drop_pipeline(context);
+		context->rapi_error = E_FAIL;
+		return false;
+	}
+
+	return true;
+}/*}}}*/
+
+bool rapi_context_recv_reply(RapiContext* context)/*{{{*/
+{
+	if ( !rapi_context_recv_queued(context) )
+		return false;
+
+	return rapi_context_read_result(context);
+}/*}}}*/
+
+bool rapi2_context_recv_reply(RapiContext* context)/*{{{*/
+{
+	if ( !rapi_context_recv_queued(context) )
+		return false;
+
+	context->rapi_error = S_OK;
+	rapi_context_end_span(context, S_OK);
+	return true;
+}/*}}}*/
+
+unsigned rapi_context_get_pending(RapiContext* context)/*{{{*/
+{
+	return context->pipeline_pending;
+}/*}}}*/
+
+void rapi_context_get_buffer_stats(RapiContext* context, RapiBufferStats* stats)/*{{{*/
+{
+	RapiBuffer* buffers[4];
+	unsigned i;
+
+	buffers[0] = context->send_buffer;
+	buffers[1] = context->recv_buffer;
+	buffers[2] = context->pipeline_buffer;
+	buffers[3] = context->pipeline_commands;
+
+	memset(stats, 0, sizeof(RapiBufferStats));
+
+	for (i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++)
+	{
+		RapiBufferStats buffer_stats;
+
+		rapi_buffer_get_stats(buffers[i], &buffer_stats);
+		stats->allocations += buffer_stats.allocations;
+		stats->shrinks     += buffer_stats.shrinks;
+		stats->capacity    += buffer_stats.capacity;
+	}
+}/*}}}*/
+
+void rapi_context_get_stats(RapiContext* context, RapiContextStats* stats)/*{{{*/
+{
+	memcpy(stats, &context->stats, sizeof(RapiContextStats));
+}/*}}}*/
+
+void rapi_context_set_span_hook(RapiContext* context, RapiContextSpanHook hook, void* user_data)/*{{{*/
+{
+	context->span_hook = hook;
+	context->span_data = user_data;
+}/*}}}*/
+
+void rapi_context_set_timeout(RapiContext* context, int timeout_ms)/*{{{*/
+{
+	synce_socket_set_timeout(context->socket, timeout_ms);
+}/*}}}*/
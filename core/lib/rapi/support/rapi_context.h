@@ -7,6 +7,48 @@
 
 struct rapi_ops_s;
 
+/* command ids below this are counted one by one */
+#define RAPI_CONTEXT_COMMAND_COUNT  128
+
+/**
+ * Counters of a context since it was created
+ */
+typedef struct _RapiContextStats
+{
+	/** commands begun, and by command id */
+	unsigned calls;
+	unsigned command_calls[RAPI_CONTEXT_COMMAND_COUNT];
+	/** calls that failed sending or receiving */
+	unsigned errors;
+	/** RAPI1 calls the device failed with an HRESULT */
+	unsigned device_errors;
+	/** including the length of each message */
+	uint64_t bytes_sent;
+	uint64_t bytes_received;
+	/** microseconds blocked writing, waiting for a reply, and reading it */
+	uint64_t send_us;
+	uint64_t wait_us;
+	uint64_t recv_us;
+} RapiContextStats;
+
+/**
+ * One call, as given to the span hook when its reply has arrived
+ */
+typedef struct _RapiContextSpan
+{
+	uint32_t command;
+	/** S_OK, or why the call failed */
+	HRESULT result;
+	/** 0 for queued commands, they are sent together */
+	size_t bytes_sent;
+	size_t bytes_received;
+	uint64_t send_us;
+	uint64_t wait_us;
+	uint64_t recv_us;
+} RapiContextSpan;
+
+typedef void (*RapiContextSpanHook)(const RapiContextSpan* span, void* user_data);
+
 typedef struct _RapiContext
 {
 	RapiBuffer* send_buffer;
@@ -21,8 +63,24 @@ typedef struct _RapiContext
 	bool own_info;
 	struct rapi_ops_s *rapi_ops;
 	unsigned refcount;
+	RapiBuffer* pipeline_buffer;
+	unsigned pipeline_pending;
+	size_t pipeline_sent;
+	size_t recv_remaining;
+	/* id of the last command begun */
+	uint32_t command;
+	/* ids of the queued commands, oldest first */
+	RapiBuffer* pipeline_commands;
+	bool pipeline_receiving;
+	RapiContextStats stats;
+	RapiContextSpan span;
+	RapiContextSpanHook span_hook;
+	void* span_data;
 } RapiContext;
 
+/* how long a single send or reply may take */
+#define RAPI_CONTEXT_DEFAULT_TIMEOUT  (120*1000)
+
 /**
  * Get current RapiContext
  */
@@ -72,5 +130,87 @@ bool rapi_context_call(RapiContext* context);
 
 bool rapi2_context_call(RapiContext* context);
 
+/**
+ * Send send_buffer and receive the first header_size bytes of the reply
+ * in recv_buffer, the rest is left on the socket to be read with
+ * rapi_context_recv_payload()
+ */
+bool rapi2_context_call_header(RapiContext* context, size_t header_size);
+
+/**
+ * Read the next size bytes of the current reply directly into data
+ */
+bool rapi_context_recv_payload(RapiContext* context, void* data, size_t size);
+
+/**
+ * Discard what is left of the current reply
+ */
+bool rapi_context_skip_payload(RapiContext* context);
+
+/**
+ * Append the command in send_buffer to the pipeline instead of
+ * sending it, the reply must later be collected with
+ * rapi2_context_recv_reply()
+ */
+bool rapi_context_queue_command(RapiContext* context);
+
+/**
+ * Send all queued commands on socket in a single write
+ */
+bool rapi_context_flush(RapiContext* context);
+
+/**
+ * Receive the reply to the oldest outstanding queued command
+ * into recv_buffer, flushing the pipeline first if needed
+ */
+bool rapi2_context_recv_reply(RapiContext* context);
+
+/**
+ * Like rapi2_context_recv_reply() for RAPI1, which also reads the
+ * result in front of the reply as rapi_context_call() does
+ */
+bool rapi_context_recv_reply(RapiContext* context);
+
+/**
+ * Get number of queued commands whose reply has not been received yet
+ */
+unsigned rapi_context_get_pending(RapiContext* context);
+
+/**
+ * Send as much of the pipeline as the socket takes without waiting.
+ * done is set once all of it has been sent.
+ */
+bool rapi_context_flush_some(RapiContext* context, bool* done);
+
+/**
+ * Receive as much of the next reply as is available without waiting.
+ * Once complete is set the reply is in recv_buffer, as after
+ * rapi2_context_recv_reply().
+ */
+bool rapi2_context_recv_reply_some(RapiContext* context, bool* complete);
+
+/**
+ * Get combined memory statistics of the context's buffers
+ */
+void rapi_context_get_buffer_stats(RapiContext* context, RapiBufferStats* stats);
+
+/**
+ * Get the counters of the context
+ */
+void rapi_context_get_stats(RapiContext* context, RapiContextStats* stats);
+
+/**
+ * Call hook with the span of each call once its reply has arrived, or
+ * stop if hook is NULL. The hook runs on the calling thread and must
+ * not make calls on the context.
+ */
+void rapi_context_set_span_hook(RapiContext* context, RapiContextSpanHook hook, void* user_data);
+
+/**
+ * Set the deadline in milliseconds for each socket read or write,
+ * or SYNCE_SOCKET_NO_TIMEOUT
+ */
+void rapi_context_set_timeout(RapiContext* context, int timeout_ms);
+
 #endif
 
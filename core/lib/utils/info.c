@@ -12,7 +12,9 @@
 #include <string.h>
 
 #if ENABLE_UDEV_SUPPORT
+#include <errno.h>
 #include <glib-object.h>
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 #endif
 
@@ -70,6 +72,12 @@ static const char* const DCCM_SERVICE      = "org.synce.dccm";
 static const char* const DCCM_MGR_PATH     = "/org/synce/dccm/DeviceManager";
 static const char* const DCCM_MGR_IFACE    = "org.synce.dccm.DeviceManager";
 static const char* const DCCM_DEV_IFACE    = "org.synce.dccm.Device";
+
+/* rewritten by dccm whenever a device comes or goes */
+#define DEVICE_GENERATION_FILE  LOCALSTATEDIR "/run/synce-devices"
+#define INFO_CACHE_DIR          "synce"
+#define INFO_CACHE_FILE         "device-info"
+#define INFO_CACHE_GROUP        "cache"
 #endif
 
 #define FREE(x)     if(x) free(x)
@@ -160,6 +168,45 @@ exit:
 
 #endif /* ENABLE_DCCM_FILE_SUPPORT */
 
+/*
+ * SYNCE_EMULATOR=ADDRESS[,MAJOR.MINOR] points every program at a device
+ * emulator instead of a real device. ADDRESS is HOST:PORT, the path of
+ * a Unix domain socket, or fd:N for a descriptor that is already
+ * connected. The OS version decides between RAPI1 and RAPI2 as it does
+ * for a real device, and defaults to 5.2.
+ */
+static SynceInfo* synce_info_from_emulator(const char* address)
+{
+  SynceInfo* result = calloc(1, sizeof(SynceInfo));
+  const char* version;
+
+  if (!result)
+    return NULL;
+
+  result->os_major = 5;
+  result->os_minor = 2;
+
+  if ((version = strchr(address, ',')) != NULL)
+  {
+    if (sscanf(version + 1, "%u.%u", &result->os_major, &result->os_minor) != 2)
+    {
+      synce_error("bad OS version in SYNCE_EMULATOR: %s", version + 1);
+      synce_info_destroy(result);
+      return NULL;
+    }
+    result->device_ip = strndup(address, version - address);
+  }
+  else
+    result->device_ip = strdup(address);
+
+  result->name = strdup("emulator");
+  result->os_name = strdup("Windows CE");
+  result->model = strdup("emulator");
+  result->transport = strdup("emulator");
+
+  return result;
+}
+
 #if ENABLE_UDEV_SUPPORT
 
 static gboolean
@@ -406,9 +453,268 @@ OUT:
   return result;
 }
 
+/*
+ * Device information cache
+ *
+ * Looking a device up costs several D-Bus round trips, and every new
+ * RAPI context does it. What was found is kept in a key file, one
+ * group per object path, both in memory and under the user runtime
+ * directory so short lived tools share it. Everything in it is only
+ * trusted while dccm's generation file is unchanged; dccm rewrites
+ * that file with each DeviceConnected and DeviceDisconnected signal.
+ * Processes running a main loop also drop their copy on the signals.
+ */
+
+G_LOCK_DEFINE_STATIC(info_cache);
+static GKeyFile *info_cache = NULL;
+
+static gchar *
+info_cache_filename(void)
+{
+  return g_build_filename(g_get_user_runtime_dir(), INFO_CACHE_DIR, INFO_CACHE_FILE, NULL);
+}
+
+/* NULL when dccm does not write one, and then nothing is cached */
+static gchar *
+info_cache_current_generation(void)
+{
+  gchar *generation = NULL;
+
+  if (!g_file_get_contents(DEVICE_GENERATION_FILE, &generation, NULL, NULL))
+    return NULL;
+
+  return g_strstrip(generation);
+}
+
+static gboolean
+info_cache_is_current(GKeyFile *cache, const gchar *generation)
+{
+  gchar *stored = g_key_file_get_string(cache, INFO_CACHE_GROUP, "generation", NULL);
+  gboolean current = stored && strcmp(stored, generation) == 0;
+
+  g_free(stored);
+  return current;
+}
+
+static void
+info_cache_device_changed_cb(G_GNUC_UNUSED GDBusConnection *connection,
+			     G_GNUC_UNUSED const gchar *sender_name,
+			     G_GNUC_UNUSED const gchar *object_path,
+			     G_GNUC_UNUSED const gchar *interface_name,
+			     const gchar *signal_name,
+			     G_GNUC_UNUSED GVariant *parameters,
+			     G_GNUC_UNUSED gpointer user_data)
+{
+  synce_trace("%s, dropping cached device information", signal_name);
+
+  G_LOCK(info_cache);
+  if (info_cache) {
+    g_key_file_free(info_cache);
+    info_cache = NULL;
+  }
+  G_UNLOCK(info_cache);
+}
+
+/* called with the cache locked */
+static void
+info_cache_subscribe(void)
+{
+  static GDBusConnection *bus = NULL;
+
+  if (bus)
+    return;
+
+  /* the reference is kept, the subscription lives as long as the bus */
+  if (!(bus = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, NULL)))
+    return;
+
+  /* both signals come from the manager, match on the interface only */
+  g_dbus_connection_signal_subscribe(bus,
+				     DCCM_SERVICE,
+				     DCCM_MGR_IFACE,
+				     NULL, /* member */
+				     DCCM_MGR_PATH,
+				     NULL, /* arg0 */
+				     G_DBUS_SIGNAL_FLAGS_NONE,
+				     info_cache_device_changed_cb,
+				     NULL, NULL);
+}
+
+static gboolean
+info_cache_matches(GKeyFile *cache, const gchar *group, SynceInfoIdField field, const char* data)
+{
+  gchar *name;
+  gboolean match;
+
+  if (strcmp(group, INFO_CACHE_GROUP) == 0)
+    return FALSE;
+
+  if (data == NULL)
+    return TRUE;
+
+  switch (field)
+    {
+    case INFO_NAME:
+      name = g_key_file_get_string(cache, group, "name", NULL);
+      match = name && strcasecmp(data, name) == 0;
+      g_free(name);
+      return match;
+    case INFO_OBJECT_PATH:
+      return strcasecmp(data, group) == 0;
+    }
+
+  return FALSE;
+}
+
+static SynceInfo *
+info_cache_read(GKeyFile *cache, const gchar *group)
+{
+  SynceInfo *result = calloc(1, sizeof(SynceInfo));
+
+  if (!result)
+    return NULL;
+
+  result->object_path    = g_strdup(group);
+  result->transport      = g_strdup("udev");
+  result->name           = g_key_file_get_string(cache, group, "name", NULL);
+  result->os_major       = g_key_file_get_integer(cache, group, "os_major", NULL);
+  result->os_minor       = g_key_file_get_integer(cache, group, "os_minor", NULL);
+  result->processor_type = g_key_file_get_integer(cache, group, "processor_type", NULL);
+  result->os_name        = g_key_file_get_string(cache, group, "os_name", NULL);
+  result->model          = g_key_file_get_string(cache, group, "model", NULL);
+  result->device_ip      = g_key_file_get_string(cache, group, "device_ip", NULL);
+  result->guid           = g_key_file_get_string(cache, group, "guid", NULL);
+  result->local_iface_ip = g_key_file_get_string(cache, group, "local_ip", NULL);
+
+  return result;
+}
+
+static void
+info_cache_store(GKeyFile *cache, const SynceInfo *info)
+{
+  const gchar *group = info->object_path;
+
+  g_key_file_set_string(cache, group, "name", info->name);
+  g_key_file_set_integer(cache, group, "os_major", info->os_major);
+  g_key_file_set_integer(cache, group, "os_minor", info->os_minor);
+  g_key_file_set_integer(cache, group, "processor_type", info->processor_type);
+  g_key_file_set_string(cache, group, "os_name", info->os_name);
+  g_key_file_set_string(cache, group, "model", info->model);
+  g_key_file_set_string(cache, group, "device_ip", info->device_ip);
+  g_key_file_set_string(cache, group, "guid", info->guid);
+  g_key_file_set_string(cache, group, "local_ip", info->local_iface_ip);
+}
+
+static void
+info_cache_save(GKeyFile *cache)
+{
+  gchar *filename = info_cache_filename();
+  gchar *dirname = g_path_get_dirname(filename);
+  gchar *contents;
+  gsize length;
+  GError *error = NULL;
+
+  contents = g_key_file_to_data(cache, &length, NULL);
+
+  if (g_mkdir_with_parents(dirname, 0700) < 0 ||
+      !g_file_set_contents(filename, contents, length, &error)) {
+    synce_warning("failed to write %s: %s", filename, error ? error->message : g_strerror(errno));
+    if (error) g_error_free(error);
+  }
+
+  g_free(contents);
+  g_free(dirname);
+  g_free(filename);
+}
+
+static SynceInfo *
+synce_info_from_udev_cached(SynceInfoIdField field, const char* data)
+{
+  SynceInfo *result = NULL;
+  gchar *generation;
+  gchar *filename;
+  gchar **groups;
+  gsize i;
+
+  if (!(generation = info_cache_current_generation()))
+    return synce_info_from_udev(field, data);
+
+  G_LOCK(info_cache);
+
+  if (info_cache && !info_cache_is_current(info_cache, generation)) {
+    g_key_file_free(info_cache);
+    info_cache = NULL;
+  }
+
+  if (!info_cache) {
+    info_cache = g_key_file_new();
+    filename = info_cache_filename();
+    if (!g_key_file_load_from_file(info_cache, filename, G_KEY_FILE_NONE, NULL) ||
+	!info_cache_is_current(info_cache, generation)) {
+      g_key_file_free(info_cache);
+      info_cache = g_key_file_new();
+      g_key_file_set_string(info_cache, INFO_CACHE_GROUP, "generation", generation);
+    }
+    g_free(filename);
+  }
+
+  groups = g_key_file_get_groups(info_cache, NULL);
+  for (i = 0; groups[i] && !result; i++)
+    if (info_cache_matches(info_cache, groups[i], field, data))
+      result = info_cache_read(info_cache, groups[i]);
+  g_strfreev(groups);
+
+  G_UNLOCK(info_cache);
+
+  if (result) {
+    synce_trace("using cached information for %s", result->object_path);
+    g_free(generation);
+    return result;
+  }
+
+  if ((result = synce_info_from_udev(field, data))) {
+    G_LOCK(info_cache);
+    /* it may have been dropped meanwhile, and would then be stale */
+    if (info_cache && info_cache_is_current(info_cache, generation)) {
+      info_cache_store(info_cache, result);
+      info_cache_save(info_cache);
+    }
+    info_cache_subscribe();
+    G_UNLOCK(info_cache);
+  }
+
+  g_free(generation);
+  return result;
+}
+
 #endif /* ENABLE_UDEV_SUPPORT */
 
 
+/** @brief Forget cached device information
+ * 
+ * Device information found through dccm is cached, and the cache
+ * is dropped when dccm reports a device connecting or disconnecting.
+ * This drops it at once, for example after a connection to a device
+ * the cache pointed at has failed.
+ */ 
+void synce_info_cache_invalidate(void)
+{
+#if ENABLE_UDEV_SUPPORT
+  gchar *filename = info_cache_filename();
+
+  G_LOCK(info_cache);
+  if (info_cache) {
+    g_key_file_free(info_cache);
+    info_cache = NULL;
+  }
+  g_unlink(filename);
+  G_UNLOCK(info_cache);
+
+  g_free(filename);
+#endif
+}
+
+
 /** @brief Get device information for a named device
  * 
  * This function obtains a new SynceInfo struct containing
@@ -433,6 +739,9 @@ SynceInfo* synce_info_new(const char* device_name)
  * dbus object path, or full path to the connection file if
  * the legacy vdccm is being used. If identification data is not
  * specified, the first device found is returned.
+ *
+ * When the SYNCE_EMULATOR environment variable is set the result
+ * describes that device emulator, whatever the field and data.
  * 
  * @param[in] field INFO_NAME or INFO_OBJECT_PATH
  * @param[in] data identification of the device to query, or NULL for any device
@@ -441,9 +750,13 @@ SynceInfo* synce_info_new(const char* device_name)
 SynceInfo* synce_info_new_by_field(SynceInfoIdField field, const char* data)
 {
   SynceInfo* result = NULL;
+  const char* emulator = getenv("SYNCE_EMULATOR");
+
+  if (emulator && *emulator)
+    return synce_info_from_emulator(emulator);
 
 #if ENABLE_UDEV_SUPPORT
-  result = synce_info_from_udev(field, data);
+  result = synce_info_from_udev_cached(field, data);
 #endif
 
 #if ENABLE_MIDASYNC
@@ -479,6 +792,7 @@ void synce_info_destroy(SynceInfo* info)
     FREE(info->model);
     FREE(info->transport);
     FREE(info->object_path);
+    FREE(info->guid);
     free(info);
   }
 }
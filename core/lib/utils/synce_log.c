@@ -13,8 +13,8 @@
  * @{ 
  */ 
 
-/* evil static data */
-static int current_log_level = SYNCE_LOG_LEVEL_DEFAULT;
+/* evil global data */
+int _synce_log_level = SYNCE_LOG_LEVEL_DEFAULT;
 static bool use_syslog = false;
 
 static int level_to_priority[] =
@@ -37,7 +37,7 @@ static int level_to_priority[] =
  */ 
 void synce_log_set_level(int level)
 {
-	current_log_level = level;
+	_synce_log_level = level;
 }
 
 /** @brief Set logging to log to syslog
@@ -65,7 +65,7 @@ void _synce_log(int level, const char* file, int line, const char* format, ...)
 {
   va_list ap;
 
-  if (level > current_log_level)
+  if (level > _synce_log_level)
     return;
 
   if (use_syslog)
@@ -101,7 +101,7 @@ void _synce_log(int level, const char* file, int line, const char* format, ...)
 void _synce_log_wstr(int level, const char* file, int line, const char* name,
 		const WCHAR* wstr)
 {
-  if (level <= current_log_level)
+  if (level <= _synce_log_level)
   {
     char* str = wstr_to_current(wstr);
     if (!str)
@@ -42,13 +42,30 @@ void synce_log_use_syslog();
 
 void _synce_log(int level, const char* file, int line, const char* format, ...);
 
+/* current level, read by the macros below so that disabled messages
+   cost a compare instead of a call */
+extern int _synce_log_level;
+
+/** @brief Check whether messages of a level are logged
+ *
+ * @param level level of message
+ */
+#define synce_log_enabled(level) ((level) <= _synce_log_level)
+
+#define _synce_log_if(level, format, args...) \
+	(synce_log_enabled(level) ? _synce_log(level,__PRETTY_FUNCTION__, __LINE__, format, ##args) : (void)0)
+
 /** @brief Log a trace level message
  * 
  * @param format printf style format string
  * @param ... arguments to the printf style string
  */
+#if SYNCE_LOG_DISABLE_TRACE
+#define synce_trace(format, args...) ((void)0)
+#else
 #define synce_trace(format, args...) \
-	_synce_log(SYNCE_LOG_LEVEL_TRACE,__PRETTY_FUNCTION__, __LINE__, format, ##args)
+	_synce_log_if(SYNCE_LOG_LEVEL_TRACE, format, ##args)
+#endif
 
 /** @brief Log a debug level message
  * 
@@ -56,7 +73,7 @@ void _synce_log(int level, const char* file, int line, const char* format, ...);
  * @param ... arguments to the printf style string
  */
 #define synce_debug(format, args...) \
-	_synce_log(SYNCE_LOG_LEVEL_DEBUG,__PRETTY_FUNCTION__, __LINE__, format, ##args)
+	_synce_log_if(SYNCE_LOG_LEVEL_DEBUG, format, ##args)
 
 /** @brief Log an information level message
  * 
@@ -64,7 +81,7 @@ void _synce_log(int level, const char* file, int line, const char* format, ...);
  * @param ... arguments to the printf style string
  */
 #define synce_info(format, args...) \
-	_synce_log(SYNCE_LOG_LEVEL_INFO,__PRETTY_FUNCTION__, __LINE__, format, ##args)
+	_synce_log_if(SYNCE_LOG_LEVEL_INFO, format, ##args)
 
 /** @brief Log a warning level message
  * 
@@ -72,7 +89,7 @@ void _synce_log(int level, const char* file, int line, const char* format, ...);
  * @param ... arguments to the printf style string
  */
 #define synce_warning(format, args...) \
-	_synce_log(SYNCE_LOG_LEVEL_WARNING,__PRETTY_FUNCTION__, __LINE__, format, ##args)
+	_synce_log_if(SYNCE_LOG_LEVEL_WARNING, format, ##args)
 
 /** @brief Conditionally log a warning level message
  * 
@@ -82,7 +99,7 @@ void _synce_log(int level, const char* file, int line, const char* format, ...);
  */
 #define synce_warning_unless(cond, format, args...) \
 	if (!(cond)) \
-	_synce_log(SYNCE_LOG_LEVEL_WARNING,__PRETTY_FUNCTION__, __LINE__, format, ##args)
+	_synce_log_if(SYNCE_LOG_LEVEL_WARNING, format, ##args)
 
 /** @brief Log an error level message
  * 
@@ -90,7 +107,7 @@ void _synce_log(int level, const char* file, int line, const char* format, ...);
  * @param ... arguments to the printf style string
  */
 #define synce_error(format, args...) \
-	_synce_log(SYNCE_LOG_LEVEL_ERROR,__PRETTY_FUNCTION__, __LINE__, format, ##args)
+	_synce_log_if(SYNCE_LOG_LEVEL_ERROR, format, ##args)
 
 void _synce_log_wstr(int level, const char* file, int line, const char* name, const WCHAR* wstr);
 
@@ -101,8 +118,13 @@ void _synce_log_wstr(int level, const char* file, int line, const char* name, co
  * 
  * @param wstr name of the variable to log
  */
+#if SYNCE_LOG_DISABLE_TRACE
+#define synce_trace_wstr(wstr) ((void)0)
+#else
 #define synce_trace_wstr(wstr) \
-	_synce_log_wstr(SYNCE_LOG_LEVEL_TRACE,__PRETTY_FUNCTION__, __LINE__, #wstr, wstr)
+	(synce_log_enabled(SYNCE_LOG_LEVEL_TRACE) ? \
+	 _synce_log_wstr(SYNCE_LOG_LEVEL_TRACE,__PRETTY_FUNCTION__, __LINE__, #wstr, wstr) : (void)0)
+#endif
 
 #ifdef __cplusplus
 }
@@ -20,6 +20,8 @@
 #include <sys/ioctl.h>
 #include <sys/poll.h>
 #include <sys/select.h>
+#include <fcntl.h>
+#include <time.h>
 
 #if !HAVE_INET_PTON
 int inet_pton(int af, const char *src, void *dst);
@@ -46,6 +48,7 @@ int inet_pton(int af, const char *src, void *dst);
 #define synce_socket_error(args...)    synce_error(args)
 
 #define RAPI_SOCKET_LISTEN_QUEUE  1024
+#define RAPI_SOCKET_MAX_IOV       16
 
 /** 
  * @defgroup SynceSocket Socket convenience functions
@@ -58,8 +61,104 @@ int inet_pton(int af, const char *src, void *dst);
 struct _SynceSocket
 {
 	int fd;
+	/* deadline for each read or write call as a whole */
+	int timeout_ms;
+	bool nonblocking;
 };
 
+/*
+ * Apply the mode chosen with synce_socket_set_nonblocking() to a newly
+ * attached descriptor
+ */
+static bool synce_socket_apply_mode(SynceSocket* socket)
+{
+	int flags;
+
+	if (socket->fd == SYNCE_SOCKET_INVALID_DESCRIPTOR)
+		return true;
+
+	if ((flags = fcntl(socket->fd, F_GETFL)) < 0)
+		goto fail;
+
+	if (socket->nonblocking)
+		flags |= O_NONBLOCK;
+	else
+		flags &= ~O_NONBLOCK;
+
+	if (fcntl(socket->fd, F_SETFL, flags) < 0)
+		goto fail;
+
+	return true;
+
+fail:
+	synce_socket_error("fcntl failed, error: %i \"%s\"", errno, strerror(errno));
+	return false;
+}
+
+static void synce_socket_start_deadline(SynceSocket* socket, struct timespec* deadline)
+{
+	if (socket->timeout_ms < 0)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+	deadline->tv_sec  += socket->timeout_ms / 1000;
+	deadline->tv_nsec += (socket->timeout_ms % 1000) * 1000000L;
+	if (deadline->tv_nsec >= 1000000000L)
+	{
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000L;
+	}
+}
+
+/*
+ * Wait until the socket is ready for poll_events or the deadline set
+ * up by synce_socket_start_deadline() passes. A socket without a
+ * timeout waits for as long as it takes.
+ */
+static bool synce_socket_wait_ready(SynceSocket* socket, short poll_events, const struct timespec* deadline)
+{
+	struct pollfd pfd;
+	struct timespec now;
+	int timeout_ms;
+	int result;
+
+	for (;;)
+	{
+		timeout_ms = -1;
+		if (socket->timeout_ms >= 0)
+		{
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			timeout_ms = (deadline->tv_sec - now.tv_sec) * 1000 +
+				(deadline->tv_nsec - now.tv_nsec) / 1000000;
+			if (timeout_ms < 0)
+				timeout_ms = 0;
+		}
+
+		pfd.fd = socket->fd;
+		pfd.events = poll_events;
+		pfd.revents = 0;
+
+		result = poll(&pfd, 1, timeout_ms);
+
+		if (result > 0)
+			/* errors and hangups are left for read() or write() to report */
+			return true;
+
+		if (result == 0)
+		{
+			synce_socket_error("timed out after %i ms", socket->timeout_ms);
+			errno = ETIMEDOUT;
+			return false;
+		}
+
+		if (errno != EINTR)
+		{
+			synce_socket_error("poll failed, error: %i \"%s\"", errno, strerror(errno));
+			return false;
+		}
+	}
+}
+
 /** @brief Create a client socket
  * 
  * This function creates a new SynceSocket object.
@@ -73,6 +172,7 @@ SynceSocket* synce_socket_new(/* TODO: some parameters here */)
 	if (socket)
 	{
 		socket->fd = SYNCE_SOCKET_INVALID_DESCRIPTOR;
+		socket->timeout_ms = SYNCE_SOCKET_NO_TIMEOUT;
 	}
 
 	return socket;
@@ -122,6 +222,49 @@ void synce_socket_take_descriptor(SynceSocket* socket, int fd)
     close(socket->fd);
 
   socket->fd = fd;
+  synce_socket_apply_mode(socket);
+}
+
+/** @brief Put a socket in non-blocking mode
+ * 
+ * In non-blocking mode the read and write functions never block in
+ * the kernel; when the socket is not ready they wait for it with
+ * poll(), up to the deadline set with synce_socket_set_timeout().
+ * The mode is kept across connect and close, and applied to any
+ * descriptor the socket gets later.
+ * 
+ * @param[in] socket the socket
+ * @param[in] nonblocking TRUE for non-blocking mode
+ * @return TRUE on success, FALSE on failure
+ */ 
+bool synce_socket_set_nonblocking(SynceSocket* socket, bool nonblocking)
+{
+  socket->nonblocking = nonblocking;
+  return synce_socket_apply_mode(socket);
+}
+
+/** @brief Set the deadline for reads and writes
+ * 
+ * Each call to synce_socket_read(), synce_socket_write() or
+ * synce_socket_writev() fails if it cannot complete within this
+ * time. The default is SYNCE_SOCKET_NO_TIMEOUT.
+ * 
+ * @param[in] socket the socket
+ * @param[in] timeoutInMilliseconds deadline per call, or SYNCE_SOCKET_NO_TIMEOUT
+ */ 
+void synce_socket_set_timeout(SynceSocket* socket, int timeoutInMilliseconds)
+{
+  socket->timeout_ms = timeoutInMilliseconds < 0 ? SYNCE_SOCKET_NO_TIMEOUT : timeoutInMilliseconds;
+}
+
+/** @brief Get the deadline for reads and writes
+ * 
+ * @param[in] socket the socket
+ * @return deadline per call in milliseconds, or SYNCE_SOCKET_NO_TIMEOUT
+ */ 
+int synce_socket_get_timeout(SynceSocket* socket)
+{
+  return socket->timeout_ms;
 }
 
 static bool synce_socket_create(SynceSocket* syncesock)
@@ -196,6 +339,9 @@ bool synce_socket_connect(SynceSocket* syncesock, const char* host, uint16_t por
 	if ( connect(syncesock->fd, (struct sockaddr*)&servaddr, sizeof(servaddr)) < 0 )
 		goto fail;
 
+	if (!synce_socket_apply_mode(syncesock))
+		goto fail;
+
 	return true;
 
 fail:
@@ -203,6 +349,45 @@ fail:
 	return false;
 }
 
+/** @brief Connect a socket to a local (Unix domain) socket
+ * 
+ * This function connects the given socket to a stream socket
+ * listening at the given path in the filesystem.
+ *
+ * If the socket is already open it is first closed.
+ * 
+ * @param[in] syncesock the socket
+ * @param[in] path path of the listening socket
+ * @return TRUE on success, FALSE on failure
+ */ 
+bool synce_socket_connect_local(SynceSocket* syncesock, const char* path)
+{
+    struct sockaddr_un localaddr;
+    int length;
+
+    synce_socket_close(syncesock);
+
+    if (!synce_socket_create_proxy(syncesock))
+        goto fail;
+
+    length = snprintf(localaddr.sun_path, sizeof(localaddr.sun_path), "%s", path);
+    if ((length < 0) || (length >= (int) sizeof(localaddr.sun_path)))
+        goto fail;
+
+    localaddr.sun_family = AF_LOCAL;
+    if (connect(syncesock->fd, (struct sockaddr *) &localaddr, sizeof(localaddr)) < 0)
+        goto fail;
+
+    if (!synce_socket_apply_mode(syncesock))
+        goto fail;
+
+    return true;
+
+fail:
+    synce_socket_close(syncesock);
+    return false;
+}
+
 /** @brief Connect a socket via vdccm proxy
  * 
  * This function connects the given socket via the vdccm
@@ -238,6 +423,9 @@ bool synce_socket_connect_proxy(SynceSocket* syncesock, const char* remoteIpAddr
     if (connect(syncesock->fd, (struct sockaddr *) &proxyaddr, sizeof(proxyaddr)) < 0)
         goto fail;
 
+    if (!synce_socket_apply_mode(syncesock))
+        goto fail;
+
     free(path);
 
     return true;
@@ -399,6 +587,7 @@ bool synce_socket_close(SynceSocket* socket)
 bool synce_socket_write(SynceSocket* socket, const void* data, size_t size)
 {
 	ssize_t bytes_left = size;
+	struct timespec deadline;
 
 	if ( SYNCE_SOCKET_INVALID_DESCRIPTOR == socket->fd )
 	{
@@ -406,9 +595,18 @@ bool synce_socket_write(SynceSocket* socket, const void* data, size_t size)
 		return false;
 	}
 
+	synce_socket_start_deadline(socket, &deadline);
+
 	while (bytes_left > 0)
 	{
-		ssize_t result = write(socket->fd, data, bytes_left);
+		ssize_t result;
+
+		/* a blocking write could outlive the deadline */
+		if (!socket->nonblocking && socket->timeout_ms >= 0 &&
+				!synce_socket_wait_ready(socket, POLLOUT, &deadline))
+			break;
+
+		result = write(socket->fd, data, bytes_left);
 
 		if (result == 0)
 		{
@@ -416,10 +614,15 @@ bool synce_socket_write(SynceSocket* socket, const void* data, size_t size)
 			 * no more data left to be written. */
 			break;
 		}
-		else if (result < 0 && (errno == EINTR || errno == EAGAIN))
+		else if (result < 0 && errno == EINTR)
 		{
-			/* There was either an interrupt or some other reason
-			 * we should try again. */
+			continue;
+		}
+		else if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			/* Wait for room rather than spinning */
+			if (!synce_socket_wait_ready(socket, POLLOUT, &deadline))
+				break;
 			continue;
 		}
 		else if (result < 0)
@@ -440,6 +643,95 @@ bool synce_socket_write(SynceSocket* socket, const void* data, size_t size)
 	return 0 == bytes_left;
 }
 
+/** @brief Write a number of buffers to an open socket
+ * 
+ * This function writes the given buffers to an open socket
+ * in order, with a gathering write, so the caller does not have to
+ * join them into a single buffer first.
+ *
+ * @param[in] socket socket to write to
+ * @param[in] iov buffers to be written
+ * @param[in] iovcnt number of buffers in iov, at most 16
+ * @return TRUE on success, FALSE on failure
+ */ 
+bool synce_socket_writev(SynceSocket* socket, const struct iovec* iov, int iovcnt)
+{
+	struct iovec vec[RAPI_SOCKET_MAX_IOV];
+	struct iovec* current = vec;
+	struct timespec deadline;
+
+	if ( SYNCE_SOCKET_INVALID_DESCRIPTOR == socket->fd )
+	{
+		synce_socket_error("Invalid file descriptor");
+		return false;
+	}
+
+	if (iovcnt < 0 || iovcnt > RAPI_SOCKET_MAX_IOV)
+	{
+		synce_socket_error("Invalid number of buffers: %i", iovcnt);
+		return false;
+	}
+
+	/* our copy is advanced over partial writes */
+	memcpy(vec, iov, iovcnt * sizeof(struct iovec));
+
+	synce_socket_start_deadline(socket, &deadline);
+
+	while (iovcnt > 0)
+	{
+		ssize_t result;
+
+		if (current->iov_len == 0)
+		{
+			current++;
+			iovcnt--;
+			continue;
+		}
+
+		if (!socket->nonblocking && socket->timeout_ms >= 0 &&
+				!synce_socket_wait_ready(socket, POLLOUT, &deadline))
+			return false;
+
+		result = writev(socket->fd, current, iovcnt);
+
+		if (result < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		else if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			if (!synce_socket_wait_ready(socket, POLLOUT, &deadline))
+				return false;
+			continue;
+		}
+		else if (result <= 0)
+		{
+			/* Something else went wrong. */
+			synce_socket_error("writev failed, error: %i \"%s\"", errno, strerror(errno));
+
+			/* Close socket on unrecoverable errors */
+			if (ECONNRESET == errno)  /* Connection reset by peer */
+				synce_socket_close(socket);
+			return false;
+		}
+
+		while (iovcnt > 0 && (size_t)result >= current->iov_len)
+		{
+			result -= current->iov_len;
+			current++;
+			iovcnt--;
+		}
+
+		if (iovcnt > 0)
+		{
+			current->iov_base = (char*)current->iov_base + result;
+			current->iov_len -= result;
+		}
+	}
+
+	return true;
+}
+
 /** @brief Read from an open socket
  * 
  * This function reads data from an open socket.
@@ -452,6 +744,7 @@ bool synce_socket_write(SynceSocket* socket, const void* data, size_t size)
 bool synce_socket_read(SynceSocket* socket, void* data, size_t size)
 {
 	ssize_t bytes_needed = size;
+	struct timespec deadline;
 
 	if ( SYNCE_SOCKET_INVALID_DESCRIPTOR == socket->fd )
 	{
@@ -459,9 +752,18 @@ bool synce_socket_read(SynceSocket* socket, void* data, size_t size)
 		return false;
 	}
 
+	synce_socket_start_deadline(socket, &deadline);
+
 	while(bytes_needed > 0)
 	{
-		ssize_t result = read(socket->fd, data, bytes_needed);
+		ssize_t result;
+
+		/* a blocking read could outlive the deadline */
+		if (!socket->nonblocking && socket->timeout_ms >= 0 &&
+				!synce_socket_wait_ready(socket, POLLIN, &deadline))
+			break;
+
+		result = read(socket->fd, data, bytes_needed);
 
 		/* synce_socket_trace("read returned %i, needed %i bytes", result, bytes_needed); */
 
@@ -470,10 +772,15 @@ bool synce_socket_read(SynceSocket* socket, void* data, size_t size)
 			/* EOF */
 			break;
 		}
-		else if (result < 0 && (errno == EINTR || errno == EAGAIN))
+		else if (result < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		else if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
 		{
-			/* There was either an interrupt or some other reason
-			 * we should try again. */
+			/* Wait for data rather than spinning */
+			if (!synce_socket_wait_ready(socket, POLLIN, &deadline))
+				break;
 			continue;
 		}
 		else if (result < 0)
@@ -494,6 +801,95 @@ bool synce_socket_read(SynceSocket* socket, void* data, size_t size)
 	return 0 == bytes_needed;
 }
 
+/** @brief Read what is available from a socket without waiting
+ * 
+ * This function reads up to size bytes that are already available,
+ * for callers driving several non-blocking sockets from one loop
+ * with synce_socket_wait_many(). Finding nothing to read is not an
+ * error; bytes_read is then 0.
+ *
+ * @param[in] socket socket to read from
+ * @param[in] data location to store the data
+ * @param[in] size maximum number of bytes to read
+ * @param[out] bytes_read number of bytes read
+ * @return TRUE on success, FALSE on failure or end of file
+ */ 
+bool synce_socket_read_some(SynceSocket* socket, void* data, size_t size, size_t* bytes_read)
+{
+	ssize_t result;
+
+	*bytes_read = 0;
+
+	if ( SYNCE_SOCKET_INVALID_DESCRIPTOR == socket->fd )
+	{
+		synce_socket_error("Invalid file descriptor");
+		return false;
+	}
+
+	do
+		result = recv(socket->fd, data, size, MSG_DONTWAIT);
+	while (result < 0 && errno == EINTR);
+
+	if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return true;
+
+	if (result <= 0)
+	{
+		if (result < 0)
+		{
+			synce_socket_error("read failed, error: %i \"%s\"", errno, strerror(errno));
+			if (ECONNRESET == errno)
+				synce_socket_close(socket);
+		}
+		return false;
+	}
+
+	*bytes_read = result;
+	return true;
+}
+
+/** @brief Write what fits to a socket without waiting
+ * 
+ * The counterpart of synce_socket_read_some(); bytes_written may be
+ * less than size, or 0 if the socket buffer is full.
+ *
+ * @param[in] socket socket to write to
+ * @param[in] data data to be written
+ * @param[in] size maximum number of bytes to write
+ * @param[out] bytes_written number of bytes written
+ * @return TRUE on success, FALSE on failure
+ */ 
+bool synce_socket_write_some(SynceSocket* socket, const void* data, size_t size, size_t* bytes_written)
+{
+	ssize_t result;
+
+	*bytes_written = 0;
+
+	if ( SYNCE_SOCKET_INVALID_DESCRIPTOR == socket->fd )
+	{
+		synce_socket_error("Invalid file descriptor");
+		return false;
+	}
+
+	do
+		result = send(socket->fd, data, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+	while (result < 0 && errno == EINTR);
+
+	if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return true;
+
+	if (result < 0)
+	{
+		synce_socket_error("write failed, error: %i \"%s\"", errno, strerror(errno));
+		if (ECONNRESET == errno)
+			synce_socket_close(socket);
+		return false;
+	}
+
+	*bytes_written = result;
+	return true;
+}
+
 #if HAVE_POLL
 
 /**
@@ -542,76 +938,114 @@ static SocketEvents from_poll_events(short poll_events)
  * @return TRUE on success, FALSE on failure
  */ 
 bool synce_socket_wait(SynceSocket* socket, int timeoutInSeconds, short* events)
+{
+	return synce_socket_wait_ms(socket,
+			timeoutInSeconds < 0 ? -1 : timeoutInSeconds * 1000, events);
+}
+
+/** @brief Wait for an event on a socket, in milliseconds
+ * 
+ * As synce_socket_wait(), with the timeout in milliseconds.
+ *
+ * @param[in] socket socket to check
+ * @param[in] timeoutInMilliseconds time to wait, 0 to report immediately, or a negative value to wait until an event is detected
+ * @param[in,out] events the events to check for; on return is set to the events detected
+ * @return TRUE on success, FALSE on failure
+ */ 
+bool synce_socket_wait_ms(SynceSocket* socket, int timeoutInMilliseconds, short* events)
+{
+	return synce_socket_wait_many(&socket, events, 1, timeoutInMilliseconds);
+}
+
+/** @brief Wait for events on a number of sockets
+ * 
+ * This function waits until at least one of the sockets has one
+ * of the events it is waiting for, so a single thread can serve
+ * many non-blocking sockets. Each entry of events is set as for
+ * synce_socket_wait(); if nothing happens in time they are all
+ * EVENT_TIMEOUT.
+ *
+ * @param[in] sockets sockets to check
+ * @param[in,out] events the events to check for on each socket; on return set to the events detected
+ * @param[in] count number of sockets
+ * @param[in] timeoutInMilliseconds time to wait, 0 to report immediately, or a negative value to wait until an event is detected
+ * @return TRUE on success, FALSE on failure
+ */ 
+bool synce_socket_wait_many(SynceSocket** sockets, short* events, unsigned count, int timeoutInMilliseconds)
 {
 	/*
 	 * This can easily be replaced by select() if needed on some platform
 	 */
 	bool success = false;
 	int result;
-	struct pollfd pfd;
+	unsigned i;
+	struct pollfd pfd_stack[8];
+	struct pollfd* pfd = pfd_stack;
 
-  if (!socket)
-  {
- 		synce_socket_error("SynceSocket is NULL");
+	if ( !sockets || !events )
+	{
+		synce_socket_error("Sockets or events parameter is NULL");
 		return false;
- }
+	}
 
-	if ( SYNCE_SOCKET_INVALID_DESCRIPTOR == socket->fd )
+	for (i = 0; i < count; i++)
 	{
-		synce_socket_error("Invalid file descriptor");
-		return false;
+		if (!sockets[i])
+		{
+			synce_socket_error("SynceSocket is NULL");
+			return false;
+		}
+
+		if ( SYNCE_SOCKET_INVALID_DESCRIPTOR == sockets[i]->fd )
+		{
+			synce_socket_error("Invalid file descriptor");
+			return false;
+		}
 	}
 
-	if ( !events )
+	if (count > sizeof(pfd_stack) / sizeof(pfd_stack[0]) &&
+			!(pfd = malloc(count * sizeof(struct pollfd))))
 	{
-		synce_socket_error("Events parameter is NULL");
+		synce_socket_error("Failed to allocate %u poll entries", count);
 		return false;
 	}
 
-	pfd.fd = socket->fd;
-	pfd.events = to_poll_events(*events);
-	pfd.revents = 0;
-
-  *events = 0;
-
-#if 0
-	while (pfd.revents != 0)
+	for (i = 0; i < count; i++)
 	{
-		synce_socket_trace("what?");
-		pfd.revents = 0;
+		pfd[i].fd = sockets[i]->fd;
+		pfd[i].events = to_poll_events(events[i]);
+		pfd[i].revents = 0;
 	}
-#endif
 
-	result = poll(&pfd, 1, timeoutInSeconds * 1000);
+	result = poll(pfd, count, timeoutInMilliseconds);
 
-	switch (result)
+	if (result == 0)
 	{
-		case 0:
-			*events = EVENT_TIMEOUT;
-			break;
-
-		case 1:
-			*events = from_poll_events(pfd.revents);
-			break;
-
-		default:
-			if (errno == EINTR)
-			{
-				*events = EVENT_INTERRUPTED;
-			}
-			else
-			{
-				synce_socket_error("poll failed (returned %i), error: %i \"%s\"",
-						result, errno, strerror(errno));
-				goto exit;
-
-			}
-			break;
+		for (i = 0; i < count; i++)
+			events[i] = EVENT_TIMEOUT;
+	}
+	else if (result > 0)
+	{
+		for (i = 0; i < count; i++)
+			events[i] = from_poll_events(pfd[i].revents);
+	}
+	else if (errno == EINTR)
+	{
+		for (i = 0; i < count; i++)
+			events[i] = EVENT_INTERRUPTED;
+	}
+	else
+	{
+		synce_socket_error("poll failed (returned %i), error: %i \"%s\"",
+				result, errno, strerror(errno));
+		goto exit;
 	}
 
 	success = true;
 
 exit:
+	if (pfd != pfd_stack)
+		free(pfd);
 	return success;
 }
 
@@ -4,6 +4,7 @@
 
 #include "synce.h"
 #include <netinet/in.h> /* for sockaddr_in */
+#include <sys/uio.h> /* for struct iovec */
 
 #ifdef __cplusplus
 extern "C"
@@ -51,16 +52,39 @@ int synce_socket_get_descriptor(SynceSocket* socket);
  */ 
 #define SYNCE_SOCKET_INVALID_DESCRIPTOR  (-1)
 
+/** @brief No deadline for reads and writes
+ * 
+ * The default for synce_socket_set_timeout(); calls wait for as
+ * long as it takes.
+ */ 
+#define SYNCE_SOCKET_NO_TIMEOUT  (-1)
+
 /*
  * Take ownership of an existing descriptor
  */
 void synce_socket_take_descriptor(SynceSocket* socket, int fd);
 
+/*
+ * Use non-blocking I/O, waiting for readiness with poll()
+ */
+bool synce_socket_set_nonblocking(SynceSocket* socket, bool nonblocking);
+
+/*
+ * Deadline in milliseconds for each read or write call
+ */
+void synce_socket_set_timeout(SynceSocket* socket, int timeoutInMilliseconds);
+int synce_socket_get_timeout(SynceSocket* socket);
+
 /*
  * Connect to remote service
  */
 bool synce_socket_connect(SynceSocket* socket, const char* host, uint16_t port);
 
+/*
+ * Connect to a Unix domain socket at path
+ */
+bool synce_socket_connect_local(SynceSocket* syncesock, const char* path);
+
 /*
  * Connect to proxy service (vdccm)
  */
@@ -86,11 +110,22 @@ bool synce_socket_close(SynceSocket* socket);
  */
 bool synce_socket_write(SynceSocket* socket, const void* data, size_t size);
 
+/*
+ * Write a number of buffers to socket, without joining them first
+ */
+bool synce_socket_writev(SynceSocket* socket, const struct iovec* iov, int iovcnt);
+
 /*
  * Read a number of bytes of data from a socket
  */
 bool synce_socket_read(SynceSocket* socket, void* data, size_t size);
 
+/*
+ * Read or write only what can be done without waiting
+ */
+bool synce_socket_read_some(SynceSocket* socket, void* data, size_t size, size_t* bytes_read);
+bool synce_socket_write_some(SynceSocket* socket, const void* data, size_t size, size_t* bytes_written);
+
 /** @brief Events detectable on a socket
  *
  * Expand as needed, just use event numbers 1,2,4,8,16,32,...
@@ -117,6 +152,12 @@ typedef enum _SocketEvents SocketEvents;
  * Wait for an event on a socket
  */
 bool synce_socket_wait(SynceSocket* socket, int timeoutInSeconds, short* events);
+bool synce_socket_wait_ms(SynceSocket* socket, int timeoutInMilliseconds, short* events);
+
+/*
+ * Wait for events on any of a number of sockets
+ */
+bool synce_socket_wait_many(SynceSocket** sockets, short* events, unsigned count, int timeoutInMilliseconds);
 
 /*
  * Get the number of bytes available on a socket
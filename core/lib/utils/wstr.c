@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #if HAVE_LOCALE_H
 #include <locale.h>
@@ -52,6 +53,9 @@
 
 #define INVALID_ICONV_HANDLE ((iconv_t)(-1))
 
+/* iconv descriptors kept open between calls */
+#define WSTR_ICONV_CACHE_SIZE 8
+
 #if HAVE_SETLOCALE && HAVE_NL_LANGINFO
 static char* current_codeset = NULL;
 
@@ -67,60 +71,403 @@ static char* get_current_codeset()
 }
 #endif
 
+typedef enum
+{
+  WSTR_DONE,
+  WSTR_NO_ROOM,
+  WSTR_SLOW,      /* outside what the fast path handles, use iconv */
+  WSTR_FAILED
+} WstrStatus;
+
+/*
+ * Hand written converter for a common case. Sizes are in bytes and
+ * without terminator, *used is set to the bytes written on WSTR_DONE.
+ */
+typedef WstrStatus (*WstrFast)(const unsigned char* in, size_t inbytes,
+    unsigned char* out, size_t outbytes, size_t* used);
+
+typedef struct
+{
+  const char* to;
+  const char* from;
+  iconv_t cd;
+} WstrIconv;
+
+static WstrIconv iconv_cache[WSTR_ICONV_CACHE_SIZE];
+static unsigned iconv_cache_count = 0;
+static pthread_mutex_t iconv_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Take a descriptor converting from one code to another out of the
+ * cache, or open a new one. Give it back with wstr_iconv_put().
+ */
+static iconv_t wstr_iconv_get(const char* to, const char* from)
+{
+  iconv_t cd = INVALID_ICONV_HANDLE;
+  unsigned i;
+
+  pthread_mutex_lock(&iconv_cache_mutex);
+  for (i = 0; i < iconv_cache_count; i++)
+  {
+    if (strcmp(iconv_cache[i].to, to) == 0 && strcmp(iconv_cache[i].from, from) == 0)
+    {
+      cd = iconv_cache[i].cd;
+      iconv_cache[i] = iconv_cache[--iconv_cache_count];
+      break;
+    }
+  }
+  pthread_mutex_unlock(&iconv_cache_mutex);
+
+  if (INVALID_ICONV_HANDLE == cd)
+  {
+    cd = iconv_open(to, from);
+    if (INVALID_ICONV_HANDLE == cd)
+      wstr_error("iconv_open(%s, %s) failed: %s", to, from, strerror(errno));
+  }
+
+  return cd;
+}
+
+/**
+ * Return a descriptor to the cache, closing it if the cache is full.
+ * The codes must outlive the cache; ours are literals or the codeset
+ * of the locale, which is never freed.
+ */
+static void wstr_iconv_put(iconv_t cd, const char* to, const char* from)
+{
+  /* back to the initial shift state for the next user */
+  iconv(cd, NULL, NULL, NULL, NULL);
+
+  pthread_mutex_lock(&iconv_cache_mutex);
+  if (iconv_cache_count < WSTR_ICONV_CACHE_SIZE)
+  {
+    iconv_cache[iconv_cache_count].to   = to;
+    iconv_cache[iconv_cache_count].from = from;
+    iconv_cache[iconv_cache_count].cd   = cd;
+    iconv_cache_count++;
+    cd = INVALID_ICONV_HANDLE;
+  }
+  pthread_mutex_unlock(&iconv_cache_mutex);
+
+  if (INVALID_ICONV_HANDLE != cd)
+    iconv_close(cd);
+}
+
+/*
+ * The fast paths below look at 8 characters at a time. The block loops
+ * are kept free of branches so the compiler can turn them into vector
+ * code; anything that is not plain ASCII drops to a per character loop
+ * for the rest of the block.
+ */
+
+#define WSTR_BLOCK 8
+
+/**
+ * UCS2 to UTF-8 for the basic multilingual plane; surrogates go to iconv
+ */
+static WstrStatus wstr_ucs2_to_utf8(const unsigned char* in, size_t inbytes,
+    unsigned char* out, size_t outbytes, size_t* used)
+{
+  size_t length = inbytes / 2;
+  size_t i = 0, o = 0, end, k;
+  unsigned bits, c;
+
+  while (i < length)
+  {
+    if (i + WSTR_BLOCK <= length && o + WSTR_BLOCK <= outbytes)
+    {
+      bits = 0;
+      for (k = 0; k < WSTR_BLOCK; k++)
+        bits |= (in[2*(i+k)] & 0x80) | in[2*(i+k)+1];
+
+      if (!bits)
+      {
+        for (k = 0; k < WSTR_BLOCK; k++)
+          out[o+k] = in[2*(i+k)];
+        i += WSTR_BLOCK;
+        o += WSTR_BLOCK;
+        continue;
+      }
+    }
+
+    end = i + WSTR_BLOCK < length ? i + WSTR_BLOCK : length;
+    for (; i < end; i++)
+    {
+      c = in[2*i] | (in[2*i+1] << 8);
+
+      if (c < 0x80)
+      {
+        if (o + 1 > outbytes)
+          return WSTR_NO_ROOM;
+        out[o++] = c;
+      }
+      else if (c < 0x800)
+      {
+        if (o + 2 > outbytes)
+          return WSTR_NO_ROOM;
+        out[o++] = 0xc0 | (c >> 6);
+        out[o++] = 0x80 | (c & 0x3f);
+      }
+      else if (c >= 0xd800 && c < 0xe000)
+        return WSTR_SLOW;
+      else
+      {
+        if (o + 3 > outbytes)
+          return WSTR_NO_ROOM;
+        out[o++] = 0xe0 | (c >> 12);
+        out[o++] = 0x80 | ((c >> 6) & 0x3f);
+        out[o++] = 0x80 | (c & 0x3f);
+      }
+    }
+  }
+
+  *used = o;
+  return WSTR_DONE;
+}
+
+/**
+ * UTF-8 to UCS2 for one to three byte sequences. Four byte sequences
+ * and malformed input go to iconv, which reports them as it always has.
+ */
+static WstrStatus wstr_utf8_to_ucs2(const unsigned char* in, size_t inbytes,
+    unsigned char* out, size_t outbytes, size_t* used)
+{
+  size_t i = 0, o = 0, end, k;
+  unsigned bits, c;
+
+  while (i < inbytes)
+  {
+    if (i + WSTR_BLOCK <= inbytes && o + 2 * WSTR_BLOCK <= outbytes)
+    {
+      bits = 0;
+      for (k = 0; k < WSTR_BLOCK; k++)
+        bits |= in[i+k];
+
+      if (!(bits & 0x80))
+      {
+        for (k = 0; k < WSTR_BLOCK; k++)
+        {
+          out[o+2*k]   = in[i+k];
+          out[o+2*k+1] = 0;
+        }
+        i += WSTR_BLOCK;
+        o += 2 * WSTR_BLOCK;
+        continue;
+      }
+    }
+
+    end = i + WSTR_BLOCK < inbytes ? i + WSTR_BLOCK : inbytes;
+    while (i < end)
+    {
+      if (o + 2 > outbytes)
+        return WSTR_NO_ROOM;
+
+      c = in[i];
+      if (c < 0x80)
+        i++;
+      else if (c >= 0xc2 && c < 0xe0)
+      {
+        if (i + 1 >= inbytes || (in[i+1] & 0xc0) != 0x80)
+          return WSTR_SLOW;
+        c = ((c & 0x1f) << 6) | (in[i+1] & 0x3f);
+        i += 2;
+      }
+      else if (c >= 0xe0 && c < 0xf0)
+      {
+        if (i + 2 >= inbytes || (in[i+1] & 0xc0) != 0x80 || (in[i+2] & 0xc0) != 0x80)
+          return WSTR_SLOW;
+        c = ((c & 0x0f) << 12) | ((in[i+1] & 0x3f) << 6) | (in[i+2] & 0x3f);
+        /* overlong forms and surrogates are not valid UTF-8 */
+        if (c < 0x800 || (c >= 0xd800 && c < 0xe000))
+          return WSTR_SLOW;
+        i += 3;
+      }
+      else
+        return WSTR_SLOW;
+
+      out[o++] = c & 0xff;
+      out[o++] = c >> 8;
+    }
+  }
+
+  *used = o;
+  return WSTR_DONE;
+}
+
+/**
+ * UCS2 to iso8859-1; characters it cannot hold go to iconv to fail there
+ */
+static WstrStatus wstr_ucs2_to_latin1(const unsigned char* in, size_t inbytes,
+    unsigned char* out, size_t outbytes, size_t* used)
+{
+  size_t length = inbytes / 2;
+  size_t i;
+  unsigned bits = 0;
+
+  if (length > outbytes)
+    return WSTR_NO_ROOM;
+
+  for (i = 0; i < length; i++)
+  {
+    bits |= in[2*i+1];
+    out[i] = in[2*i];
+  }
+
+  if (bits)
+    return WSTR_SLOW;
+
+  *used = length;
+  return WSTR_DONE;
+}
+
+/**
+ * iso8859-1 to UCS2, every byte is a character of its own
+ */
+static WstrStatus wstr_latin1_to_ucs2(const unsigned char* in, size_t inbytes,
+    unsigned char* out, size_t outbytes, size_t* used)
+{
+  size_t i;
+
+  if (inbytes * 2 > outbytes)
+    return WSTR_NO_ROOM;
+
+  for (i = 0; i < inbytes; i++)
+  {
+    out[2*i]   = in[i];
+    out[2*i+1] = 0;
+  }
+
+  *used = inbytes * 2;
+  return WSTR_DONE;
+}
+
+/**
+ * Convert inbytes of in from one code to another into out, trying the
+ * fast path first if there is one. Nothing is terminated here.
+ */
+static WstrStatus wstr_convert(const char* to, const char* from, WstrFast fast,
+    const char* in, size_t inbytes, char* out, size_t outbytes, size_t* used)
+{
+  WstrStatus status = WSTR_SLOW;
+  ICONV_CONST char* inbuf_iterator = (ICONV_CONST char*)in;
+  char* outbuf_iterator = out;
+  size_t inbytesleft = inbytes, outbytesleft = outbytes;
+  iconv_t cd;
+  int error;
+
+  if (fast)
+    status = fast((const unsigned char*)in, inbytes, (unsigned char*)out, outbytes, used);
+
+  if (WSTR_SLOW != status)
+    return status;
+
+  cd = wstr_iconv_get(to, from);
+  if (INVALID_ICONV_HANDLE == cd)
+    return WSTR_FAILED;
+
+  if (iconv(cd, &inbuf_iterator, &inbytesleft, &outbuf_iterator, &outbytesleft) == (size_t)-1)
+  {
+    error = errno;
+    if (E2BIG == error)
+      status = WSTR_NO_ROOM;
+    else
+    {
+      wstr_error("iconv(%s, %s) failed: %s, inbytesleft=%i, outbytesleft=%i",
+          to, from, strerror(error), inbytesleft, outbytesleft);
+      /* it would be nice to use rapi_trace_wstr here, but
+         that would cause recursion */
+      status = WSTR_FAILED;
+    }
+  }
+  else
+    status = WSTR_DONE;
+
+  wstr_iconv_put(cd, to, from);
+
+  *used = outbytes - outbytesleft;
+  return status;
+}
+
 
 /**
  * Convert a string from UCS2 to some other code
+ *
+ * max_char_size is the most bytes a character of the basic multilingual
+ * plane takes in code, so the first guess at the size is nearly always
+ * right.
  */
-static char* wstr_to_x(LPCWSTR inbuf, const char* code)
+static char* wstr_to_x(LPCWSTR inbuf, const char* code, WstrFast fast, size_t max_char_size)
 {
-	size_t length = wstr_strlen(inbuf), size = length;
-	size_t inbytesleft = length * 2, outbytesleft = size;
-	char* outbuf = malloc(outbytesleft+sizeof(char)), *tmp;
-  char* outbuf_iterator = outbuf;
-  ICONV_CONST char* inbuf_iterator = (ICONV_CONST char*)inbuf;
-	iconv_t cd = INVALID_ICONV_HANDLE;
+	size_t inbytes, size, used = 0;
+	char* outbuf = NULL, *tmp;
+	WstrStatus status;
 
 	if (!inbuf)
 	{
 		wstr_error("inbuf is NULL");
 		return NULL;
 	}
-	
-  cd = iconv_open(code, wstr_WIDE);
-	if (INVALID_ICONV_HANDLE == cd)
-	{
-		wstr_error("iconv_open(%s, %s) failed: %s", code, wstr_WIDE, strerror(errno));
-		return NULL;
-	}
-	
-	while (iconv(cd, &inbuf_iterator, &inbytesleft,
-		     &outbuf_iterator, &outbytesleft) == (size_t)-1) {
-		if (errno != E2BIG) {
-			wstr_error("iconv failed: inbytesleft=%i, outbytesleft="
-				   "%i", inbytesleft, outbytesleft);
-			/* it would be nice to use rapi_trace_wstr here, but
-			   that would cause recursion */
-			wstr_free_string(outbuf);
-			return NULL;
-		}
 
-		size += length;
+	inbytes = wstr_strlen(inbuf) * sizeof(WCHAR);
+	size = inbytes / sizeof(WCHAR) * max_char_size;
+
+	for (;;)
+	{
 		tmp = realloc(outbuf, size + 1);
 		if (tmp == NULL) {
 			wstr_error("realloc failed");
 			free(outbuf);
 			return NULL;
 		}
-		outbytesleft += length;
-		outbuf_iterator += tmp - outbuf;
 		outbuf = tmp;
+
+		status = wstr_convert(code, wstr_WIDE, fast, (const char*)inbuf, inbytes, outbuf, size, &used);
+		if (WSTR_NO_ROOM != status)
+			break;
+
+		size = size * 2 + 16;
 	}
 
-  iconv_close(cd);
+	if (WSTR_DONE != status)
+	{
+		wstr_free_string(outbuf);
+		return NULL;
+	}
 
-	*outbuf_iterator = '\0';
+	outbuf[used] = '\0';
 
-  return outbuf;
+	return outbuf;
+}
+
+/**
+ * Convert a string from UCS2 to some other code into a buffer of size
+ * bytes, terminator included
+ */
+static bool wstr_to_x_buffer(LPCWSTR inbuf, const char* code, WstrFast fast,
+		char* buffer, size_t size)
+{
+	size_t used = 0;
+	WstrStatus status;
+
+	if (!inbuf || !buffer || !size)
+	{
+		wstr_error("bad parameter: inbuf=%p, buffer=%p, size=%i", inbuf, buffer, size);
+		return false;
+	}
+
+	status = wstr_convert(code, wstr_WIDE, fast,
+			(const char*)inbuf, wstr_strlen(inbuf) * sizeof(WCHAR), buffer, size - 1, &used);
+
+	if (WSTR_DONE != status)
+	{
+		if (WSTR_NO_ROOM == status)
+			wstr_warning("buffer of %i bytes is too small", size);
+		*buffer = '\0';
+		return false;
+	}
+
+	buffer[used] = '\0';
+	return true;
 }
 
 /** @brief Convert string from UCS2 to iso8859-1
@@ -133,7 +480,7 @@ static char* wstr_to_x(LPCWSTR inbuf, const char* code)
  */ 
 char* wstr_to_ascii(LPCWSTR unicode)
 {
-	return wstr_to_x(unicode, wstr_ASCII);
+	return wstr_to_x(unicode, wstr_ASCII, wstr_ucs2_to_latin1, 1);
 }
 
 /** @brief Convert string from UCS2 to UTF8
@@ -146,7 +493,7 @@ char* wstr_to_ascii(LPCWSTR unicode)
  */ 
 char* wstr_to_utf8(LPCWSTR unicode)
 {
-	return wstr_to_x(unicode, wstr_UTF8);
+	return wstr_to_x(unicode, wstr_UTF8, wstr_ucs2_to_utf8, 3);
 }
 
 #if HAVE_SETLOCALE && HAVE_NL_LANGINFO
@@ -160,52 +507,109 @@ char* wstr_to_utf8(LPCWSTR unicode)
  */ 
 char* wstr_to_current(LPCWSTR unicode)
 {
-  return wstr_to_x(unicode, get_current_codeset());
+  return wstr_to_x(unicode, get_current_codeset(), NULL, 4);
 }
 #endif
 
+/** @brief Convert string from UCS2 to iso8859-1 into a buffer
+ * 
+ * Like wstr_to_ascii(), but the result is written to a buffer
+ * supplied by the caller instead of allocated.
+ * 
+ * @param[in] unicode UCS2 string to convert
+ * @param[out] buffer receives the string in ascii encoding
+ * @param[in] size size of buffer in bytes, including the terminator
+ * @return TRUE on success, FALSE on failure or if buffer is too small
+ */ 
+bool wstr_to_ascii_buffer(LPCWSTR unicode, char* buffer, size_t size)
+{
+	return wstr_to_x_buffer(unicode, wstr_ASCII, wstr_ucs2_to_latin1, buffer, size);
+}
+
+/** @brief Convert string from UCS2 to UTF8 into a buffer
+ * 
+ * Like wstr_to_utf8(), but the result is written to a buffer
+ * supplied by the caller instead of allocated.
+ * 
+ * @param[in] unicode UCS2 string to convert
+ * @param[out] buffer receives the string in UTF8 encoding
+ * @param[in] size size of buffer in bytes, including the terminator
+ * @return TRUE on success, FALSE on failure or if buffer is too small
+ */ 
+bool wstr_to_utf8_buffer(LPCWSTR unicode, char* buffer, size_t size)
+{
+	return wstr_to_x_buffer(unicode, wstr_UTF8, wstr_ucs2_to_utf8, buffer, size);
+}
+
 /**
- * Convert a string from iso8859-1 to UCS2
+ * Convert a string from some code to UCS2
  */
-static LPWSTR wstr_from_x(const char* inbuf, const char* code)
+static LPWSTR wstr_from_x(const char* inbuf, const char* code, WstrFast fast)
 {
-	size_t length = strlen(inbuf);
-	size_t inbytesleft = length, outbytesleft = (length+1)* 2;
-	ICONV_CONST char * inbuf_iterator = (ICONV_CONST char*)inbuf;
-	LPWSTR outbuf = malloc(outbytesleft+sizeof(WCHAR));
-	char *outbuf_iterator = (char*)outbuf;
-	size_t result;
-	iconv_t cd = INVALID_ICONV_HANDLE;
+	size_t length, used = 0;
+	LPWSTR outbuf;
+	WstrStatus status;
 
 	if (!inbuf)
 	{
 		wstr_error("inbuf is NULL");
 		return NULL;
 	}
-	
-	cd = iconv_open(wstr_WIDE, code);
-	if (INVALID_ICONV_HANDLE == cd)
+
+	/* none of our codes makes more than one UCS2 character of a byte */
+	length = strlen(inbuf);
+	outbuf = malloc((length + 1) * sizeof(WCHAR));
+	if (!outbuf)
 	{
-		wstr_error("iconv_open(%s, %s) failed: %s", code, wstr_WIDE, strerror(errno));
+		wstr_error("malloc failed");
 		return NULL;
 	}
 
-	result = iconv(cd, &inbuf_iterator, &inbytesleft, &outbuf_iterator, &outbytesleft);
-	iconv_close(cd);
-
-	if ((size_t)-1 == result)
+	status = wstr_convert(wstr_WIDE, code, fast, inbuf, length, (char*)outbuf, length * sizeof(WCHAR), &used);
+	if (WSTR_DONE != status)
 	{
-		wstr_error("iconv failed: inbytesleft=%i, outbytesleft=%i, inbuf=\"%s\"", 
-				inbytesleft, outbytesleft, inbuf);
+		if (WSTR_NO_ROOM == status)
+			wstr_error("conversion of \"%s\" from %s needs more than %i bytes", inbuf, code, length * sizeof(WCHAR));
 		wstr_free_string(outbuf);
 		return NULL;
 	}
 
-	*(LPWSTR)outbuf_iterator = '\0';
+	outbuf[used / sizeof(WCHAR)] = '\0';
 
 	return outbuf;
 }
 
+/**
+ * Convert a string from some code to UCS2 into a buffer of length
+ * characters, terminator included
+ */
+static bool wstr_from_x_buffer(const char* inbuf, const char* code, WstrFast fast,
+		LPWSTR buffer, size_t length)
+{
+	size_t used = 0;
+	WstrStatus status;
+
+	if (!inbuf || !buffer || !length)
+	{
+		wstr_error("bad parameter: inbuf=%p, buffer=%p, length=%i", inbuf, buffer, length);
+		return false;
+	}
+
+	status = wstr_convert(wstr_WIDE, code, fast,
+			inbuf, strlen(inbuf), (char*)buffer, (length - 1) * sizeof(WCHAR), &used);
+
+	if (WSTR_DONE != status)
+	{
+		if (WSTR_NO_ROOM == status)
+			wstr_warning("buffer of %i characters is too small", length);
+		*buffer = '\0';
+		return false;
+	}
+
+	buffer[used / sizeof(WCHAR)] = '\0';
+	return true;
+}
+
 /** @brief Convert string from iso8859-1 to UCS2
  * 
  * This function converts a string from iso8859-1 (ascii)
@@ -216,7 +620,7 @@ static LPWSTR wstr_from_x(const char* inbuf, const char* code)
  */ 
 LPWSTR wstr_from_ascii(const char* inbuf)
 {
-	return wstr_from_x(inbuf, wstr_ASCII);
+	return wstr_from_x(inbuf, wstr_ASCII, wstr_latin1_to_ucs2);
 }
 
 /** @brief Convert string from UTF8 to UCS2
@@ -229,7 +633,7 @@ LPWSTR wstr_from_ascii(const char* inbuf)
  */ 
 LPWSTR wstr_from_utf8(const char* inbuf)
 {
-	return wstr_from_x(inbuf, wstr_UTF8);
+	return wstr_from_x(inbuf, wstr_UTF8, wstr_utf8_to_ucs2);
 }
 
 #if HAVE_SETLOCALE && HAVE_NL_LANGINFO
@@ -243,10 +647,40 @@ LPWSTR wstr_from_utf8(const char* inbuf)
  */ 
 LPWSTR wstr_from_current(const char* inbuf)
 {
-  return wstr_from_x(inbuf, get_current_codeset());
+  return wstr_from_x(inbuf, get_current_codeset(), NULL);
 }
 #endif
 
+/** @brief Convert string from iso8859-1 to UCS2 into a buffer
+ * 
+ * Like wstr_from_ascii(), but the result is written to a buffer
+ * supplied by the caller instead of allocated.
+ * 
+ * @param[in] inbuf ascii string to convert
+ * @param[out] buffer receives the string in UCS2 encoding
+ * @param[in] length size of buffer in UCS2 characters, including the terminator
+ * @return TRUE on success, FALSE on failure or if buffer is too small
+ */ 
+bool wstr_from_ascii_buffer(const char* inbuf, LPWSTR buffer, size_t length)
+{
+	return wstr_from_x_buffer(inbuf, wstr_ASCII, wstr_latin1_to_ucs2, buffer, length);
+}
+
+/** @brief Convert string from UTF8 to UCS2 into a buffer
+ * 
+ * Like wstr_from_utf8(), but the result is written to a buffer
+ * supplied by the caller instead of allocated.
+ * 
+ * @param[in] inbuf UTF8 string to convert
+ * @param[out] buffer receives the string in UCS2 encoding
+ * @param[in] length size of buffer in UCS2 characters, including the terminator
+ * @return TRUE on success, FALSE on failure or if buffer is too small
+ */ 
+bool wstr_from_utf8_buffer(const char* inbuf, LPWSTR buffer, size_t length)
+{
+	return wstr_from_x_buffer(inbuf, wstr_UTF8, wstr_utf8_to_ucs2, buffer, length);
+}
+
 /** @brief Free a string returned by a conversion function
  * 
  * This function frees the memory allocated for a string
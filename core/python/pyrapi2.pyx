@@ -9,11 +9,22 @@ For more information, go to www.synce.org"""
 include "types.pxi"
 include "constants.pxi"
 import sys
+import io
 
 cdef extern from "Python.h":
     object PyString_FromStringAndSize ( char *, int )
+    char *PyString_AS_STRING(object string)
     object PyCObject_FromVoidPtr(void* cobj, void (*destr)(void *))
 
+    ctypedef struct Py_buffer:
+        void *buf
+        Py_ssize_t len
+    int PyObject_GetBuffer(object obj, Py_buffer *view, int flags) except -1
+    void PyBuffer_Release(Py_buffer *view)
+    enum:
+        PyBUF_SIMPLE
+        PyBUF_WRITABLE
+
 cdef extern from "stdlib.h":
     void *malloc(size_t size) nogil
     void *realloc(void *ptr, size_t size) nogil
@@ -965,10 +976,41 @@ class RegKey(object):
             raise RAPIError(retval)
 
 
+# largest read or write of a single RAPI call
+cdef enum:
+    FILE_CHUNK_SIZE = 1024*1024
+
+cdef BOOL _read_file(IRAPISession *session, HANDLE hFile, LPBYTE buffer, DWORD size, DWORD *total_read) nogil:
+    """Read into buffer until it is full or the end of the file is reached"""
+
+    cdef DWORD bytes_read
+    cdef DWORD bytes_to_read
+
+    total_read[0] = 0
+
+    while total_read[0] < size:
+        bytes_to_read = size - total_read[0]
+        if bytes_to_read > FILE_CHUNK_SIZE:
+            bytes_to_read = FILE_CHUNK_SIZE
+
+        if not IRAPISession_CeReadFile(session, hFile, buffer + total_read[0], bytes_to_read, &bytes_read, NULL):
+            return 0
+
+        if bytes_read == 0:
+            break
+
+        total_read[0] = total_read[0] + bytes_read
+
+    return 1
+
+
 class RAPIFile(object):
     """File object from a Windows Mobile Device
 
-    This attempts to be as close as possible to a standard Python file-like object"""
+    This attempts to be as close as possible to a standard Python file-like object.
+    It can also serve as the raw stream of io.BufferedReader and friends, see
+    RAPISession.file_open(). The GIL is released while waiting for the device,
+    so other threads can run, but a session is still for one thread at a time."""
 
     def __init__(self, RAPISession rapi_session not None, handle, filename, mode):
         self.rapi_session = rapi_session
@@ -979,118 +1021,216 @@ class RAPIFile(object):
     def __del__(self):
         self.close()
 
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.close()
+
+    def _get_closed(self):
+        return self.handle == 0
+
+    closed = property(_get_closed, doc="True once the file handle is closed.")
+
+    def readable(self):
+        return self.mode[0] == "r" or "+" in self.mode
+
+    def writable(self):
+        return self.mode[0] in "wa" or "+" in self.mode
+
+    def seekable(self):
+        return True
+
+    def flush(self):
+        pass
+
     def read(self, size=-1):
         """Read from the file.
 
         Reads at most size bytes from the file, or the complete file if size is not given"""
 
+        cdef HANDLE hFile
         cdef DWORD bytes_read
-        cdef DWORD bytes_to_read
-        cdef LPBYTE readbuf
+        cdef DWORD buffer_size
+        cdef DWORD total_read
         cdef LPBYTE buffer
+        cdef LPBYTE new_buffer
         cdef BOOL retval
-        cdef DWORD total_read
         cdef RAPISession session
+        cdef object returnstring
 
         session = self.rapi_session
+        hFile = self.handle
 
-        total_read = 0
+        if size == 0:
+            return ""
 
-        if size >= 0:
-            bytes_to_read = size
-        else:
-            bytes_to_read = 1024*1024
+        # a known size is read straight into the string returned
+        if size > 0:
+            returnstring = PyString_FromStringAndSize(NULL, size)
+            buffer = <LPBYTE> PyString_AS_STRING(returnstring)
+            buffer_size = size
+
+            with nogil:
+                retval = _read_file(session.rapi_conn, hFile, buffer, buffer_size, &total_read)
+
+            if retval == FALSE:
+                raise RAPIError(session=self.rapi_session)
+
+            if total_read < buffer_size:
+                returnstring = returnstring[:total_read]
 
-        readbuf = <LPBYTE> malloc (bytes_to_read)
-        buffer = NULL
+            return returnstring
 
+        buffer_size = FILE_CHUNK_SIZE
+        buffer = <LPBYTE> malloc (buffer_size)
+        if buffer == NULL:
+            raise MemoryError()
+
+        total_read = 0
         while TRUE:
-            retval = IRAPISession_CeReadFile(session.rapi_conn, self.handle, readbuf, bytes_to_read, &bytes_read, NULL)
+            with nogil:
+                retval = _read_file(session.rapi_conn, hFile, buffer + total_read, buffer_size - total_read, &bytes_read)
 
             if retval == FALSE:
-                free(readbuf)
                 free(buffer)
                 raise RAPIError(session=self.rapi_session)
 
-            if bytes_read == 0:
-                break
-
-            buffer = <LPBYTE> realloc(buffer, (total_read + bytes_read))
-            memcpy(buffer+(sizeof(BYTE)*total_read), readbuf, bytes_read)
             total_read = total_read + bytes_read
-
-            if bytes_read < bytes_to_read:
-                bytes_to_read = bytes_to_read - bytes_read
-                continue
-
-            if size >= 0:
+            if total_read < buffer_size:
                 break
 
-            bytes_to_read = 1024*1024
-
-        free(readbuf)
+            new_buffer = <LPBYTE> realloc (buffer, buffer_size * 2)
+            if new_buffer == NULL:
+                free(buffer)
+                raise MemoryError()
+            buffer = new_buffer
+            buffer_size = buffer_size * 2
 
-        cdef object returnstring
         returnstring = PyString_FromStringAndSize(<char *>buffer, total_read)
         free(buffer)
         return returnstring
 
 
+    def readinto(self, b):
+        """Read from the file into a writable buffer.
+
+        Fills b, a bytearray, memoryview or other object supporting the
+        buffer protocol, straight from the device without intermediate
+        copies. Returns the number of bytes read, which is less than
+        len(b) only at the end of the file."""
+
+        cdef HANDLE hFile
+        cdef Py_buffer view
+        cdef DWORD buffer_size
+        cdef DWORD total_read
+        cdef BOOL retval
+        cdef RAPISession session
+
+        session = self.rapi_session
+        hFile = self.handle
+
+        PyObject_GetBuffer(b, &view, PyBUF_WRITABLE)
+        buffer_size = view.len
+
+        with nogil:
+            retval = _read_file(session.rapi_conn, hFile, <LPBYTE>view.buf, buffer_size, &total_read)
+
+        PyBuffer_Release(&view)
+
+        if retval == FALSE:
+            raise RAPIError(session=self.rapi_session)
+
+        return total_read
+
+
     def write(self, buffer):
         """Write to the file.
 
-        Writes the given buffer to the file."""
+        Writes the given buffer, a string or any other object supporting
+        the buffer protocol, to the file."""
 
         cdef HANDLE hFile
-        cdef char * lpBuffer
+        cdef Py_buffer view
+        cdef LPBYTE lpBuffer
         cdef DWORD bytes_to_write
         cdef DWORD bytes_written
+        cdef DWORD total_written
         cdef BOOL retval
         cdef RAPISession session
 
         session = self.rapi_session
 
         hFile = self.handle
-        lpBuffer = buffer
-        bytes_to_write = len(buffer)
+        PyObject_GetBuffer(buffer, &view, PyBUF_SIMPLE)
+        lpBuffer = <LPBYTE>view.buf
+        total_written = 0
+        retval = 1
 
         with nogil:
-            retval = IRAPISession_CeWriteFile(session.rapi_conn, hFile, lpBuffer, bytes_to_write, &bytes_written, NULL)
+            while total_written < view.len:
+                bytes_to_write = view.len - total_written
+                if bytes_to_write > FILE_CHUNK_SIZE:
+                    bytes_to_write = FILE_CHUNK_SIZE
+
+                retval = IRAPISession_CeWriteFile(session.rapi_conn, hFile, lpBuffer + total_written, bytes_to_write, &bytes_written, NULL)
+                if not retval or bytes_written == 0:
+                    break
+
+                total_written = total_written + bytes_written
+
+        PyBuffer_Release(&view)
 
         if retval == FALSE:
             raise RAPIError(session=self.rapi_session)
 
-        return bytes_written
+        return total_written
 
     def tell(self):
         """Return the position of the file pointer."""
 
+        cdef HANDLE hFile
+        cdef DWORD move_method
         cdef DWORD retval
         cdef RAPISession session
 
         session = self.rapi_session
+        hFile = self.handle
+        move_method = FILE_CURRENT
 
-        retval = IRAPISession_CeSetFilePointer(session.rapi_conn, self.handle, 0, NULL, FILE_CURRENT);
+        with nogil:
+            retval = IRAPISession_CeSetFilePointer(session.rapi_conn, hFile, 0, NULL, move_method)
         if retval == 0xFFFFFFFF:
             raise RAPIError(session=self.rapi_session)
 
         return retval
 
     def seek(self, offset, whence=0):
-        """ Set the position of the file pointer."""
+        """ Set the position of the file pointer, and return the new position."""
 
+        cdef HANDLE hFile
+        cdef LONG distance
+        cdef DWORD move_method
         cdef DWORD retval
         cdef RAPISession session
 
         session = self.rapi_session
+        hFile = self.handle
+        distance = offset
+        move_method = whence
 
-        retval = IRAPISession_CeSetFilePointer(session.rapi_conn, self.handle, offset, NULL, whence);
+        with nogil:
+            retval = IRAPISession_CeSetFilePointer(session.rapi_conn, hFile, distance, NULL, move_method)
         if retval == 0xFFFFFFFF:
             raise RAPIError(session=self.rapi_session)
 
+        return retval
+
     def close(self):
         """Close the file handle."""
 
+        cdef HANDLE hFile
+        cdef BOOL retval
         cdef RAPISession session
 
         session = self.rapi_session
@@ -1098,7 +1238,9 @@ class RAPIFile(object):
         if self.handle == 0:
             return
 
-        retval = IRAPISession_CeCloseHandle(session.rapi_conn, self.handle)
+        hFile = self.handle
+        with nogil:
+            retval = IRAPISession_CeCloseHandle(session.rapi_conn, hFile)
         self.handle = 0
         if retval == FALSE:
             raise RAPIError(session=self.rapi_session)
@@ -1406,16 +1548,21 @@ cdef class RAPISession:
         return result
 
 
-    def file_open(self, filename, mode="r", shareMode=0, flagsAndAttributes=0):
+    def file_open(self, filename, mode="r", shareMode=0, flagsAndAttributes=0, buffering=0):
         """Open a file.
 
         Takes as an argument the name of the file, and the open mode. Returns
-        a RAPIFile object."""
+        a RAPIFile object, or if buffering is given, an io.BufferedReader,
+        io.BufferedWriter or io.BufferedRandom with buffers of that size
+        around it."""
 
         cdef LPWSTR filename_w
         cdef HANDLE fileHandle
         cdef DWORD desiredAccess
         cdef DWORD createDisposition
+        cdef DWORD dwShareMode
+        cdef DWORD dwFlagsAndAttributes
+        cdef DWORD moveMethod
         cdef DWORD seek_ret
 
         if mode[0] not in "rwa":
@@ -1436,18 +1583,33 @@ cdef class RAPISession:
         if "+" in mode:
             desiredAccess = desiredAccess|GENERIC_WRITE
 
-        fileHandle = IRAPISession_CeCreateFile(self.rapi_conn, filename_w, desiredAccess, shareMode, NULL, createDisposition, flagsAndAttributes, 0)
+        dwShareMode = shareMode
+        dwFlagsAndAttributes = flagsAndAttributes
+
+        with nogil:
+            fileHandle = IRAPISession_CeCreateFile(self.rapi_conn, filename_w, desiredAccess, dwShareMode, NULL, createDisposition, dwFlagsAndAttributes, 0)
 
         wstr_free_string(filename_w)
         if fileHandle == <HANDLE> -1:
             raise RAPIError(session=self)
 
         if mode[0] == "a":
-            seek_ret = IRAPISession_CeSetFilePointer(self.rapi_conn, fileHandle, 0, NULL, FILE_END)
+            moveMethod = FILE_END
+            with nogil:
+                seek_ret = IRAPISession_CeSetFilePointer(self.rapi_conn, fileHandle, 0, NULL, moveMethod)
             if seek_ret == 0xFFFFFFFF:
                 raise RAPIError(session=self)
 
-        return RAPIFile(self, fileHandle, filename, mode)
+        rapi_file = RAPIFile(self, fileHandle, filename, mode)
+        if buffering <= 0:
+            return rapi_file
+
+        if "+" in mode:
+            return io.BufferedRandom(rapi_file, buffering)
+        elif mode[0] == "r":
+            return io.BufferedReader(rapi_file, buffering)
+        else:
+            return io.BufferedWriter(rapi_file, buffering)
 
 
     #TODO: Provide the user with the processInformation
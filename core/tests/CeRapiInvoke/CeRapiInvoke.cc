@@ -3,6 +3,7 @@
 #include <iostream>
 #include <stdint.h>
 #include <string.h>
+#include <poll.h>
 
 #include "rapi.h"
 #include "pcommon.h"
@@ -183,6 +184,81 @@ exit:
   return success;
 }
 
+// the same exchange with the non-blocking calls, waiting with poll()
+static bool transfer_some(IRAPIStream* stream, BYTE* buffer, ULONG size, bool write)
+{
+  ULONG done = 0;
+
+  while (done < size)
+  {
+    ULONG count = 0;
+    HRESULT hr = write ?
+      IRAPIStream_WriteSome(stream, buffer + done, size - done, &count) :
+      IRAPIStream_ReadSome(stream, buffer + done, size - done, &count);
+
+    if ((HRESULT)E_PENDING == hr)
+    {
+      struct pollfd pfd;
+      pfd.fd = IRAPIStream_GetRawSocket(stream);
+      pfd.events = write ? POLLOUT : POLLIN;
+      pfd.revents = 0;
+      if (poll(&pfd, 1, 10000) <= 0)
+        return false;
+      continue;
+    }
+
+    if (hr != S_OK)
+      return false;
+
+    done += count;
+  }
+
+  return true;
+}
+
+static bool test_ping_stream_some()
+{
+  bool success = false;
+
+  IRAPIStream* stream = NULL;
+
+  DWORD le_size = htole32(PING_BUFFER_SIZE);
+  HRESULT hr = rapi_invoke(
+      REMOTE_DLL,
+      "PingStream",
+      sizeof(le_size), (BYTE*)&le_size,
+      0, NULL,
+      &stream,
+      0);
+  if (hr != S_OK)
+    return false;
+
+  BYTE input_buffer[PING_BUFFER_SIZE];
+  BYTE output_buffer[PING_BUFFER_SIZE];
+
+  for (unsigned i = 0; i < PING_BUFFER_SIZE; i++)
+    input_buffer[i] = i;
+
+  if (!transfer_some(stream, input_buffer, PING_BUFFER_SIZE, true))
+  {
+    cerr << "IRAPIStream_WriteSome failed" << endl;
+    goto exit;
+  }
+
+  if (!transfer_some(stream, output_buffer, PING_BUFFER_SIZE, false))
+  {
+    cerr << "IRAPIStream_ReadSome failed" << endl;
+    goto exit;
+  }
+
+  success =
+    memcmp(input_buffer, output_buffer, PING_BUFFER_SIZE) == 0;
+
+exit:
+  IRAPIStream_Release(stream);
+  return success;
+}
+
 static bool test_last_error()
 {
   DWORD last_error = ERROR_INVALID_PARAMETER;
@@ -281,6 +357,14 @@ int main()
   }
     cout << "ok" << endl;
 
+  cout << "Testing \"ping\" by non-blocking stream... ";
+  if (!test_ping_stream_some())
+  {
+    cerr << "PingStream failed" << endl;
+    ++error_count;
+  } else
+    cout << "ok" << endl;
+
 exit:
 #if 1
   if (!CeDeleteFile(remote_dll))
@@ -0,0 +1,232 @@
+/* $Id$ */
+#undef __STRICT_ANSI__
+#define _GNU_SOURCE
+#include "rapi_emulator.h"
+#include <synce_log.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+/*
+ * Serve an emulated device until killed. The SYNCE_EMULATOR value to
+ * reach it is printed on stdout, for example
+ *
+ *   rapi-emulator -l rndis > emulator.env &
+ *   . ./emulator.env
+ *   pls
+ */
+
+static void show_usage(const char* name)
+{
+  fprintf(stderr,
+      "Syntax:\n"
+      "\n"
+      "\t%s [-d LEVEL] [-p PORT | -u PATH] [-r] [-l LINK] [-L USEC] [-b BYTES] [-h]\n"
+      "\n"
+      "\t-d LEVEL     Set debug log level\n"
+      "\t                0 - No logging (default)\n"
+      "\t                1 - Errors only\n"
+      "\t                2 - Errors and warnings\n"
+      "\t                3 - Everything\n"
+      "\t-h           Show this help message\n"
+      "\t-p PORT      Listen on 127.0.0.1:PORT, 0 picks a free port (default)\n"
+      "\t-u PATH      Listen on a Unix domain socket instead\n"
+      "\t-r           Speak RAPI1 with the database calls instead of RAPI2\n"
+      "\t-l LINK      Mimic a link: none (default), rndis or serial\n"
+      "\t-L USEC      Latency added to each call, overrides the link\n"
+      "\t-b BYTES     Bandwidth in bytes per second, overrides the link\n",
+      name);
+}
+
+typedef struct _Parameters
+{
+  int port;
+  const char* path;
+  bool rapi1;
+  unsigned latency_us;
+  unsigned bytes_per_sec;
+} Parameters;
+
+static bool handle_parameters(int argc, char** argv, Parameters* parameters)
+{
+  int c;
+  int log_level = SYNCE_LOG_LEVEL_LOWEST;
+  const RapiEmulatorLink* link;
+  long latency = -1;
+  long bandwidth = -1;
+
+  memset(parameters, 0, sizeof(Parameters));
+
+  while ((c = getopt(argc, argv, "b:d:hl:L:p:ru:")) != -1)
+  {
+    switch (c)
+    {
+      case 'b':
+        bandwidth = atol(optarg);
+        break;
+
+      case 'd':
+        log_level = atoi(optarg);
+        break;
+
+      case 'l':
+        if ((link = rapi_emulator_find_link(optarg)) == NULL)
+        {
+          fprintf(stderr, "%s: unknown link '%s'\n", argv[0], optarg);
+          return false;
+        }
+        parameters->latency_us = link->latency_us;
+        parameters->bytes_per_sec = link->bytes_per_sec;
+        break;
+
+      case 'L':
+        latency = atol(optarg);
+        break;
+
+      case 'p':
+        parameters->port = atoi(optarg);
+        break;
+
+      case 'r':
+        parameters->rapi1 = true;
+        break;
+
+      case 'u':
+        parameters->path = optarg;
+        break;
+
+      case 'h':
+      default:
+        show_usage(argv[0]);
+        return false;
+    }
+  }
+
+  if (latency >= 0)
+    parameters->latency_us = latency;
+  if (bandwidth >= 0)
+    parameters->bytes_per_sec = bandwidth;
+
+  synce_log_set_level(log_level);
+
+  return true;
+}
+
+static SynceSocket* listen_local(const char* path)
+{
+  SynceSocket* server = synce_socket_new();
+  struct sockaddr_un address;
+  int fd;
+
+  if (!server)
+    return NULL;
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+  unlink(path);
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+      bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+      listen(fd, 5) < 0)
+  {
+    fprintf(stderr, "Failed to listen on %s: %s\n", path, strerror(errno));
+    if (fd >= 0)
+      close(fd);
+    synce_socket_free(server);
+    return NULL;
+  }
+
+  synce_socket_take_descriptor(server, fd);
+  return server;
+}
+
+static SynceSocket* listen_tcp(int* port)
+{
+  SynceSocket* server = synce_socket_new();
+  struct sockaddr_in address;
+  socklen_t length = sizeof(address);
+
+  if (!server || !synce_socket_listen(server, "127.0.0.1", *port))
+  {
+    fprintf(stderr, "Failed to listen on port %i\n", *port);
+    synce_socket_free(server);
+    return NULL;
+  }
+
+  if (getsockname(synce_socket_get_descriptor(server), (struct sockaddr*)&address, &length) == 0)
+    *port = ntohs(address.sin_port);
+
+  return server;
+}
+
+int main(int argc, char** argv)
+{
+  int result = 1;
+  Parameters parameters;
+  RapiEmulator* emulator = NULL;
+  SynceSocket* server = NULL;
+  char* address = NULL;
+  char* value = NULL;
+
+  if (!handle_parameters(argc, argv, &parameters))
+    goto exit;
+
+  if ((emulator = rapi_emulator_new(parameters.rapi1)) == NULL)
+  {
+    fprintf(stderr, "%s: Failed to create the emulator\n", argv[0]);
+    goto exit;
+  }
+
+  rapi_emulator_set_link(emulator, parameters.latency_us, parameters.bytes_per_sec);
+
+  if (parameters.path)
+  {
+    if ((server = listen_local(parameters.path)) == NULL)
+      goto exit;
+    address = strdup(parameters.path);
+  }
+  else
+  {
+    if ((server = listen_tcp(&parameters.port)) == NULL)
+      goto exit;
+    if (asprintf(&address, "127.0.0.1:%i", parameters.port) < 0)
+      address = NULL;
+  }
+
+  if (!address || (value = rapi_emulator_env_value(emulator, address)) == NULL)
+    goto exit;
+
+  printf("SYNCE_EMULATOR=%s; export SYNCE_EMULATOR\n", value);
+  fflush(stdout);
+
+  for (;;)
+  {
+    SynceSocket* client = synce_socket_accept(server, NULL);
+
+    if (!client)
+    {
+      if (EINTR == errno)
+        continue;
+      break;
+    }
+
+    if (!rapi_emulator_serve_async(emulator, client))
+      synce_socket_free(client);
+  }
+
+exit:
+  free(value);
+  free(address);
+  if (server)
+    synce_socket_free(server);
+  if (parameters.path)
+    unlink(parameters.path);
+  rapi_emulator_free(emulator);
+  return result;
+}
@@ -0,0 +1,2692 @@
+/* $Id$ */
+#undef __STRICT_ANSI__
+#define _GNU_SOURCE
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "rapi_emulator.h"
+#include "rapi_buffer.h"
+#include <synce_log.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define EMULATOR_FIRST_HANDLE   0x100
+#define EMULATOR_FIRST_OID      0x10000
+
+/* what CeGetVersionEx reports, and the client uses to pick a protocol */
+#define RAPI1_OS_MAJOR    4
+#define RAPI1_OS_MINOR    20
+#define RAPI1_OS_BUILD    1081
+#define RAPI2_OS_MAJOR    5
+#define RAPI2_OS_MINOR    2
+#define RAPI2_OS_BUILD    21140
+
+#define FILE_SEPARATORS   "\\/"
+#define KEY_SEPARATORS    "\\"
+
+/* a CEPROPVAL on the wire, with 32 bit offsets instead of pointers */
+#define WIRE_PROPVAL_SIZE 16
+
+#define ALIGN4(value)     (((value) + 3) & ~3)
+
+static const RapiEmulatorLink links[] =
+{
+  { "none",   0,     0      },
+  /* USB RNDIS on a typical Windows Mobile 5/6 device */
+  { "rndis",  2000,  800000 },
+  /* 115200 baud serial cable with PPP */
+  { "serial", 30000, 11000  },
+  { NULL,     0,     0      }
+};
+
+/*
+ * A file or directory, or a registry key
+ */
+typedef struct _EmulatorValue
+{
+  char* name;
+  DWORD type;
+  unsigned char* data;
+  DWORD size;
+} EmulatorValue;
+
+typedef struct _EmulatorNode EmulatorNode;
+
+struct _EmulatorNode
+{
+  char* name;
+  EmulatorNode* parent;
+  /* sorted by name, ignoring case */
+  EmulatorNode** children;
+  unsigned child_count;
+  unsigned child_alloc;
+  /* open handles; a deleted node lives on until the last is closed */
+  unsigned refs;
+  bool deleted;
+
+  DWORD attributes;
+  FILETIME creation_time;
+  FILETIME access_time;
+  FILETIME write_time;
+  CEOID oid;
+  unsigned char* data;
+  size_t size;
+  size_t alloc;
+
+  EmulatorValue* values;
+  unsigned value_count;
+};
+
+/*
+ * A record keeps its properties in the wire format, CEPROPVALs with
+ * offsets into the data that follows them
+ */
+typedef struct _EmulatorRecord
+{
+  CEOID oid;
+  WORD prop_count;
+  DWORD size;
+  unsigned char* data;
+} EmulatorRecord;
+
+typedef struct _EmulatorDatabase
+{
+  CEOID oid;
+  char* name;
+  DWORD type;
+  DWORD flags;
+  WORD sort_count;
+  SORTORDERSPEC sort[CEDB_MAXSORTORDER];
+  FILETIME modified;
+  EmulatorRecord* records;
+  unsigned record_count;
+  unsigned record_alloc;
+  unsigned refs;
+  bool deleted;
+} EmulatorDatabase;
+
+typedef enum _EmulatorHandleType
+{
+  HANDLE_FREE = 0,
+  HANDLE_FILE,
+  HANDLE_FIND,
+  HANDLE_KEY,
+  HANDLE_DATABASE,
+  HANDLE_DATABASE_ENUM
+} EmulatorHandleType;
+
+typedef struct _EmulatorHandle
+{
+  EmulatorHandleType type;
+  EmulatorNode* node;
+  EmulatorDatabase* database;
+  /* file offset, next child to match, or current record */
+  uint64_t position;
+  DWORD flags;
+  char* pattern;
+} EmulatorHandle;
+
+/*
+ * A single CEDB property while records are checked or merged
+ */
+typedef struct _EmulatorProp
+{
+  uint32_t propid;
+  uint16_t len;
+  uint16_t flags;
+  unsigned char value[8];
+  const unsigned char* data;
+  uint32_t data_size;
+} EmulatorProp;
+
+struct _RapiEmulator
+{
+  bool rapi1;
+  pthread_mutex_t mutex;
+  pthread_cond_t idle;
+  unsigned connections;
+
+  unsigned latency_us;
+  unsigned bytes_per_sec;
+  unsigned calls;
+
+  CEOID next_oid;
+  EmulatorNode* files;
+  EmulatorNode* registry[4];
+
+  EmulatorDatabase** databases;
+  unsigned database_count;
+  unsigned database_alloc;
+
+  EmulatorHandle* handles;
+  unsigned handle_count;
+};
+
+typedef void (*EmulatorCommand)(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply);
+
+typedef struct _EmulatorCommandEntry
+{
+  uint32_t id;
+  const char* name;
+  EmulatorCommand function;
+} EmulatorCommandEntry;
+
+
+/*
+ * Reading requests; a short request reads as zeros and empty strings
+ */
+
+static uint32_t get_uint32(RapiBuffer* request)
+{
+  uint32_t value = 0;
+  rapi_buffer_read_uint32(request, &value);
+  return value;
+}
+
+static uint16_t get_uint16(RapiBuffer* request)
+{
+  uint16_t value = 0;
+  rapi_buffer_read_uint16(request, &value);
+  return value;
+}
+
+static char* get_wide(RapiBuffer* request, size_t chars)
+{
+  WCHAR* wide;
+  char* result = NULL;
+
+  if (!chars || chars > 0x10000)
+    return NULL;
+
+  if ((wide = calloc(chars + 1, sizeof(WCHAR))) == NULL)
+    return NULL;
+
+  if (rapi_buffer_read_data(request, wide, chars * sizeof(WCHAR)))
+    result = wstr_to_utf8(wide);
+
+  free(wide);
+  return result;
+}
+
+/* as written by rapi2_buffer_write_string(), size in bytes */
+static char* get_string2(RapiBuffer* request)
+{
+  return get_wide(request, get_uint32(request) / sizeof(WCHAR));
+}
+
+/* as written by rapi_buffer_write_string(), size in characters */
+static char* get_string1(RapiBuffer* request)
+{
+  if (get_uint32(request) != 1)
+    return NULL;
+  return get_wide(request, get_uint32(request));
+}
+
+/*
+ * Writing replies
+ */
+
+/* as read by rapi_buffer_read_string(), length without terminator */
+static void put_string(RapiBuffer* reply, const char* utf8)
+{
+  WCHAR* wide = wstr_from_utf8(utf8 ? utf8 : "");
+  uint32_t length = wide ? wstr_strlen(wide) : 0;
+
+  rapi_buffer_write_uint32(reply, length);
+  if (length)
+    rapi_buffer_write_data(reply, wide, length * sizeof(WCHAR));
+  wstr_free_string(wide);
+}
+
+static void put_filetime(RapiBuffer* reply, const FILETIME* filetime)
+{
+  rapi_buffer_write_uint32(reply, filetime->dwLowDateTime);
+  rapi_buffer_write_uint32(reply, filetime->dwHighDateTime);
+}
+
+/* overwrite a uint32 written earlier at offset */
+static void patch_uint32(RapiBuffer* reply, size_t offset, uint32_t value)
+{
+  uint32_t le = htole32(value);
+  memcpy(rapi_buffer_get_raw(reply) + offset, &le, sizeof(le));
+}
+
+static size_t wide_length(const char* utf8)
+{
+  WCHAR* wide = wstr_from_utf8(utf8 ? utf8 : "");
+  size_t length = wide ? wstr_strlen(wide) : 0;
+  wstr_free_string(wide);
+  return length;
+}
+
+static void now_filetime(FILETIME* filetime)
+{
+  filetime_from_unix_time(time(NULL), filetime);
+}
+
+
+/*
+ * Files, directories and registry keys
+ */
+
+static EmulatorNode* node_new(const char* name, DWORD attributes)
+{
+  EmulatorNode* node = calloc(1, sizeof(EmulatorNode));
+
+  if (!node)
+    return NULL;
+
+  node->name = strdup(name);
+  node->attributes = attributes;
+  now_filetime(&node->creation_time);
+  node->access_time = node->write_time = node->creation_time;
+  return node;
+}
+
+static void node_free(EmulatorNode* node)
+{
+  unsigned i;
+
+  for (i = 0; i < node->child_count; i++)
+  {
+    EmulatorNode* child = node->children[i];
+
+    child->parent = NULL;
+    child->deleted = true;
+    if (0 == child->refs)
+      node_free(child);
+  }
+
+  for (i = 0; i < node->value_count; i++)
+  {
+    free(node->values[i].name);
+    free(node->values[i].data);
+  }
+
+  free(node->values);
+  free(node->children);
+  free(node->data);
+  free(node->name);
+  free(node);
+}
+
+static bool node_is_directory(EmulatorNode* node)
+{
+  return node && (node->attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+/* index of name among the children, or where it would go */
+static unsigned node_search(EmulatorNode* parent, const char* name, bool* found)
+{
+  unsigned low = 0;
+  unsigned high = parent->child_count;
+
+  *found = false;
+  while (low < high)
+  {
+    unsigned middle = (low + high) / 2;
+    int compare = strcasecmp(parent->children[middle]->name, name);
+
+    if (0 == compare)
+    {
+      *found = true;
+      return middle;
+    }
+
+    if (compare < 0)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  return low;
+}
+
+static EmulatorNode* node_child(EmulatorNode* parent, const char* name)
+{
+  bool found;
+  unsigned index = node_search(parent, name, &found);
+  return found ? parent->children[index] : NULL;
+}
+
+static bool node_attach(EmulatorNode* parent, EmulatorNode* node)
+{
+  bool found;
+  unsigned index = node_search(parent, node->name, &found);
+
+  if (found)
+    return false;
+
+  if (parent->child_count == parent->child_alloc)
+  {
+    unsigned alloc = parent->child_alloc ? parent->child_alloc * 2 : 8;
+    EmulatorNode** children = realloc(parent->children, alloc * sizeof(EmulatorNode*));
+
+    if (!children)
+      return false;
+
+    parent->children = children;
+    parent->child_alloc = alloc;
+  }
+
+  memmove(parent->children + index + 1, parent->children + index,
+      (parent->child_count - index) * sizeof(EmulatorNode*));
+  parent->children[index] = node;
+  parent->child_count++;
+  node->parent = parent;
+  return true;
+}
+
+static void node_detach(EmulatorNode* node)
+{
+  EmulatorNode* parent = node->parent;
+  bool found;
+  unsigned index;
+
+  if (!parent)
+    return;
+
+  index = node_search(parent, node->name, &found);
+  if (found)
+  {
+    parent->child_count--;
+    memmove(parent->children + index, parent->children + index + 1,
+        (parent->child_count - index) * sizeof(EmulatorNode*));
+  }
+
+  node->parent = NULL;
+}
+
+/* remove node from the tree, freeing it once no handle refers to it */
+static void node_delete(EmulatorNode* node)
+{
+  node_detach(node);
+  node->deleted = true;
+  if (0 == node->refs)
+    node_free(node);
+}
+
+static void node_unref(EmulatorNode* node)
+{
+  if (0 == --node->refs && node->deleted)
+    node_free(node);
+}
+
+static EmulatorNode* node_lookup(EmulatorNode* root, const char* path, const char* separators)
+{
+  EmulatorNode* node = root;
+  char* copy;
+  char* part;
+  char* save = NULL;
+
+  if (!path)
+    return root;
+
+  if ((copy = strdup(path)) == NULL)
+    return NULL;
+
+  for (part = strtok_r(copy, separators, &save); part && node; part = strtok_r(NULL, separators, &save))
+    node = node_child(node, part);
+
+  free(copy);
+  return node;
+}
+
+/* the node that would hold path, and the last part of path */
+static EmulatorNode* node_lookup_parent(EmulatorNode* root, const char* path,
+    const char* separators, const char** name)
+{
+  const char* last = NULL;
+  const char* p;
+  EmulatorNode* parent;
+  char* directory;
+
+  for (p = path; *p; p++)
+    if (strchr(separators, *p))
+      last = p;
+
+  if (!last)
+  {
+    *name = path;
+    return root;
+  }
+
+  *name = last + 1;
+  if ((directory = strndup(path, last - path)) == NULL)
+    return NULL;
+
+  parent = node_lookup(root, directory, separators);
+  free(directory);
+  return parent;
+}
+
+static bool node_is_inside(EmulatorNode* node, EmulatorNode* ancestor)
+{
+  for (; node; node = node->parent)
+    if (node == ancestor)
+      return true;
+  return false;
+}
+
+static EmulatorNode* file_new(RapiEmulator* emulator, EmulatorNode* parent, const char* name, DWORD attributes)
+{
+  EmulatorNode* node;
+
+  if (!*name || (node = node_new(name, attributes)) == NULL)
+    return NULL;
+
+  node->oid = emulator->next_oid++;
+  if (!node_attach(parent, node))
+  {
+    node_free(node);
+    return NULL;
+  }
+
+  return node;
+}
+
+static bool file_resize(EmulatorNode* node, size_t size)
+{
+  if (size > node->alloc)
+  {
+    size_t alloc = node->alloc ? node->alloc : 4096;
+    unsigned char* data;
+
+    while (alloc < size)
+      alloc *= 2;
+
+    if ((data = realloc(node->data, alloc)) == NULL)
+      return false;
+
+    node->data = data;
+    node->alloc = alloc;
+  }
+
+  if (size > node->size)
+    memset(node->data + node->size, 0, size - node->size);
+
+  node->size = size;
+  now_filetime(&node->write_time);
+  return true;
+}
+
+static bool file_copy_data(EmulatorNode* target, EmulatorNode* source)
+{
+  target->size = 0;
+  if (!file_resize(target, source->size))
+    return false;
+
+  memcpy(target->data, source->data, source->size);
+  return true;
+}
+
+static bool name_matches(const char* pattern, const char* name)
+{
+  /* *.* also matches names without a dot */
+  if (0 == strcmp(pattern, "*.*"))
+    return true;
+  return 0 == fnmatch(pattern, name, FNM_CASEFOLD | FNM_NOESCAPE);
+}
+
+static bool find_wanted(EmulatorNode* node, const char* pattern, DWORD flags)
+{
+  if ((flags & FAF_FOLDERS_ONLY) && !node_is_directory(node))
+    return false;
+  if ((flags & FAF_ATTRIB_NO_HIDDEN) && (node->attributes & FILE_ATTRIBUTE_HIDDEN))
+    return false;
+  return name_matches(pattern, node->name);
+}
+
+static DWORD find_attributes(EmulatorNode* node, DWORD flags)
+{
+  DWORD attributes = node->attributes;
+
+  if ((flags & FAF_ATTRIB_CHILDREN) && node->child_count)
+    attributes |= FILE_ATTRIBUTE_HAS_CHILDREN;
+  return attributes;
+}
+
+/* a whole CE_FIND_DATA, as rapi_buffer_read_find_data() expects */
+static void put_find_data(RapiBuffer* reply, EmulatorNode* node)
+{
+  WCHAR name[MAX_PATH];
+  WCHAR* wide;
+
+  rapi_buffer_write_uint32(reply, node ? sizeof(CE_FIND_DATA) : 0);
+  if (!node)
+    return;
+
+  memset(name, 0, sizeof(name));
+  if ((wide = wstr_from_utf8(node->name)) != NULL)
+  {
+    size_t length = wstr_strlen(wide);
+
+    if (length >= MAX_PATH)
+      length = MAX_PATH - 1;
+    memcpy(name, wide, length * sizeof(WCHAR));
+    wstr_free_string(wide);
+  }
+
+  rapi_buffer_write_uint32(reply, node->attributes);
+  put_filetime(reply, &node->creation_time);
+  put_filetime(reply, &node->access_time);
+  put_filetime(reply, &node->write_time);
+  rapi_buffer_write_uint32(reply, (uint64_t)node->size >> 32);
+  rapi_buffer_write_uint32(reply, (uint32_t)node->size);
+  rapi_buffer_write_uint32(reply, node->oid);
+  rapi_buffer_write_data(reply, name, sizeof(name));
+}
+
+/* the fields of one CeFindAllFiles entry, see rapi_buffer_read_find_data_array() */
+static void put_find_fields(RapiBuffer* reply, EmulatorNode* node, DWORD flags)
+{
+  WCHAR* wide = NULL;
+  uint32_t name_size = 0;
+
+  if (flags & FAF_NAME)
+  {
+    wide = wstr_from_utf8(node->name);
+    name_size = wide ? (wstr_strlen(wide) + 1) * sizeof(WCHAR) : 0;
+    rapi_buffer_write_uint32(reply, name_size);
+  }
+
+  if (flags & FAF_ATTRIBUTES)
+    rapi_buffer_write_uint32(reply, find_attributes(node, flags));
+  if (flags & FAF_CREATION_TIME)
+    put_filetime(reply, &node->creation_time);
+  if (flags & FAF_LASTACCESS_TIME)
+    put_filetime(reply, &node->access_time);
+  if (flags & FAF_LASTWRITE_TIME)
+    put_filetime(reply, &node->write_time);
+  if (flags & FAF_SIZE_HIGH)
+    rapi_buffer_write_uint32(reply, (uint64_t)node->size >> 32);
+  if (flags & FAF_SIZE_LOW)
+    rapi_buffer_write_uint32(reply, (uint32_t)node->size);
+  if (flags & FAF_OID)
+    rapi_buffer_write_uint32(reply, node->oid);
+
+  if (flags & FAF_NAME)
+  {
+    if (wide)
+      rapi_buffer_write_data(reply, wide, name_size);
+    wstr_free_string(wide);
+  }
+}
+
+
+/*
+ * Handles
+ */
+
+static HANDLE handle_new(RapiEmulator* emulator, EmulatorHandleType type)
+{
+  unsigned i;
+
+  for (i = 0; i < emulator->handle_count; i++)
+    if (HANDLE_FREE == emulator->handles[i].type)
+      break;
+
+  if (i == emulator->handle_count)
+  {
+    unsigned count = emulator->handle_count ? emulator->handle_count * 2 : 16;
+    EmulatorHandle* handles = realloc(emulator->handles, count * sizeof(EmulatorHandle));
+
+    if (!handles)
+      return INVALID_HANDLE_VALUE;
+
+    memset(handles + emulator->handle_count, 0,
+        (count - emulator->handle_count) * sizeof(EmulatorHandle));
+    emulator->handles = handles;
+    emulator->handle_count = count;
+  }
+
+  memset(&emulator->handles[i], 0, sizeof(EmulatorHandle));
+  emulator->handles[i].type = type;
+  return EMULATOR_FIRST_HANDLE + i;
+}
+
+static EmulatorHandle* handle_get(RapiEmulator* emulator, HANDLE handle, EmulatorHandleType type)
+{
+  EmulatorHandle* entry;
+
+  if (handle < EMULATOR_FIRST_HANDLE || handle - EMULATOR_FIRST_HANDLE >= emulator->handle_count)
+    return NULL;
+
+  entry = &emulator->handles[handle - EMULATOR_FIRST_HANDLE];
+  if (HANDLE_FREE == entry->type || (type != HANDLE_FREE && entry->type != type))
+    return NULL;
+
+  return entry;
+}
+
+static HANDLE handle_open_node(RapiEmulator* emulator, EmulatorHandleType type, EmulatorNode* node)
+{
+  HANDLE handle = handle_new(emulator, type);
+
+  if (handle != INVALID_HANDLE_VALUE)
+  {
+    emulator->handles[handle - EMULATOR_FIRST_HANDLE].node = node;
+    node->refs++;
+  }
+
+  return handle;
+}
+
+static void database_unref(EmulatorDatabase* database);
+
+static bool handle_close(RapiEmulator* emulator, HANDLE handle)
+{
+  EmulatorHandle* entry = handle_get(emulator, handle, HANDLE_FREE);
+
+  if (!entry)
+    return false;
+
+  if (entry->node)
+    node_unref(entry->node);
+  if (entry->database)
+    database_unref(entry->database);
+  free(entry->pattern);
+
+  memset(entry, 0, sizeof(EmulatorHandle));
+  return true;
+}
+
+
+/*
+ * RAPI2 file access
+ */
+
+static void file_create(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  char* path = get_string2(request);
+  DWORD access = get_uint32(request);
+  DWORD share_mode SYNCE_UNUSED = get_uint32(request);
+  DWORD disposition = get_uint32(request);
+  DWORD attributes = get_uint32(request) & 0xffff;
+  EmulatorNode* parent = NULL;
+  EmulatorNode* node = NULL;
+  const char* name = NULL;
+  DWORD error = ERROR_SUCCESS;
+  HANDLE handle = INVALID_HANDLE_VALUE;
+
+  if (path)
+    parent = node_lookup_parent(emulator->files, path, FILE_SEPARATORS, &name);
+
+  if (!node_is_directory(parent))
+    error = ERROR_PATH_NOT_FOUND;
+  else if ((node = node_child(parent, name)) != NULL && node_is_directory(node))
+    error = ERROR_ACCESS_DENIED;
+  else
+  {
+    if (0 == (attributes & ~FILE_ATTRIBUTE_NORMAL))
+      attributes = FILE_ATTRIBUTE_ARCHIVE;
+
+    switch (disposition)
+    {
+      case CREATE_NEW:
+        if (node)
+          error = ERROR_FILE_EXISTS;
+        else if (!(node = file_new(emulator, parent, name, attributes)))
+          error = ERROR_INVALID_NAME;
+        break;
+
+      case CREATE_ALWAYS:
+      case OPEN_ALWAYS:
+        if (node)
+        {
+          if (CREATE_ALWAYS == disposition)
+            file_resize(node, 0);
+          error = ERROR_ALREADY_EXISTS;
+        }
+        else if (!(node = file_new(emulator, parent, name, attributes)))
+          error = ERROR_INVALID_NAME;
+        break;
+
+      case OPEN_EXISTING:
+      case TRUNCATE_EXISTING:
+        if (!node)
+          error = ERROR_FILE_NOT_FOUND;
+        else if (TRUNCATE_EXISTING == disposition)
+          file_resize(node, 0);
+        break;
+
+      default:
+        error = ERROR_INVALID_PARAMETER;
+        break;
+    }
+  }
+
+  if (node && (ERROR_SUCCESS == error || ERROR_ALREADY_EXISTS == error))
+  {
+    handle = handle_open_node(emulator, HANDLE_FILE, node);
+    if (handle != INVALID_HANDLE_VALUE)
+      emulator->handles[handle - EMULATOR_FIRST_HANDLE].flags = access;
+  }
+
+  rapi_buffer_write_uint32(reply, error);
+  rapi_buffer_write_uint32(reply, handle);
+  free(path);
+}
+
+static void file_read(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorHandle* file = handle_get(emulator, get_uint32(request), HANDLE_FILE);
+  uint32_t wanted = get_uint32(request);
+  uint32_t count = 0;
+
+  if (!file)
+  {
+    rapi_buffer_write_uint32(reply, ERROR_INVALID_HANDLE);
+    rapi_buffer_write_uint32(reply, false);
+    rapi_buffer_write_uint32(reply, 0);
+    return;
+  }
+
+  if (!(file->flags & GENERIC_READ))
+  {
+    rapi_buffer_write_uint32(reply, ERROR_ACCESS_DENIED);
+    rapi_buffer_write_uint32(reply, false);
+    rapi_buffer_write_uint32(reply, 0);
+    return;
+  }
+
+  if (file->position < file->node->size)
+  {
+    count = file->node->size - file->position;
+    if (count > wanted)
+      count = wanted;
+  }
+
+  rapi_buffer_write_uint32(reply, ERROR_SUCCESS);
+  rapi_buffer_write_uint32(reply, true);
+  rapi_buffer_write_uint32(reply, count);
+  if (count)
+    rapi_buffer_write_data(reply, file->node->data + file->position, count);
+
+  file->position += count;
+  now_filetime(&file->node->access_time);
+}
+
+static void file_write(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorHandle* file = handle_get(emulator, get_uint32(request), HANDLE_FILE);
+  uint32_t count = get_uint32(request);
+  DWORD error = ERROR_SUCCESS;
+
+  if (!file)
+    error = ERROR_INVALID_HANDLE;
+  else if (!(file->flags & GENERIC_WRITE))
+    error = ERROR_ACCESS_DENIED;
+  else if (file->position + count > file->node->size &&
+      !file_resize(file->node, file->position + count))
+    error = ERROR_DISK_FULL;
+  else if (!rapi_buffer_read_data(request, file->node->data + file->position, count))
+    error = ERROR_INVALID_PARAMETER;
+
+  if (ERROR_SUCCESS == error)
+  {
+    file->position += count;
+    now_filetime(&file->node->write_time);
+  }
+  else
+    count = 0;
+
+  rapi_buffer_write_uint32(reply, error);
+  rapi_buffer_write_uint32(reply, ERROR_SUCCESS == error);
+  rapi_buffer_write_uint32(reply, count);
+}
+
+static void close_handle(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  bool success = handle_close(emulator, get_uint32(request));
+
+  rapi_buffer_write_uint32(reply, success ? ERROR_SUCCESS : ERROR_INVALID_HANDLE);
+  rapi_buffer_write_uint32(reply, success);
+}
+
+static void file_set_pointer(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorHandle* file = handle_get(emulator, get_uint32(request), HANDLE_FILE);
+  int64_t distance = (int32_t)get_uint32(request);
+  bool have_high = get_uint32(request);
+  DWORD method;
+  int64_t position = 0;
+  DWORD error = ERROR_SUCCESS;
+
+  if (have_high)
+    distance = (int64_t)(((uint64_t)get_uint32(request) << 32) | (uint32_t)distance);
+  method = get_uint32(request);
+
+  if (!file)
+    error = ERROR_INVALID_HANDLE;
+  else
+  {
+    switch (method)
+    {
+      case FILE_BEGIN:    position = distance; break;
+      case FILE_CURRENT:  position = file->position + distance; break;
+      case FILE_END:      position = file->node->size + distance; break;
+      default:            error = ERROR_INVALID_PARAMETER; break;
+    }
+
+    if (ERROR_SUCCESS == error && position < 0)
+      error = ERROR_NEGATIVE_SEEK;
+    if (ERROR_SUCCESS == error)
+      file->position = position;
+  }
+
+  if (error != ERROR_SUCCESS)
+    position = -1;
+
+  rapi_buffer_write_uint32(reply, error);
+  rapi_buffer_write_uint32(reply, (uint32_t)position);
+  if (have_high)
+    rapi_buffer_write_uint32(reply, (uint32_t)((uint64_t)position >> 32));
+}
+
+static void file_set_end(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorHandle* file = handle_get(emulator, get_uint32(request), HANDLE_FILE);
+  DWORD error = ERROR_SUCCESS;
+
+  if (!file)
+    error = ERROR_INVALID_HANDLE;
+  else if (!(file->flags & GENERIC_WRITE))
+    error = ERROR_ACCESS_DENIED;
+  else if (!file_resize(file->node, file->position))
+    error = ERROR_DISK_FULL;
+
+  rapi_buffer_write_uint32(reply, error);
+  rapi_buffer_write_uint32(reply, ERROR_SUCCESS == error);
+}
+
+static void file_get_time(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorHandle* file = handle_get(emulator, get_uint32(request), HANDLE_FILE);
+
+  rapi_buffer_write_uint32(reply, file ? ERROR_SUCCESS : ERROR_INVALID_HANDLE);
+  rapi_buffer_write_uint32(reply, file != NULL);
+  if (file)
+  {
+    put_filetime(reply, &file->node->creation_time);
+    put_filetime(reply, &file->node->access_time);
+    put_filetime(reply, &file->node->write_time);
+  }
+}
+
+static void get_optional_filetime(RapiBuffer* request, FILETIME* filetime)
+{
+  if (get_uint32(request) == sizeof(FILETIME))
+  {
+    filetime->dwLowDateTime = get_uint32(request);
+    filetime->dwHighDateTime = get_uint32(request);
+  }
+}
+
+static void file_set_time(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorHandle* file = handle_get(emulator, get_uint32(request), HANDLE_FILE);
+  FILETIME times[3];
+
+  memset(times, 0, sizeof(times));
+  if (file)
+  {
+    times[0] = file->node->creation_time;
+    times[1] = file->node->access_time;
+    times[2] = file->node->write_time;
+  }
+
+  get_optional_filetime(request, &times[0]);
+  get_optional_filetime(request, &times[1]);
+  get_optional_filetime(request, &times[2]);
+
+  if (file)
+  {
+    file->node->creation_time = times[0];
+    file->node->access_time = times[1];
+    file->node->write_time = times[2];
+  }
+
+  rapi_buffer_write_uint32(reply, file ? ERROR_SUCCESS : ERROR_INVALID_HANDLE);
+  rapi_buffer_write_uint32(reply, file != NULL);
+}
+
+static void file_get_size(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorHandle* file = handle_get(emulator, get_uint32(request), HANDLE_FILE);
+  bool want_high = (1 == get_uint32(request));
+  uint64_t size = file ? file->node->size : 0;
+
+  rapi_buffer_write_uint32(reply, file ? ERROR_SUCCESS : ERROR_INVALID_HANDLE);
+  rapi_buffer_write_uint32(reply, file ? (uint32_t)size : INVALID_FILE_SIZE);
+
+  /* as read by rapi_buffer_read_optional_uint32() */
+  if (want_high)
+  {
+    rapi_buffer_write_uint32(reply, 1);
+    rapi_buffer_write_uint32(reply, sizeof(uint32_t));
+    rapi_buffer_write_uint32(reply, 1);
+    rapi_buffer_write_uint32(reply, size >> 32);
+  }
+  else
+    rapi_buffer_write_uint32(reply, 0);
+}
+
+
+/*
+ * RAPI2 file management
+ */
+
+static void file_find_all(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  char* path = get_string2(request);
+  DWORD flags = get_uint32(request);
+  const char* pattern = NULL;
+  EmulatorNode* directory = NULL;
+  uint32_t count = 0;
+  size_t count_offset;
+  unsigned i;
+
+  if (path)
+    directory = node_lookup_parent(emulator->files, path, FILE_SEPARATORS, &pattern);
+
+  rapi_buffer_write_uint32(reply, node_is_directory(directory) ? ERROR_SUCCESS : ERROR_PATH_NOT_FOUND);
+  rapi_buffer_write_uint32(reply, node_is_directory(directory));
+  count_offset = rapi_buffer_get_size(reply);
+  rapi_buffer_write_uint32(reply, 0);
+
+  if (node_is_directory(directory))
+  {
+    for (i = 0; i < directory->child_count; i++)
+    {
+      EmulatorNode* node = directory->children[i];
+
+      if (!find_wanted(node, pattern, flags))
+        continue;
+
+      put_find_fields(reply, node, flags);
+      count++;
+    }
+
+    patch_uint32(reply, count_offset, count);
+  }
+
+  free(path);
+}
+
+/* the next match at or after the handle's position */
+static EmulatorNode* file_find_next_match(EmulatorHandle* find)
+{
+  EmulatorNode* directory = find->node;
+
+  while (find->position < directory->child_count)
+  {
+    EmulatorNode* node = directory->children[find->position++];
+
+    if (find_wanted(node, find->pattern, 0))
+      return node;
+  }
+
+  return NULL;
+}
+
+static void file_find_first(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  char* path = get_string2(request);
+  const char* pattern = NULL;
+  EmulatorNode* directory = NULL;
+  EmulatorNode* node = NULL;
+  HANDLE handle = INVALID_HANDLE_VALUE;
+  DWORD error = ERROR_SUCCESS;
+
+  if (path)
+    directory = node_lookup_parent(emulator->files, path, FILE_SEPARATORS, &pattern);
+
+  if (!node_is_directory(directory))
+    error = ERROR_PATH_NOT_FOUND;
+  else if ((handle = handle_open_node(emulator, HANDLE_FIND, directory)) != INVALID_HANDLE_VALUE)
+  {
+    EmulatorHandle* find = &emulator->handles[handle - EMULATOR_FIRST_HANDLE];
+
+    find->pattern = strdup(pattern);
+    if (!(node = file_find_next_match(find)))
+    {
+      handle_close(emulator, handle);
+      handle = INVALID_HANDLE_VALUE;
+      error = ERROR_FILE_NOT_FOUND;
+    }
+  }
+
+  rapi_buffer_write_uint32(reply, error);
+  rapi_buffer_write_uint32(reply, handle);
+  put_find_data(reply, node);
+  free(path);
+}
+
+static void file_find_next(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorHandle* find = handle_get(emulator, get_uint32(request), HANDLE_FIND);
+  EmulatorNode* node = find ? file_find_next_match(find) : NULL;
+
+  rapi_buffer_write_uint32(reply, node ? ERROR_SUCCESS : find ? ERROR_NO_MORE_FILES : ERROR_INVALID_HANDLE);
+  rapi_buffer_write_uint32(reply, node != NULL);
+  put_find_data(reply, node);
+}
+
+static void file_get_attributes(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  char* path = get_string2(request);
+  EmulatorNode* node = path ? node_lookup(emulator->files, path, FILE_SEPARATORS) : NULL;
+
+  rapi_buffer_write_uint32(reply, node ? ERROR_SUCCESS : ERROR_FILE_NOT_FOUND);
+  rapi_buffer_write_uint32(reply, node ? node->attributes : 0xFFFFFFFF);
+  free(path);
+}
+
+static void file_delete(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  char* path = get_string2(request);
+  EmulatorNode* node = path ? node_lookup(emulator->files, path, FILE_SEPARATORS) : NULL;
+  DWORD error = ERROR_SUCCESS;
+
+  if (!node)
+    error = ERROR_FILE_NOT_FOUND;
+  else if (node_is_directory(node))
+    error = ERROR_ACCESS_DENIED;
+  else if (node->refs)
+    error = ERROR_SHARING_VIOLATION;
+  else
+    node_delete(node);
+
+  rapi_buffer_write_uint32(reply, error);
+  rapi_buffer_write_uint32(reply, ERROR_SUCCESS == error);
+  free(path);
+}
+
+static void directory_create(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  char* path = get_string2(request);
+  const char* name = NULL;
+  EmulatorNode* parent = NULL;
+  DWORD error = ERROR_SUCCESS;
+
+  if (path)
+    parent = node_lookup_parent(emulator->files, path, FILE_SEPARATORS, &name);
+
+  if (!node_is_directory(parent))
+    error = ERROR_PATH_NOT_FOUND;
+  else if (node_child(parent, name))
+    error = ERROR_ALREADY_EXISTS;
+  else if (!file_new(emulator, parent, name, FILE_ATTRIBUTE_DIRECTORY))
+    error = ERROR_INVALID_NAME;
+
+  rapi_buffer_write_uint32(reply, error);
+  rapi_buffer_write_uint32(reply, ERROR_SUCCESS == error);
+  free(path);
+}
+
+static void directory_remove(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  char* path = get_string2(request);
+  EmulatorNode* node = path ? node_lookup(emulator->files, path, FILE_SEPARATORS) : NULL;
+  DWORD error = ERROR_SUCCESS;
+
+  if (!node)
+    error = ERROR_FILE_NOT_FOUND;
+  else if (!node_is_directory(node) || node == emulator->files)
+    error = ERROR_ACCESS_DENIED;
+  else if (node->child_count)
+    error = ERROR_DIR_NOT_EMPTY;
+  else
+    node_delete(node);
+
+  rapi_buffer_write_uint32(reply, error);
+  rapi_buffer_write_uint32(reply, ERROR_SUCCESS == error);
+  free(path);
+}
+
+static void file_move(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  char* from = get_string2(request);
+  char* to = get_string2(request);
+  EmulatorNode* node = from ? node_lookup(emulator->files, from, FILE_SEPARATORS) : NULL;
+  EmulatorNode* parent = NULL;
+  const char* name = NULL;
+  DWORD error = ERROR_SUCCESS;
+
+  if (to)
+    parent = node_lookup_parent(emulator->files, to, FILE_SEPARATORS, &name);
+
+  if (!node || node == emulator->files)
+    error = ERROR_FILE_NOT_FOUND;
+  else if (!node_is_directory(parent) || node_is_inside(parent, node))
+    error = ERROR_PATH_NOT_FOUND;
+  else if (!*name)
+    error = ERROR_INVALID_NAME;
+  else if (node_child(parent, name))
+    error = ERROR_ALREADY_EXISTS;
+  else
+  {
+    char* new_name = strdup(name);
+
+    node_detach(node);
+    free(node->name);
+    node->name = new_name;
+    node_attach(parent, node);
+  }
+
+  rapi_buffer_write_uint32(reply, error);
+  rapi_buffer_write_uint32(reply, ERROR_SUCCESS == error);
+  free(from);
+  free(to);
+}
+
+static void file_copy(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  char* from = get_string2(request);
+  char* to = get_string2(request);
+  bool fail_if_exists = get_uint32(request);
+  EmulatorNode* source = from ? node_lookup(emulator->files, from, FILE_SEPARATORS) : NULL;
+  EmulatorNode* parent = NULL;
+  EmulatorNode* target;
+  const char* name = NULL;
+  DWORD error = ERROR_SUCCESS;
+
+  if (to)
+    parent = node_lookup_parent(emulator->files, to, FILE_SEPARATORS, &name);
+
+  if (!source)
+    error = ERROR_FILE_NOT_FOUND;
+  else if (node_is_directory(source))
+    error = ERROR_ACCESS_DENIED;
+  else if (!node_is_directory(parent))
+    error = ERROR_PATH_NOT_FOUND;
+  else if ((target = node_child(parent, name)) != NULL)
+  {
+    if (fail_if_exists)
+      error = ERROR_FILE_EXISTS;
+    else if (node_is_directory(target))
+      error = ERROR_ACCESS_DENIED;
+    else if (target != source && !file_copy_data(target, source))
+      error = ERROR_DISK_FULL;
+  }
+  else if (!(target = file_new(emulator, parent, name, source->attributes)))
+    error = ERROR_INVALID_NAME;
+  else if (!file_copy_data(target, source))
+    error = ERROR_DISK_FULL;
+
+  rapi_buffer_write_uint32(reply, error);
+  rapi_buffer_write_uint32(reply, ERROR_SUCCESS == error);
+  free(from);
+  free(to);
+}
+
+static void special_folder_path(RapiEmulator* emulator SYNCE_UNUSED, RapiBuffer* request, RapiBuffer* reply)
+{
+  uint32_t folder = get_uint32(request);
+  uint32_t size = get_uint32(request);
+  const char* path = NULL;
+
+  switch (folder)
+  {
+    case CSIDL_PROGRAMS:          path = "\\Windows\\Start Menu\\Programs"; break;
+    case CSIDL_PERSONAL:          path = "\\My Documents"; break;
+    case CSIDL_FAVORITES_GRYPHON:
+    case CSIDL_FAVORITES:         path = "\\Windows\\Favorites"; break;
+    case CSIDL_STARTUP:           path = "\\Windows\\StartUp"; break;
+    case CSIDL_RECENT:            path = "\\Windows\\Recent"; break;
+    case CSIDL_STARTMENU:         path = "\\Windows\\Start Menu"; break;
+    case CSIDL_DESKTOPDIRECTORY:  path = "\\Windows\\Desktop"; break;
+    case CSIDL_FONTS:             path = "\\Windows\\Fonts"; break;
+  }
+
+  if (path && wide_length(path) + 1 > size)
+    path = NULL;
+
+  rapi_buffer_write_uint32(reply, path ? ERROR_SUCCESS : ERROR_INVALID_PARAMETER);
+  put_string(reply, path);
+}
+
+static void get_version(RapiEmulator* emulator, RapiBuffer* request SYNCE_UNUSED, RapiBuffer* reply)
+{
+  WCHAR csd_version[128];
+
+  memset(csd_version, 0, sizeof(csd_version));
+
+  rapi_buffer_write_uint32(reply, ERROR_SUCCESS);
+  rapi_buffer_write_uint32(reply, true);
+  rapi_buffer_write_uint32(reply, sizeof(CEOSVERSIONINFO));
+  rapi_buffer_write_uint32(reply, sizeof(CEOSVERSIONINFO));
+  rapi_buffer_write_uint32(reply, emulator->rapi1 ? RAPI1_OS_MAJOR : RAPI2_OS_MAJOR);
+  rapi_buffer_write_uint32(reply, emulator->rapi1 ? RAPI1_OS_MINOR : RAPI2_OS_MINOR);
+  rapi_buffer_write_uint32(reply, emulator->rapi1 ? RAPI1_OS_BUILD : RAPI2_OS_BUILD);
+  rapi_buffer_write_uint32(reply, VER_PLATFORM_WIN32_CE);
+  rapi_buffer_write_data(reply, csd_version, sizeof(csd_version));
+}
+
+
+/*
+ * RAPI2 registry
+ */
+
+static EmulatorNode* key_resolve(RapiEmulator* emulator, HKEY hkey)
+{
+  EmulatorHandle* key;
+
+  if (hkey >= (HKEY)HKEY_CLASSES_ROOT && hkey <= (HKEY)HKEY_USERS)
+    return emulator->registry[hkey - (HKEY)HKEY_CLASSES_ROOT];
+
+  key = handle_get(emulator, hkey, HANDLE_KEY);
+  return (key && !key->node->deleted) ? key->node : NULL;
+}
+
+static EmulatorValue* key_find_value(EmulatorNode* key, const char* name)
+{
+  unsigned i;
+
+  if (!name)
+    name = "";
+
+  for (i = 0; i < key->value_count; i++)
+    if (0 == strcasecmp(key->values[i].name, name))
+      return &key->values[i];
+
+  return NULL;
+}
+
+/* the size check and value as CeRegQueryValueEx and CeRegEnumValue expect */
+static void put_value(RapiBuffer* reply, EmulatorValue* value, uint32_t buffer_size)
+{
+  /* a zero buffer size only asks for type and size */
+  if (buffer_size && buffer_size < value->size)
+  {
+    rapi_buffer_write_uint32(reply, ERROR_MORE_DATA);
+    rapi_buffer_write_uint32(reply, ERROR_MORE_DATA);
+    return;
+  }
+
+  rapi_buffer_write_uint32(reply, ERROR_SUCCESS);
+  rapi_buffer_write_uint32(reply, ERROR_SUCCESS);
+  rapi_buffer_write_uint32(reply, value->type);
+  rapi_buffer_write_uint32(reply, value->size);
+  if (buffer_size && value->size)
+    rapi_buffer_write_data(reply, value->data, value->size);
+}
+
+static void put_key_result(RapiBuffer* reply, LONG result)
+{
+  rapi_buffer_write_uint32(reply, result);
+  rapi_buffer_write_uint32(reply, result);
+}
+
+static void key_open(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorNode* parent = key_resolve(emulator, get_uint32(request));
+  char* subkey = get_string2(request);
+  EmulatorNode* key = parent ? node_lookup(parent, subkey, KEY_SEPARATORS) : NULL;
+  HANDLE handle = INVALID_HANDLE_VALUE;
+
+  if (key)
+    handle = handle_open_node(emulator, HANDLE_KEY, key);
+
+  if (handle != INVALID_HANDLE_VALUE)
+  {
+    put_key_result(reply, ERROR_SUCCESS);
+    rapi_buffer_write_uint32(reply, handle);
+  }
+  else
+    put_key_result(reply, parent ? ERROR_FILE_NOT_FOUND : ERROR_INVALID_HANDLE);
+
+  free(subkey);
+}
+
+static void key_create(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorNode* key = key_resolve(emulator, get_uint32(request));
+  char* subkey = get_string2(request);
+  char* class_name = get_string2(request);
+  DWORD disposition = REG_OPENED_EXISTING_KEY;
+  HANDLE handle = INVALID_HANDLE_VALUE;
+  char* part;
+  char* save = NULL;
+
+  if (key && subkey)
+  {
+    for (part = strtok_r(subkey, KEY_SEPARATORS, &save); part && key; part = strtok_r(NULL, KEY_SEPARATORS, &save))
+    {
+      EmulatorNode* child = node_child(key, part);
+
+      if (!child)
+      {
+        if ((child = node_new(part, 0)) != NULL && !node_attach(key, child))
+        {
+          node_free(child);
+          child = NULL;
+        }
+        disposition = REG_CREATED_NEW_KEY;
+      }
+
+      key = child;
+    }
+  }
+
+  if (key)
+    handle = handle_open_node(emulator, HANDLE_KEY, key);
+
+  if (handle != INVALID_HANDLE_VALUE)
+  {
+    put_key_result(reply, ERROR_SUCCESS);
+    rapi_buffer_write_uint32(reply, handle);
+    rapi_buffer_write_uint32(reply, disposition);
+  }
+  else
+    put_key_result(reply, key ? ERROR_NOT_ENOUGH_MEMORY : ERROR_INVALID_HANDLE);
+
+  free(subkey);
+  free(class_name);
+}
+
+static void key_close(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  HKEY hkey = get_uint32(request);
+
+  if (handle_get(emulator, hkey, HANDLE_KEY))
+  {
+    handle_close(emulator, hkey);
+    put_key_result(reply, ERROR_SUCCESS);
+  }
+  else
+    put_key_result(reply, ERROR_INVALID_HANDLE);
+}
+
+static void key_delete(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorNode* parent = key_resolve(emulator, get_uint32(request));
+  char* subkey = get_string2(request);
+  EmulatorNode* key = (parent && subkey && *subkey) ? node_lookup(parent, subkey, KEY_SEPARATORS) : NULL;
+
+  /* like Windows CE, this takes the subkeys too */
+  if (key && key != parent)
+  {
+    node_delete(key);
+    put_key_result(reply, ERROR_SUCCESS);
+  }
+  else
+    put_key_result(reply, parent ? ERROR_FILE_NOT_FOUND : ERROR_INVALID_HANDLE);
+
+  free(subkey);
+}
+
+static void key_enum_key(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorNode* key = key_resolve(emulator, get_uint32(request));
+  uint32_t index = get_uint32(request);
+  uint32_t name_size = get_uint32(request);
+  uint32_t class_size = get_uint32(request);
+  EmulatorNode* child;
+
+  if (!key)
+  {
+    put_key_result(reply, ERROR_INVALID_HANDLE);
+    return;
+  }
+
+  if (index >= key->child_count)
+  {
+    put_key_result(reply, ERROR_NO_MORE_ITEMS);
+    return;
+  }
+
+  child = key->children[index];
+  if (wide_length(child->name) + 1 > name_size)
+  {
+    put_key_result(reply, ERROR_MORE_DATA);
+    return;
+  }
+
+  put_key_result(reply, ERROR_SUCCESS);
+  put_string(reply, child->name);
+  if (class_size)
+    put_string(reply, "");
+}
+
+static void key_enum_value(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorNode* key = key_resolve(emulator, get_uint32(request));
+  uint32_t index = get_uint32(request);
+  uint32_t name_size = get_uint32(request);
+  uint32_t data_size = get_uint32(request);
+  EmulatorValue* value;
+
+  if (!key)
+  {
+    put_key_result(reply, ERROR_INVALID_HANDLE);
+    return;
+  }
+
+  if (index >= key->value_count)
+  {
+    put_key_result(reply, ERROR_NO_MORE_ITEMS);
+    return;
+  }
+
+  value = &key->values[index];
+  if (wide_length(value->name) + 1 > name_size || (data_size && data_size < value->size))
+  {
+    put_key_result(reply, ERROR_MORE_DATA);
+    return;
+  }
+
+  put_key_result(reply, ERROR_SUCCESS);
+  put_string(reply, value->name);
+  rapi_buffer_write_uint32(reply, value->type);
+  rapi_buffer_write_uint32(reply, value->size);
+  if (data_size && value->size)
+    rapi_buffer_write_data(reply, value->data, value->size);
+}
+
+static void key_query_info(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorNode* key = key_resolve(emulator, get_uint32(request));
+  uint32_t class_size = get_uint32(request);
+  DWORD max_subkey = 0;
+  DWORD max_name = 0;
+  DWORD max_data = 0;
+  unsigned i;
+
+  if (!key)
+  {
+    put_key_result(reply, ERROR_INVALID_HANDLE);
+    return;
+  }
+
+  for (i = 0; i < key->child_count; i++)
+  {
+    DWORD length = wide_length(key->children[i]->name);
+    if (length > max_subkey)
+      max_subkey = length;
+  }
+
+  for (i = 0; i < key->value_count; i++)
+  {
+    DWORD length = wide_length(key->values[i].name);
+    if (length > max_name)
+      max_name = length;
+    if (key->values[i].size > max_data)
+      max_data = key->values[i].size;
+  }
+
+  put_key_result(reply, ERROR_SUCCESS);
+  rapi_buffer_write_uint32(reply, 0);       /* class length */
+  if (class_size)
+    put_string(reply, "");
+  rapi_buffer_write_uint32(reply, key->child_count);
+  rapi_buffer_write_uint32(reply, max_subkey);
+  rapi_buffer_write_uint32(reply, 0);       /* longest class */
+  rapi_buffer_write_uint32(reply, key->value_count);
+  rapi_buffer_write_uint32(reply, max_name);
+  rapi_buffer_write_uint32(reply, max_data);
+}
+
+static void key_query_value(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorNode* key = key_resolve(emulator, get_uint32(request));
+  char* name = get_string2(request);
+  uint32_t data_size = get_uint32(request);
+  EmulatorValue* value = key ? key_find_value(key, name) : NULL;
+
+  if (value)
+    put_value(reply, value, data_size);
+  else
+    put_key_result(reply, key ? ERROR_FILE_NOT_FOUND : ERROR_INVALID_HANDLE);
+
+  free(name);
+}
+
+static void key_set_value(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorNode* key = key_resolve(emulator, get_uint32(request));
+  char* name = get_string2(request);
+  DWORD type = get_uint32(request);
+  DWORD size = get_uint32(request);
+  unsigned char* data = size ? malloc(size) : NULL;
+  EmulatorValue* value;
+  LONG result = ERROR_SUCCESS;
+
+  if (!key)
+    result = ERROR_INVALID_HANDLE;
+  else if (size && (!data || !rapi_buffer_read_data(request, data, size)))
+    result = ERROR_INVALID_PARAMETER;
+  else if ((value = key_find_value(key, name)) != NULL)
+  {
+    free(value->data);
+    value->type = type;
+    value->data = data;
+    value->size = size;
+    data = NULL;
+  }
+  else
+  {
+    EmulatorValue* values = realloc(key->values, (key->value_count + 1) * sizeof(EmulatorValue));
+
+    if (!values)
+      result = ERROR_NOT_ENOUGH_MEMORY;
+    else
+    {
+      key->values = values;
+      value = &key->values[key->value_count++];
+      value->name = strdup(name ? name : "");
+      value->type = type;
+      value->data = data;
+      value->size = size;
+      data = NULL;
+    }
+  }
+
+  put_key_result(reply, result);
+  free(data);
+  free(name);
+}
+
+static void key_delete_value(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorNode* key = key_resolve(emulator, get_uint32(request));
+  char* name = get_string2(request);
+  EmulatorValue* value = key ? key_find_value(key, name) : NULL;
+
+  if (value)
+  {
+    unsigned index = value - key->values;
+
+    free(value->name);
+    free(value->data);
+    key->value_count--;
+    memmove(key->values + index, key->values + index + 1,
+        (key->value_count - index) * sizeof(EmulatorValue));
+    put_key_result(reply, ERROR_SUCCESS);
+  }
+  else
+    put_key_result(reply, key ? ERROR_FILE_NOT_FOUND : ERROR_INVALID_HANDLE);
+
+  free(name);
+}
+
+
+/*
+ * RAPI1 databases
+ */
+
+static void database_free(EmulatorDatabase* database)
+{
+  unsigned i;
+
+  for (i = 0; i < database->record_count; i++)
+    free(database->records[i].data);
+
+  free(database->records);
+  free(database->name);
+  free(database);
+}
+
+static void database_unref(EmulatorDatabase* database)
+{
+  if (0 == --database->refs && database->deleted)
+    database_free(database);
+}
+
+static EmulatorDatabase* database_find(RapiEmulator* emulator, CEOID oid, const char* name, unsigned* index)
+{
+  unsigned i;
+
+  for (i = 0; i < emulator->database_count; i++)
+  {
+    EmulatorDatabase* database = emulator->databases[i];
+
+    if ((oid && database->oid == oid) || (!oid && name && 0 == strcasecmp(database->name, name)))
+    {
+      if (index)
+        *index = i;
+      return database;
+    }
+  }
+
+  return NULL;
+}
+
+static DWORD database_size(EmulatorDatabase* database)
+{
+  DWORD size = 0;
+  unsigned i;
+
+  for (i = 0; i < database->record_count; i++)
+    size += database->records[i].size;
+  return size;
+}
+
+static int record_find(EmulatorDatabase* database, CEOID oid)
+{
+  unsigned i;
+
+  for (i = 0; i < database->record_count; i++)
+    if (database->records[i].oid == oid)
+      return i;
+  return -1;
+}
+
+/*
+ * Check the wire format of count properties in data and fill props;
+ * strings and blobs must lie inside data
+ */
+static bool props_parse(const unsigned char* data, DWORD size, WORD count, EmulatorProp* props)
+{
+  unsigned i;
+
+  if ((DWORD)count * WIRE_PROPVAL_SIZE > size)
+    return false;
+
+  for (i = 0; i < count; i++)
+  {
+    const unsigned char* p = data + i * WIRE_PROPVAL_SIZE;
+    uint32_t offset;
+    uint32_t length;
+
+    memcpy(&props[i].propid, p, 4);
+    memcpy(&props[i].len, p + 4, 2);
+    memcpy(&props[i].flags, p + 6, 2);
+    memcpy(props[i].value, p + 8, 8);
+    props[i].propid = letoh32(props[i].propid);
+    props[i].len = letoh16(props[i].len);
+    props[i].flags = letoh16(props[i].flags);
+    props[i].data = NULL;
+    props[i].data_size = 0;
+
+    if (props[i].flags & CEDB_PROPDELETE)
+      continue;
+
+    switch (props[i].propid & 0xffff)
+    {
+      case CEVT_LPWSTR:
+        memcpy(&offset, p + 8, 4);
+        offset = letoh32(offset);
+        for (length = 0; offset + length + 1 < size; length += 2)
+          if (0 == data[offset + length] && 0 == data[offset + length + 1])
+            break;
+        if (offset + length + 1 >= size)
+          return false;
+        props[i].data = data + offset;
+        props[i].data_size = length + 2;
+        break;
+
+      case CEVT_BLOB:
+        memcpy(&length, p + 8, 4);
+        memcpy(&offset, p + 12, 4);
+        length = letoh32(length);
+        offset = letoh32(offset);
+        if (offset > size || length > size - offset)
+          return false;
+        props[i].data = data + offset;
+        props[i].data_size = length;
+        break;
+
+      case CEVT_I2:
+      case CEVT_I4:
+      case CEVT_R8:
+      case CEVT_BOOL:
+      case CEVT_UI2:
+      case CEVT_UI4:
+      case CEVT_FILETIME:
+        break;
+
+      default:
+        return false;
+    }
+  }
+
+  return true;
+}
+
+/* build the wire format of props into record */
+static bool props_store(EmulatorRecord* record, const EmulatorProp* props, WORD count)
+{
+  DWORD size = count * WIRE_PROPVAL_SIZE;
+  DWORD offset;
+  unsigned char* data;
+  unsigned i;
+
+  for (i = 0; i < count; i++)
+    size += ALIGN4(props[i].data_size);
+
+  if ((data = calloc(1, size ? size : 1)) == NULL)
+    return false;
+
+  offset = count * WIRE_PROPVAL_SIZE;
+  for (i = 0; i < count; i++)
+  {
+    unsigned char* p = data + i * WIRE_PROPVAL_SIZE;
+    uint32_t propid = htole32(props[i].propid);
+    uint16_t len = htole16(props[i].len);
+    uint16_t flags = htole16(props[i].flags);
+    uint32_t le_offset = htole32(offset);
+
+    memcpy(p, &propid, 4);
+    memcpy(p + 4, &len, 2);
+    memcpy(p + 6, &flags, 2);
+    memcpy(p + 8, props[i].value, 8);
+
+    if (props[i].data)
+    {
+      if (CEVT_BLOB == (props[i].propid & 0xffff))
+        memcpy(p + 12, &le_offset, 4);
+      else
+        memcpy(p + 8, &le_offset, 4);
+
+      memcpy(data + offset, props[i].data, props[i].data_size);
+      offset += ALIGN4(props[i].data_size);
+    }
+  }
+
+  free(record->data);
+  record->data = data;
+  record->size = size;
+  record->prop_count = count;
+  return true;
+}
+
+static void database_create(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorDatabase* database = NULL;
+  DWORD type = get_uint32(request);
+  WORD sort_count = get_uint16(request);
+  SORTORDERSPEC sort[CEDB_MAXSORTORDER];
+  DWORD error = ERROR_SUCCESS;
+  char* name;
+  unsigned i;
+
+  memset(sort, 0, sizeof(sort));
+  for (i = 0; i < sort_count; i++)
+  {
+    CEPROPID propid = get_uint32(request);
+    DWORD flags = get_uint32(request);
+
+    if (i < CEDB_MAXSORTORDER)
+    {
+      sort[i].propid = propid;
+      sort[i].dwFlags = flags;
+    }
+  }
+
+  name = get_string1(request);
+
+  if (!name || !*name || sort_count > CEDB_MAXSORTORDER)
+    error = ERROR_INVALID_PARAMETER;
+  else if (database_find(emulator, 0, name, NULL))
+    error = ERROR_DUP_NAME;
+  else if (emulator->database_count == emulator->database_alloc)
+  {
+    unsigned alloc = emulator->database_alloc ? emulator->database_alloc * 2 : 16;
+    EmulatorDatabase** databases = realloc(emulator->databases, alloc * sizeof(EmulatorDatabase*));
+
+    if (databases)
+    {
+      emulator->databases = databases;
+      emulator->database_alloc = alloc;
+    }
+    else
+      error = ERROR_NOT_ENOUGH_MEMORY;
+  }
+
+  if (ERROR_SUCCESS == error)
+  {
+    if ((database = calloc(1, sizeof(EmulatorDatabase))) != NULL)
+    {
+      database->oid = emulator->next_oid++;
+      database->name = name;
+      database->type = type;
+      database->sort_count = sort_count;
+      memcpy(database->sort, sort, sizeof(sort));
+      now_filetime(&database->modified);
+      emulator->databases[emulator->database_count++] = database;
+      name = NULL;
+    }
+    else
+      error = ERROR_NOT_ENOUGH_MEMORY;
+  }
+
+  rapi_buffer_write_uint32(reply, error);
+  rapi_buffer_write_uint32(reply, database ? database->oid : 0);
+  free(name);
+}
+
+static void database_delete(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  unsigned index = 0;
+  EmulatorDatabase* database = database_find(emulator, get_uint32(request), NULL, &index);
+  DWORD error = ERROR_SUCCESS;
+
+  if (!database)
+    error = ERROR_FILE_NOT_FOUND;
+  else if (database->refs)
+    error = ERROR_SHARING_VIOLATION;
+  else
+  {
+    emulator->database_count--;
+    memmove(emulator->databases + index, emulator->databases + index + 1,
+        (emulator->database_count - index) * sizeof(EmulatorDatabase*));
+    database_free(database);
+  }
+
+  rapi_buffer_write_uint32(reply, error);
+  rapi_buffer_write_uint32(reply, ERROR_SUCCESS == error);
+}
+
+static void database_find_all(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  DWORD type = get_uint32(request);
+  WORD flags = get_uint16(request);
+  uint16_t count = 0;
+  uint16_t count_le;
+  size_t count_offset = rapi_buffer_get_size(reply);
+  unsigned i;
+  unsigned j;
+
+  rapi_buffer_write_uint16(reply, 0);
+
+  for (i = 0; i < emulator->database_count; i++)
+  {
+    EmulatorDatabase* database = emulator->databases[i];
+    WCHAR* name;
+    uint32_t name_length;
+
+    if (type && database->type != type)
+      continue;
+
+    name = wstr_from_utf8(database->name);
+    name_length = name ? wstr_strlen(name) + 1 : 0;
+
+    if (flags & FAD_OID)
+      rapi_buffer_write_uint32(reply, database->oid);
+    if (flags & FAD_NAME)
+      rapi_buffer_write_uint32(reply, name_length);
+    if (flags & FAD_FLAGS)
+      rapi_buffer_write_uint32(reply, database->flags);
+    if (flags & FAD_NAME)
+      rapi_buffer_write_data(reply, name, name_length * sizeof(WCHAR));
+    if (flags & FAD_TYPE)
+      rapi_buffer_write_uint32(reply, database->type);
+    if (flags & FAD_NUM_RECORDS)
+      rapi_buffer_write_uint16(reply, database->record_count);
+    if (flags & FAD_NUM_SORT_ORDER)
+      rapi_buffer_write_uint16(reply, database->sort_count);
+    if (flags & FAD_SIZE)
+      rapi_buffer_write_uint32(reply, database_size(database));
+    if (flags & FAD_LAST_MODIFIED)
+      put_filetime(reply, &database->modified);
+    if (flags & FAD_SORT_SPECS)
+    {
+      for (j = 0; j < CEDB_MAXSORTORDER; j++)
+      {
+        rapi_buffer_write_uint32(reply, database->sort[j].propid);
+        rapi_buffer_write_uint32(reply, database->sort[j].dwFlags);
+      }
+    }
+
+    wstr_free_string(name);
+    count++;
+  }
+
+  count_le = htole16(count);
+  memcpy(rapi_buffer_get_raw(reply) + count_offset, &count_le, sizeof(count_le));
+}
+
+static void database_find_first(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  DWORD type = get_uint32(request);
+  HANDLE handle = handle_new(emulator, HANDLE_DATABASE_ENUM);
+
+  if (handle != INVALID_HANDLE_VALUE)
+    emulator->handles[handle - EMULATOR_FIRST_HANDLE].flags = type;
+
+  rapi_buffer_write_uint32(reply, handle != INVALID_HANDLE_VALUE ? ERROR_SUCCESS : ERROR_NOT_ENOUGH_MEMORY);
+  rapi_buffer_write_uint32(reply, handle);
+}
+
+static void database_find_next(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorHandle* find = handle_get(emulator, get_uint32(request), HANDLE_DATABASE_ENUM);
+  CEOID oid = 0;
+
+  while (find && find->position < emulator->database_count)
+  {
+    EmulatorDatabase* database = emulator->databases[find->position++];
+
+    if (0 == find->flags || database->type == find->flags)
+    {
+      oid = database->oid;
+      break;
+    }
+  }
+
+  rapi_buffer_write_uint32(reply, oid ? ERROR_SUCCESS : find ? ERROR_NO_MORE_ITEMS : ERROR_INVALID_HANDLE);
+  rapi_buffer_write_uint32(reply, oid);
+}
+
+static void database_open(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  CEOID oid = get_uint32(request);
+  CEPROPID propid SYNCE_UNUSED = get_uint32(request);
+  DWORD flags = get_uint32(request);
+  char* name = oid ? NULL : get_string1(request);
+  EmulatorDatabase* database = (oid || name) ? database_find(emulator, oid, name, NULL) : NULL;
+  HANDLE handle = INVALID_HANDLE_VALUE;
+
+  if (database && (handle = handle_new(emulator, HANDLE_DATABASE)) != INVALID_HANDLE_VALUE)
+  {
+    EmulatorHandle* entry = &emulator->handles[handle - EMULATOR_FIRST_HANDLE];
+
+    entry->database = database;
+    entry->flags = flags;
+    database->refs++;
+  }
+
+  rapi_buffer_write_uint32(reply, database ? ERROR_SUCCESS : ERROR_FILE_NOT_FOUND);
+  rapi_buffer_write_uint32(reply, handle);
+  if (!oid)
+    rapi_buffer_write_uint32(reply, database ? database->oid : 0);
+
+  free(name);
+}
+
+static void record_read(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorHandle* entry = handle_get(emulator, get_uint32(request), HANDLE_DATABASE);
+  EmulatorRecord* record = NULL;
+
+  /* flags and the property list; all properties are always returned */
+  get_uint32(request);
+
+  if (entry && entry->position < entry->database->record_count)
+    record = &entry->database->records[entry->position];
+
+  rapi_buffer_write_uint32(reply, record ? ERROR_SUCCESS : entry ? ERROR_NO_MORE_ITEMS : ERROR_INVALID_HANDLE);
+  rapi_buffer_write_uint32(reply, record ? record->oid : 0);
+  rapi_buffer_write_uint32(reply, record ? record->size : 0);
+  rapi_buffer_write_uint16(reply, record ? record->prop_count : 0);
+  if (record)
+  {
+    rapi_buffer_write_data(reply, record->data, record->size);
+    if (entry->flags & CEDB_AUTOINCREMENT)
+      entry->position++;
+  }
+}
+
+/* update the record oid, or add it if new */
+static DWORD record_write_props(EmulatorDatabase* database, CEOID oid, bool new_record,
+    const unsigned char* data, DWORD size, WORD count)
+{
+  EmulatorProp* props;
+  EmulatorRecord* record;
+  EmulatorRecord added;
+  DWORD error = ERROR_SUCCESS;
+  int index = -1;
+  unsigned existing = 0;
+  unsigned total;
+  unsigned i;
+  unsigned j;
+
+  if (!new_record && (index = record_find(database, oid)) < 0)
+    return ERROR_INVALID_PARAMETER;
+
+  total = count + (index >= 0 ? database->records[index].prop_count : 0);
+  if ((props = calloc(total ? total : 1, sizeof(EmulatorProp))) == NULL)
+    return ERROR_NOT_ENOUGH_MEMORY;
+
+  /* existing properties first, then the new ones replace or add */
+  if (index >= 0)
+  {
+    record = &database->records[index];
+    props_parse(record->data, record->size, record->prop_count, props);
+    existing = record->prop_count;
+  }
+
+  if (!props_parse(data, size, count, props + existing))
+  {
+    free(props);
+    return ERROR_INVALID_PARAMETER;
+  }
+
+  /* merging never writes past the property being merged */
+  total = existing;
+  for (i = existing; i < existing + count; i++)
+  {
+    for (j = 0; j < total; j++)
+      if (props[j].propid == props[i].propid)
+        break;
+
+    if (props[i].flags & CEDB_PROPDELETE)
+    {
+      if (j < total)
+      {
+        memmove(props + j, props + j + 1, (total - j - 1) * sizeof(EmulatorProp));
+        total--;
+      }
+      continue;
+    }
+
+    props[j] = props[i];
+    if (j == total)
+      total++;
+  }
+
+  if (index >= 0)
+  {
+    /* props point into the old data, so build the new copy aside first */
+    memset(&added, 0, sizeof(added));
+    if (props_store(&added, props, total))
+    {
+      record = &database->records[index];
+      free(record->data);
+      record->data = added.data;
+      record->size = added.size;
+      record->prop_count = added.prop_count;
+    }
+    else
+      error = ERROR_NOT_ENOUGH_MEMORY;
+  }
+  else
+  {
+    if (database->record_count == database->record_alloc)
+    {
+      unsigned alloc = database->record_alloc ? database->record_alloc * 2 : 64;
+      EmulatorRecord* records = realloc(database->records, alloc * sizeof(EmulatorRecord));
+
+      if (records)
+      {
+        database->records = records;
+        database->record_alloc = alloc;
+      }
+    }
+
+    memset(&added, 0, sizeof(added));
+    if (database->record_count < database->record_alloc && props_store(&added, props, total))
+    {
+      added.oid = oid;
+      database->records[database->record_count++] = added;
+    }
+    else
+      error = ERROR_NOT_ENOUGH_MEMORY;
+  }
+
+  if (ERROR_SUCCESS == error)
+    now_filetime(&database->modified);
+
+  free(props);
+  return error;
+}
+
+static void record_write(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorHandle* entry = handle_get(emulator, get_uint32(request), HANDLE_DATABASE);
+  CEOID oid = get_uint32(request);
+  WORD count = get_uint16(request);
+  DWORD size = get_uint32(request);
+  unsigned char* data = malloc(size ? size : 1);
+  DWORD error;
+
+  if (!entry)
+    error = ERROR_INVALID_HANDLE;
+  else if (!data || (size && !rapi_buffer_read_data(request, data, size)))
+    error = ERROR_INVALID_PARAMETER;
+  else
+  {
+    bool new_record = (0 == oid);
+
+    if (new_record)
+      oid = emulator->next_oid++;
+    if ((error = record_write_props(entry->database, oid, new_record, data, size, count)) != ERROR_SUCCESS)
+      oid = 0;
+  }
+
+  rapi_buffer_write_uint32(reply, error);
+  rapi_buffer_write_uint32(reply, ERROR_SUCCESS == error ? oid : 0);
+  free(data);
+}
+
+static void record_seek(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorHandle* entry = handle_get(emulator, get_uint32(request), HANDLE_DATABASE);
+  DWORD type = get_uint32(request);
+  int32_t value = get_uint32(request);
+  int64_t index = -1;
+  DWORD error = ERROR_SUCCESS;
+
+  if (!entry)
+    error = ERROR_INVALID_HANDLE;
+  else
+  {
+    switch (type)
+    {
+      case CEDB_SEEK_CEOID:     index = record_find(entry->database, value); break;
+      case CEDB_SEEK_BEGINNING: index = value; break;
+      case CEDB_SEEK_CURRENT:   index = (int64_t)entry->position + value; break;
+      case CEDB_SEEK_END:       index = (int64_t)entry->database->record_count - 1 - value; break;
+      default:                  error = ERROR_CALL_NOT_IMPLEMENTED; break;
+    }
+
+    if (ERROR_SUCCESS == error && (index < 0 || index >= entry->database->record_count))
+      error = ERROR_SEEK;
+  }
+
+  if (ERROR_SUCCESS == error)
+    entry->position = index;
+
+  rapi_buffer_write_uint32(reply, error);
+  rapi_buffer_write_uint32(reply, ERROR_SUCCESS == error ? entry->database->records[index].oid : 0);
+  rapi_buffer_write_uint32(reply, ERROR_SUCCESS == error ? (uint32_t)index : 0);
+}
+
+static void record_delete(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  EmulatorHandle* entry = handle_get(emulator, get_uint32(request), HANDLE_DATABASE);
+  CEOID oid = get_uint32(request);
+  int index = entry ? record_find(entry->database, oid) : -1;
+  DWORD error = ERROR_SUCCESS;
+
+  if (!entry)
+    error = ERROR_INVALID_HANDLE;
+  else if (index < 0)
+    error = ERROR_INVALID_PARAMETER;
+  else
+  {
+    EmulatorDatabase* database = entry->database;
+
+    free(database->records[index].data);
+    database->record_count--;
+    memmove(database->records + index, database->records + index + 1,
+        (database->record_count - index) * sizeof(EmulatorRecord));
+    now_filetime(&database->modified);
+  }
+
+  rapi_buffer_write_uint32(reply, error);
+  rapi_buffer_write_uint32(reply, ERROR_SUCCESS == error);
+}
+
+
+/*
+ * Command tables, ids as in backend_ops_1 and backend_ops_2
+ */
+
+static const EmulatorCommandEntry rapi1_commands[] =
+{
+  { 0x08, "CeCloseHandle",        close_handle },
+  { 0x0a, "CeFindFirstDatabase",  database_find_first },
+  { 0x0b, "CeFindNextDatabase",   database_find_next },
+  { 0x0d, "CeCreateDatabase",     database_create },
+  { 0x0e, "CeOpenDatabase",       database_open },
+  { 0x0f, "CeDeleteDatabase",     database_delete },
+  { 0x10, "CeReadRecordProps",    record_read },
+  { 0x11, "CeWriteRecordProps",   record_write },
+  { 0x12, "CeDeleteRecord",       record_delete },
+  { 0x13, "CeSeekDatabase",       record_seek },
+  { 0x2c, "CeFindAllDatabases",   database_find_all },
+  { 0x3b, "CeGetVersionEx",       get_version },
+  { 0,    NULL,                   NULL }
+};
+
+static const EmulatorCommandEntry rapi2_commands[] =
+{
+  { 0x11, "CeFindFirstFile",        file_find_first },
+  { 0x12, "CeFindNextFile",         file_find_next },
+  { 0x13, "CeFindClose",            close_handle },
+  { 0x14, "CeGetFileAttributes",    file_get_attributes },
+  { 0x16, "CeCreateFile",           file_create },
+  { 0x17, "CeReadFile",             file_read },
+  { 0x18, "CeWriteFile",            file_write },
+  { 0x19, "CeCloseHandle",          close_handle },
+  { 0x1a, "CeFindAllFiles",         file_find_all },
+  { 0x26, "CeSetFilePointer",       file_set_pointer },
+  { 0x27, "CeSetEndOfFile",         file_set_end },
+  { 0x28, "CeCreateDirectory",      directory_create },
+  { 0x29, "CeRemoveDirectory",      directory_remove },
+  { 0x2b, "CeMoveFile",             file_move },
+  { 0x2c, "CeCopyFile",             file_copy },
+  { 0x2d, "CeDeleteFile",           file_delete },
+  { 0x2e, "CeGetFileSize",          file_get_size },
+  { 0x2f, "CeRegOpenKeyEx",         key_open },
+  { 0x30, "CeRegEnumKeyEx",         key_enum_key },
+  { 0x31, "CeRegCreateKeyEx",       key_create },
+  { 0x32, "CeRegCloseKey",          key_close },
+  { 0x33, "CeRegDeleteKey",         key_delete },
+  { 0x34, "CeRegEnumValue",         key_enum_value },
+  { 0x35, "CeRegDeleteValue",       key_delete_value },
+  { 0x36, "CeRegQueryInfoKey",      key_query_info },
+  { 0x37, "CeRegQueryValueEx",      key_query_value },
+  { 0x38, "CeRegSetValueEx",        key_set_value },
+  { 0x41, "CeGetFileTime",          file_get_time },
+  { 0x42, "CeSetFileTime",          file_set_time },
+  { 0x43, "CeGetVersionEx",         get_version },
+  { 0x4b, "CeGetSpecialFolderPath", special_folder_path },
+  { 0,    NULL,                     NULL }
+};
+
+static void emulator_dispatch(RapiEmulator* emulator, RapiBuffer* request, RapiBuffer* reply)
+{
+  const EmulatorCommandEntry* entry = emulator->rapi1 ? rapi1_commands : rapi2_commands;
+  uint32_t id = get_uint32(request);
+
+  for (; entry->name; entry++)
+    if (entry->id == id)
+      break;
+
+  if (emulator->rapi1)
+  {
+    /* result_1 of rapi_context_call(), 1 is followed by an HRESULT */
+    rapi_buffer_write_uint32(reply, entry->name ? 0 : 1);
+    if (!entry->name)
+      rapi_buffer_write_uint32(reply, E_NOTIMPL);
+  }
+
+  if (entry->name)
+  {
+    synce_trace("command 0x%02x %s", id, entry->name);
+    entry->function(emulator, request, reply);
+  }
+  else
+  {
+    synce_warning("command 0x%02x is not emulated", id);
+    if (!emulator->rapi1)
+    {
+      rapi_buffer_write_uint32(reply, ERROR_CALL_NOT_IMPLEMENTED);
+      rapi_buffer_write_uint32(reply, 0);
+    }
+  }
+}
+
+static uint64_t emulator_now_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* time the link needs to carry a call with these sizes */
+static uint64_t emulator_transfer_us(RapiEmulator* emulator, size_t request_size, size_t reply_size)
+{
+  if (!emulator->bytes_per_sec)
+    return 0;
+
+  return (uint64_t)(request_size + reply_size + 2 * sizeof(uint32_t)) * 1000000 / emulator->bytes_per_sec;
+}
+
+/*
+ * Replies waiting for the link, in the order they are due. Buffers
+ * stay in their slots to be reused.
+ */
+typedef struct _EmulatorReply
+{
+  RapiBuffer* buffer;
+  uint64_t due_us;
+} EmulatorReply;
+
+typedef struct _EmulatorReplyQueue
+{
+  EmulatorReply* replies;
+  unsigned capacity;
+  unsigned first;
+  unsigned count;
+  uint64_t last_due_us;
+} EmulatorReplyQueue;
+
+static EmulatorReply* reply_queue_push(EmulatorReplyQueue* queue)
+{
+  EmulatorReply* reply;
+
+  if (queue->count == queue->capacity)
+  {
+    unsigned capacity = queue->capacity ? queue->capacity * 2 : 16;
+    EmulatorReply* replies = calloc(capacity, sizeof(EmulatorReply));
+    unsigned i;
+
+    if (!replies)
+      return NULL;
+
+    for (i = 0; i < queue->capacity; i++)
+      replies[i] = queue->replies[(queue->first + i) % queue->capacity];
+
+    free(queue->replies);
+    queue->replies = replies;
+    queue->capacity = capacity;
+    queue->first = 0;
+  }
+
+  reply = &queue->replies[(queue->first + queue->count) % queue->capacity];
+  if (!reply->buffer && (reply->buffer = rapi_buffer_new()) == NULL)
+    return NULL;
+
+  rapi_buffer_clear(reply->buffer);
+  queue->count++;
+  return reply;
+}
+
+static void reply_queue_free(EmulatorReplyQueue* queue)
+{
+  unsigned i;
+
+  for (i = 0; i < queue->capacity; i++)
+    rapi_buffer_free(queue->replies[i].buffer);
+  free(queue->replies);
+}
+
+/*
+ * Send the replies that are due, and say how long until the next one
+ * is, or -1 if none is waiting
+ */
+static bool emulator_send_due(EmulatorReplyQueue* queue, SynceSocket* socket, int64_t* wait_us)
+{
+  uint64_t now = emulator_now_us();
+
+  while (queue->count)
+  {
+    EmulatorReply* reply = &queue->replies[queue->first];
+
+    if (reply->due_us > now)
+    {
+      *wait_us = reply->due_us - now;
+      return true;
+    }
+
+    if (!rapi_buffer_send(reply->buffer, socket))
+      return false;
+
+    queue->first = (queue->first + 1) % queue->capacity;
+    queue->count--;
+  }
+
+  *wait_us = -1;
+  return true;
+}
+
+/*
+ * Commands are read as soon as they arrive, and each reply is sent
+ * latency_us after its command came in, so that pipelined calls
+ * overlap their latency as on a real link. The bytes of all calls
+ * share the bandwidth.
+ */
+bool rapi_emulator_serve(RapiEmulator* emulator, SynceSocket* socket)
+{
+  RapiBuffer* request = rapi_buffer_new();
+  EmulatorReplyQueue queue;
+  int fd = synce_socket_get_descriptor(socket);
+  bool success = false;
+  char peek;
+
+  memset(&queue, 0, sizeof(queue));
+
+  if (!request)
+    goto exit;
+
+  for (;;)
+  {
+    EmulatorReply* reply;
+    struct pollfd pfd;
+    struct timespec timeout;
+    int64_t wait_us;
+    uint64_t arrived;
+    ssize_t result;
+
+    if (!emulator_send_due(&queue, socket, &wait_us))
+      break;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    timeout.tv_sec = wait_us / 1000000;
+    timeout.tv_nsec = (wait_us % 1000000) * 1000;
+
+    result = ppoll(&pfd, 1, wait_us < 0 ? NULL : &timeout, NULL);
+    if (result < 0 && EINTR != errno)
+    {
+      synce_error("poll failed: %s", strerror(errno));
+      break;
+    }
+    if (result <= 0)
+      continue;
+
+    /* a clean disconnect between commands is not an error */
+    result = recv(fd, &peek, 1, MSG_PEEK);
+
+    if (0 == result)
+    {
+      success = true;
+      break;
+    }
+
+    if (result < 0)
+    {
+      if (EINTR == errno)
+        continue;
+      synce_error("recv failed: %s", strerror(errno));
+      break;
+    }
+
+    if (!rapi_buffer_recv(request, socket))
+      break;
+
+    arrived = emulator_now_us();
+
+    if ((reply = reply_queue_push(&queue)) == NULL)
+      break;
+
+    pthread_mutex_lock(&emulator->mutex);
+    emulator_dispatch(emulator, request, reply->buffer);
+    emulator->calls++;
+    reply->due_us = arrived + emulator->latency_us;
+    if (reply->due_us < queue.last_due_us)
+      reply->due_us = queue.last_due_us;
+    reply->due_us += emulator_transfer_us(emulator,
+        rapi_buffer_get_size(request), rapi_buffer_get_size(reply->buffer));
+    pthread_mutex_unlock(&emulator->mutex);
+
+    queue.last_due_us = reply->due_us;
+  }
+
+exit:
+  rapi_buffer_free(request);
+  reply_queue_free(&queue);
+  return success;
+}
+
+typedef struct _EmulatorConnection
+{
+  RapiEmulator* emulator;
+  SynceSocket* socket;
+} EmulatorConnection;
+
+static void* emulator_thread(void* data)
+{
+  EmulatorConnection* connection = data;
+  RapiEmulator* emulator = connection->emulator;
+
+  rapi_emulator_serve(emulator, connection->socket);
+  synce_socket_free(connection->socket);
+  free(connection);
+
+  pthread_mutex_lock(&emulator->mutex);
+  if (0 == --emulator->connections)
+    pthread_cond_broadcast(&emulator->idle);
+  pthread_mutex_unlock(&emulator->mutex);
+
+  return NULL;
+}
+
+bool rapi_emulator_serve_async(RapiEmulator* emulator, SynceSocket* socket)
+{
+  EmulatorConnection* connection = malloc(sizeof(EmulatorConnection));
+  pthread_t thread;
+
+  if (!connection)
+    return false;
+
+  connection->emulator = emulator;
+  connection->socket = socket;
+
+  pthread_mutex_lock(&emulator->mutex);
+  emulator->connections++;
+  pthread_mutex_unlock(&emulator->mutex);
+
+  if (pthread_create(&thread, NULL, emulator_thread, connection) != 0)
+  {
+    synce_error("failed to start a thread: %s", strerror(errno));
+    pthread_mutex_lock(&emulator->mutex);
+    emulator->connections--;
+    pthread_mutex_unlock(&emulator->mutex);
+    free(connection);
+    return false;
+  }
+
+  pthread_detach(thread);
+  return true;
+}
+
+int rapi_emulator_start(RapiEmulator* emulator)
+{
+  SynceSocket* socket;
+  int fds[2];
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+  {
+    synce_error("socketpair failed: %s", strerror(errno));
+    return -1;
+  }
+
+  if ((socket = synce_socket_new()) == NULL)
+    goto fail;
+
+  synce_socket_take_descriptor(socket, fds[1]);
+  if (!rapi_emulator_serve_async(emulator, socket))
+  {
+    synce_socket_free(socket);
+    close(fds[0]);
+    return -1;
+  }
+
+  return fds[0];
+
+fail:
+  close(fds[0]);
+  close(fds[1]);
+  return -1;
+}
+
+RapiEmulator* rapi_emulator_new(bool rapi1)
+{
+  RapiEmulator* emulator = calloc(1, sizeof(RapiEmulator));
+  unsigned i;
+
+  if (!emulator)
+    return NULL;
+
+  emulator->rapi1 = rapi1;
+  emulator->next_oid = EMULATOR_FIRST_OID;
+  pthread_mutex_init(&emulator->mutex, NULL);
+  pthread_cond_init(&emulator->idle, NULL);
+
+  if ((emulator->files = node_new("", FILE_ATTRIBUTE_DIRECTORY)) == NULL)
+    goto fail;
+
+  for (i = 0; i < 4; i++)
+    if ((emulator->registry[i] = node_new("", 0)) == NULL)
+      goto fail;
+
+  /* what every device has */
+  file_new(emulator, emulator->files, "My Documents", FILE_ATTRIBUTE_DIRECTORY);
+  file_new(emulator, emulator->files, "Temp", FILE_ATTRIBUTE_DIRECTORY);
+  file_new(emulator, emulator->files, "Windows", FILE_ATTRIBUTE_DIRECTORY);
+
+  return emulator;
+
+fail:
+  rapi_emulator_free(emulator);
+  return NULL;
+}
+
+void rapi_emulator_free(RapiEmulator* emulator)
+{
+  unsigned i;
+
+  if (!emulator)
+    return;
+
+  pthread_mutex_lock(&emulator->mutex);
+  while (emulator->connections)
+    pthread_cond_wait(&emulator->idle, &emulator->mutex);
+  pthread_mutex_unlock(&emulator->mutex);
+
+  for (i = 0; i < emulator->handle_count; i++)
+    if (emulator->handles[i].type != HANDLE_FREE)
+      handle_close(emulator, EMULATOR_FIRST_HANDLE + i);
+  free(emulator->handles);
+
+  for (i = 0; i < emulator->database_count; i++)
+    database_free(emulator->databases[i]);
+  free(emulator->databases);
+
+  if (emulator->files)
+    node_free(emulator->files);
+  for (i = 0; i < 4; i++)
+    if (emulator->registry[i])
+      node_free(emulator->registry[i]);
+
+  pthread_cond_destroy(&emulator->idle);
+  pthread_mutex_destroy(&emulator->mutex);
+  free(emulator);
+}
+
+const RapiEmulatorLink* rapi_emulator_find_link(const char* name)
+{
+  const RapiEmulatorLink* link;
+
+  for (link = links; link->name; link++)
+    if (0 == strcasecmp(link->name, name))
+      return link;
+
+  return NULL;
+}
+
+void rapi_emulator_set_link(RapiEmulator* emulator, unsigned latency_us, unsigned bytes_per_sec)
+{
+  pthread_mutex_lock(&emulator->mutex);
+  emulator->latency_us = latency_us;
+  emulator->bytes_per_sec = bytes_per_sec;
+  pthread_mutex_unlock(&emulator->mutex);
+}
+
+char* rapi_emulator_env_value(RapiEmulator* emulator, const char* address)
+{
+  char* value = NULL;
+
+  if (asprintf(&value, "%s,%u.%u", address,
+        emulator->rapi1 ? RAPI1_OS_MAJOR : RAPI2_OS_MAJOR,
+        emulator->rapi1 ? RAPI1_OS_MINOR : RAPI2_OS_MINOR) < 0)
+    return NULL;
+
+  return value;
+}
+
+unsigned rapi_emulator_get_calls(RapiEmulator* emulator)
+{
+  unsigned calls;
+
+  pthread_mutex_lock(&emulator->mutex);
+  calls = emulator->calls;
+  pthread_mutex_unlock(&emulator->mutex);
+
+  return calls;
+}
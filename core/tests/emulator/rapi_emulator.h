@@ -0,0 +1,93 @@
+/* $Id$ */
+#ifndef __rapi_emulator_h__
+#define __rapi_emulator_h__
+
+/*
+ * An in-memory Windows CE device for tests and benchmarks. It keeps a
+ * filesystem, a registry and CEDB databases and answers commands with
+ * the framing rapi_buffer_send() and rapi_buffer_recv() use, over TCP,
+ * a Unix domain socket or a socketpair.
+ *
+ * The emulator speaks RAPI2 (file and registry calls) or RAPI1 (the
+ * CEDB database calls; RAPI2 has none). Point rapi_context_connect()
+ * at it by setting SYNCE_EMULATOR to the value of
+ * rapi_emulator_env_value(), which also carries the OS version that
+ * makes the client pick the matching protocol.
+ */
+
+#include <synce.h>
+#include <synce_socket.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct _RapiEmulator RapiEmulator;
+
+/*
+ * Delay added to each call to mimic a real link: a reply is sent
+ * latency_us after its command arrived, plus the time the request and
+ * reply bytes take at bytes_per_sec. Pipelined calls overlap their
+ * latency but not their bytes.
+ */
+typedef struct _RapiEmulatorLink
+{
+  const char* name;
+  unsigned latency_us;
+  unsigned bytes_per_sec;   /* 0 for no limit */
+} RapiEmulatorLink;
+
+/*
+ * Create an empty device, speaking RAPI1 instead of RAPI2 if rapi1
+ */
+RapiEmulator* rapi_emulator_new(bool rapi1);
+
+/*
+ * Wait for all connections served from threads to end, then free the
+ * device and everything in it
+ */
+void rapi_emulator_free(RapiEmulator* emulator);
+
+/*
+ * Link presets: "none", "rndis" and "serial", or NULL if unknown
+ */
+const RapiEmulatorLink* rapi_emulator_find_link(const char* name);
+
+/*
+ * Change the link delays, also while connections are served
+ */
+void rapi_emulator_set_link(RapiEmulator* emulator, unsigned latency_us, unsigned bytes_per_sec);
+
+/*
+ * Answer commands on socket until the peer disconnects
+ */
+bool rapi_emulator_serve(RapiEmulator* emulator, SynceSocket* socket);
+
+/*
+ * Serve socket from a new thread, which frees it when done
+ */
+bool rapi_emulator_serve_async(RapiEmulator* emulator, SynceSocket* socket);
+
+/*
+ * Serve one end of a new socketpair from a thread and return the other
+ * end, or -1 on failure. Use "fd:N" as the address for it.
+ */
+int rapi_emulator_start(RapiEmulator* emulator);
+
+/*
+ * SYNCE_EMULATOR value for reaching the emulator at address (HOST:PORT,
+ * a socket path or fd:N); free it with free()
+ */
+char* rapi_emulator_env_value(RapiEmulator* emulator, const char* address);
+
+/*
+ * Number of commands answered so far
+ */
+unsigned rapi_emulator_get_calls(RapiEmulator* emulator);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
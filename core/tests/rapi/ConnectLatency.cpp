@@ -0,0 +1,75 @@
+// $Id$
+//
+// Time what a short lived tool like pls spends before its first RAPI
+// call, with and without cached device information. Needs a device.
+//
+// Usage: ConnectLatency [rounds]
+//
+#include "test.h"
+
+extern "C" {
+#include <stdlib.h>
+}
+
+static double lookup(bool cached)
+{
+	if (!cached)
+		synce_info_cache_invalidate();
+
+	double start = monotonic_seconds();
+	SynceInfo* info = synce_info_new(NULL);
+	double elapsed = monotonic_seconds() - start;
+
+	if (!info)
+		return -1;
+	synce_info_destroy(info);
+	return elapsed;
+}
+
+static double init(bool cached)
+{
+	if (!cached)
+		synce_info_cache_invalidate();
+
+	double start = monotonic_seconds();
+	if (FAILED(CeRapiInit()))
+		return -1;
+	double elapsed = monotonic_seconds() - start;
+
+	CeRapiUninit();
+	return elapsed;
+}
+
+static int report(const char* label, double (*measure)(bool), unsigned rounds)
+{
+	double cold = 0, warm = 0, t;
+
+	for (unsigned i = 0; i < rounds; i++)
+	{
+		if ((t = measure(false)) < 0)
+			return TEST_FAILED;
+		cold += t;
+		if ((t = measure(true)) < 0)
+			return TEST_FAILED;
+		warm += t;
+	}
+
+	printf("  %-16s %8.2f ms uncached, %8.2f ms cached\n", label,
+			cold * 1e3 / rounds, warm * 1e3 / rounds);
+	return TEST_SUCCEEDED;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned rounds = argc > 1 ? atoi(argv[1]) : 20;
+
+	printf("%u rounds:\n", rounds);
+	if (report("synce_info_new", lookup, rounds) != TEST_SUCCEEDED ||
+			report("CeRapiInit", init, rounds) != TEST_SUCCEEDED)
+	{
+		printf("FAIL: no device\n");
+		return TEST_FAILED;
+	}
+
+	return TEST_SUCCEEDED;
+}
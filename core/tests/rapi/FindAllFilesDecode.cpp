@@ -0,0 +1,187 @@
+// $Id$
+//
+// Benchmark of decoding a CeFindAllFiles reply, needs no device.
+//
+// Usage: FindAllFilesDecode [entries] [rounds]
+//
+#include "test.h"
+
+extern "C" {
+#include <stdlib.h>
+#include "rapi_buffer.h"
+}
+
+#define ALL_FIELDS (FAF_ATTRIBUTES | FAF_CREATION_TIME | FAF_LASTACCESS_TIME | \
+		FAF_LASTWRITE_TIME | FAF_SIZE_HIGH | FAF_SIZE_LOW | FAF_OID | FAF_NAME)
+
+//
+// Build a RAPI2 style reply with entries named like "file00042.txt"
+//
+static void make_reply(RapiBuffer* buffer, uint32_t flags, unsigned count)
+{
+	char name[32];
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		snprintf(name, sizeof(name), "file%05u.txt", i);
+		WCHAR* wide = wstr_from_ascii(name);
+		uint32_t name_size = (strlen(name) + 1) * sizeof(WCHAR);
+
+		if (flags & FAF_NAME)
+			rapi_buffer_write_uint32(buffer, name_size);
+		if (flags & FAF_ATTRIBUTES)
+			rapi_buffer_write_uint32(buffer, 0x20);
+		if (flags & FAF_CREATION_TIME)
+		{
+			rapi_buffer_write_uint32(buffer, i);
+			rapi_buffer_write_uint32(buffer, 0x01c00000);
+		}
+		if (flags & FAF_LASTACCESS_TIME)
+		{
+			rapi_buffer_write_uint32(buffer, i + 1);
+			rapi_buffer_write_uint32(buffer, 0x01c00000);
+		}
+		if (flags & FAF_LASTWRITE_TIME)
+		{
+			rapi_buffer_write_uint32(buffer, i + 2);
+			rapi_buffer_write_uint32(buffer, 0x01c00000);
+		}
+		if (flags & FAF_SIZE_HIGH)
+			rapi_buffer_write_uint32(buffer, 0);
+		if (flags & FAF_SIZE_LOW)
+			rapi_buffer_write_uint32(buffer, i * 512);
+		if (flags & FAF_OID)
+			rapi_buffer_write_uint32(buffer, 0x10000 + i);
+		if (flags & FAF_NAME)
+			rapi_buffer_write_data(buffer, wide, name_size);
+
+		wstr_free_string(wide);
+	}
+}
+
+//
+// The decoder CeFindAllFiles used before, one call per field
+//
+static bool decode_per_field(RapiBuffer* buffer, uint32_t flags, CE_FIND_DATA* array, unsigned count)
+{
+	uint32_t name_size = 0;
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		if (flags & FAF_NAME)
+			rapi_buffer_read_uint32(buffer, &name_size);
+		if (flags & FAF_ATTRIBUTES)
+			rapi_buffer_read_uint32(buffer, &array[i].dwFileAttributes);
+		if (flags & FAF_CREATION_TIME)
+		{
+			rapi_buffer_read_uint32(buffer, &array[i].ftCreationTime.dwLowDateTime);
+			rapi_buffer_read_uint32(buffer, &array[i].ftCreationTime.dwHighDateTime);
+		}
+		if (flags & FAF_LASTACCESS_TIME)
+		{
+			rapi_buffer_read_uint32(buffer, &array[i].ftLastAccessTime.dwLowDateTime);
+			rapi_buffer_read_uint32(buffer, &array[i].ftLastAccessTime.dwHighDateTime);
+		}
+		if (flags & FAF_LASTWRITE_TIME)
+		{
+			rapi_buffer_read_uint32(buffer, &array[i].ftLastWriteTime.dwLowDateTime);
+			rapi_buffer_read_uint32(buffer, &array[i].ftLastWriteTime.dwHighDateTime);
+		}
+		if (flags & FAF_SIZE_HIGH)
+			rapi_buffer_read_uint32(buffer, &array[i].nFileSizeHigh);
+		if (flags & FAF_SIZE_LOW)
+			rapi_buffer_read_uint32(buffer, &array[i].nFileSizeLow);
+		if (flags & FAF_OID)
+			rapi_buffer_read_uint32(buffer, &array[i].dwOID);
+		if (flags & FAF_NAME)
+		{
+			if (!rapi_buffer_read_data(buffer, array[i].cFileName, name_size))
+				return false;
+			synce_trace_wstr(array[i].cFileName);
+		}
+	}
+
+	return true;
+}
+
+static bool decode_bulk(RapiBuffer* buffer, uint32_t flags, CE_FIND_DATA* array, unsigned count)
+{
+	return rapi_buffer_read_find_data_array(buffer, flags, 1, array, count);
+}
+
+typedef bool (*Decoder)(RapiBuffer*, uint32_t, CE_FIND_DATA*, unsigned);
+
+//
+// Decode the reply in wire rounds times, only the decoding is timed
+//
+static double run(const char* label, Decoder decode, RapiBuffer* wire,
+		uint32_t flags, CE_FIND_DATA* array, unsigned count, unsigned rounds)
+{
+	RapiBuffer* reply = rapi_buffer_new();
+	size_t size = rapi_buffer_get_size(wire);
+	double elapsed = 0;
+
+	for (unsigned r = 0; r < rounds; r++)
+	{
+		unsigned char* data = (unsigned char*)malloc(size);
+		memcpy(data, rapi_buffer_get_raw(wire), size);
+		rapi_buffer_reset(reply, data, size);
+
+		double start = monotonic_seconds();
+		bool ok = decode(reply, flags, array, count);
+		elapsed += monotonic_seconds() - start;
+
+		if (!ok)
+		{
+			printf("%s: decoding failed\n", label);
+			rapi_buffer_free(reply);
+			return 0;
+		}
+	}
+
+	rapi_buffer_free(reply);
+
+	double rate = (double)count * rounds / elapsed;
+	printf("  %-10s %12.0f entries/s\n", label, rate);
+	return rate;
+}
+
+static int bench(const char* label, uint32_t flags, unsigned count, unsigned rounds)
+{
+	RapiBuffer* buffer = rapi_buffer_new();
+	CE_FIND_DATA* expected = (CE_FIND_DATA*)calloc(count, sizeof(CE_FIND_DATA));
+	CE_FIND_DATA* actual = (CE_FIND_DATA*)calloc(count, sizeof(CE_FIND_DATA));
+
+	make_reply(buffer, flags, count);
+	printf("%s, %u entries in %u bytes:\n", label, count, (unsigned)rapi_buffer_get_size(buffer));
+
+	double before = run("per field", decode_per_field, buffer, flags, expected, count, rounds);
+	double after = run("bulk", decode_bulk, buffer, flags, actual, count, rounds);
+
+	int result = TEST_SUCCEEDED;
+	if (memcmp(expected, actual, count * sizeof(CE_FIND_DATA)) != 0)
+	{
+		printf("FAIL: decoders disagree\n");
+		result = TEST_FAILED;
+	}
+	else if (before > 0)
+		printf("  speedup    %12.2fx\n", after / before);
+
+	free(expected);
+	free(actual);
+	rapi_buffer_free(buffer);
+	return result;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned count = argc > 1 ? atoi(argv[1]) : 20000;
+	unsigned rounds = argc > 2 ? atoi(argv[2]) : 50;
+
+	if (bench("all fields", ALL_FIELDS, count, rounds) != TEST_SUCCEEDED)
+		return TEST_FAILED;
+	if (bench("names and sizes", FAF_NAME | FAF_SIZE_LOW | FAF_ATTRIBUTES, count, rounds) != TEST_SUCCEEDED)
+		return TEST_FAILED;
+
+	return TEST_SUCCEEDED;
+}
@@ -0,0 +1,611 @@
+// $Id$
+//
+// Throughput and latency of representative RAPI calls. By default the
+// calls go to an in-process emulator, so the numbers show the cost of
+// the client side: rapi_buffer, rapi_context and the backend ops.
+//
+// Usage: rapi-bench [-D] [-j] [-l LINK] [-n CALLS] [-f FILTER] [-d LEVEL]
+//
+//   -D         Use a real device, or the emulator SYNCE_EMULATOR points at
+//   -j         One JSON object per benchmark instead of a table
+//   -l LINK    Link the in-process emulator mimics: none, rndis or serial
+//   -n CALLS   Timed calls per benchmark (default 2000)
+//   -f FILTER  Only run benchmarks whose name contains FILTER
+//
+// Allocations per call are counted on the calling thread only, so the
+// emulator threads do not show up in them.
+//
+#include "test.h"
+#include "rapi_emulator.h"
+
+extern "C" {
+#include <stdlib.h>
+#include <synce_log.h>
+}
+
+#include <algorithm>
+#include <vector>
+
+#define BENCH_DIRECTORY     "\\Temp\\rapi-bench"
+#define BENCH_KEY           "Software\\SynCE\\rapi-bench"
+#define BENCH_DATABASE      "rapi-bench"
+#define BENCH_FILES         100
+#define BENCH_VALUES        32
+#define BENCH_RECORDS       1000
+#define BENCH_CHUNKS        16
+#define WARMUP_CALLS        10
+
+//
+// Allocation counting, by wrapping the glibc allocator
+//
+static __thread bool counting = false;
+static __thread unsigned long allocations = 0;
+
+#ifdef __GLIBC__
+#define HAVE_ALLOCATION_COUNT 1
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size)
+{
+	if (counting)
+		allocations++;
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+	if (counting)
+		allocations++;
+	return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+	if (counting)
+		allocations++;
+	return __libc_realloc(ptr, size);
+}
+}
+#else
+#define HAVE_ALLOCATION_COUNT 0
+#endif
+
+//
+// What the benchmarks share; set up by the setup functions
+//
+static struct
+{
+	WCHAR* directory;
+	WCHAR* pattern;
+	WCHAR* file;
+	HANDLE handle;
+	unsigned size;
+	unsigned calls;
+	unsigned char* buffer;
+	HKEY key;
+	CEOID database;
+	LPBYTE record;
+	DWORD record_size;
+} state;
+
+struct Bench
+{
+	const char* name;
+	unsigned size;
+	// needs the RAPI1 database calls
+	bool database;
+	bool (*setup)(Bench* bench);
+	// untimed, before every call
+	bool (*prepare)(Bench* bench);
+	bool (*call)(Bench* bench);
+	void (*teardown)(Bench* bench);
+	// bytes moved by one call, for MB/s
+	unsigned bytes;
+};
+
+static WCHAR* wide(const char* utf8)
+{
+	return wstr_from_utf8(utf8);
+}
+
+static WCHAR* bench_file_name(unsigned i)
+{
+	char name[64];
+	snprintf(name, sizeof(name), BENCH_DIRECTORY "\\file%04u.dat", i);
+	return wide(name);
+}
+
+//
+// Files
+//
+static bool files_setup(Bench* bench)
+{
+	state.directory = wide(BENCH_DIRECTORY);
+	state.pattern = wide(BENCH_DIRECTORY "\\*.*");
+	CeCreateDirectory(state.directory, NULL);
+
+	for (unsigned i = 0; i < BENCH_FILES; i++)
+	{
+		WCHAR* name = bench_file_name(i);
+		HANDLE handle = CeCreateFile(name, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+		DWORD written;
+
+		wstr_free_string(name);
+		if (INVALID_HANDLE_VALUE == handle)
+			return false;
+
+		CeWriteFile(handle, "rapi-bench", 10, &written, NULL);
+		CeCloseHandle(handle);
+	}
+
+	state.file = bench_file_name(0);
+	return true;
+}
+
+static void files_teardown(Bench* bench)
+{
+	for (unsigned i = 0; i < BENCH_FILES; i++)
+	{
+		WCHAR* name = bench_file_name(i);
+		CeDeleteFile(name);
+		wstr_free_string(name);
+	}
+
+	CeRemoveDirectory(state.directory);
+	wstr_free_string(state.directory);
+	wstr_free_string(state.pattern);
+	wstr_free_string(state.file);
+	state.directory = state.pattern = state.file = NULL;
+}
+
+static bool get_file_attributes(Bench* bench)
+{
+	return CeGetFileAttributes(state.file) != 0xFFFFFFFF;
+}
+
+static bool find_all_files(Bench* bench)
+{
+	LPCE_FIND_DATA data = NULL;
+	DWORD count = 0;
+
+	if (!CeFindAllFiles(state.pattern, FAF_NAME | FAF_ATTRIBUTES | FAF_SIZE_LOW | FAF_LASTWRITE_TIME,
+				&count, &data))
+		return false;
+
+	CeRapiFreeBuffer(data);
+	return BENCH_FILES == count;
+}
+
+//
+// Reading and writing in chunks of bench->size
+//
+static bool chunks_setup(Bench* bench)
+{
+	DWORD written;
+
+	state.file = wide(BENCH_DIRECTORY "\\chunks.dat");
+	state.directory = wide(BENCH_DIRECTORY);
+	state.size = bench->size;
+	state.calls = 0;
+	state.buffer = (unsigned char*)calloc(1, state.size);
+	CeCreateDirectory(state.directory, NULL);
+
+	state.handle = CeCreateFile(state.file, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (INVALID_HANDLE_VALUE == state.handle)
+		return false;
+
+	for (unsigned i = 0; i < BENCH_CHUNKS; i++)
+		if (!CeWriteFile(state.handle, state.buffer, state.size, &written, NULL))
+			return false;
+
+	bench->bytes = state.size;
+	return true;
+}
+
+static void chunks_teardown(Bench* bench)
+{
+	if (state.handle != INVALID_HANDLE_VALUE)
+		CeCloseHandle(state.handle);
+	state.handle = INVALID_HANDLE_VALUE;
+
+	CeDeleteFile(state.file);
+	CeRemoveDirectory(state.directory);
+	wstr_free_string(state.file);
+	wstr_free_string(state.directory);
+	free(state.buffer);
+	state.file = state.directory = NULL;
+	state.buffer = NULL;
+}
+
+static bool chunks_prepare(Bench* bench)
+{
+	if (0 == state.calls++ % BENCH_CHUNKS)
+		return CeSetFilePointer(state.handle, 0, NULL, FILE_BEGIN) == 0;
+	return true;
+}
+
+static bool read_file(Bench* bench)
+{
+	DWORD read = 0;
+	return CeReadFile(state.handle, state.buffer, state.size, &read, NULL) && read == state.size;
+}
+
+static bool write_file(Bench* bench)
+{
+	DWORD written = 0;
+	return CeWriteFile(state.handle, state.buffer, state.size, &written, NULL) && written == state.size;
+}
+
+//
+// Registry
+//
+static bool values_setup(Bench* bench)
+{
+	WCHAR* subkey = wide(BENCH_KEY);
+	DWORD disposition;
+	LONG result = CeRegCreateKeyEx(HKEY_CURRENT_USER, subkey, 0, NULL, 0, 0, NULL,
+			&state.key, &disposition);
+
+	wstr_free_string(subkey);
+	if (result != ERROR_SUCCESS)
+		return false;
+
+	for (unsigned i = 0; i < BENCH_VALUES; i++)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "value%02u", i);
+		WCHAR* value_name = wide(name);
+		WCHAR* data = wide("a typical string value");
+
+		result = CeRegSetValueEx(state.key, value_name, 0, REG_SZ, (BYTE*)data,
+				(wstrlen(data) + 1) * sizeof(WCHAR));
+		wstr_free_string(value_name);
+		wstr_free_string(data);
+		if (result != ERROR_SUCCESS)
+			return false;
+	}
+
+	state.calls = 0;
+	return true;
+}
+
+static void values_teardown(Bench* bench)
+{
+	WCHAR* subkey = wide(BENCH_KEY);
+
+	CeRegCloseKey(state.key);
+	CeRegDeleteKey(HKEY_CURRENT_USER, subkey);
+	wstr_free_string(subkey);
+}
+
+static bool reg_enum_value(Bench* bench)
+{
+	WCHAR name[64];
+	BYTE data[256];
+	DWORD name_size = sizeof(name) / sizeof(WCHAR);
+	DWORD data_size = sizeof(data);
+	DWORD type;
+
+	return ERROR_SUCCESS == CeRegEnumValue(state.key, state.calls++ % BENCH_VALUES,
+			name, &name_size, NULL, &type, data, &data_size);
+}
+
+//
+// Databases, read with CEDB_AUTOINCREMENT
+//
+static bool records_setup(Bench* bench)
+{
+	WCHAR* name = wide(BENCH_DATABASE);
+	WCHAR* text = wide("a record of the kind a contact or appointment has");
+	SORTORDERSPEC sort = { 0x00010013, 0 };
+	CEOID oid = 0;
+	HANDLE handle;
+	CEPROPVAL props[3];
+
+	memset(props, 0, sizeof(props));
+	props[0].propid = 0x00010013;       // CEVT_UI4
+	props[1].propid = 0x0002001f;       // CEVT_LPWSTR
+	props[1].val.lpwstr = text;
+	props[2].propid = 0x00030040;       // CEVT_FILETIME
+
+	state.database = CeCreateDatabase(name, 0x42454e43, 1, &sort);
+	handle = state.database ? CeOpenDatabase(&oid, name, 0, CEDB_AUTOINCREMENT, 0) : INVALID_HANDLE_VALUE;
+	wstr_free_string(name);
+
+	if (INVALID_HANDLE_VALUE == handle)
+	{
+		wstr_free_string(text);
+		return false;
+	}
+
+	for (unsigned i = 0; i < BENCH_RECORDS; i++)
+	{
+		props[0].val.ulVal = i;
+		if (!CeWriteRecordProps(handle, 0, 3, props))
+		{
+			wstr_free_string(text);
+			CeCloseHandle(handle);
+			return false;
+		}
+	}
+
+	wstr_free_string(text);
+	state.handle = handle;
+	state.record = NULL;
+	state.record_size = 0;
+	state.calls = 0;
+	return true;
+}
+
+static void records_teardown(Bench* bench)
+{
+	if (state.handle != INVALID_HANDLE_VALUE)
+		CeCloseHandle(state.handle);
+	state.handle = INVALID_HANDLE_VALUE;
+
+	if (state.database)
+		CeDeleteDatabase(state.database);
+	state.database = 0;
+
+	free(state.record);
+	state.record = NULL;
+}
+
+static bool records_prepare(Bench* bench)
+{
+	DWORD index;
+
+	if (0 == state.calls++ % BENCH_RECORDS)
+		return CeSeekDatabase(state.handle, CEDB_SEEK_BEGINNING, 0, &index) != 0;
+	return true;
+}
+
+static bool read_record_props(Bench* bench)
+{
+	WORD count = 0;
+
+	// the buffer is kept and grown as an application would
+	return CeReadRecordProps(state.handle, CEDB_ALLOWREALLOC, &count, NULL,
+			&state.record, &state.record_size) != 0 && 3 == count;
+}
+
+static Bench benches[] =
+{
+	{ "CeGetFileAttributes", 0,     false, files_setup,   NULL,            get_file_attributes, files_teardown,   0 },
+	{ "CeFindAllFiles",      BENCH_FILES, false, files_setup, NULL,        find_all_files,      files_teardown,   0 },
+	{ "CeReadFile",          512,   false, chunks_setup,  chunks_prepare,  read_file,           chunks_teardown,  0 },
+	{ "CeReadFile",          4096,  false, chunks_setup,  chunks_prepare,  read_file,           chunks_teardown,  0 },
+	{ "CeReadFile",          65536, false, chunks_setup,  chunks_prepare,  read_file,           chunks_teardown,  0 },
+	{ "CeWriteFile",         512,   false, chunks_setup,  chunks_prepare,  write_file,          chunks_teardown,  0 },
+	{ "CeWriteFile",         4096,  false, chunks_setup,  chunks_prepare,  write_file,          chunks_teardown,  0 },
+	{ "CeWriteFile",         65536, false, chunks_setup,  chunks_prepare,  write_file,          chunks_teardown,  0 },
+	{ "CeRegEnumValue",      BENCH_VALUES, false, values_setup, NULL,      reg_enum_value,      values_teardown,  0 },
+	{ "CeReadRecordProps",   BENCH_RECORDS, true, records_setup, records_prepare, read_record_props, records_teardown, 0 },
+	{ NULL,                  0,     false, NULL,          NULL,            NULL,                NULL,             0 }
+};
+
+struct Result
+{
+	unsigned calls;
+	double elapsed;
+	double p50;
+	double p99;
+	double allocations;
+};
+
+//
+// Time calls calls one at a time, with prepare outside the timing
+//
+static bool measure(Bench* bench, unsigned calls, Result* result)
+{
+	std::vector<double> times;
+	unsigned long counted = 0;
+
+	times.reserve(calls);
+
+	for (unsigned i = 0; i < WARMUP_CALLS; i++)
+		if ((bench->prepare && !bench->prepare(bench)) || !bench->call(bench))
+			return false;
+
+	for (unsigned i = 0; i < calls; i++)
+	{
+		if (bench->prepare && !bench->prepare(bench))
+			return false;
+
+		allocations = 0;
+		double start = monotonic_seconds();
+		counting = true;
+		bool ok = bench->call(bench);
+		counting = false;
+		times.push_back(monotonic_seconds() - start);
+		counted += allocations;
+
+		if (!ok)
+			return false;
+	}
+
+	result->calls = calls;
+	result->elapsed = 0;
+	for (unsigned i = 0; i < calls; i++)
+		result->elapsed += times[i];
+
+	std::sort(times.begin(), times.end());
+	result->p50 = times[calls / 2];
+	result->p99 = times[(calls * 99) / 100 < calls ? (calls * 99) / 100 : calls - 1];
+	result->allocations = HAVE_ALLOCATION_COUNT ? (double)counted / calls : -1;
+	return true;
+}
+
+static void report(Bench* bench, Result* result, const char* link, bool json)
+{
+	double rate = result->calls / result->elapsed;
+	double mbps = bench->bytes * rate / (1024 * 1024);
+
+	if (json)
+	{
+		printf("{\"bench\":\"%s\",\"size\":%u,\"link\":\"%s\",\"calls\":%u,"
+				"\"calls_per_sec\":%.1f,\"p50_us\":%.2f,\"p99_us\":%.2f,"
+				"\"allocs_per_call\":%.2f,\"mb_per_sec\":%.2f}\n",
+				bench->name, bench->size, link, result->calls, rate,
+				result->p50 * 1e6, result->p99 * 1e6, result->allocations, mbps);
+	}
+	else
+	{
+		printf("%-20s %6u %10.0f %9.1f %9.1f %8.2f",
+				bench->name, bench->size, rate, result->p50 * 1e6, result->p99 * 1e6,
+				result->allocations);
+		if (bench->bytes)
+			printf(" %8.2f", mbps);
+		printf("\n");
+	}
+	fflush(stdout);
+}
+
+static void report_skipped(Bench* bench, const char* link, bool json)
+{
+	if (json)
+		printf("{\"bench\":\"%s\",\"size\":%u,\"link\":\"%s\",\"skipped\":true}\n",
+				bench->name, bench->size, link);
+	else
+		printf("%-20s %6u   skipped, not supported by the device\n", bench->name, bench->size);
+}
+
+//
+// Point CeRapiInit at a fresh connection to emulator, if any
+//
+static bool connect_session(RapiEmulator* emulator)
+{
+	if (emulator)
+	{
+		char address[32];
+		int fd = rapi_emulator_start(emulator);
+
+		if (fd < 0)
+			return false;
+
+		snprintf(address, sizeof(address), "fd:%i", fd);
+		char* value = rapi_emulator_env_value(emulator, address);
+		setenv("SYNCE_EMULATOR", value, 1);
+		free(value);
+	}
+
+	return SUCCEEDED(CeRapiInit());
+}
+
+static int run(RapiEmulator* emulator, bool database, bool device,
+		unsigned calls, const char* filter, const char* link, bool json)
+{
+	int result = TEST_SUCCEEDED;
+
+	if (!connect_session(emulator))
+	{
+		printf("FAIL: unable to connect\n");
+		return TEST_FAILED;
+	}
+
+	for (Bench* bench = benches; bench->name; bench++)
+	{
+		Result measured;
+
+		// with a device, everything goes over the one connection
+		if (!device && bench->database != database)
+			continue;
+		if (filter && !strstr(bench->name, filter))
+			continue;
+
+		state.handle = INVALID_HANDLE_VALUE;
+		if (!bench->setup(bench))
+		{
+			bench->teardown(bench);
+			if (bench->database)
+				report_skipped(bench, link, json);
+			else
+			{
+				printf("FAIL: %s setup\n", bench->name);
+				result = TEST_FAILED;
+			}
+			continue;
+		}
+
+		if (measure(bench, calls, &measured))
+			report(bench, &measured, link, json);
+		else
+		{
+			printf("FAIL: %s %u\n", bench->name, bench->size);
+			result = TEST_FAILED;
+		}
+
+		bench->teardown(bench);
+	}
+
+	CeRapiUninit();
+	return result;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned calls = 2000;
+	const char* filter = NULL;
+	const char* link_name = "none";
+	bool device = false;
+	bool json = false;
+	int log_level = SYNCE_LOG_LEVEL_LOWEST;
+	int c;
+
+	while ((c = getopt(argc, argv, "Dd:f:jl:n:")) != -1)
+	{
+		switch (c)
+		{
+			case 'D': device = true; break;
+			case 'd': log_level = atoi(optarg); break;
+			case 'f': filter = optarg; break;
+			case 'j': json = true; break;
+			case 'l': link_name = optarg; break;
+			case 'n': calls = atoi(optarg); break;
+			default:
+				fprintf(stderr, "Usage: %s [-D] [-j] [-l LINK] [-n CALLS] [-f FILTER] [-d LEVEL]\n", argv[0]);
+				return TEST_FAILED;
+		}
+	}
+
+	synce_log_set_level(log_level);
+
+	if (0 == calls)
+		calls = 1;
+
+	if (!json)
+		printf("%-20s %6s %10s %9s %9s %8s %8s\n",
+				"bench", "size", "calls/s", "p50 us", "p99 us", "allocs", "MB/s");
+
+	if (device)
+		return run(NULL, false, true, calls, filter, "device", json);
+
+	const RapiEmulatorLink* link = rapi_emulator_find_link(link_name);
+	if (!link)
+	{
+		fprintf(stderr, "%s: unknown link '%s'\n", argv[0], link_name);
+		return TEST_FAILED;
+	}
+
+	// the file and registry calls over RAPI2, the database calls over RAPI1
+	int result = TEST_SUCCEEDED;
+	for (int rapi1 = 0; rapi1 < 2; rapi1++)
+	{
+		RapiEmulator* emulator = rapi_emulator_new(rapi1);
+
+		if (!emulator)
+			return TEST_FAILED;
+
+		rapi_emulator_set_link(emulator, link->latency_us, link->bytes_per_sec);
+		if (run(emulator, rapi1, false, calls, filter, link->name, json) != TEST_SUCCEEDED)
+			result = TEST_FAILED;
+		rapi_emulator_free(emulator);
+	}
+
+	return result;
+}
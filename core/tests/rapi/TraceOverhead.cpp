@@ -0,0 +1,53 @@
+// $Id$
+//
+// Benchmark of what a disabled trace message costs, needs no device.
+//
+// Usage: TraceOverhead [calls]
+//
+#include "test.h"
+
+extern "C" {
+#include <stdlib.h>
+#include <synce_log.h>
+}
+
+static void report(const char* label, double elapsed, unsigned calls)
+{
+	printf("  %-24s %8.2f ns/call\n", label, elapsed * 1e9 / calls);
+}
+
+int main(int argc, char** argv)
+{
+	unsigned calls = argc > 1 ? atoi(argv[1]) : 10000000;
+	volatile unsigned sink = 0;
+	double start;
+
+	synce_log_set_level(SYNCE_LOG_LEVEL_DEFAULT);
+	printf("%u trace calls at the default log level:\n", calls);
+
+	// what synce_trace() expanded to before, a call that returns at once
+	start = monotonic_seconds();
+	for (unsigned i = 0; i < calls; i++)
+	{
+		sink = i;
+		_synce_log(SYNCE_LOG_LEVEL_TRACE, __PRETTY_FUNCTION__, __LINE__,
+				"size=0x%08x read_index=%u", i, sink);
+	}
+	report("unconditional call", monotonic_seconds() - start, calls);
+
+	start = monotonic_seconds();
+	for (unsigned i = 0; i < calls; i++)
+	{
+		sink = i;
+		synce_trace("size=0x%08x read_index=%u", i, sink);
+	}
+	report("level check", monotonic_seconds() - start, calls);
+
+	// with --disable-trace the message is gone, this is the bare loop
+	start = monotonic_seconds();
+	for (unsigned i = 0; i < calls; i++)
+		sink = i;
+	report("compiled out", monotonic_seconds() - start, calls);
+
+	return TEST_SUCCEEDED;
+}
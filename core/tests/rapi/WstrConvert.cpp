@@ -0,0 +1,175 @@
+// $Id$
+//
+// Benchmark of UCS2 <-> UTF-8 conversion against a fresh iconv
+// descriptor per call, as wstr_to_utf8() used to do. Needs no device.
+//
+// Usage: WstrConvert [calls]
+//
+#include "test.h"
+
+extern "C" {
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <iconv.h>
+}
+
+//
+// The conversion as it was: iconv_open, a guessed size, iconv_close
+//
+static char* old_to_utf8(LPCWSTR unicode)
+{
+	size_t length = wstrlen(unicode);
+	size_t inbytesleft = length * 2, outbytesleft = length * 3;
+	char* outbuf = (char*)malloc(outbytesleft + 1);
+	char* out = outbuf;
+	char* in = (char*)unicode;
+	iconv_t cd = iconv_open("UTF-8", "ucs-2le");
+
+	iconv(cd, &in, &inbytesleft, &out, &outbytesleft);
+	iconv_close(cd);
+	*out = '\0';
+	return outbuf;
+}
+
+static LPWSTR old_from_utf8(const char* utf8)
+{
+	size_t length = strlen(utf8);
+	size_t inbytesleft = length, outbytesleft = (length + 1) * 2;
+	LPWSTR outbuf = (LPWSTR)malloc(outbytesleft + sizeof(WCHAR));
+	char* out = (char*)outbuf;
+	char* in = (char*)utf8;
+	iconv_t cd = iconv_open("ucs-2le", "UTF-8");
+	size_t result = iconv(cd, &in, &inbytesleft, &out, &outbytesleft);
+
+	iconv_close(cd);
+	if ((size_t)-1 == result)
+	{
+		free(outbuf);
+		return NULL;
+	}
+	*(LPWSTR)out = '\0';
+	return outbuf;
+}
+
+// a path, a name with accents, a name in kana, one beyond the BMP
+static const char* samples[] = {
+	"\\My Documents\\Personal\\Meeting notes 2007-03-14.txt",
+	"\\Storage Card\\Musik\\Bj\xc3\xb6rk - J\xc3\xb3ga.mp3",
+	"\\\xe3\x83\x9e\xe3\x82\xa4 \xe3\x83\x89\xe3\x82\xad\xe3\x83\xa5\xe3\x83\xa1\xe3\x83\xb3\xe3\x83\x88",
+	"\\Clef \xf0\x9d\x84\x9e.txt",
+};
+
+static int check()
+{
+	int result = TEST_SUCCEEDED;
+	char buffer[256];
+	WCHAR wide[256];
+
+	for (unsigned i = 0; i < sizeof(samples) / sizeof(samples[0]); i++)
+	{
+		LPWSTR expected = old_from_utf8(samples[i]);
+		LPWSTR actual = wstr_from_utf8(samples[i]);
+		char* back = actual ? wstr_to_utf8(actual) : NULL;
+		bool wide_ok, back_ok;
+
+		// ucs-2 has no room for the last sample, both must fail alike
+		if (!expected || !actual)
+			wide_ok = !expected && !actual;
+		else
+			wide_ok = wstr_equal(expected, actual);
+		back_ok = !actual || (back && strcmp(back, samples[i]) == 0);
+
+		if (actual && (!wstr_from_utf8_buffer(samples[i], wide, 256) || !wstr_equal(wide, actual)))
+			wide_ok = false;
+		if (actual && (!wstr_to_utf8_buffer(actual, buffer, sizeof(buffer)) || strcmp(buffer, samples[i]) != 0))
+			back_ok = false;
+
+		if (!wide_ok || !back_ok)
+		{
+			printf("FAIL: sample %u does not convert like iconv\n", i);
+			result = TEST_FAILED;
+		}
+
+		free(expected);
+		wstr_free_string(actual);
+		wstr_free_string(back);
+	}
+
+	// too small a buffer fails cleanly
+	LPWSTR path = wstr_from_utf8(samples[0]);
+	if (wstr_to_utf8_buffer(path, buffer, 8) || buffer[0] != '\0')
+	{
+		printf("FAIL: short buffer accepted\n");
+		result = TEST_FAILED;
+	}
+	wstr_free_string(path);
+
+	return result;
+}
+
+static void report(const char* label, double before, double after, unsigned calls)
+{
+	printf("  %-16s %8.0f ns/call -> %6.0f ns/call, %5.1fx\n", label,
+			before * 1e9 / calls, after * 1e9 / calls, before / after);
+}
+
+static void bench(const char* label, const char* utf8, unsigned calls)
+{
+	LPWSTR wide = wstr_from_utf8(utf8);
+	char buffer[256];
+	WCHAR wbuffer[256];
+	double start, before, after;
+
+	printf("%s, %u calls:\n", label, calls);
+
+	start = monotonic_seconds();
+	for (unsigned i = 0; i < calls; i++)
+		free(old_to_utf8(wide));
+	before = monotonic_seconds() - start;
+
+	start = monotonic_seconds();
+	for (unsigned i = 0; i < calls; i++)
+		wstr_free_string(wstr_to_utf8(wide));
+	after = monotonic_seconds() - start;
+	report("to utf8", before, after, calls);
+
+	start = monotonic_seconds();
+	for (unsigned i = 0; i < calls; i++)
+		wstr_to_utf8_buffer(wide, buffer, sizeof(buffer));
+	after = monotonic_seconds() - start;
+	report("to utf8 buffer", before, after, calls);
+
+	start = monotonic_seconds();
+	for (unsigned i = 0; i < calls; i++)
+		free(old_from_utf8(utf8));
+	before = monotonic_seconds() - start;
+
+	start = monotonic_seconds();
+	for (unsigned i = 0; i < calls; i++)
+		wstr_free_string(wstr_from_utf8(utf8));
+	after = monotonic_seconds() - start;
+	report("from utf8", before, after, calls);
+
+	start = monotonic_seconds();
+	for (unsigned i = 0; i < calls; i++)
+		wstr_from_utf8_buffer(utf8, wbuffer, 256);
+	after = monotonic_seconds() - start;
+	report("from utf8 buffer", before, after, calls);
+
+	wstr_free_string(wide);
+}
+
+int main(int argc, char** argv)
+{
+	unsigned calls = argc > 1 ? atoi(argv[1]) : 200000;
+
+	if (check() != TEST_SUCCEEDED)
+		return TEST_FAILED;
+
+	bench("ascii path", samples[0], calls);
+	bench("latin path", samples[1], calls);
+	bench("kana path", samples[2], calls);
+
+	return TEST_SUCCEEDED;
+}
@@ -15,6 +15,7 @@ using namespace synce;
 #include <unistd.h>
 #include <sys/mman.h>
 #include <errno.h>
+#include <time.h>
 #endif
 
 //
@@ -75,6 +76,18 @@ WCHAR* to_unicode(const char* inbuf)
 	return wstr_from_ascii(inbuf);
 }
 
+#ifndef WIN32
+//
+// Seconds on the monotonic clock, for the benchmarks
+//
+double monotonic_seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+#endif
+
 #if 0
 // This does not work with Linux kernel 2.2 and earlier
 bool is_valid_ptr(void * ptr)
@@ -73,6 +73,7 @@ struct _AnyFile
 	ANYFILE_ACCESSOR write;
 	ANYFILE_CLOSE close;
 	IRAPISession *session;
+	IRAPITransfer *transfer;
 };
 
 static void anyfile_remote_close(AnyFile* file)
@@ -80,6 +81,9 @@ static void anyfile_remote_close(AnyFile* file)
 	HRESULT hr;
 	DWORD last_error;
 
+	IRAPITransfer_Release(file->transfer);
+	file->transfer = NULL;
+
 	if (!(IRAPISession_CeCloseHandle(file->session, file->handle.remote))) {
 	  if (FAILED(hr = IRAPISession_CeRapiGetError(file->session))) {
 	    synce_error("Error closing remote file: %08x: %s",
@@ -101,7 +105,7 @@ static bool anyfile_remote_read(AnyFile* file, unsigned char* buffer, size_t byt
 
 	BOOL result;
 	DWORD lpNumberOfBytesRead = 0;
-	result = IRAPISession_CeReadFile(file->session, file->handle.remote, buffer, bytes, &lpNumberOfBytesRead, NULL);
+	result = IRAPITransfer_Read(file->transfer, buffer, bytes, &lpNumberOfBytesRead);
 	*bytesAccessed = lpNumberOfBytesRead;
 
 	if (!result) {
@@ -125,7 +129,7 @@ static bool anyfile_remote_write(AnyFile* file, unsigned char* buffer, size_t by
 
 	BOOL result;
 	DWORD lpNumberOfBytesWritten = 0;
-	result = IRAPISession_CeWriteFile(file->session, file->handle.remote, buffer, bytes, &lpNumberOfBytesWritten, NULL);
+	result = IRAPITransfer_Write(file->transfer, buffer, bytes, &lpNumberOfBytesWritten);
 	*bytesAccessed = lpNumberOfBytesWritten;
 
 	if (!result) {
@@ -218,6 +222,14 @@ static AnyFile* anyfile_remote_open(const char* filename, ANYFILE_ACCESS access,
 	  free(file);
 	  file = NULL;
 	}
+	else if (FAILED(hr = IRAPISession_CreateTransfer(session, file->handle.remote, &file->transfer)))
+	{
+		synce_error("Failed to set up transfer for '%s': %08x: %s",
+			    filename, hr, synce_strerror_from_hresult(hr));
+		IRAPISession_CeCloseHandle(session, file->handle.remote);
+		free(file);
+		file = NULL;
+	}
 	else
 	{
 		file->close = anyfile_remote_close;
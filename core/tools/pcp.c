@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <sys/stat.h>
 #include <dirent.h>
 #include <errno.h>
@@ -13,15 +14,20 @@
 char* dev_name = NULL;
 bool recursive = false;
 char* prog_name = NULL;
+int jobs = 1;
+IRAPICopyEngine* engine = NULL;
 
 static void show_usage(const char* name)
 {
 	fprintf(stderr,
 			"Syntax:\n"
 			"\n"
-			"\t%s [-r] [-d LEVEL] [-p DEVNAME] [-h] SOURCE DESTINATION\n"
+			"\t%s [-r] [-j JOBS] [-d LEVEL] [-p DEVNAME] [-h] SOURCE DESTINATION\n"
 			"\n"
 			"\t-r           Copy directories recursively\n"
+			"\t-j, --jobs JOBS\n"
+			"\t             Copy up to JOBS files at once, each over its own\n"
+			"\t             connection to the device (default 1)\n"
 			"\t-d LEVEL     Set debug log level\n"
 			"\t                 0 - No logging (default)\n"
 			"\t                 1 - Errors only\n"
@@ -39,9 +45,15 @@ static bool handle_parameters(int argc, char** argv, char** source, char** dest)
 	int c;
 	int path_count;
 	int log_level = SYNCE_LOG_LEVEL_ERROR;
+	static const struct option long_options[] =
+	{
+		{ "jobs", required_argument, NULL, 'j' },
+		{ "help", no_argument,       NULL, 'h' },
+		{ NULL,   0,                 NULL, 0   }
+	};
 	prog_name = strdup(argv[0]);
 
-	while ((c = getopt(argc, argv, "rd:hp:")) != -1)
+	while ((c = getopt_long(argc, argv, "rj:d:hp:", long_options, NULL)) != -1)
 	{
 		switch (c)
 		{
@@ -49,6 +61,16 @@ static bool handle_parameters(int argc, char** argv, char** source, char** dest)
 				recursive = true;
 				break;
 
+			case 'j':
+				jobs = atoi(optarg);
+				if (jobs < 1)
+				{
+					fprintf(stderr, "%s: Invalid number of jobs '%s'\n\n", argv[0], optarg);
+					show_usage(argv[0]);
+					return false;
+				}
+				break;
+
 			case 'd':
 				log_level = atoi(optarg);
 				break;
@@ -116,7 +138,8 @@ static bool remote_copy(IRAPISession *session, const char* ascii_source, const c
   return result;
 }
 
-#define ANYFILE_BUFFER_SIZE (64*1024)
+/* large enough for the biggest chunk the transfer may settle on */
+#define ANYFILE_BUFFER_SIZE RAPI_TRANSFER_MAX_CHUNK
 
 static bool anyfile_copy(IRAPISession *session, const char* source_ascii, const char* dest_ascii, size_t* bytes_copied)
 {
@@ -196,8 +219,80 @@ exit:
 	return success;
 }
 
+/*
+ * Hand a local <-> remote copy to the copy engine; it runs once the
+ * whole tree has been walked
+ */
+static bool queue_copy(const char* source, const char* dest)
+{
+	HRESULT hr;
+	RAPI_COPYDIRECTION direction;
+	const char* local;
+	char* remote;
+	WCHAR* wide_remote;
+
+	if (is_remote_file(source))
+	{
+		direction = RAPI_COPY_FROM_DEVICE;
+		local = dest;
+		remote = strdup(source);
+	}
+	else
+	{
+		direction = RAPI_COPY_TO_DEVICE;
+		local = source;
+		remote = strdup(dest);
+	}
+
+	convert_to_backward_slashes(remote);
+	wide_remote = wstr_from_current(remote + 1);
+	if (!wide_remote)
+	{
+		fprintf(stderr, "%s: Failed to convert the name '%s' from the current encoding to UCS2\n", prog_name, remote);
+		free(remote);
+		return false;
+	}
+	free(remote);
+
+	hr = IRAPICopyEngine_AddFile(engine, direction, local, wide_remote);
+	wstr_free_string(wide_remote);
+
+	if (FAILED(hr))
+	{
+		fprintf(stderr, "%s: Failed to queue copy of '%s' to '%s': %s\n",
+				prog_name, source, dest, synce_strerror_from_hresult(hr));
+		return false;
+	}
+
+	return true;
+}
+
+static void copy_done(const char* local, LPCWSTR remote, RAPI_COPYDIRECTION direction,
+		HRESULT hr, int err, void* user_data)
+{
+	char* remote_ascii;
+
+	if (SUCCEEDED(hr))
+		return;
+
+	remote_ascii = wstr_to_current(remote);
+
+	if (err)
+		fprintf(stderr, "%s: Failed to copy %s '%s': %s\n", prog_name,
+				direction == RAPI_COPY_TO_DEVICE ? "from" : "to", local, strerror(err));
+	else
+		fprintf(stderr, "%s: Failed to copy %s ':%s': %s\n", prog_name,
+				direction == RAPI_COPY_TO_DEVICE ? "to" : "from",
+				remote_ascii ? remote_ascii : "?", synce_strerror_from_hresult(hr));
+
+	wstr_free_string(remote_ascii);
+}
+
 static bool copy_file(IRAPISession *session, const char* source, const char* dest, size_t* bytes_copied)
 {
+	if (engine && is_remote_file(source) != is_remote_file(dest))
+		return queue_copy(source, dest);
+
 	if (is_remote_file(source) && is_remote_file(dest))
 	{
 		/*
@@ -604,6 +699,7 @@ int main(int argc, char** argv)
 	time_t duration;
 	size_t bytes_copied = 0;
 	DWORD last_error;
+	RAPI_COPYSTATS stats;
 	
 	if (!handle_parameters(argc, argv, &source, &dest))
 		goto exit;
@@ -755,11 +851,55 @@ int main(int argc, char** argv)
 		    "Please view the built-in help or read the man page.\n");
 	  }
 
+	if (jobs > 1)
+	{
+	  if (FAILED(hr = IRAPIDevice_CreateCopyEngine(device, jobs, &engine)))
+	  {
+	    fprintf(stderr, "%s: Could not open copy sessions to device: %08x: %s\n",
+		    argv[0], hr, synce_strerror_from_hresult(hr));
+	    goto exit;
+	  }
+	  IRAPICopyEngine_SetCallback(engine, copy_done, NULL);
+	}
+
 	start = time(NULL);
 
 	if (!do_copy(session, source, dest, &bytes_copied))
 	  goto exit;
 
+	if (engine)
+	{
+	  hr = IRAPICopyEngine_Run(engine);
+	  IRAPICopyEngine_GetStats(engine, &stats);
+
+	  printf("Copied %u files (%llu bytes) over %u sessions in %u.%03u seconds",
+		 stats.dwFilesCopied, (unsigned long long)stats.cbCopied, stats.dwSessions,
+		 stats.dwElapsedMs / 1000, stats.dwElapsedMs % 1000);
+	  if (stats.dwElapsedMs > 0)
+	    printf(", that's %llu bytes/s", (unsigned long long)(stats.cbCopied * 1000 / stats.dwElapsedMs));
+	  printf(".\n");
+
+	  if (stats.dwFilesCopied > 0)
+	    printf("Per file latency: min %u ms, avg %u ms, max %u ms.\n",
+		   stats.dwMinFileMs, stats.dwAvgFileMs, stats.dwMaxFileMs);
+
+	  if (FAILED(hr))
+	  {
+	    fprintf(stderr, "%s: Could not start copying: %08x: %s\n",
+		    argv[0], hr, synce_strerror_from_hresult(hr));
+	    goto exit;
+	  }
+
+	  if (stats.dwFilesFailed > 0)
+	  {
+	    fprintf(stderr, "%s: %u files could not be copied\n", argv[0], stats.dwFilesFailed);
+	    goto exit;
+	  }
+
+	  result = 0;
+	  goto exit;
+	}
+
 	duration = time(NULL) - start;
 
 	if (0 == duration)
@@ -781,6 +921,9 @@ exit:
 	if (dest)
 		free(dest);
 
+	if (engine)
+	  IRAPICopyEngine_Release(engine);
+
 	if (session)
 	{
 	  IRAPISession_CeRapiUninit(session);
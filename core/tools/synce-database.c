@@ -6,11 +6,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
+#include <errno.h>
+#include <sys/time.h>
 
 
 char* dev_name = NULL;
 bool list_recurse = false ; 
 const char *prog_name;
+const char *db_to_dump = NULL;
+const char *columns_file = NULL;
+WORD batch_size = 0;
 
 
 static void show_usage(const char* name)
@@ -18,34 +23,22 @@ static void show_usage(const char* name)
 	fprintf(stderr,
 			"Syntax:\n"
 			"\n"
-			"\t%s [-d LEVEL] [-p DEVNAME] [-t TYPE ] [-h]\n"
-                        "\t[-r] PARENTKEY KEY VALUE\t\tRead value\n"
-                        "\t  -w PARENTKEY KEY VALUE NEWVALUE\tWrite value\n"
-                        "\t  -l PARENTKEY KEY\t\tList key\n"
-                        "\t  -n PARENTKEY KEY\t\t\tNew key\n"
-                        "\t  -x PARENTKEY KEY VALUE\t\tDelete value (not supported)\n"
-                        "\t  -X PARENTKEY KEY\t\t\tDelete key (not supported)\n"
+			"\t%s [-d LEVEL] [-p DEVNAME] [-h]\n"
+                        "\t  [-r DATABASE [-o FILE] [-b COUNT]]\n"
 			"\n"
 			"\t-d LEVEL     Set debug log level\n"
 			"\t                 0 - No logging (default)\n"
 			"\t                 1 - Errors only\n"
 			"\t                 2 - Errors and warnings\n"
 			"\t                 3 - Everything\n"
-			"\t-D           Dump complete registry to screen\n"
-			"\t-L           Enable list recursion\n"
 			"\t-h           Show this help message\n"
                         "\t-p DEVNAME   Mobile device name\n"
-                        "\t-t TYPE      New type for writes:\n"
-                        "\t\tsz         String (default)\n"
-                        "\t\tdword      Double-word\n"
-                        "\t\tdword_bige Big-endian double-word\n"
-                        "\t\texpand_sz  String with path expansion\n"
-                        "\t\tmulti_sz   Multiple strings (not supported)\n"
-                        "\t\tbinary     Binary data (not supported)\n"
-			"\tPARENTKEY    Registry parent (HKLM, etc.)\n"
-			"\tKEY          Registry key\n"
-			"\tVALUE        Registry value within key\n"
-			"\tNEWVALUE     New value for writes\n"
+                        "\t-r DATABASE  Read all records of a database, by name or oid\n"
+                        "\t-o FILE      Write the records to FILE as tab separated\n"
+                        "\t             columns, one per property, instead of listing them\n"
+                        "\t-b COUNT     Records read per round trip\n"
+                        "\n"
+                        "\tWithout -r the databases on the device are listed.\n"
                         "",
 			name
                 );
@@ -126,17 +119,29 @@ static bool handle_parameters(int argc, char** argv)
 {
 	int c;
 	int log_level = SYNCE_LOG_LEVEL_LOWEST;
-	while ((c = getopt(argc, argv, "d:hp:t:rwxlnXDL")) != -1)
+	while ((c = getopt(argc, argv, "b:d:ho:p:r:")) != -1)
 	{
 		switch (c)
 		{
+			case 'b':
+				batch_size = atoi(optarg);
+				break;
+
 			case 'd':
 				log_level = atoi(optarg);
 				break;
 
+                        case 'o':
+                                columns_file = optarg;
+                                break;
+
                         case 'p':
                                 dev_name = optarg;
                                 break;
+
+                        case 'r':
+                                db_to_dump = optarg;
+                                break;
 			
 			case 'h':
 			default:
@@ -149,6 +154,11 @@ static bool handle_parameters(int argc, char** argv)
 
         argc -= optind;
 
+        if (columns_file && !db_to_dump) {
+                fprintf(stderr, "%s: -o needs a database to read with -r\n", argv[0]);
+                return false;
+        }
+
 	return true;
 }
 
@@ -297,48 +307,15 @@ list_databases_by_enum(IRAPISession *session)
         return result;
 }
 
-bool
-read_record(IRAPISession *session, HANDLE handle)
+
+void
+print_record(CEPROPVAL *field, WORD num_props)
 {
-        bool result = FALSE;
-        HRESULT hr;
-        DWORD last_error;
         uint i;
         char *tmp_str = NULL;
-        CEOID rec_oid = 0;
-        /* 0 = don't allow realloc of buffer */
-        DWORD dwFlags = CEDB_ALLOWREALLOC;
-
-        WORD num_props = 0;
-        CEPROPID * rgPropID = NULL;
-        LPBYTE buffer = malloc(4096*4096);
-        DWORD lpcbBuffer = 4096*4096;
-        CEPROPVAL *field = NULL;
-
-        rec_oid = IRAPISession_CeReadRecordProps(session, handle,
-                                    dwFlags, 
-                                    &num_props,
-                                    rgPropID,
-                                    &buffer, 
-                                    &lpcbBuffer 
-                                    );
-
-        if (rec_oid == 0) {
-                if (FAILED(hr = IRAPISession_CeRapiGetError(session))) {
-                        fprintf(stderr, "%s: error reading record: %s\n",
-                                prog_name, synce_strerror(hr));
-                        goto exit;
-                }
-
-                last_error = IRAPISession_CeGetLastError(session);
-                fprintf(stderr, "%s: error reading record: %s\n",
-                        prog_name, synce_strerror(last_error));
-                goto exit;
-        }
 
         printf("Number of properties = %d\n", num_props);
 
-        field = (CEPROPVAL*)buffer;
         for (i = 0; i < num_props; i++) {
                 printf("field %d: %s: ", i, property_type_to_str(field[i].propid));
 
@@ -360,7 +337,7 @@ read_record(IRAPISession *session, HANDLE handle)
                                 printf("%d\n", field[i].val.iVal);
                                 break;
                         case CEVT_I4:
-                                printf("%d\n", field[i].val.iVal);
+                                printf("%d\n", field[i].val.lVal);
                                 break;
                         case CEVT_LPWSTR:
                                 tmp_str = wstr_to_current(field[i].val.lpwstr);
@@ -374,13 +351,52 @@ read_record(IRAPISession *session, HANDLE handle)
                                 printf("%u\n", field[i].val.uiVal);
                                 break;
                         case CEVT_UI4:
-                                printf("%u\n", field[i].val.uiVal);
+                                printf("%u\n", field[i].val.ulVal);
                                 break;
                         default:
                                 printf("unknown\n");
                                 break;
                         }
         }
+}
+
+bool
+read_record(IRAPISession *session, HANDLE handle)
+{
+        bool result = FALSE;
+        HRESULT hr;
+        DWORD last_error;
+        CEOID rec_oid = 0;
+        /* 0 = don't allow realloc of buffer */
+        DWORD dwFlags = CEDB_ALLOWREALLOC;
+
+        WORD num_props = 0;
+        CEPROPID * rgPropID = NULL;
+        LPBYTE buffer = malloc(4096*4096);
+        DWORD lpcbBuffer = 4096*4096;
+
+        rec_oid = IRAPISession_CeReadRecordProps(session, handle,
+                                    dwFlags, 
+                                    &num_props,
+                                    rgPropID,
+                                    &buffer, 
+                                    &lpcbBuffer 
+                                    );
+
+        if (rec_oid == 0) {
+                if (FAILED(hr = IRAPISession_CeRapiGetError(session))) {
+                        fprintf(stderr, "%s: error reading record: %s\n",
+                                prog_name, synce_strerror(hr));
+                        goto exit;
+                }
+
+                last_error = IRAPISession_CeGetLastError(session);
+                fprintf(stderr, "%s: error reading record: %s\n",
+                        prog_name, synce_strerror(last_error));
+                goto exit;
+        }
+
+        print_record((CEPROPVAL*)buffer, num_props);
 
         result = TRUE;
  exit:
@@ -458,6 +474,282 @@ read_database(IRAPISession *session, const char *dbname, CEOID oid)
 }
 
 
+static double
+seconds_since(const struct timeval *start)
+{
+        struct timeval now;
+
+        gettimeofday(&now, NULL);
+        return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1e6;
+}
+
+
+/*
+ * The columns of a tab separated dump are the properties found in the
+ * first batch of records. Properties that only turn up later are added
+ * to the end of their row as PROPID=VALUE.
+ */
+typedef struct _Columns
+{
+        FILE *file;
+        CEPROPID *propids;
+        unsigned count;
+        unsigned extra;
+} Columns;
+
+static void
+write_escaped(FILE *file, const char *str)
+{
+        for (; *str; str++) {
+                switch (*str) {
+                case '\\':
+                        fputs("\\\\", file);
+                        break;
+                case '\t':
+                        fputs("\\t", file);
+                        break;
+                case '\n':
+                        fputs("\\n", file);
+                        break;
+                case '\r':
+                        fputs("\\r", file);
+                        break;
+                default:
+                        putc(*str, file);
+                        break;
+                }
+        }
+}
+
+static void
+write_column_value(FILE *file, const CEPROPVAL *field)
+{
+        TIME_FIELDS time_fields;
+        char *tmp_str = NULL;
+        DWORD i;
+
+        if (field->wFlags & CEDB_PROPNOTFOUND)
+                return;
+
+        switch (field->propid & 0xffff)
+                {
+                case CEVT_BLOB:
+                        for (i = 0; i < field->val.blob.dwCount; i++)
+                                fprintf(file, "%02x", field->val.blob.lpb[i]);
+                        break;
+                case CEVT_BOOL:
+                        fprintf(file, "%d", field->val.boolVal ? 1 : 0);
+                        break;
+                case CEVT_FILETIME:
+                        time_fields_from_filetime(&field->val.filetime, &time_fields);
+                        fprintf(file, "%04d-%02d-%02d %02d:%02d:%02d",
+                                time_fields.Year, time_fields.Month, time_fields.Day,
+                                time_fields.Hour, time_fields.Minute, time_fields.Second);
+                        break;
+                case CEVT_I2:
+                        fprintf(file, "%d", field->val.iVal);
+                        break;
+                case CEVT_I4:
+                        fprintf(file, "%d", field->val.lVal);
+                        break;
+                case CEVT_LPWSTR:
+                        tmp_str = wstr_to_utf8(field->val.lpwstr);
+                        if (tmp_str)
+                                write_escaped(file, tmp_str);
+                        free(tmp_str);
+                        break;
+                case CEVT_R8:
+                        fprintf(file, "%.17g", field->val.dblVal);
+                        break;
+                case CEVT_UI2:
+                        fprintf(file, "%u", field->val.uiVal);
+                        break;
+                case CEVT_UI4:
+                        fprintf(file, "%u", field->val.ulVal);
+                        break;
+                }
+}
+
+static bool
+columns_add(Columns *columns, CEPROPID propid)
+{
+        CEPROPID *propids;
+        unsigned i;
+
+        for (i = 0; i < columns->count; i++)
+                if (columns->propids[i] == propid)
+                        return true;
+
+        propids = realloc(columns->propids, (columns->count + 1) * sizeof(CEPROPID));
+        if (!propids)
+                return false;
+
+        columns->propids = propids;
+        columns->propids[columns->count++] = propid;
+        return true;
+}
+
+static bool
+columns_write_header(Columns *columns, const RAPI_DBRECORD *records, DWORD count)
+{
+        unsigned i;
+        WORD j;
+
+        for (i = 0; i < count; i++)
+                for (j = 0; j < records[i].cPropID; j++)
+                        if (!columns_add(columns, records[i].rgPropVal[j].propid))
+                                return false;
+
+        fprintf(columns->file, "oid");
+        for (i = 0; i < columns->count; i++)
+                fprintf(columns->file, "\t%08x", columns->propids[i]);
+        putc('\n', columns->file);
+        return true;
+}
+
+static void
+columns_write_record(Columns *columns, const RAPI_DBRECORD *record)
+{
+        FILE *file = columns->file;
+        unsigned i;
+        WORD j;
+
+        fprintf(file, "%08x", record->oid);
+
+        for (i = 0; i < columns->count; i++) {
+                putc('\t', file);
+                for (j = 0; j < record->cPropID; j++)
+                        if (record->rgPropVal[j].propid == columns->propids[i]) {
+                                write_column_value(file, &record->rgPropVal[j]);
+                                break;
+                        }
+        }
+
+        for (j = 0; j < record->cPropID; j++) {
+                for (i = 0; i < columns->count; i++)
+                        if (record->rgPropVal[j].propid == columns->propids[i])
+                                break;
+                if (i < columns->count)
+                        continue;
+
+                fprintf(file, "\t%08x=", record->rgPropVal[j].propid);
+                write_column_value(file, &record->rgPropVal[j]);
+                columns->extra++;
+        }
+
+        putc('\n', file);
+}
+
+
+bool
+dump_database(IRAPISession *session, const char *db, const char *file_name, WORD batch)
+{
+        bool result = FALSE;
+        HRESULT hr;
+        IRAPIDatabaseCursor *cursor = NULL;
+        LPWSTR name = NULL;
+        CEOID oid;
+        char *end = NULL;
+        LPBYTE buffer = NULL;
+        DWORD buffer_size = 0;
+        DWORD count;
+        DWORD i;
+        unsigned records = 0;
+        Columns columns;
+        struct timeval start;
+        double seconds;
+
+        memset(&columns, 0, sizeof(columns));
+
+        /* a number is an oid, anything else a name */
+        oid = strtoul(db, &end, 0);
+        if (*end != '\0' || end == db) {
+                oid = 0;
+                name = wstr_from_current(db);
+                if (!name) {
+                        fprintf(stderr, "%s: Failed to convert database name '%s' from current encoding to UCS2\n",
+                                prog_name, db);
+                        goto exit;
+                }
+        }
+
+        if (file_name && (columns.file = fopen(file_name, "w")) == NULL) {
+                fprintf(stderr, "%s: Failed to create '%s': %s\n",
+                        prog_name, file_name, strerror(errno));
+                goto exit;
+        }
+
+        gettimeofday(&start, NULL);
+
+        hr = IRAPISession_CreateDatabaseCursor(session, oid, name, 0, batch, &cursor);
+        if ((HRESULT)E_NOTIMPL == hr) {
+                fprintf(stderr, "%s: This device has no databases to read\n", prog_name);
+                goto exit;
+        }
+        if (FAILED(hr)) {
+                fprintf(stderr, "%s: error opening database %s: %s\n",
+                        prog_name, db, synce_strerror_from_hresult(hr));
+                goto exit;
+        }
+
+        if (!columns.file) {
+                IRAPIDatabaseCursor_GetOid(cursor, &oid);
+                printf("opened database ceoid = 0x%x\n", oid);
+        }
+
+        while ((hr = IRAPIDatabaseCursor_Next(cursor, &buffer, &buffer_size, &count)) == S_OK) {
+                RAPI_DBRECORD *batch_records = (RAPI_DBRECORD*)buffer;
+
+                if (columns.file && 0 == records &&
+                    !columns_write_header(&columns, batch_records, count)) {
+                        fprintf(stderr, "%s: Failed to allocate columns\n", prog_name);
+                        goto exit;
+                }
+
+                for (i = 0; i < count; i++) {
+                        records++;
+                        if (columns.file)
+                                columns_write_record(&columns, &batch_records[i]);
+                        else {
+                                printf("record %u (oid=0x%x)\n", records, batch_records[i].oid);
+                                print_record(batch_records[i].rgPropVal, batch_records[i].cPropID);
+                        }
+                }
+        }
+
+        if (FAILED(hr)) {
+                fprintf(stderr, "%s: error reading database %s after %u records: %s\n",
+                        prog_name, db, records, synce_strerror_from_hresult(hr));
+                goto exit;
+        }
+
+        if (columns.file && (fflush(columns.file) != 0 || ferror(columns.file))) {
+                fprintf(stderr, "%s: Failed to write '%s': %s\n",
+                        prog_name, file_name, strerror(errno));
+                goto exit;
+        }
+
+        seconds = seconds_since(&start);
+        fprintf(stderr, "%u records in %.2f s, %.0f records/s\n",
+                records, seconds, seconds > 0 ? records / seconds : 0.0);
+        if (columns.extra)
+                fprintf(stderr, "%u properties not in the first batch were added to the end of their rows\n",
+                        columns.extra);
+
+        result = TRUE;
+ exit:
+        if (cursor)
+                IRAPIDatabaseCursor_Release(cursor);
+        if (columns.file)
+                fclose(columns.file);
+        free(columns.propids);
+        free(buffer);
+        if (name)
+                wstr_free_string(name);
+        return result;
+}
+
+
 int
 main(int argc, char** argv)
 {
@@ -529,6 +821,12 @@ main(int argc, char** argv)
 	  goto exit;
 	}
 
+        if (db_to_dump) {
+                if (dump_database(session, db_to_dump, columns_file, batch_size))
+                        result = 0;
+                goto exit;
+        }
+
         list_databases_by_all(session);
         list_databases_by_enum(session);
 
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <getopt.h>
 
 #define ACTION_READVAL 0
@@ -14,15 +15,45 @@
 #define ACTION_NEWKEY 4
 #define ACTION_DELETEKEY 5
 #define ACTION_DUMP_REGISTRY 6
+#define ACTION_EXPORT 7
+#define ACTION_IMPORT 8
 
 
 char* dev_name = NULL;
 int action = ACTION_READVAL;
 bool list_recurse = false ; 
 const char *prog_name;
+const char *snapshot_file = NULL;
 
 #define STR_EQUAL(a,b)  (0 == strcasecmp(a,b))
 
+static const struct
+{
+  const char *name;
+  const char *abbreviation;
+  HKEY hkey;
+} root_keys[] =
+{
+  { "HKEY_CLASSES_ROOT",  "HKCR", HKEY_CLASSES_ROOT },
+  { "HKEY_CURRENT_USER",  "HKCU", HKEY_CURRENT_USER },
+  { "HKEY_LOCAL_MACHINE", "HKLM", HKEY_LOCAL_MACHINE },
+  { "HKEY_USERS",         "HKU",  HKEY_USERS }
+};
+
+#define ROOT_KEY_COUNT (sizeof(root_keys) / sizeof(root_keys[0]))
+
+/* Index in root_keys of a root key name or abbreviation, or -1 */
+static int find_root_key(const char *name)
+{
+  int i;
+
+  for (i = 0; i < (int)ROOT_KEY_COUNT; i++)
+    if (STR_EQUAL(name, root_keys[i].name) || STR_EQUAL(name, root_keys[i].abbreviation))
+      return i;
+
+  return -1;
+}
+
 
 
 static void show_usage(const char* name)
@@ -37,6 +68,8 @@ static void show_usage(const char* name)
                         "\t  -n PARENTKEY KEY\t\t\tNew key\n"
                         "\t  -x PARENTKEY KEY VALUE\t\tDelete value (not supported)\n"
                         "\t  -X PARENTKEY KEY\t\t\tDelete key (not supported)\n"
+                        "\t  -E FILE PARENTKEY [KEY]\t\tExport key and subkeys to a snapshot\n"
+                        "\t  -I FILE\t\t\t\tImport a snapshot\n"
 			"\n"
 			"\t-d LEVEL     Set debug log level\n"
 			"\t                 0 - No logging (default)\n"
@@ -58,6 +91,7 @@ static void show_usage(const char* name)
 			"\tKEY          Registry key\n"
 			"\tVALUE        Registry value within key\n"
 			"\tNEWVALUE     New value for writes\n"
+			"\tFILE         Snapshot file, in regedit format if named *.reg\n"
                         "",
 			name
                 );
@@ -134,7 +168,7 @@ static bool handle_parameters(int argc, char** argv, char** parent_str, char** k
 {
 	int c;
 	int log_level = SYNCE_LOG_LEVEL_LOWEST;
-	while ((c = getopt(argc, argv, "d:hp:t:rwxlnXDL")) != -1)
+	while ((c = getopt(argc, argv, "d:hp:t:rwxlnXDLE:I:")) != -1)
 	{
 		switch (c)
 		{
@@ -177,6 +211,16 @@ static bool handle_parameters(int argc, char** argv, char** parent_str, char** k
                                 action = ACTION_DUMP_REGISTRY;
                                 break;
 
+                        case 'E':
+                                action = ACTION_EXPORT;
+                                snapshot_file = optarg;
+                                break;
+
+                        case 'I':
+                                action = ACTION_IMPORT;
+                                snapshot_file = optarg;
+                                break;
+
                         case 't':
                                 if (strcasecmp(optarg,"binary") == 0)
                                 {
@@ -247,6 +291,22 @@ static bool handle_parameters(int argc, char** argv, char** parent_str, char** k
               return false;
             }
             break;
+          case ACTION_EXPORT:
+            if (argc != 1 && argc != 2)
+            {
+              fprintf(stderr,"Wrong number of parameters\n");
+              show_usage(argv[0]);
+              return false;
+            }
+            break;
+          case ACTION_IMPORT:
+            if (argc != 0)
+            {
+              fprintf(stderr,"Wrong number of parameters\n");
+              show_usage(argv[0]);
+              return false;
+            }
+            break;
         }
 
 
@@ -554,29 +614,878 @@ int list_key(IRAPISession *session, HKEY key, const char* key_path, bool do_recu
 }
 
 
+static HRESULT dump_entry(LPCWSTR pszKey, LPCWSTR pszValueName, DWORD dwType,
+                          const BYTE *pData, DWORD cbData, LPVOID pUserData)
+{
+  const char *root_name = (const char*)pUserData;
+  const LPCWSTR name_wide = pszValueName ? pszValueName : pszKey;
+  char *name = NULL;
+  LPBYTE value = NULL;
+
+  name = wstr_to_current(name_wide);
+  if (!name) {
+    fprintf(stderr, "Failed to convert registry name to current encoding, skipping\n");
+    return S_OK;
+  }
+
+  if (!pszValueName) {
+    printf("\n[%s%s%s]\n", root_name, *name ? "\\" : "", name);
+    free(name);
+    return S_OK;
+  }
+
+  /* Room for a terminator, the device does not always send one */
+  value = calloc(1, cbData + sizeof(DWORD));
+  if (!value) {
+    free(name);
+    return E_OUTOFMEMORY;
+  }
+  memcpy(value, pData, cbData);
+
+  print_value(name, dwType, value, cbData);
+
+  free(value);
+  free(name);
+  return S_OK;
+}
+
+/*
+ * Dump one root key with pipelined calls, or with a call per key and
+ * value on devices that only do RAPI1
+ */
+static int dump_root_key(IRAPISession *session, HKEY key, const char *key_path)
+{
+  HRESULT hr;
+
+  hr = IRAPISession_RegExport(session, key, NULL, dump_entry, (LPVOID)key_path);
+  if ((HRESULT)E_NOTIMPL == hr)
+    return list_key(session, key, key_path, true);
+
+  if (FAILED(hr)) {
+    fprintf(stderr, "Failed to dump '%s': %s\n", key_path, synce_strerror_from_hresult(hr));
+    return 1;
+  }
+
+  return 0;
+}
+
 int dump_registry(IRAPISession *session)
 {
   int result = 0;
 
   /* First the HKLM */
-  result = list_key(session, HKEY_LOCAL_MACHINE, "HKEY_LOCAL_MACHINE", true);
+  result = dump_root_key(session, HKEY_LOCAL_MACHINE, "HKEY_LOCAL_MACHINE");
   if (result != 0) {
   	return result;
   }
 
   /* Then the HKCU */
-  result = list_key(session, HKEY_CURRENT_USER, "HKEY_CURRENT_USER", true );
+  result = dump_root_key(session, HKEY_CURRENT_USER, "HKEY_CURRENT_USER");
   if (result != 0) {
   	return result;
   }
 
   /* And finally the HKCR */
-  result = list_key(session, HKEY_CLASSES_ROOT, "HKEY_CLASSES_ROOT", true );
+  result = dump_root_key(session, HKEY_CLASSES_ROOT, "HKEY_CLASSES_ROOT");
+
+  return result;
+}
+
+
+/*
+ * Registry snapshots
+ *
+ * A snapshot holds a tree of keys and values as written by -E and read
+ * by -I. Files named *.reg use the text format of regedit; anything
+ * else gets a compact binary format:
+ *
+ *   "SYNCEREG" u32 version
+ *   'K' u32 root, u32 length, path         a key, path relative to root
+ *   'V' u32 length, name, u32 type, u32 size, data
+ *                                          a value in the last key
+ *
+ * Numbers are little endian, names and paths are UTF-8 without a
+ * terminator.
+ */
+
+#define SNAPSHOT_MAGIC "SYNCEREG"
+#define SNAPSHOT_VERSION 1
+#define REG_HEADER "Windows Registry Editor Version 5.00"
+
+/* Bytes on one line of a hex value in a .reg file */
+#define REG_HEX_PER_LINE 25
+
+typedef struct _Snapshot
+{
+  FILE *file;
+  bool reg;
+  int root;
+  char *subkey;     /* UTF-8, empty for the root key itself */
+} Snapshot;
+
+static bool is_reg_file(const char *file_name)
+{
+  size_t length = strlen(file_name);
+
+  return length > 4 && STR_EQUAL(file_name + length - 4, ".reg");
+}
+
+static bool write_u32(FILE *file, uint32_t value)
+{
+  value = htole32(value);
+  return fwrite(&value, sizeof(value), 1, file) == 1;
+}
+
+static bool write_block(FILE *file, const void *data, uint32_t size)
+{
+  return write_u32(file, size) && (size == 0 || fwrite(data, size, 1, file) == 1);
+}
+
+static void write_reg_string(FILE *file, const char *str)
+{
+  putc('"', file);
+  for (; *str; str++)
+  {
+    if ('\\' == *str || '"' == *str)
+      putc('\\', file);
+    putc(*str, file);
+  }
+  putc('"', file);
+}
+
+/*
+ * Can this REG_SZ be written as a quoted string and read back as the
+ * same bytes?
+ */
+static bool is_reg_string(const BYTE *data, DWORD size)
+{
+  DWORD i;
+  WCHAR c;
+
+  if (size < sizeof(WCHAR) || size % sizeof(WCHAR))
+    return false;
+
+  for (i = 0; i < size; i += sizeof(WCHAR))
+  {
+    c = data[i] | (data[i + 1] << 8);
+    if (0 == c)
+      return i + sizeof(WCHAR) == size;
+    if ('\n' == c || '\r' == c)
+      return false;
+  }
+
+  return false;
+}
+
+static void write_reg_value(FILE *file, const char *name, DWORD type, const BYTE *data, DWORD size)
+{
+  char *str = NULL;
+  uint32_t dword;
+  DWORD i;
+
+  if (*name)
+    write_reg_string(file, name);
+  else
+    putc('@', file);
+  putc('=', file);
+
+  if (REG_SZ == type && is_reg_string(data, size) &&
+      (str = wstr_to_utf8((LPCWSTR)data)) != NULL)
+  {
+    write_reg_string(file, str);
+    putc('\n', file);
+    free(str);
+    return;
+  }
+
+  if (REG_DWORD == type && sizeof(dword) == size)
+  {
+    memcpy(&dword, data, sizeof(dword));
+    fprintf(file, "dword:%08x\n", letoh32(dword));
+    return;
+  }
+
+  if (REG_BINARY == type)
+    fprintf(file, "hex:");
+  else
+    fprintf(file, "hex(%x):", type);
+
+  for (i = 0; i < size; i++)
+  {
+    if (i && 0 == i % REG_HEX_PER_LINE)
+      fprintf(file, ",\\\n  ");
+    else if (i)
+      putc(',', file);
+    fprintf(file, "%02x", data[i]);
+  }
+  putc('\n', file);
+}
+
+static char *snapshot_key_path(const Snapshot *snapshot, LPCWSTR key)
+{
+  char *relative = NULL;
+  char *path = NULL;
+
+  if ((relative = wstr_to_utf8(key)) == NULL)
+    return NULL;
+
+  if (!*snapshot->subkey)
+    return relative;
+
+  if (!*relative)
+  {
+    free(relative);
+    return strdup(snapshot->subkey);
+  }
+
+  path = malloc(strlen(snapshot->subkey) + strlen(relative) + 2);
+  if (path)
+    sprintf(path, "%s\\%s", snapshot->subkey, relative);
+  free(relative);
+  return path;
+}
 
+static HRESULT export_entry(LPCWSTR pszKey, LPCWSTR pszValueName, DWORD dwType,
+                            const BYTE *pData, DWORD cbData, LPVOID pUserData)
+{
+  Snapshot *snapshot = (Snapshot*)pUserData;
+  FILE *file = snapshot->file;
+  char *name = NULL;
+  bool success = true;
+
+  if (!pszValueName)
+    name = snapshot_key_path(snapshot, pszKey);
+  else
+    name = wstr_to_utf8(pszValueName);
+
+  if (!name)
+  {
+    fprintf(stderr, "%s: Failed to convert registry name to UTF-8\n", prog_name);
+    return E_FAIL;
+  }
+
+  if (!pszValueName && snapshot->reg)
+    fprintf(file, "\n[%s%s%s]\n", root_keys[snapshot->root].name, *name ? "\\" : "", name);
+  else if (!pszValueName)
+    success = putc('K', file) != EOF &&
+      write_u32(file, (uint32_t)root_keys[snapshot->root].hkey) &&
+      write_block(file, name, strlen(name));
+  else if (snapshot->reg)
+    write_reg_value(file, name, dwType, pData, cbData);
+  else
+    success = putc('V', file) != EOF &&
+      write_block(file, name, strlen(name)) &&
+      write_u32(file, dwType) &&
+      write_block(file, pData, cbData);
+
+  free(name);
+
+  if (!success || ferror(file))
+  {
+    fprintf(stderr, "%s: Failed to write snapshot: %s\n", prog_name, strerror(errno));
+    return E_FAIL;
+  }
+
+  return S_OK;
+}
+
+int export_snapshot(IRAPISession *session, int root, const char *key_name, const char *file_name)
+{
+  int result = 1;
+  Snapshot snapshot;
+  LPWSTR key_name_wide = NULL;
+  HRESULT hr;
+
+  memset(&snapshot, 0, sizeof(snapshot));
+  snapshot.root = root;
+  snapshot.reg = is_reg_file(file_name);
+
+  if (key_name)
+  {
+    key_name_wide = wstr_from_current(key_name);
+    if (!key_name_wide)
+    {
+      fprintf(stderr, "%s: Failed to convert registry key name '%s' from current encoding to UCS2\n", prog_name, key_name);
+      goto exit;
+    }
+    snapshot.subkey = wstr_to_utf8(key_name_wide);
+  }
+  else
+    snapshot.subkey = strdup("");
+
+  if (!snapshot.subkey)
+    goto exit;
+
+  if ((snapshot.file = fopen(file_name, "wb")) == NULL)
+  {
+    fprintf(stderr, "%s: Failed to create '%s': %s\n", prog_name, file_name, strerror(errno));
+    goto exit;
+  }
+
+  if (snapshot.reg)
+    fprintf(snapshot.file, "%s\n", REG_HEADER);
+  else if (fwrite(SNAPSHOT_MAGIC, 8, 1, snapshot.file) != 1 ||
+           !write_u32(snapshot.file, SNAPSHOT_VERSION))
+  {
+    fprintf(stderr, "%s: Failed to write snapshot: %s\n", prog_name, strerror(errno));
+    goto exit;
+  }
+
+  hr = IRAPISession_RegExport(session, root_keys[root].hkey, key_name_wide, export_entry, &snapshot);
+  if ((HRESULT)E_NOTIMPL == hr)
+  {
+    fprintf(stderr, "%s: Registry snapshots are not supported by this device\n", prog_name);
+    goto exit;
+  }
+  if (FAILED(hr))
+  {
+    fprintf(stderr, "%s: Failed to export '%s%s%s': %s\n", prog_name,
+            root_keys[root].name, key_name ? "\\" : "", key_name ? key_name : "",
+            synce_strerror_from_hresult(hr));
+    goto exit;
+  }
+  if (S_FALSE == hr)
+    fprintf(stderr, "%s: Some keys or values could not be read and were skipped\n", prog_name);
+
+  if (fflush(snapshot.file) != 0 || ferror(snapshot.file))
+  {
+    fprintf(stderr, "%s: Failed to write snapshot: %s\n", prog_name, strerror(errno));
+    goto exit;
+  }
+
+  result = 0;
+
+exit:
+  if (snapshot.file && fclose(snapshot.file) != 0 && 0 == result)
+  {
+    fprintf(stderr, "%s: Failed to write snapshot: %s\n", prog_name, strerror(errno));
+    result = 1;
+  }
+  free(snapshot.subkey);
+  if (key_name_wide)
+    wstr_free_string(key_name_wide);
   return result;
 }
 
 
+typedef struct _Importer
+{
+  IRAPISession *session;
+  IRAPIRegImport *imports[ROOT_KEY_COUNT];
+  IRAPIRegImport *import;   /* import of the current key */
+  LPWSTR key;               /* current key, NULL to skip its values */
+  const char *file_name;
+  int line;
+  bool failed;
+} Importer;
+
+static void import_warning(Importer *importer, const char *message)
+{
+  if (importer->line)
+    fprintf(stderr, "%s: %s:%i: %s\n", prog_name, importer->file_name, importer->line, message);
+  else
+    fprintf(stderr, "%s: %s: %s\n", prog_name, importer->file_name, message);
+}
+
+/* Report a problem that makes the import fail, but maybe not stop */
+static void import_error(Importer *importer, const char *message)
+{
+  import_warning(importer, message);
+  importer->failed = true;
+}
+
+static bool import_key(Importer *importer, int root, const char *path)
+{
+  HRESULT hr;
+
+  if (importer->key)
+    wstr_free_string(importer->key);
+  importer->key = NULL;
+
+  if (!importer->imports[root] &&
+      FAILED(hr = IRAPISession_CreateRegImport(importer->session, root_keys[root].hkey, NULL, &importer->imports[root])))
+  {
+    fprintf(stderr, "%s: Failed to start import into %s: %s\n", prog_name,
+            root_keys[root].name, synce_strerror_from_hresult(hr));
+    importer->failed = true;
+    return false;
+  }
+  importer->import = importer->imports[root];
+
+  if ((importer->key = wstr_from_utf8(path)) == NULL)
+  {
+    import_error(importer, "Invalid UTF-8 in key name, skipping key");
+    return true;
+  }
+
+  if (FAILED(hr = IRAPIRegImport_CreateKey(importer->import, importer->key)))
+  {
+    fprintf(stderr, "%s: Failed to import '%s\\%s': %s\n", prog_name,
+            root_keys[root].name, path, synce_strerror_from_hresult(hr));
+    importer->failed = true;
+    return false;
+  }
+
+  return true;
+}
+
+static bool import_value(Importer *importer, const char *name, DWORD type, const void *data, DWORD size)
+{
+  LPWSTR name_wide = NULL;
+  HRESULT hr;
+
+  if (!importer->key)
+    return true;
+
+  if ((name_wide = wstr_from_utf8(name)) == NULL)
+  {
+    import_error(importer, "Invalid UTF-8 in value name, skipping value");
+    return true;
+  }
+
+  hr = IRAPIRegImport_SetValue(importer->import, importer->key, name_wide, type, data, size);
+  wstr_free_string(name_wide);
+
+  if (FAILED(hr))
+  {
+    fprintf(stderr, "%s: Failed to import value '%s': %s\n", prog_name,
+            name, synce_strerror_from_hresult(hr));
+    importer->failed = true;
+    return false;
+  }
+
+  return true;
+}
+
+static bool read_u32(FILE *file, uint32_t *value)
+{
+  if (fread(value, sizeof(*value), 1, file) != 1)
+    return false;
+  *value = letoh32(*value);
+  return true;
+}
+
+/* Read a block and add a terminator, for the names */
+static bool read_block(FILE *file, char **data, uint32_t *size)
+{
+  if (!read_u32(file, size) || *size > 0x10000000)
+    return false;
+
+  if ((*data = malloc(*size + 1)) == NULL)
+    return false;
+  (*data)[*size] = '\0';
+
+  if (*size && fread(*data, *size, 1, file) != 1)
+  {
+    free(*data);
+    *data = NULL;
+    return false;
+  }
+
+  return true;
+}
+
+static bool import_snapshot_binary(Importer *importer, FILE *file)
+{
+  uint32_t version;
+  uint32_t hkey;
+  uint32_t type;
+  uint32_t size;
+  char *name = NULL;
+  char *data = NULL;
+  bool success = true;
+  bool corrupt = false;
+  int root;
+  int c;
+
+  if (!read_u32(file, &version) || version != SNAPSHOT_VERSION)
+  {
+    import_error(importer, "Unsupported snapshot version");
+    return false;
+  }
+
+  while (success && (c = getc(file)) != EOF)
+  {
+    if ('K' == c)
+    {
+      if (!read_u32(file, &hkey) || !read_block(file, &name, &size))
+      {
+        corrupt = true;
+        break;
+      }
+
+      for (root = 0; root < (int)ROOT_KEY_COUNT; root++)
+        if ((HKEY)hkey == root_keys[root].hkey)
+          break;
+
+      if (root == (int)ROOT_KEY_COUNT)
+      {
+        import_error(importer, "Unknown root key in snapshot");
+        success = false;
+      }
+      else
+        success = import_key(importer, root, name);
+    }
+    else if ('V' == c)
+    {
+      if (!read_block(file, &name, &size) || !read_u32(file, &type) ||
+          !read_block(file, &data, &size))
+      {
+        corrupt = true;
+        break;
+      }
+
+      if (!importer->import)
+      {
+        import_error(importer, "Value before the first key in snapshot");
+        success = false;
+      }
+      else
+        success = import_value(importer, name, type, data, size);
+    }
+    else
+    {
+      corrupt = true;
+      break;
+    }
+
+    free(name);
+    free(data);
+    name = data = NULL;
+  }
+
+  free(name);
+  free(data);
+
+  if (corrupt || ferror(file))
+  {
+    import_error(importer, "Snapshot is truncated or corrupt");
+    success = false;
+  }
+
+  return success;
+}
+
+/* Parse a quoted string at *p, moving *p past it */
+static char *parse_reg_string(const char **p)
+{
+  const char *s = *p + 1;
+  char *str = malloc(strlen(s) + 1);
+  char *out = str;
+
+  if (!str)
+    return NULL;
+
+  for (; *s && '"' != *s; s++)
+  {
+    if ('\\' == *s && s[1])
+      s++;
+    *out++ = *s;
+  }
+
+  if ('"' != *s)
+  {
+    free(str);
+    return NULL;
+  }
+
+  *out = '\0';
+  *p = s + 1;
+  return str;
+}
+
+/* Parse a comma separated list of hex bytes */
+static BYTE *parse_reg_hex(const char *p, DWORD *size)
+{
+  BYTE *data = malloc(strlen(p) / 2 + 1);
+  unsigned long byte;
+  char *end;
+
+  if (!data)
+    return NULL;
+
+  *size = 0;
+  for (;;)
+  {
+    while (' ' == *p || '\t' == *p)
+      p++;
+    if (!*p)
+      break;
+
+    byte = strtoul(p, &end, 16);
+    if (end == p || byte > 0xff)
+      goto fail;
+    data[(*size)++] = byte;
+
+    p = end;
+    while (' ' == *p || '\t' == *p)
+      p++;
+    if (',' == *p)
+      p++;
+    else if (*p)
+      goto fail;
+  }
+
+  return data;
+
+fail:
+  free(data);
+  return NULL;
+}
+
+static bool import_reg_key(Importer *importer, char *line)
+{
+  size_t length = strlen(line);
+  char *path;
+  int root;
+
+  if ('-' == line[1])
+  {
+    import_warning(importer, "Deleting keys is not supported, skipping key");
+    if (importer->key)
+      wstr_free_string(importer->key);
+    importer->key = NULL;
+    return true;
+  }
+
+  if (']' != line[length - 1])
+  {
+    import_error(importer, "Syntax error in key name");
+    return false;
+  }
+  line[length - 1] = '\0';
+
+  if ((path = strchr(line + 1, '\\')) != NULL)
+    *path++ = '\0';
+  else
+    path = "";
+
+  if ((root = find_root_key(line + 1)) < 0)
+  {
+    import_error(importer, "Invalid parent key");
+    return false;
+  }
+
+  return import_key(importer, root, path);
+}
+
+static bool import_reg_value(Importer *importer, const char *line)
+{
+  const char *p = line;
+  char *name = NULL;
+  char *str = NULL;
+  LPWSTR str_wide = NULL;
+  BYTE *data = NULL;
+  DWORD size = 0;
+  DWORD type;
+  uint32_t dword;
+  char *end;
+  bool success = false;
+
+  if ('@' == *p)
+  {
+    name = strdup("");
+    p++;
+  }
+  else
+    name = parse_reg_string(&p);
+
+  if (!name)
+    goto syntax_error;
+
+  while (' ' == *p || '\t' == *p)
+    p++;
+  if ('=' != *p++)
+    goto syntax_error;
+  while (' ' == *p || '\t' == *p)
+    p++;
+
+  if (!importer->import)
+  {
+    import_error(importer, "Value before the first key");
+    goto exit;
+  }
+
+  if ('"' == *p)
+  {
+    if ((str = parse_reg_string(&p)) == NULL)
+      goto syntax_error;
+    if ((str_wide = wstr_from_utf8(str)) == NULL)
+    {
+      import_error(importer, "Invalid UTF-8 in string value, skipping value");
+      success = true;
+      goto exit;
+    }
+    success = import_value(importer, name, REG_SZ, str_wide, (wstrlen(str_wide) + 1) * sizeof(WCHAR));
+  }
+  else if (0 == strncasecmp(p, "dword:", 6))
+  {
+    dword = strtoul(p + 6, &end, 16);
+    if (end == p + 6 || *end)
+      goto syntax_error;
+    dword = htole32(dword);
+    success = import_value(importer, name, REG_DWORD, &dword, sizeof(dword));
+  }
+  else if (0 == strncasecmp(p, "hex:", 4) || 0 == strncasecmp(p, "hex(", 4))
+  {
+    if (':' == p[3])
+    {
+      type = REG_BINARY;
+      p += 4;
+    }
+    else
+    {
+      type = strtoul(p + 4, &end, 16);
+      if (end == p + 4 || 0 != strncmp(end, "):", 2))
+        goto syntax_error;
+      p = end + 2;
+    }
+
+    if ((data = parse_reg_hex(p, &size)) == NULL)
+      goto syntax_error;
+    success = import_value(importer, name, type, data, size);
+  }
+  else if ('-' == *p)
+  {
+    import_warning(importer, "Deleting values is not supported, skipping value");
+    success = true;
+  }
+  else
+    goto syntax_error;
+
+  goto exit;
+
+syntax_error:
+  import_error(importer, "Syntax error in value");
+exit:
+  free(name);
+  free(str);
+  free(data);
+  if (str_wide)
+    wstr_free_string(str_wide);
+  return success;
+}
+
+static bool import_snapshot_reg(Importer *importer, FILE *file)
+{
+  char *buffer = NULL;
+  size_t buffer_size = 0;
+  char *line = NULL;
+  size_t line_size = 0;
+  size_t length;
+  ssize_t count;
+  bool continued = false;
+  bool success = true;
+  char *p;
+
+  while (success && (count = getline(&buffer, &buffer_size, file)) >= 0)
+  {
+    importer->line++;
+
+    /* Drop the line end and the byte order mark regedit writes */
+    while (count > 0 && strchr(" \t\r\n", buffer[count - 1]))
+      buffer[--count] = '\0';
+    p = buffer;
+    if (1 == importer->line && 0 == strncmp(p, "\xef\xbb\xbf", 3))
+      p += 3;
+    if (continued)
+      while (' ' == *p || '\t' == *p)
+        p++;
+
+    /* Join lines ending in a backslash */
+    length = continued ? strlen(line) : 0;
+    if (length + strlen(p) + 1 > line_size)
+    {
+      line_size = length + strlen(p) + 1;
+      if ((line = realloc(line, line_size)) == NULL)
+      {
+        success = false;
+        break;
+      }
+    }
+    strcpy(line + length, p);
+    length += strlen(p);
+
+    if (length && '\\' == line[length - 1])
+    {
+      line[length - 1] = '\0';
+      continued = true;
+      continue;
+    }
+    continued = false;
+
+    if (!*line || ';' == *line || 0 == strcmp(line, REG_HEADER) || 0 == strcmp(line, "REGEDIT4"))
+      continue;
+
+    if ('[' == *line)
+      success = import_reg_key(importer, line);
+    else if ('@' == *line || '"' == *line)
+      success = import_reg_value(importer, line);
+    else
+    {
+      import_error(importer, "Syntax error");
+      success = false;
+    }
+  }
+
+  if (success && continued)
+  {
+    import_error(importer, "Unexpected end of file after a continued line");
+    success = false;
+  }
+
+  free(buffer);
+  free(line);
+  return success;
+}
+
+int import_snapshot(IRAPISession *session, const char *file_name)
+{
+  Importer importer;
+  FILE *file = NULL;
+  char magic[8];
+  bool success = false;
+  HRESULT hr;
+  int i;
+
+  memset(&importer, 0, sizeof(importer));
+  importer.session = session;
+  importer.file_name = file_name;
+
+  if ((file = fopen(file_name, "rb")) == NULL)
+  {
+    fprintf(stderr, "%s: Failed to open '%s': %s\n", prog_name, file_name, strerror(errno));
+    return 1;
+  }
+
+  if (fread(magic, sizeof(magic), 1, file) == 1 && 0 == memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)))
+    success = import_snapshot_binary(&importer, file);
+  else if (fseek(file, 0, SEEK_SET) == 0)
+    success = import_snapshot_reg(&importer, file);
+
+  /* Write out what was queued even after an error, then report the first failure */
+  for (i = 0; i < (int)ROOT_KEY_COUNT; i++)
+  {
+    if (!importer.imports[i])
+      continue;
+
+    if (FAILED(hr = IRAPIRegImport_Flush(importer.imports[i])))
+    {
+      fprintf(stderr, "%s: Failed to import into %s: %s\n", prog_name,
+              root_keys[i].name, synce_strerror_from_hresult(hr));
+      success = false;
+    }
+    IRAPIRegImport_Release(importer.imports[i]);
+  }
+
+  if (importer.key)
+    wstr_free_string(importer.key);
+  fclose(file);
+
+  return success && !importer.failed ? 0 : 1;
+}
+
+
 int delete_val(IRAPISession *session, HKEY key, const char *value_name)
 {
   int result = 1;
@@ -760,6 +1669,7 @@ int main(int argc, char** argv)
   HRESULT hr;
   DWORD value_type = REG_SZ;
   LONG retval;
+  int root;
 
   prog_name = argv[0];
   
@@ -831,32 +1741,30 @@ int main(int argc, char** argv)
 	  goto exit;
   }
 
+  if (action == ACTION_IMPORT)
+  {
+    result = import_snapshot(session, snapshot_file);
+    goto exit;
+  }
+
   /* handle abbreviations */
-  if (STR_EQUAL(parent_str, "HKCR"))
-    parent_str = "HKEY_CLASSES_ROOT";
-  else if (STR_EQUAL(parent_str, "HKCU"))
-    parent_str = "HKEY_CURRENT_USER";
-  else if (STR_EQUAL(parent_str, "HKLM"))
-    parent_str = "HKEY_LOCAL_MACHINE";
-  else if (STR_EQUAL(parent_str, "HKU"))
-    parent_str = "HKEY_USERS";
-
-  if (STR_EQUAL(parent_str, "HKEY_CLASSES_ROOT"))
-    parent = HKEY_CLASSES_ROOT;
-  else if (STR_EQUAL(parent_str, "HKEY_CURRENT_USER"))
-    parent = HKEY_CURRENT_USER;
-  else if (STR_EQUAL(parent_str, "HKEY_LOCAL_MACHINE"))
-    parent = HKEY_LOCAL_MACHINE;
-  else if (STR_EQUAL(parent_str, "HKEY_USERS"))
-    parent = HKEY_USERS;
-  else
+  if ((root = find_root_key(parent_str)) < 0)
   {
     fprintf(stderr, "Invalid parent key\n");
     goto exit;
   }
+  parent_str = (char*)root_keys[root].name;
+  parent = root_keys[root].hkey;
 
 
-  convert_to_backward_slashes(key_name);
+  if (key_name)
+    convert_to_backward_slashes(key_name);
+
+  if (action == ACTION_EXPORT)
+  {
+    result = export_snapshot(session, root, key_name, snapshot_file);
+    goto exit;
+  }
 
 
   if (action == ACTION_DELETEKEY)
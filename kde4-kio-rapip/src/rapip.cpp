@@ -28,7 +28,7 @@
 #include <rapip.h>
 #include <stdlib.h>
 
-#define ANYFILE_BUFFER_SIZE (64*1024)
+#define ANYFILE_BUFFER_SIZE RAPI_TRANSFER_MAX_CHUNK
 
 static bool show_hidden_files = true;
 
@@ -239,8 +239,8 @@ bool kio_rapipProtocol::list_matching_files(QString &path)
 void kio_rapipProtocol::get(const KUrl& url)
 {
     DWORD bytes_read;
-    unsigned char buffer[ANYFILE_BUFFER_SIZE];
     QByteArray array;
+    synce::IRAPITransfer *transfer = NULL;
     KIO::filesize_t processed_size = 0;
     QString qPath;
     KMimeType::Ptr mt;
@@ -258,20 +258,19 @@ void kio_rapipProtocol::get(const KUrl& url)
             HANDLE remote = synce::IRAPISession_CeCreateFile(session, qPath.utf16(), GENERIC_READ, 0, NULL,
                                                 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
             if (!(INVALID_HANDLE_VALUE == remote)) {
-                do {
-                    if ((ceOk = synce::IRAPISession_CeReadFile(session, remote, buffer, ANYFILE_BUFFER_SIZE, &bytes_read, NULL))) {
-                        if (ceOk && bytes_read > 0) {
-			    /*QByteArray.setRawData and resetRawData are deprecated; this method WFM but 
-			     *is probably not optimal - Tejas Guruswamy <masterpatricko@gmail.com>
-			     */
-                            array = QByteArray((char *) buffer, bytes_read);
-                            data(array);
-			    array.clear();
-                            processed_size += bytes_read;
-                            processedSize(processed_size);
-                        }
+                ceOk = SUCCEEDED(synce::IRAPISession_CreateTransfer(session, remote, &transfer));
+                while (ceOk) {
+                    array.resize(ANYFILE_BUFFER_SIZE);
+                    if ((ceOk = synce::IRAPITransfer_Read(transfer, array.data(), ANYFILE_BUFFER_SIZE, &bytes_read))) {
+                        if (bytes_read == 0)
+                            break;
+                        array.resize(bytes_read);
+                        data(array);
+                        processed_size += bytes_read;
+                        processedSize(processed_size);
                     }
-                } while (ceOk && bytes_read > 0);
+                }
+                synce::IRAPITransfer_Release(transfer);
                 if (ceOk) {
                     data(QByteArray());
                     processedSize(processed_size);
@@ -298,6 +297,7 @@ void kio_rapipProtocol::put(const KUrl& url, int /* permissions */, KIO::JobFlag
     QByteArray buffer;
     KMimeType::Ptr mt;
     QString qPath;
+    synce::IRAPITransfer *transfer = NULL;
 
     ceOk = true;
 
@@ -323,13 +323,16 @@ void kio_rapipProtocol::put(const KUrl& url, int /* permissions */, KIO::JobFlag
                 Qt::HANDLE remote = synce::IRAPISession_CeCreateFile(session, qPath.utf16(), GENERIC_WRITE, 0, NULL,
                                                     CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
                 if (!(INVALID_HANDLE_VALUE == remote)) {
-                    do {
+                    ceOk = SUCCEEDED(synce::IRAPISession_CreateTransfer(session, remote, &transfer));
+                    result = 1;
+                    while (result > 0 && ceOk) {
                         dataReq();
                         result = readData(buffer);
                         if (result > 0) {
-                            ceOk = synce::IRAPISession_CeWriteFile(session, remote, (unsigned char *) buffer.data(), buffer.size(), &bytes_written, NULL);
+                            ceOk = synce::IRAPITransfer_Write(transfer, buffer.data(), buffer.size(), &bytes_written);
                         }
-                    } while (result > 0 && ceOk);
+                    }
+                    synce::IRAPITransfer_Release(transfer);
                     if (ceOk) {
                         finished();
                     } else {
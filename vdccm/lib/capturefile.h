@@ -0,0 +1,53 @@
+//
+// C++ Interface: capturefile
+//
+// Description: Layout of the files written by CaptureWriter.
+//
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#ifndef CAPTUREFILE_H
+#define CAPTUREFILE_H
+
+#include <stdint.h>
+
+/*
+ * A capture file, all numbers little endian, is a file header
+ *
+ *     uint32 magic, uint16 major version, uint16 minor version,
+ *     uint32 snap length, uint32 reserved
+ *
+ * followed by records of a header
+ *
+ *     uint32 seconds, uint32 microseconds, uint32 captured length, uint32 length,
+ *     uint32 stream, uint32 direction
+ *
+ * and the captured length bytes of the data. Like in pcap files the time is the
+ * time of day the data was seen and length tells how long the data was, of which
+ * only captured length bytes are kept. Stream and direction tell which connection,
+ * and which way, the data has been seen on; vdccm writes the directions below.
+ */
+#define CAPTURE_MAGIC               0x70616372      /* "rcap" */
+#define CAPTURE_VERSION_MAJOR       1
+#define CAPTURE_VERSION_MINOR       0
+#define CAPTURE_FILE_HEADER_SIZE    16
+#define CAPTURE_RECORD_HEADER_SIZE  24
+
+#define RAPI_CAPTURE_TO_DEVICE      0       /* sent by the application */
+#define RAPI_CAPTURE_TO_APPLICATION 1       /* sent by the device */
+
+inline void capturePut32(unsigned char *buffer, uint32_t value)
+{
+    buffer[0] = value & 0xff;
+    buffer[1] = (value >> 8) & 0xff;
+    buffer[2] = (value >> 16) & 0xff;
+    buffer[3] = (value >> 24) & 0xff;
+}
+
+inline uint32_t captureGet32(const unsigned char *buffer)
+{
+    return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((uint32_t) buffer[3] << 24);
+}
+
+#endif
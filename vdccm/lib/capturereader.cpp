@@ -0,0 +1,114 @@
+//
+// C++ Implementation: capturereader
+//
+// Description: Reads back the records of a capture file.
+//
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "capturereader.h"
+#include "capturefile.h"
+
+
+CaptureReader::CaptureReader()
+    : file(NULL),
+      buffer(NULL),
+      bufferSize(0),
+      snapLength(0)
+{
+}
+
+
+CaptureReader::~CaptureReader()
+{
+    close();
+    delete[] buffer;
+}
+
+
+/*!
+    \fn CaptureReader::open(const char *path)
+ */
+bool CaptureReader::open(const char *path)
+{
+    unsigned char header[CAPTURE_FILE_HEADER_SIZE];
+
+    close();
+
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    if (fread(header, sizeof(header), 1, file) != 1 || captureGet32(header) != CAPTURE_MAGIC ||
+            header[4] != CAPTURE_VERSION_MAJOR) {
+        close();
+        return false;
+    }
+    snapLength = captureGet32(header + 8);
+
+    return true;
+}
+
+
+/*!
+    \fn CaptureReader::close()
+ */
+void CaptureReader::close()
+{
+    if (file != NULL) {
+        fclose(file);
+        file = NULL;
+    }
+}
+
+
+/*!
+    \fn CaptureReader::next(Record &record)
+ */
+const unsigned char *CaptureReader::next(Record &record)
+{
+    unsigned char header[CAPTURE_RECORD_HEADER_SIZE];
+
+    if (file == NULL || fread(header, sizeof(header), 1, file) != 1) {
+        return NULL;
+    }
+
+    record.seconds = captureGet32(header);
+    record.microseconds = captureGet32(header + 4);
+    record.capturedLength = captureGet32(header + 8);
+    record.length = captureGet32(header + 12);
+    record.stream = captureGet32(header + 16);
+    record.direction = captureGet32(header + 20);
+
+    if (record.capturedLength > record.length) {
+        return NULL;
+    }
+
+    /* one byte more, so that an empty record is not taken for the end */
+    if (record.capturedLength + 1 > bufferSize) {
+        delete[] buffer;
+        bufferSize = record.capturedLength + 1;
+        buffer = new unsigned char[bufferSize];
+    }
+
+    if (record.capturedLength > 0 && fread(buffer, record.capturedLength, 1, file) != 1) {
+        return NULL;
+    }
+
+    return buffer;
+}
+
+
+/*!
+    \fn CaptureReader::getSnapLength() const
+ */
+uint32_t CaptureReader::getSnapLength() const
+{
+    return snapLength;
+}
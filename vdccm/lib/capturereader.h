@@ -0,0 +1,69 @@
+//
+// C++ Interface: capturereader
+//
+// Description: Reads back the records of a capture file.
+//
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#ifndef CAPTUREREADER_H
+#define CAPTUREREADER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/**
+ * @brief Reads the files written by CaptureWriter, record by record.
+ */
+class CaptureReader
+{
+public:
+    class Record
+    {
+    public:
+        uint32_t seconds;
+        uint32_t microseconds;
+        uint32_t capturedLength;
+        uint32_t length;
+        uint32_t stream;
+        uint32_t direction;
+    };
+
+    CaptureReader();
+    ~CaptureReader();
+
+    /**
+     * @brief Opens a capture file and checks its header.
+     */
+    bool open(const char *path);
+    void close();
+
+    /**
+     * @brief Reads the next record.
+     * @return The captured bytes, valid until the next call, or NULL at the end of
+     * the file or if it is cut short.
+     */
+    const unsigned char *next(Record &record);
+
+    uint32_t getSnapLength() const;
+
+protected:
+    CaptureReader &operator=(const CaptureReader &captureReader)
+    {
+        return *this;
+    }
+
+    explicit CaptureReader(const CaptureReader &captureReader)
+    {
+    }
+
+private:
+    FILE *file;
+    unsigned char *buffer;
+    size_t bufferSize;
+    uint32_t snapLength;
+};
+
+#endif
@@ -0,0 +1,297 @@
+//
+// C++ Implementation: capturewriter
+//
+// Description: Writes timestamped records to a capture file from a thread of its own.
+//
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "capturewriter.h"
+#include "capturefile.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/* how long records may wait to be written with others, in milliseconds */
+#define FLUSH_INTERVAL 100
+
+
+CaptureWriter::CaptureWriter(size_t bufferSize)
+{
+    fd = -1;
+    capacity = bufferSize;
+    ring = new unsigned char[capacity];
+    head = 0;
+    tail = 0;
+    used = 0;
+    dropped = 0;
+    streams = 0;
+    closing = false;
+    failed = false;
+    threadRunning = false;
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+}
+
+
+CaptureWriter::~CaptureWriter()
+{
+    close();
+    delete[] ring;
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+}
+
+
+/*!
+    \fn CaptureWriter::open(const char *path, uint32_t snapLength)
+ */
+bool CaptureWriter::open(const char *path, uint32_t snapLength)
+{
+    unsigned char header[CAPTURE_FILE_HEADER_SIZE];
+
+    fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    capturePut32(header, CAPTURE_MAGIC);
+    header[4] = CAPTURE_VERSION_MAJOR;
+    header[5] = 0;
+    header[6] = CAPTURE_VERSION_MINOR;
+    header[7] = 0;
+    capturePut32(header + 8, snapLength);
+    capturePut32(header + 12, 0);
+
+    if (::write(fd, header, sizeof(header)) != (ssize_t) sizeof(header)) {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+
+/*!
+    \fn CaptureWriter::start()
+ */
+bool CaptureWriter::start()
+{
+    if (fd < 0 || threadRunning) {
+        return fd >= 0;
+    }
+
+    if (pthread_create(&thread, NULL, threadMain, this) != 0) {
+        return false;
+    }
+    threadRunning = true;
+
+    return true;
+}
+
+
+/*!
+    \fn CaptureWriter::close()
+ */
+void CaptureWriter::close()
+{
+    if (fd < 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&mutex);
+    closing = true;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+
+    /* without a thread what has been buffered is written out here */
+    if (threadRunning) {
+        pthread_join(thread, NULL);
+        threadRunning = false;
+    } else {
+        run();
+    }
+
+    ::close(fd);
+    fd = -1;
+}
+
+
+/*!
+    \fn CaptureWriter::put(const unsigned char *data, size_t size)
+ */
+void CaptureWriter::put(const unsigned char *data, size_t size)
+{
+    size_t first = capacity - head;
+
+    if (first > size) {
+        first = size;
+    }
+    memcpy(ring + head, data, first);
+    memcpy(ring, data + first, size - first);
+
+    head = (head + size) % capacity;
+    used += size;
+}
+
+
+/*!
+    \fn CaptureWriter::write(uint32_t stream, uint32_t direction, const unsigned char *data, size_t capturedLength, size_t length)
+ */
+bool CaptureWriter::write(uint32_t stream, uint32_t direction, const unsigned char *data,
+                          size_t capturedLength, size_t length)
+{
+    unsigned char header[CAPTURE_RECORD_HEADER_SIZE];
+    struct timeval tv;
+
+    if (capturedLength > length) {
+        capturedLength = length;
+    }
+
+    gettimeofday(&tv, NULL);
+    capturePut32(header, tv.tv_sec);
+    capturePut32(header + 4, tv.tv_usec);
+    capturePut32(header + 8, capturedLength);
+    capturePut32(header + 12, length);
+    capturePut32(header + 16, stream);
+    capturePut32(header + 20, direction);
+
+    pthread_mutex_lock(&mutex);
+    if (fd < 0 || closing || failed || capacity - used < sizeof(header) + capturedLength) {
+        dropped++;
+        pthread_mutex_unlock(&mutex);
+        return false;
+    }
+
+    /* the thread sleeps until there is something, then waits for more to come */
+    if (used == 0 || (used < capacity / 4 && used + sizeof(header) + capturedLength >= capacity / 4)) {
+        pthread_cond_signal(&cond);
+    }
+    put(header, sizeof(header));
+    put(data, capturedLength);
+    pthread_mutex_unlock(&mutex);
+
+    return true;
+}
+
+
+/*!
+    \fn CaptureWriter::newStream()
+ */
+uint32_t CaptureWriter::newStream()
+{
+    uint32_t stream;
+
+    pthread_mutex_lock(&mutex);
+    stream = ++streams;
+    pthread_mutex_unlock(&mutex);
+
+    return stream;
+}
+
+
+/*!
+    \fn CaptureWriter::getDropped()
+ */
+unsigned long CaptureWriter::getDropped()
+{
+    unsigned long count;
+
+    pthread_mutex_lock(&mutex);
+    count = dropped;
+    pthread_mutex_unlock(&mutex);
+
+    return count;
+}
+
+
+/*!
+    \fn CaptureWriter::run()
+ */
+void CaptureWriter::run()
+{
+    pthread_mutex_lock(&mutex);
+
+    for (;;) {
+        while (used == 0 && !closing) {
+            pthread_cond_wait(&cond, &mutex);
+        }
+
+        /* few large writes instead of one per record */
+        if (used < capacity / 4 && !closing) {
+            struct timeval now;
+            struct timespec deadline;
+
+            gettimeofday(&now, NULL);
+            deadline.tv_sec = now.tv_sec + FLUSH_INTERVAL / 1000;
+            deadline.tv_nsec = (now.tv_usec + (FLUSH_INTERVAL % 1000) * 1000) * 1000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+
+            while (used < capacity / 4 && !closing) {
+                if (pthread_cond_timedwait(&cond, &mutex, &deadline) == ETIMEDOUT) {
+                    break;
+                }
+            }
+        }
+
+        if (used == 0) {
+            break;
+        }
+
+        /* the bytes from tail on are not touched by write() until they are taken off */
+        size_t size = capacity - tail;
+        if (size > used) {
+            size = used;
+        }
+        const unsigned char *data = ring + tail;
+
+        pthread_mutex_unlock(&mutex);
+        ssize_t n = ::write(fd, data, size);
+        pthread_mutex_lock(&mutex);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        /* after a failed write the file ends with a part of a record, stop there */
+        if (n <= 0) {
+            failed = true;
+            n = used;
+        }
+
+        tail = (tail + n) % capacity;
+        used -= n;
+    }
+
+    pthread_mutex_unlock(&mutex);
+}
+
+
+/*!
+    \fn CaptureWriter::threadMain(void *arg)
+ */
+void *CaptureWriter::threadMain(void *arg)
+{
+    sigset_t signals;
+
+    /* signals are handled by the main thread */
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    ((CaptureWriter *) arg)->run();
+
+    return NULL;
+}
@@ -0,0 +1,91 @@
+//
+// C++ Interface: capturewriter
+//
+// Description: Writes timestamped records to a capture file from a thread of its own.
+//
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#ifndef CAPTUREWRITER_H
+#define CAPTUREWRITER_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * @brief Captures data to a file without making the capturing thread wait for the disk.
+ *
+ * write() only copies the record into a ring buffer, a thread of the writer's own
+ * passes it on to the file. If the disk does not keep up and the ring buffer is full
+ * the record is dropped and counted instead of waiting. write() may be called from
+ * any number of threads. The format of the file is described in capturefile.h.
+ */
+class CaptureWriter
+{
+public:
+    CaptureWriter(size_t bufferSize = 4 * 1024 * 1024);
+    ~CaptureWriter();
+
+    /**
+     * @brief Creates the file and writes its header.
+     *
+     * Records written before start() are kept in the ring buffer.
+     */
+    bool open(const char *path, uint32_t snapLength);
+
+    bool start();
+
+    /**
+     * @brief Writes out what is still buffered and closes the file.
+     */
+    void close();
+
+    /**
+     * @brief Queues a record of the first capturedLength bytes of length bytes of data.
+     * @return false if the record has been dropped.
+     */
+    bool write(uint32_t stream, uint32_t direction, const unsigned char *data,
+               size_t capturedLength, size_t length);
+
+    /**
+     * @brief A number for a new stream, different from those handed out before.
+     */
+    uint32_t newStream();
+
+    unsigned long getDropped();
+
+protected:
+    CaptureWriter &operator=(const CaptureWriter &captureWriter)
+    {
+        return *this;
+    }
+
+    explicit CaptureWriter(const CaptureWriter &captureWriter)
+    {
+    }
+
+private:
+    void put(const unsigned char *data, size_t size);
+    void run();
+    static void *threadMain(void *arg);
+
+private:
+    int fd;
+    unsigned char *ring;
+    size_t capacity;
+    size_t head;
+    size_t tail;
+    size_t used;
+    unsigned long dropped;
+    uint32_t streams;
+    bool closing;
+    bool failed;
+    bool threadRunning;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+#endif
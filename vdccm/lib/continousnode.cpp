@@ -29,7 +29,7 @@ ContinousNode::ContinousNode(const int sec, const int usec)
     delta.tv_sec = sec;
     delta.tv_usec = usec;
 
-    gettimeofday(&tv, NULL);
+    tv = now();
     calcNextTrigger();
 }
 
@@ -42,7 +42,7 @@ ContinousNode::~ContinousNode()
 void ContinousNode::trigger()
 {
     calcNextTrigger();
-    timerNodeManager->setDirty();
+    timerNodeManager->update(this);
     shot();
 }
 
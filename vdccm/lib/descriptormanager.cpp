@@ -24,11 +24,14 @@
 #include "descriptor.h"
 #include "multiplexer.h"
 #include <algorithm>
+#include <poll.h>
 
 using namespace std;
 
-DescriptorManager::DescriptorManager()
+DescriptorManager::DescriptorManager(Multiplexer *multiplexer, enum Descriptor::eventType eventType)
 {
+    this->multiplexer = multiplexer;
+    this->eventType = eventType;
     FD_ZERO(&this->staticFdSet);
     FD_ZERO(&this->workingFdSet);
     it = descriptors.end();
@@ -49,11 +52,16 @@ bool DescriptorManager::add(Descriptor * descriptor)
 {
     bool ret = true;
 
-    if (descriptor->getDescriptor() >= 0) {
+    if (descriptor->getDescriptor() >= 0 && (descriptor->getDescriptor() < FD_SETSIZE || epoll())) {
         if (find(descriptors.begin(), descriptors.end(), descriptor) == descriptors.end()) {
         descriptors.push_back(descriptor);
-            FD_SET(descriptor->getDescriptor(), &staticFdSet);
+            if (descriptor->getDescriptor() < FD_SETSIZE) {
+                FD_SET(descriptor->getDescriptor(), &staticFdSet);
+            }
             listDirty = true;
+            if (multiplexer != NULL) {
+                multiplexer->watch(descriptor, eventType);
+            }
         } else {
             ret = false;
         }
@@ -83,8 +91,13 @@ bool DescriptorManager::remove(Descriptor * descriptor)
         } else {
             descriptors.erase(rit);
         }
-        FD_CLR(descriptor->getDescriptor(), &staticFdSet);
+        if (descriptor->getDescriptor() < FD_SETSIZE) {
+            FD_CLR(descriptor->getDescriptor(), &staticFdSet);
+        }
         listDirty = true;
+        if (multiplexer != NULL) {
+            multiplexer->unwatch(descriptor, eventType);
+        }
     } else {
         ret = false;
     }
@@ -93,6 +106,16 @@ bool DescriptorManager::remove(Descriptor * descriptor)
 }
 
 
+/*!
+    \fn DescriptorManager::epoll()
+    select() cannot take descriptors from FD_SETSIZE up, epoll can.
+ */
+bool DescriptorManager::epoll() const
+{
+    return multiplexer != NULL && multiplexer->getBackend() == Multiplexer::EPOLL;
+}
+
+
 /*!
     \fn DescriptorManager::fdSet()
  */
@@ -150,26 +173,20 @@ int DescriptorManager::process(enum Descriptor::eventType et, fd_set *fdSet)
 
 
 /*!
-    \fn DescriptorManager::dataPending(const Descriptor *descriptor, int sec, int usec)
+    \fn DescriptorManager::dispatch(Descriptor *descriptor, enum Descriptor::eventType et)
  */
-bool DescriptorManager::dataPending(const Descriptor *descriptor, int sec, int usec)
+void DescriptorManager::dispatch(Descriptor *descriptor, enum Descriptor::eventType et)
 {
-    bool ret = false;
-    fd_set fdSet;
-    FD_ZERO(&fdSet);
-
-    FD_SET(descriptor->getDescriptor(), &fdSet);
-
-    struct timeval tv;
-
-    tv.tv_sec = sec;
-    tv.tv_usec = usec;
+    descriptor->event(et);
+}
 
-    if (select(descriptor->getDescriptor() + 1, &fdSet, NULL, NULL, &tv) > 0) {
-        ret = true;
-    }
 
-    return ret;
+/*!
+    \fn DescriptorManager::dataPending(const Descriptor *descriptor, int sec, int usec)
+ */
+bool DescriptorManager::dataPending(const Descriptor *descriptor, int sec, int usec)
+{
+    return waitFor(descriptor, POLLIN, sec, usec);
 }
 
 
@@ -178,20 +195,21 @@ bool DescriptorManager::dataPending(const Descriptor *descriptor, int sec, int u
  */
 bool DescriptorManager::writable(const Descriptor *descriptor, int sec, int usec)
 {
-    bool ret = false;
-    fd_set fdSet;
-    FD_ZERO(&fdSet);
-
-    FD_SET(descriptor->getDescriptor(), &fdSet);
+    return waitFor(descriptor, POLLOUT, sec, usec);
+}
 
-    struct timeval tv;
 
-    tv.tv_sec = sec;
-    tv.tv_usec = usec;
+/*!
+    \fn DescriptorManager::waitFor(const Descriptor *descriptor, short events, int sec, int usec)
+ */
+bool DescriptorManager::waitFor(const Descriptor *descriptor, short events, int sec, int usec)
+{
+    struct pollfd pfd;
 
-    if (select(descriptor->getDescriptor() + 1, NULL, &fdSet, NULL, &tv) > 0) {
-        ret = true;
-    }
+    // poll() rather than select(): under epoll descriptors may be beyond FD_SETSIZE
+    pfd.fd = descriptor->getDescriptor();
+    pfd.events = events;
+    pfd.revents = 0;
 
-    return ret;
+    return ::poll(&pfd, 1, sec * 1000 + (usec + 999) / 1000) > 0;
 }
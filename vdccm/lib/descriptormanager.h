@@ -24,6 +24,7 @@
 #define DESCRIPTORMANAGER_H
 
 #include <sys/types.h>
+#include <stddef.h>
 #include <list>
 #include "descriptor.h"
 
@@ -35,7 +36,7 @@ class Multiplexer;
 */
 class DescriptorManager{
 public:
-    DescriptorManager();
+    DescriptorManager(Multiplexer *multiplexer = NULL, enum Descriptor::eventType eventType = Descriptor::READ);
     virtual ~DescriptorManager();
 
     bool add(Descriptor * descriptor);
@@ -55,11 +56,16 @@ protected:
     }
 
 private:
+    bool epoll() const;
     fd_set* fdSet();
     Descriptor* getHighestDescriptor();
     int process(enum Descriptor::eventType et, fd_set *);
+    void dispatch(Descriptor *descriptor, enum Descriptor::eventType et);
+    static bool waitFor(const Descriptor *descriptor, short events, int sec, int usec);
 
 private:
+    Multiplexer *multiplexer;
+    enum Descriptor::eventType eventType;
     fd_set staticFdSet;
     fd_set workingFdSet;
     std::list<Descriptor *> descriptors;
@@ -0,0 +1,292 @@
+//
+// C++ Implementation: eventloop
+//
+// Description: A Multiplexer run by a thread of its own.
+//
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "eventloop.h"
+#include "descriptor.h"
+#include "descriptormanager.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+using namespace std;
+
+/* the read end of the wakeup pipe, readable while callbacks are queued */
+class WakeupDescriptor : public Descriptor
+{
+public:
+    WakeupDescriptor(EventLoop *eventLoop, int descriptor)
+        : eventLoop(eventLoop)
+    {
+        setDescriptor(descriptor);
+    }
+
+protected:
+    virtual void event(enum eventType et)
+    {
+        char buffer[64];
+
+        while (read(getDescriptor(), buffer, sizeof(buffer)) > 0)
+            ;
+
+        eventLoop->runPending();
+    }
+
+private:
+    EventLoop *eventLoop;
+};
+
+
+static pthread_key_t currentKey;
+static pthread_once_t currentOnce = PTHREAD_ONCE_INIT;
+
+static void createCurrentKey()
+{
+    pthread_key_create(&currentKey, NULL);
+}
+
+
+EventLoop::EventLoop(enum Multiplexer::Backend backend)
+{
+    multiplexer = new Multiplexer(backend);
+    ownMultiplexer = true;
+    init();
+}
+
+
+EventLoop::EventLoop(Multiplexer *multiplexer)
+{
+    this->multiplexer = multiplexer;
+    ownMultiplexer = false;
+    init();
+    setCurrent(this);
+}
+
+
+EventLoop::~EventLoop()
+{
+    stop();
+
+    if (wakeupDescriptor != NULL) {
+        multiplexer->getReadManager()->remove(wakeupDescriptor);
+        delete wakeupDescriptor;
+        ::close(wakeupFds[0]);
+        ::close(wakeupFds[1]);
+    }
+
+    while (!pending.empty()) {
+        delete pending.front();
+        pending.pop_front();
+    }
+
+    if (current() == this) {
+        setCurrent(NULL);
+    }
+
+    if (ownMultiplexer) {
+        delete multiplexer;
+    }
+
+    pthread_mutex_destroy(&mutex);
+}
+
+
+/*!
+    \fn EventLoop::init()
+ */
+void EventLoop::init()
+{
+    pthread_mutex_init(&mutex, NULL);
+    threadRunning = false;
+    running = false;
+    wakeupDescriptor = NULL;
+
+    if (pipe(wakeupFds) < 0) {
+        return;
+    }
+
+    fcntl(wakeupFds[0], F_SETFL, fcntl(wakeupFds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(wakeupFds[1], F_SETFL, fcntl(wakeupFds[1], F_GETFL) | O_NONBLOCK);
+    fcntl(wakeupFds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(wakeupFds[1], F_SETFD, FD_CLOEXEC);
+
+    wakeupDescriptor = new WakeupDescriptor(this, wakeupFds[0]);
+    multiplexer->getReadManager()->add(wakeupDescriptor);
+}
+
+
+/*!
+    \fn EventLoop::start()
+ */
+bool EventLoop::start()
+{
+    if (!ownMultiplexer || threadRunning) {
+        return true;
+    }
+
+    if (wakeupDescriptor == NULL) {
+        return false;
+    }
+
+    running = true;
+    if (pthread_create(&thread, NULL, threadMain, this) != 0) {
+        running = false;
+        return false;
+    }
+    threadRunning = true;
+
+    return true;
+}
+
+
+/*!
+    \fn EventLoop::stop()
+ */
+void EventLoop::stop()
+{
+    if (!threadRunning) {
+        return;
+    }
+
+    post(new MethodCallback<EventLoop>(this, &EventLoop::quit));
+    pthread_join(thread, NULL);
+    threadRunning = false;
+}
+
+
+/*!
+    \fn EventLoop::quit()
+ */
+void EventLoop::quit()
+{
+    running = false;
+}
+
+
+/*!
+    \fn EventLoop::threadMain(void *arg)
+ */
+void *EventLoop::threadMain(void *arg)
+{
+    EventLoop *eventLoop = (EventLoop *) arg;
+    sigset_t signals;
+
+    /* signals are handled by the main thread */
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    setCurrent(eventLoop);
+    Multiplexer::setThreadMultiplexer(eventLoop->multiplexer);
+
+    while (eventLoop->running) {
+        eventLoop->multiplexer->multiplex();
+    }
+
+    Multiplexer::setThreadMultiplexer(NULL);
+    setCurrent(NULL);
+
+    return NULL;
+}
+
+
+/*!
+    \fn EventLoop::post(Callback *callback)
+ */
+void EventLoop::post(Callback *callback)
+{
+    bool wakeup;
+
+    pthread_mutex_lock(&mutex);
+    wakeup = pending.empty();
+    pending.push_back(callback);
+    pthread_mutex_unlock(&mutex);
+
+    /* a byte is already in the pipe for the callbacks queued before */
+    if (wakeup && wakeupDescriptor != NULL) {
+        while (write(wakeupFds[1], "", 1) < 0 && errno == EINTR)
+            ;
+    }
+}
+
+
+/*!
+    \fn EventLoop::invoke(Callback *callback)
+ */
+void EventLoop::invoke(Callback *callback)
+{
+    if (isCurrent()) {
+        callback->run();
+        delete callback;
+    } else {
+        post(callback);
+    }
+}
+
+
+/*!
+    \fn EventLoop::runPending()
+ */
+void EventLoop::runPending()
+{
+    deque<Callback *> callbacks;
+
+    pthread_mutex_lock(&mutex);
+    callbacks.swap(pending);
+    pthread_mutex_unlock(&mutex);
+
+    while (!callbacks.empty()) {
+        Callback *callback = callbacks.front();
+        callbacks.pop_front();
+        callback->run();
+        delete callback;
+    }
+}
+
+
+/*!
+    \fn EventLoop::getMultiplexer() const
+ */
+Multiplexer *EventLoop::getMultiplexer() const
+{
+    return multiplexer;
+}
+
+
+/*!
+    \fn EventLoop::isCurrent() const
+ */
+bool EventLoop::isCurrent() const
+{
+    return current() == this;
+}
+
+
+/*!
+    \fn EventLoop::current()
+ */
+EventLoop *EventLoop::current()
+{
+    pthread_once(&currentOnce, createCurrentKey);
+
+    return (EventLoop *) pthread_getspecific(currentKey);
+}
+
+
+/*!
+    \fn EventLoop::setCurrent(EventLoop *eventLoop)
+ */
+void EventLoop::setCurrent(EventLoop *eventLoop)
+{
+    pthread_once(&currentOnce, createCurrentKey);
+    pthread_setspecific(currentKey, eventLoop);
+}
@@ -0,0 +1,166 @@
+//
+// C++ Interface: eventloop
+//
+// Description: A Multiplexer run by a thread of its own.
+//
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include "multiplexer.h"
+#include <pthread.h>
+#include <deque>
+
+class WakeupDescriptor;
+
+/**
+ * @brief A Multiplexer together with the thread running it.
+ *
+ * Descriptors and timer nodes belong to the loop they were added on and must only be
+ * touched by its thread. Other threads hand work over to a loop with post(): the
+ * callback is queued and the loop is woken through a pipe, then runs it in its own
+ * thread. Inside a loop's thread Multiplexer::self() is the multiplexer of that loop,
+ * so code written for the single threaded daemon adds its descriptors to the right
+ * one.
+ */
+class EventLoop
+{
+public:
+    /**
+     * @brief Work to be run on a loop; deleted once it has run.
+     */
+    class Callback
+    {
+    public:
+        virtual ~Callback()
+        {
+        }
+
+        virtual void run() = 0;
+    };
+
+    /**
+     * @brief Callback calling a method without arguments.
+     */
+    template<class T>
+    class MethodCallback : public Callback
+    {
+    public:
+        MethodCallback(T *object, void (T::*method)())
+            : object(object), method(method)
+        {
+        }
+
+        virtual void run()
+        {
+            (object->*method)();
+        }
+
+    private:
+        T *object;
+        void (T::*method)();
+    };
+
+    /**
+     * @brief Callback calling a method with one argument, which is copied.
+     */
+    template<class T, class A>
+    class MethodCallback1 : public Callback
+    {
+    public:
+        MethodCallback1(T *object, void (T::*method)(A), A argument)
+            : object(object), method(method), argument(argument)
+        {
+        }
+
+        virtual void run()
+        {
+            (object->*method)(argument);
+        }
+
+    private:
+        T *object;
+        void (T::*method)(A);
+        A argument;
+    };
+
+    /**
+     * @brief Creates a loop with a multiplexer of its own, to be run by start().
+     */
+    EventLoop(enum Multiplexer::Backend backend);
+
+    /**
+     * @brief Wraps a multiplexer the calling thread runs itself.
+     *
+     * The calling thread becomes the thread of this loop; start() and stop() do
+     * nothing then.
+     */
+    EventLoop(Multiplexer *multiplexer);
+
+    ~EventLoop();
+
+    bool start();
+    void stop();
+
+    /**
+     * @brief Queues callback to be run by the thread of this loop.
+     *
+     * Can be called from any thread. The loop takes ownership of callback.
+     */
+    void post(Callback *callback);
+
+    /**
+     * @brief Runs callback at once if called on this loop, posts it otherwise.
+     */
+    void invoke(Callback *callback);
+
+    /**
+     * @brief Runs the callbacks queued so far in the calling thread.
+     *
+     * The loop's thread does this by itself; a loop wrapping the caller's
+     * multiplexer needs it once the caller no longer multiplexes.
+     */
+    void runPending();
+
+    Multiplexer *getMultiplexer() const;
+    bool isCurrent() const;
+
+    /**
+     * @brief The loop run by the calling thread, NULL if it runs none.
+     */
+    static EventLoop *current();
+
+protected:
+    EventLoop &operator=(const EventLoop &eventLoop)
+    {
+        return *this;
+    }
+
+    explicit EventLoop(const EventLoop &eventLoop)
+    {
+    }
+
+private:
+    void init();
+    void quit();
+    static void *threadMain(void *arg);
+    static void setCurrent(EventLoop *eventLoop);
+
+private:
+    Multiplexer *multiplexer;
+    bool ownMultiplexer;
+    WakeupDescriptor *wakeupDescriptor;
+    int wakeupFds[2];
+    pthread_mutex_t mutex;
+    std::deque<Callback *> pending;
+    pthread_t thread;
+    bool threadRunning;
+    volatile bool running;
+
+friend class WakeupDescriptor;
+};
+
+#endif
@@ -0,0 +1,120 @@
+//
+// C++ Implementation: eventlooppool
+//
+// Description: A fixed set of EventLoop threads connections are spread over.
+//
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "eventlooppool.h"
+
+EventLoopPool *EventLoopPool::eventLoopPool = NULL;
+
+
+EventLoopPool::EventLoopPool(int threads, enum Multiplexer::Backend backend, EventLoop *mainLoop)
+{
+    this->mainLoop = mainLoop;
+    nextLoop = 0;
+    pthread_mutex_init(&mutex, NULL);
+
+    for (int i = 0; i < threads; i++) {
+        loops.push_back(new EventLoop(backend));
+    }
+
+    eventLoopPool = this;
+}
+
+
+EventLoopPool::~EventLoopPool()
+{
+    stop();
+
+    for (unsigned int i = 0; i < loops.size(); i++) {
+        delete loops[i];
+    }
+
+    pthread_mutex_destroy(&mutex);
+
+    if (eventLoopPool == this) {
+        eventLoopPool = NULL;
+    }
+}
+
+
+/*!
+    \fn EventLoopPool::self()
+ */
+EventLoopPool *EventLoopPool::self()
+{
+    return eventLoopPool;
+}
+
+
+/*!
+    \fn EventLoopPool::start()
+ */
+bool EventLoopPool::start()
+{
+    for (unsigned int i = 0; i < loops.size(); i++) {
+        if (!loops[i]->start()) {
+            stop();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/*!
+    \fn EventLoopPool::stop()
+ */
+void EventLoopPool::stop()
+{
+    for (unsigned int i = 0; i < loops.size(); i++) {
+        loops[i]->stop();
+    }
+}
+
+
+/*!
+    \fn EventLoopPool::next()
+ */
+EventLoop *EventLoopPool::next()
+{
+    EventLoop *eventLoop;
+
+    if (loops.empty()) {
+        return mainLoop;
+    }
+
+    pthread_mutex_lock(&mutex);
+    eventLoop = loops[nextLoop];
+    nextLoop = (nextLoop + 1) % loops.size();
+    pthread_mutex_unlock(&mutex);
+
+    return eventLoop;
+}
+
+
+/*!
+    \fn EventLoopPool::getMainLoop() const
+ */
+EventLoop *EventLoopPool::getMainLoop() const
+{
+    return mainLoop;
+}
+
+
+/*!
+    \fn EventLoopPool::getThreads() const
+ */
+int EventLoopPool::getThreads() const
+{
+    return loops.size();
+}
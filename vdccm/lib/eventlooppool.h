@@ -0,0 +1,59 @@
+//
+// C++ Interface: eventlooppool
+//
+// Description: A fixed set of EventLoop threads connections are spread over.
+//
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#ifndef EVENTLOOPPOOL_H
+#define EVENTLOOPPOOL_H
+
+#include "eventloop.h"
+#include <vector>
+
+/**
+ * @brief Hands out the loops of a number of threads round robin.
+ *
+ * A pool without threads hands out the main loop only, everything then runs in the
+ * main thread as it did before there were loops.
+ */
+class EventLoopPool
+{
+public:
+    EventLoopPool(int threads, enum Multiplexer::Backend backend, EventLoop *mainLoop);
+    ~EventLoopPool();
+
+    static EventLoopPool *self();
+
+    bool start();
+    void stop();
+
+    /**
+     * @brief The loop to put the next connection on.
+     */
+    EventLoop *next();
+
+    EventLoop *getMainLoop() const;
+    int getThreads() const;
+
+protected:
+    EventLoopPool &operator=(const EventLoopPool &eventLoopPool)
+    {
+        return *this;
+    }
+
+    explicit EventLoopPool(const EventLoopPool &eventLoopPool)
+    {
+    }
+
+private:
+    static EventLoopPool *eventLoopPool;
+    EventLoop *mainLoop;
+    std::vector<EventLoop *> loops;
+    unsigned int nextLoop;
+    pthread_mutex_t mutex;
+};
+
+#endif
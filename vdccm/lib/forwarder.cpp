@@ -0,0 +1,193 @@
+//
+// C++ Implementation: forwarder
+//
+// Description: Moves bytes from one descriptor to another.
+//
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "forwarder.h"
+#include "descriptor.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+Forwarder::Forwarder(const Descriptor *from, const Descriptor *to, size_t chunkSize, bool zeroCopy)
+    : from(from),
+      to(to),
+      tap(NULL),
+      chunkSize(chunkSize),
+      buffer(NULL),
+      offset(0),
+      pending(0)
+{
+    pipeFds[0] = -1;
+    pipeFds[1] = -1;
+
+#ifdef HAVE_SPLICE
+    if (zeroCopy && pipe(pipeFds) < 0) {
+        pipeFds[0] = -1;
+        pipeFds[1] = -1;
+    }
+#endif
+}
+
+
+Forwarder::~Forwarder()
+{
+    closePipe();
+    delete[] buffer;
+}
+
+
+/*!
+    \fn Forwarder::closePipe()
+ */
+void Forwarder::closePipe()
+{
+    if (pipeFds[0] >= 0) {
+        ::close(pipeFds[0]);
+        ::close(pipeFds[1]);
+        pipeFds[0] = -1;
+        pipeFds[1] = -1;
+    }
+}
+
+
+/*!
+    \fn Forwarder::isZeroCopy() const
+ */
+bool Forwarder::isZeroCopy() const
+{
+    return pipeFds[0] >= 0;
+}
+
+
+/*!
+    \fn Forwarder::setTap(Tap *tap)
+ */
+void Forwarder::setTap(Tap *tap)
+{
+    this->tap = tap;
+
+    if (tap != NULL && pending == 0) {
+        closePipe();
+    }
+}
+
+
+/*!
+    \fn Forwarder::isPending() const
+ */
+bool Forwarder::isPending() const
+{
+    return pending > 0;
+}
+
+
+/*!
+    \fn Forwarder::forward()
+ */
+Forwarder::Result Forwarder::forward()
+{
+    ssize_t n = -1;
+
+    if (pending > 0) {
+        return flush();
+    }
+
+#ifdef HAVE_SPLICE
+    if (isZeroCopy()) {
+        n = splice(from->getDescriptor(), NULL, pipeFds[1], NULL, chunkSize,
+                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+        /* not every pair of descriptors can be spliced, nothing has been taken then */
+        if (n < 0 && errno == EINVAL) {
+            closePipe();
+        }
+    }
+#endif
+
+    if (!isZeroCopy()) {
+        if (buffer == NULL) {
+            buffer = new unsigned char[chunkSize];
+        }
+        n = read(from->getDescriptor(), buffer, chunkSize);
+        offset = 0;
+
+        if (n > 0 && tap != NULL) {
+            tap->forwarded(buffer, n);
+        }
+    }
+
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return DONE;
+    }
+
+    if (n <= 0) {
+        return CLOSED;
+    }
+
+    pending = n;
+
+    return flush();
+}
+
+
+/*!
+    \fn Forwarder::flush()
+ */
+Forwarder::Result Forwarder::flush()
+{
+    while (pending > 0) {
+        ssize_t n;
+
+#ifdef HAVE_SPLICE
+        if (isZeroCopy()) {
+            n = splice(pipeFds[0], NULL, to->getDescriptor(), NULL, pending,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        } else
+#endif
+        {
+            n = write(to->getDescriptor(), buffer + offset, pending);
+            if (n > 0) {
+                offset += n;
+            }
+        }
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        /* the destination cannot be spliced to, take the bytes back out of the pipe */
+        if (n < 0 && errno == EINVAL && isZeroCopy()) {
+            if (buffer == NULL) {
+                buffer = new unsigned char[chunkSize];
+            }
+            offset = 0;
+            if (read(pipeFds[0], buffer, pending) != (ssize_t) pending) {
+                return CLOSED;
+            }
+            closePipe();
+            continue;
+        }
+
+        if (n < 0 && errno == EAGAIN) {
+            return BLOCKED;
+        }
+
+        if (n <= 0) {
+            return CLOSED;
+        }
+
+        pending -= n;
+    }
+
+    return DONE;
+}
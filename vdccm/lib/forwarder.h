@@ -0,0 +1,104 @@
+//
+// C++ Interface: forwarder
+//
+// Description: Moves bytes from one descriptor to another.
+//
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#ifndef FORWARDER_H
+#define FORWARDER_H
+
+#include <sys/types.h>
+
+class Descriptor;
+
+/**
+ * @brief Passes the bytes arriving on one descriptor on to another.
+ *
+ * Where splice() is available the bytes go through a pipe and are never copied to
+ * user space. Otherwise, or if the kernel refuses to splice the two descriptors, they
+ * are copied through a buffer. Both descriptors have to be non-blocking: a destination
+ * that takes no more makes forward() and flush() return BLOCKED with the rest kept,
+ * and the caller is expected to wait until it is writable and call flush() then,
+ * without reading more from the source in between.
+ */
+class Forwarder
+{
+public:
+    enum Result {
+        DONE = 0,
+        BLOCKED,
+        CLOSED
+    };
+
+    /**
+     * @brief Sees the bytes passing through a forwarder, in the order they arrive.
+     */
+    class Tap
+    {
+    public:
+        virtual ~Tap()
+        {
+        }
+
+        virtual void forwarded(const unsigned char *data, size_t length) = 0;
+    };
+
+    /**
+     * @brief Creates a forwarder passing at most chunkSize bytes per forward().
+     *
+     * With zeroCopy false the bytes are always copied through a buffer.
+     */
+    Forwarder(const Descriptor *from, const Descriptor *to, size_t chunkSize, bool zeroCopy = true);
+
+    ~Forwarder();
+
+    /**
+     * @brief Reads what is available from the source and passes it on.
+     * @return CLOSED if the source was closed or one of the descriptors failed.
+     */
+    Result forward();
+
+    /**
+     * @brief Passes on the bytes left over by an earlier BLOCKED forward() or flush().
+     */
+    Result flush();
+
+    bool isPending() const;
+    bool isZeroCopy() const;
+
+    /**
+     * @brief Shows every byte read from the source to tap before it is passed on.
+     *
+     * The bytes have to be copied through the buffer for this, splice() is not used
+     * any more once a tap is set.
+     */
+    void setTap(Tap *tap);
+
+protected:
+    Forwarder &operator=(const Forwarder &forwarder)
+    {
+        return *this;
+    }
+
+    explicit Forwarder(const Forwarder &forwarder)
+    {
+    }
+
+private:
+    void closePipe();
+
+private:
+    const Descriptor *from;
+    const Descriptor *to;
+    Tap *tap;
+    size_t chunkSize;
+    int pipeFds[2];
+    unsigned char *buffer;
+    size_t offset;
+    size_t pending;
+};
+
+#endif
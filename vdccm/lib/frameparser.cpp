@@ -0,0 +1,114 @@
+//
+// C++ Implementation: frameparser
+//
+// Description: Splits a byte stream into length prefixed frames.
+//
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "frameparser.h"
+#include <stdint.h>
+#include <string.h>
+
+#define PREFIX_SIZE 4
+
+
+FrameParser::FrameParser(Listener *listener, size_t snapLength)
+    : listener(listener),
+      buffered(0),
+      received(0),
+      length(0)
+{
+    this->snapLength = (snapLength < PREFIX_SIZE) ? PREFIX_SIZE : snapLength;
+    buffer = new unsigned char[this->snapLength];
+}
+
+
+FrameParser::~FrameParser()
+{
+    delete[] buffer;
+}
+
+
+/*!
+    \fn FrameParser::frameLength(const unsigned char *prefix)
+ */
+size_t FrameParser::frameLength(const unsigned char *prefix)
+{
+    uint32_t payload = prefix[0] | (prefix[1] << 8) | (prefix[2] << 16) | ((uint32_t) prefix[3] << 24);
+
+    return PREFIX_SIZE + (size_t) payload;
+}
+
+
+/*!
+    \fn FrameParser::forwarded(const unsigned char *data, size_t size)
+ */
+void FrameParser::forwarded(const unsigned char *data, size_t size)
+{
+    feed(data, size);
+}
+
+
+/*!
+    \fn FrameParser::feed(const unsigned char *data, size_t size)
+ */
+void FrameParser::feed(const unsigned char *data, size_t size)
+{
+    while (size > 0) {
+        /* a frame starting and ending in this piece is not copied */
+        if (received == 0 && size >= PREFIX_SIZE) {
+            size_t frame = frameLength(data);
+
+            if (frame <= size) {
+                listener->frameParsed(this, data, (frame < snapLength) ? frame : snapLength, frame);
+                data += frame;
+                size -= frame;
+                continue;
+            }
+        }
+
+        size_t n;
+
+        if (received < PREFIX_SIZE) {
+            n = PREFIX_SIZE - received;
+            if (n > size) {
+                n = size;
+            }
+            memcpy(buffer + buffered, data, n);
+            buffered += n;
+            received += n;
+            if (received == PREFIX_SIZE) {
+                length = frameLength(buffer);
+            }
+        } else {
+            n = length - received;
+            if (n > size) {
+                n = size;
+            }
+
+            size_t keep = snapLength - buffered;
+            if (keep > n) {
+                keep = n;
+            }
+            memcpy(buffer + buffered, data, keep);
+            buffered += keep;
+            received += n;
+        }
+
+        data += n;
+        size -= n;
+
+        if (received >= PREFIX_SIZE && received == length) {
+            listener->frameParsed(this, buffer, buffered, length);
+            buffered = 0;
+            received = 0;
+            length = 0;
+        }
+    }
+}
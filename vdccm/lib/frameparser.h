@@ -0,0 +1,73 @@
+//
+// C++ Interface: frameparser
+//
+// Description: Splits a byte stream into length prefixed frames.
+//
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#ifndef FRAMEPARSER_H
+#define FRAMEPARSER_H
+
+#include "forwarder.h"
+#include <sys/types.h>
+
+/**
+ * @brief Finds the frames in a stream of frames each led by a 32 bit little endian
+ * length of the bytes following it, as RAPI packets are.
+ *
+ * The stream may be fed in pieces of any size. Frames that arrive whole within one
+ * piece are handed to the listener where they are; only frames split over pieces are
+ * put together, in a buffer of snapLength bytes allocated once. Frames longer than
+ * that are handed on with their first snapLength bytes only.
+ */
+class FrameParser : public Forwarder::Tap
+{
+public:
+    class Listener
+    {
+    public:
+        virtual ~Listener()
+        {
+        }
+
+        /**
+         * @brief Called for each frame, length prefix included.
+         *
+         * Only capturedLength of the length bytes of the frame are at frame. The bytes
+         * are valid during the call only.
+         */
+        virtual void frameParsed(FrameParser *frameParser, const unsigned char *frame,
+                                 size_t capturedLength, size_t length) = 0;
+    };
+
+    FrameParser(Listener *listener, size_t snapLength);
+    ~FrameParser();
+
+    void feed(const unsigned char *data, size_t size);
+    virtual void forwarded(const unsigned char *data, size_t size);
+
+protected:
+    FrameParser &operator=(const FrameParser &frameParser)
+    {
+        return *this;
+    }
+
+    explicit FrameParser(const FrameParser &frameParser)
+    {
+    }
+
+private:
+    static size_t frameLength(const unsigned char *prefix);
+
+private:
+    Listener *listener;
+    unsigned char *buffer;
+    size_t snapLength;
+    size_t buffered;
+    size_t received;
+    size_t length;
+};
+
+#endif
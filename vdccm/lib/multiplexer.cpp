@@ -20,24 +20,88 @@
  * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE       *
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                  *
  ***************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include "multiplexer.h"
 #include "timernodemanager.h"
+#include "timernode.h"
 #include "descriptormanager.h"
 #include "descriptor.h"
 #include <sys/select.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+
+/* ready descriptors taken from the kernel per multiplex() */
+#define MAX_EPOLL_EVENTS 64
+#endif
+
+#ifdef HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#endif
+
+using namespace std;
 
 Multiplexer* Multiplexer::multiplexer = NULL;
 
+/* the multiplexer of the EventLoop run by a thread */
+static pthread_key_t threadMultiplexerKey;
+static pthread_once_t threadMultiplexerOnce = PTHREAD_ONCE_INIT;
 
-Multiplexer::Multiplexer()
+static void createThreadMultiplexerKey()
 {
-    readManager = new DescriptorManager();
-    writeManager = new DescriptorManager();
-    exceptionManager = new DescriptorManager();
+    pthread_key_create(&threadMultiplexerKey, NULL);
+}
+
+
+Multiplexer::Multiplexer(enum Backend backend)
+{
+    readManager = new DescriptorManager(this, Descriptor::READ);
+    writeManager = new DescriptorManager(this, Descriptor::WRITE);
+    exceptionManager = new DescriptorManager(this, Descriptor::EXCEPTION);
     timerNodeManager = new TimerNodeManager();
-    multiplexer = this;
+    generation = 0;
+    epollFd = -1;
+    timerFd = -1;
+    timerArmed = false;
+
+#ifdef HAVE_SYS_EPOLL_H
+    if (backend == EPOLL) {
+        epollFd = epoll_create(MAX_EPOLL_EVENTS);
+    }
+
+#if defined(HAVE_SYS_TIMERFD_H) && defined(CLOCK_MONOTONIC)
+    if (epollFd >= 0) {
+        timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    }
+
+    if (timerFd >= 0) {
+        struct epoll_event event;
+
+        /* generation 0 is never given to a descriptor */
+        event.events = EPOLLIN;
+        event.data.u64 = (uint32_t) timerFd;
+
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &event) < 0) {
+            ::close(timerFd);
+            timerFd = -1;
+        }
+    }
+#endif
+#endif
+
+    if (epollFd < 0) {
+        backend = SELECT;
+    }
+
+    this->backend = backend;
 }
 
 
@@ -47,7 +111,15 @@ Multiplexer::~Multiplexer()
     delete writeManager;
     delete exceptionManager;
     delete timerNodeManager;
-    multiplexer = NULL;
+    if (timerFd >= 0) {
+        ::close(timerFd);
+    }
+    if (epollFd >= 0) {
+        ::close(epollFd);
+    }
+    if (multiplexer == this) {
+        multiplexer = NULL;
+    }
 }
 
 
@@ -88,11 +160,33 @@ DescriptorManager* Multiplexer::getWriteManager() const
 }
 
 
+/*!
+    \fn Multiplexer::getBackend() const
+ */
+enum Multiplexer::Backend Multiplexer::getBackend() const
+{
+    return backend;
+}
+
+
 /*!
     \fn Multiplexer::multiplex()
     \retval 0 on select error, if negativ, the absolut values is the number of not processed descriptors, if positiv number of processed descriptors - all ok!
  */
 int Multiplexer::multiplex()
+{
+    if (backend == EPOLL) {
+        return multiplexEpoll();
+    }
+
+    return multiplexSelect();
+}
+
+
+/*!
+    \fn Multiplexer::multiplexSelect()
+ */
+int Multiplexer::multiplexSelect()
 {
     tv = timerNodeManager->process();
 
@@ -175,16 +269,289 @@ int Multiplexer::multiplex()
 }
 
 
+/*!
+    \fn Multiplexer::multiplexEpoll()
+ */
+int Multiplexer::multiplexEpoll()
+{
+    int ret = 0;
+
+#ifdef HAVE_SYS_EPOLL_H
+    tv = timerNodeManager->process();
+
+    int timeout = -1;
+
+    if (!armTimer()) {
+        timeout = 0;
+        if (tv.tv_sec >= 0 && tv.tv_usec >= 0) {
+            timeout = tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000;
+        }
+    }
+
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+
+    int numFds = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, timeout);
+
+    int numberProcessed = 0;
+
+    for (int i = 0; i < numFds; i++) {
+        int fd = (int) (events[i].data.u64 & 0xffffffff);
+        unsigned int fdGeneration = (unsigned int) (events[i].data.u64 >> 32);
+        int processed = 0;
+
+        if (fd == timerFd && fdGeneration == 0) {
+            uint64_t expirations;
+
+            /* the timer nodes are run by the next multiplex() */
+            if (read(timerFd, &expirations, sizeof(expirations)) < 0) {
+                expirations = 0;
+            }
+            timerArmed = false;
+            numberProcessed++;
+            continue;
+        }
+
+        /*
+         * Same order as multiplexSelect(), and like select() report errors and hangups
+         * as readable and writable. An earlier event() may have removed or replaced the
+         * descriptor, dispatch() checks it is still the one the event was meant for.
+         */
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+            processed += dispatch(fd, fdGeneration, Descriptor::READ);
+        }
+
+        if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+            processed += dispatch(fd, fdGeneration, Descriptor::WRITE);
+        }
+
+        if (events[i].events & EPOLLPRI) {
+            processed += dispatch(fd, fdGeneration, Descriptor::EXCEPTION);
+        }
+
+        if (processed > 0) {
+            numberProcessed++;
+        }
+    }
+
+    if (numFds < 0) {
+        ret = 0;
+    } else if (numberProcessed == numFds) {
+        ret = numberProcessed;
+    } else {
+        ret = numberProcessed - numFds;
+    }
+#endif
+
+    return ret;
+}
+
+
+/*!
+    \fn Multiplexer::dispatch(int fd, unsigned int generation, enum Descriptor::eventType et)
+ */
+int Multiplexer::dispatch(int fd, unsigned int generation, enum Descriptor::eventType et)
+{
+    map<int, Interest>::iterator iit = interests.find(fd);
+
+    if (iit == interests.end() || iit->second.generation != generation) {
+        return 0;
+    }
+
+    Descriptor *descriptor = iit->second.descriptors[et];
+
+    if (descriptor == NULL) {
+        return 0;
+    }
+
+    switch(et) {
+    case Descriptor::READ:
+        readManager->dispatch(descriptor, et);
+        break;
+    case Descriptor::WRITE:
+        writeManager->dispatch(descriptor, et);
+        break;
+    case Descriptor::EXCEPTION:
+        exceptionManager->dispatch(descriptor, et);
+        break;
+    }
+
+    return 1;
+}
+
+
+/*!
+    \fn Multiplexer::watch(Descriptor *descriptor, enum Descriptor::eventType et)
+ */
+void Multiplexer::watch(Descriptor *descriptor, enum Descriptor::eventType et)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (backend != EPOLL) {
+        return;
+    }
+
+    int fd = descriptor->getDescriptor();
+    map<int, Interest>::iterator iit = interests.find(fd);
+    int op = EPOLL_CTL_MOD;
+
+    if (iit == interests.end()) {
+        Interest interest;
+
+        interest.descriptors[Descriptor::READ] = NULL;
+        interest.descriptors[Descriptor::WRITE] = NULL;
+        interest.descriptors[Descriptor::EXCEPTION] = NULL;
+        interest.generation = ++generation;
+        iit = interests.insert(make_pair(fd, interest)).first;
+        op = EPOLL_CTL_ADD;
+    }
+
+    iit->second.descriptors[et] = descriptor;
+
+
+    /* the kernel drops descriptors on close(), a reused number may be new to it or not */
+    if (control(op, fd, iit->second) < 0) {
+        if (op == EPOLL_CTL_MOD && errno == ENOENT) {
+            control(EPOLL_CTL_ADD, fd, iit->second);
+        } else if (op == EPOLL_CTL_ADD && errno == EEXIST) {
+            control(EPOLL_CTL_MOD, fd, iit->second);
+        }
+    }
+#endif
+}
+
+
+/*!
+    \fn Multiplexer::unwatch(Descriptor *descriptor, enum Descriptor::eventType et)
+ */
+void Multiplexer::unwatch(Descriptor *descriptor, enum Descriptor::eventType et)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (backend != EPOLL) {
+        return;
+    }
+
+    int fd = descriptor->getDescriptor();
+    map<int, Interest>::iterator iit = interests.find(fd);
+
+    /* the number may have been reused by a descriptor added after this one was closed */
+    if (iit == interests.end() || iit->second.descriptors[et] != descriptor) {
+        return;
+    }
+
+    iit->second.descriptors[et] = NULL;
+
+    if (iit->second.descriptors[Descriptor::READ] == NULL &&
+            iit->second.descriptors[Descriptor::WRITE] == NULL &&
+            iit->second.descriptors[Descriptor::EXCEPTION] == NULL) {
+        control(EPOLL_CTL_DEL, fd, iit->second);
+        interests.erase(iit);
+    } else {
+        control(EPOLL_CTL_MOD, fd, iit->second);
+    }
+#endif
+}
+
+
+/*!
+    \fn Multiplexer::control(int op, int fd, const Interest &interest)
+ */
+int Multiplexer::control(int op, int fd, const Interest &interest)
+{
+    int ret = -1;
+
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event event;
+
+    event.events = 0;
+    if (interest.descriptors[Descriptor::READ] != NULL) {
+        event.events |= EPOLLIN;
+    }
+    if (interest.descriptors[Descriptor::WRITE] != NULL) {
+        event.events |= EPOLLOUT;
+    }
+    if (interest.descriptors[Descriptor::EXCEPTION] != NULL) {
+        event.events |= EPOLLPRI;
+    }
+    event.data.u64 = ((uint64_t) interest.generation << 32) | (uint32_t) fd;
+
+    ret = epoll_ctl(epollFd, op, fd, &event);
+#endif
+
+    return ret;
+}
+
+
+/*!
+    \fn Multiplexer::armTimer()
+    Sets the timerfd to the expiry time of the next timer node.
+    \retval false if there is no timerfd or no timer node, epoll_wait() then needs a timeout
+ */
+bool Multiplexer::armTimer()
+{
+    bool ret = false;
+
+#if defined(HAVE_SYS_TIMERFD_H) && defined(CLOCK_MONOTONIC)
+    struct timeval expiry;
+
+    if (timerFd >= 0 && timerNodeManager->nextExpiry(expiry)) {
+        if (!timerArmed || !(expiry == timerExpiry)) {
+            struct itimerspec its;
+
+            its.it_interval.tv_sec = 0;
+            its.it_interval.tv_nsec = 0;
+            its.it_value.tv_sec = expiry.tv_sec;
+            its.it_value.tv_nsec = expiry.tv_usec * 1000;
+
+            /* an all-zero time would disarm the timer */
+            if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+                its.it_value.tv_nsec = 1;
+            }
+
+            timerArmed = timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &its, NULL) == 0;
+            timerExpiry = expiry;
+        }
+
+        ret = timerArmed;
+    }
+#endif
+
+    return ret;
+}
+
+
 /*!
     \fn Multiplexer::self()
  */
 Multiplexer* Multiplexer::self()
 {
-    Multiplexer *mux = multiplexer;
+    return self(SELECT);
+}
+
+
+/*!
+    \fn Multiplexer::self(enum Backend backend)
+ */
+Multiplexer* Multiplexer::self(enum Backend backend)
+{
+    pthread_once(&threadMultiplexerOnce, createThreadMultiplexerKey);
+
+    Multiplexer *mux = (Multiplexer *) pthread_getspecific(threadMultiplexerKey);
 
-    if (multiplexer == NULL) {
-        mux = new Multiplexer();
+    if (mux == NULL) {
+        if (multiplexer == NULL) {
+            multiplexer = new Multiplexer(backend);
+        }
+        mux = multiplexer;
     }
 
     return mux;
 }
+
+
+/*!
+    \fn Multiplexer::setThreadMultiplexer(Multiplexer *multiplexer)
+ */
+void Multiplexer::setThreadMultiplexer(Multiplexer *multiplexer)
+{
+    pthread_once(&threadMultiplexerOnce, createThreadMultiplexerKey);
+    pthread_setspecific(threadMultiplexerKey, multiplexer);
+}
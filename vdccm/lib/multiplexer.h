@@ -24,6 +24,7 @@
 #define MULTIPLEXER_H
 
 #include <sys/time.h>
+#include <map>
 #include <descriptormanager.h>
 #include <timernodemanager.h>
 
@@ -33,16 +34,41 @@
 */
 class Multiplexer {
 public:
+    /**
+     * @brief How multiplex() waits for descriptors.
+     *
+     * SELECT rebuilds the descriptor sets and tests every managed descriptor on each
+     * call. EPOLL registers descriptors with the kernel as they are added to a
+     * DescriptorManager, and only visits the ready ones. It is level-triggered, so
+     * event() is called under the same conditions as with SELECT. Where timerfd is
+     * available, EPOLL also waits for the next timer through one, armed with its
+     * exact expiry time.
+     */
+    enum Backend {
+        SELECT = 0,
+        EPOLL
+    };
+
     ~Multiplexer();
     TimerNodeManager* getTimerNodeManager() const;
     DescriptorManager* getExceptionManager() const;
     DescriptorManager* getReadManager() const;
     DescriptorManager* getWriteManager() const;
+    enum Backend getBackend() const;
     int multiplex();
     static Multiplexer* self();
 
+    /**
+     * @brief Returns the multiplexer, creating it with the given backend if there is none.
+     *
+     * In a thread running an EventLoop this is the multiplexer of that loop, otherwise
+     * the one of the main thread. Falls back to SELECT if EPOLL is not available; see
+     * getBackend().
+     */
+    static Multiplexer* self(enum Backend backend);
+
 protected:
-    Multiplexer();
+    Multiplexer(enum Backend backend = SELECT);
     Multiplexer &operator=(Multiplexer &multiplexer)
     {
         return multiplexer;
@@ -53,12 +79,39 @@ protected:
     }
 
 private:
+    int multiplexSelect();
+    int multiplexEpoll();
+    void watch(Descriptor *descriptor, enum Descriptor::eventType et);
+    void unwatch(Descriptor *descriptor, enum Descriptor::eventType et);
+    int dispatch(int fd, unsigned int generation, enum Descriptor::eventType et);
+
+private:
+    /* the descriptors interested in a file descriptor, indexed by event type */
+    struct Interest {
+        Descriptor *descriptors[3];
+        unsigned int generation;
+    };
+
+    int control(int op, int fd, const Interest &interest);
+    bool armTimer();
+    static void setThreadMultiplexer(Multiplexer *multiplexer);
+
     static Multiplexer *multiplexer;
     struct timeval tv;
     DescriptorManager* readManager;
     DescriptorManager* writeManager;
     DescriptorManager* exceptionManager;
     TimerNodeManager* timerNodeManager;
+    enum Backend backend;
+    int epollFd;
+    int timerFd;
+    bool timerArmed;
+    struct timeval timerExpiry;
+    unsigned int generation;
+    std::map<int, Interest> interests;
+
+friend class DescriptorManager;
+friend class EventLoop;
 };
 
 #endif
@@ -31,6 +31,9 @@
 class SingleShotNode : public TimerNode
 {
 public:
+    /**
+     * @brief Fires once at tv, an absolute time taken from TimerNode::now().
+     */
     SingleShotNode(const struct timeval &tv);
     virtual ~SingleShotNode();
 
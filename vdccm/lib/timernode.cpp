@@ -20,18 +20,29 @@
  * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE       *
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                  *
  ***************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include "timernode.h"
 #include "timernodemanager.h"
 #include <unistd.h>
+#include <time.h>
+#include <stddef.h>
 
 
 TimerNode::TimerNode()
 {
+    timerNodeManager = NULL;
+    heapIndex = -1;
 }
 
 
 TimerNode::~TimerNode()
 {
+    if (timerNodeManager != NULL) {
+        timerNodeManager->remove(this);
+    }
 }
 
 
@@ -41,6 +52,29 @@ TimerNodeManager *TimerNode::getTimerNodeManager() const
 }
 
 
+/*!
+    \fn TimerNode::now()
+ */
+struct timeval TimerNode::now()
+{
+    struct timeval tv;
+
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        tv.tv_sec = ts.tv_sec;
+        tv.tv_usec = ts.tv_nsec / 1000;
+        return tv;
+    }
+#endif
+
+    gettimeofday(&tv, NULL);
+
+    return tv;
+}
+
+
 /*!
     \fn TimerNode::setTimerNodeManager(TimerNodeManager *timerNodeManager)
  */
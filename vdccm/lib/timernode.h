@@ -37,6 +37,14 @@ public:
     virtual ~TimerNode();
     bool expired(struct timeval tv);
     TimerNodeManager *getTimerNodeManager() const;
+
+    /**
+     * @brief The current time on the clock timers run on.
+     *
+     * This is CLOCK_MONOTONIC where available, so timers are not moved by changes
+     * of the system time. Absolute times given to a TimerNode must be taken from it.
+     */
+    static struct timeval now();
     virtual operator struct timeval() const
     {
         return tv;
@@ -53,6 +61,10 @@ protected:
     struct timeval tv;
     TimerNodeManager *timerNodeManager;
 
+private:
+    /* position in the heap of the TimerNodeManager, -1 if not in one */
+    int heapIndex;
+
 friend class TimerNodeManager;
 };
 
@@ -22,21 +22,22 @@
  ***************************************************************************/
 #include "timernodemanager.h"
 #include "timernode.h"
-#include <algorithm>
+#include <cstddef>
 
 
 using namespace std;
 
 TimerNodeManager::TimerNodeManager()
 {
-    listDirty = false;
-    dontIncrement = false;
-    it = timerNodes.end();
 }
 
 
 TimerNodeManager::~TimerNodeManager()
 {
+    for (unsigned int i = 0; i < heap.size(); i++) {
+        heap[i]->heapIndex = -1;
+        heap[i]->setTimerNodeManager(NULL);
+    }
 }
 
 
@@ -46,10 +47,12 @@ TimerNodeManager::~TimerNodeManager()
 bool TimerNodeManager::add(TimerNode * timerNode)
 {
     bool ret = true;
-    if (find(timerNodes.begin(), timerNodes.end(), timerNode) == timerNodes.end()) {
-        timerNodes.push_back(timerNode);
+
+    if (timerNode->heapIndex < 0) {
+        heap.push_back(timerNode);
+        place(timerNode, heap.size() - 1);
+        siftUp(timerNode->heapIndex);
         timerNode->setTimerNodeManager(this);
-        listDirty = true;
     } else {
         ret = false;
     }
@@ -64,19 +67,18 @@ bool TimerNodeManager::add(TimerNode * timerNode)
 bool TimerNodeManager::remove(TimerNode * timerNode)
 {
     bool ret = true;
-    list<TimerNode *>::iterator rit;
 
-    rit = find(timerNodes.begin(), timerNodes.end(), timerNode);
+    if (timerNode->heapIndex >= 0 && timerNode->timerNodeManager == this) {
+        unsigned int index = timerNode->heapIndex;
+        TimerNode *last = heap.back();
 
-    if (rit != timerNodes.end()) {
-        if (rit == it) {
-            it = timerNodes.erase(rit);
-            dontIncrement = true;
-        } else {
-            timerNodes.erase(rit);
+        heap.pop_back();
+        if (last != timerNode) {
+            place(last, index);
+            update(last);
         }
+        timerNode->heapIndex = -1;
         timerNode->setTimerNodeManager(NULL);
-        listDirty = true;
     } else {
         ret = false;
     }
@@ -85,56 +87,29 @@ bool TimerNodeManager::remove(TimerNode * timerNode)
 }
 
 
-bool TimerNodeManager::compare(const TimerNode * const tn1, const TimerNode * const tn2)
-{
-    return *tn1 < *tn2;
-}
-
-
 /*!
     \fn TimerNodeManager::process()
  */
 struct timeval TimerNodeManager::process()
 {
-    if (listDirty) {
-        timerNodes.sort(TimerNodeManager::compare);
-        listDirty = false;
+    /*
+     * One clock read for the whole pass. A node due at that time is triggered, and
+     * again if it is still due after it rescheduled itself, but a node whose time
+     * comes only while the others run waits for the next call.
+     */
+    struct timeval actualTime = TimerNode::now();
+
+    while (!heap.empty() && heap.front()->expired(actualTime)) {
+        heap.front()->trigger();
     }
 
-    int numberProcessed;
-    dontIncrement = false;
-
-    struct timeval actualTime;
-
-    do {
-        it = timerNodes.begin();
-        numberProcessed = 0;
-        while(it != timerNodes.end()) {
-            gettimeofday(&actualTime, NULL);
-            if ((*it)->expired(actualTime)) {
-                (*it)->trigger();
-                numberProcessed++;
-            }
-            if (!dontIncrement) {
-                ++it;
-            } else {
-                dontIncrement = false;
-            }
-        }
-        if (listDirty) {
-            timerNodes.sort(TimerNodeManager::compare);
-            listDirty = false;
-        }
-    } while(numberProcessed > 0);
-
     struct timeval tv;
 
-    if (timerNodes.size() == 0) {
+    if (heap.empty()) {
         tv.tv_sec = 10;
         tv.tv_usec = 0;
     } else {
-        gettimeofday(&actualTime, NULL);
-        tv = *timerNodes.front() - actualTime;
+        tv = *heap.front() - actualTime;
     }
 
     return tv;
@@ -142,9 +117,78 @@ struct timeval TimerNodeManager::process()
 
 
 /*!
-    \fn TimerNodeManager::setDirty()
+    \fn TimerNodeManager::nextExpiry(struct timeval &tv) const
+    \retval false if there is no timer node
+ */
+bool TimerNodeManager::nextExpiry(struct timeval &tv) const
+{
+    if (heap.empty()) {
+        return false;
+    }
+
+    tv = *heap.front();
+
+    return true;
+}
+
+
+/*!
+    \fn TimerNodeManager::update(TimerNode *timerNode)
+    Moves the node to its place after its expiry time changed.
  */
- void TimerNodeManager::setDirty()
+void TimerNodeManager::update(TimerNode *timerNode)
 {
-    listDirty = true;
+    unsigned int index = timerNode->heapIndex;
+
+    siftUp(index);
+    if ((unsigned int) timerNode->heapIndex == index) {
+        siftDown(index);
+    }
+}
+
+
+void TimerNodeManager::place(TimerNode *timerNode, unsigned int index)
+{
+    heap[index] = timerNode;
+    timerNode->heapIndex = index;
+}
+
+
+void TimerNodeManager::siftUp(unsigned int index)
+{
+    TimerNode *timerNode = heap[index];
+
+    while (index > 0) {
+        unsigned int parent = (index - 1) / 2;
+
+        if (!(*timerNode < *heap[parent])) {
+            break;
+        }
+        place(heap[parent], index);
+        index = parent;
+    }
+
+    place(timerNode, index);
+}
+
+
+void TimerNodeManager::siftDown(unsigned int index)
+{
+    TimerNode *timerNode = heap[index];
+    unsigned int size = heap.size();
+
+    while (2 * index + 1 < size) {
+        unsigned int child = 2 * index + 1;
+
+        if (child + 1 < size && *heap[child + 1] < *heap[child]) {
+            child++;
+        }
+        if (!(*heap[child] < *timerNode)) {
+            break;
+        }
+        place(heap[child], index);
+        index = child;
+    }
+
+    place(timerNode, index);
 }
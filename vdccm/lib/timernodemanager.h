@@ -23,13 +23,18 @@
 #ifndef TIMERNODEMANAGER_H
 #define TIMERNODEMANAGER_H
 
-#include <list>
+#include <sys/time.h>
+#include <vector>
 
 class TimerNode;
 class Multiplexer;
 
 /**
 @author Volker Christian
+
+The timer nodes are kept in a binary min-heap ordered by expiry time. Each node
+knows its own position in the heap, so add(), remove() and rescheduling a node
+take O(log n), and process() only looks at the nodes that are due.
 */
 class TimerNodeManager{
 public:
@@ -50,14 +55,14 @@ protected:
 
 private:
     struct timeval process();
-    void setDirty();
-    static bool compare(const TimerNode * tn1, const TimerNode * tn2);
+    bool nextExpiry(struct timeval &tv) const;
+    void update(TimerNode *timerNode);
+    void place(TimerNode *timerNode, unsigned int index);
+    void siftUp(unsigned int index);
+    void siftDown(unsigned int index);
 
 private:
-    std::list<TimerNode *> timerNodes;
-    std::list<TimerNode *>::iterator it;
-    bool listDirty;
-    bool dontIncrement;
+    std::vector<TimerNode *> heap;
 
 friend class Multiplexer;
 friend class SingleShotNode;
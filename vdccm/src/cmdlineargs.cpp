@@ -40,6 +40,9 @@ int CmdLineArgs::missingPingCount = DCCM_MAX_PING_COUNT;
 int CmdLineArgs::pingDelay = DCCM_PING_INTERVAL ;
 bool CmdLineArgs::syncClock = false;
 bool CmdLineArgs::bypassRootCheck = false;
+bool CmdLineArgs::_useEpoll = false;
+int CmdLineArgs::loopThreads = 0;
+string CmdLineArgs::captureFile = "";
 
 CmdLineArgs::CmdLineArgs()
 {
@@ -53,7 +56,7 @@ CmdLineArgs::~CmdLineArgs()
 void CmdLineArgs::usage(const char *name)
 {
     cout << "Syntax:" << endl << endl
-         << "\t" << name << " [-d level] [-f] [-h] [-p password] [-i] [-u count] [-s sec]" << endl << endl
+         << "\t" << name << " [-d level] [-f] [-h] [-p password] [-i] [-u count] [-s sec] [-e] [-l count] [-c file]" << endl << endl
          << "\t-t           Synchronize clock of WM5 devices with host-time" << endl
          << "\t-d level     Set debug log level" << endl
          << "\t           0 - No logging" << endl
@@ -68,7 +71,10 @@ void CmdLineArgs::usage(const char *name)
          << "\t-i           Use ip-address of device for identification" << endl
          << "\t-u count     Allowed numbers of unanswered pings (default 3)" << endl
          << "\t-s sec       Delay between pings in seconds (default 5)" << endl
-         << "\t-r           Bypass \"do not start as root\"-check" << endl;
+         << "\t-r           Bypass \"do not start as root\"-check" << endl
+         << "\t-e           Wait for connections with epoll instead of select" << endl
+         << "\t-l count     Number of event-loop threads for devices (default 0)" << endl
+         << "\t-c file      Capture the proxied RAPI packets to file" << endl;
 }
 
 
@@ -76,12 +82,20 @@ bool CmdLineArgs::parseArgs(int argc, char *argv[])
 {
     int c;
 
-    while ((c = getopt(argc, argv, "d:fhtrp:iu:s:")) != -1) {
+    while ((c = getopt(argc, argv, "d:efhtrp:iu:s:l:c:")) != -1) {
         switch (c) {
+        case 'c':
+            captureFile = optarg;
+            break;
+
         case 'd':
             logLevel = atoi(optarg);
             break;
 
+        case 'e':
+            _useEpoll = true;
+            break;
+
         case 'f':
             _isDaemon = false;
             break;
@@ -102,6 +116,13 @@ bool CmdLineArgs::parseArgs(int argc, char *argv[])
             pingDelay = atoi(optarg);
             break;
 
+        case 'l':
+            loopThreads = atoi(optarg);
+            if (loopThreads < 0) {
+                loopThreads = 0;
+            }
+            break;
+
         case 't':
             syncClock = true;
             break;
@@ -204,3 +225,21 @@ bool CmdLineArgs::getBypassRootCheck()
 {
     return bypassRootCheck;
 }
+
+
+bool CmdLineArgs::useEpoll()
+{
+    return _useEpoll;
+}
+
+
+int CmdLineArgs::getLoopThreads()
+{
+    return loopThreads;
+}
+
+
+string CmdLineArgs::getCaptureFile()
+{
+    return captureFile;
+}
@@ -40,6 +40,9 @@ public:
     static bool getSyncClock();
     static int getLogLevel();
     static bool getBypassRootCheck();
+    static bool useEpoll();
+    static int getLoopThreads();
+    static std::string getCaptureFile();
 
 private:
     CmdLineArgs();
@@ -54,6 +57,9 @@ private:
     static int pingDelay;
     static bool syncClock;
     static bool bypassRootCheck;
+    static bool _useEpoll;
+    static int loopThreads;
+    static std::string captureFile;
 };
 
 #endif
@@ -1,6 +1,7 @@
 #include "cutils.h"
 #include "utils.h"
 #include "windowscedevicebase.h"
+#include "devicemanager.h"
 
 void
 _vdccm_acquire_root_privileges ()
@@ -19,7 +20,8 @@ _vdccm_ce_device_base_disconnect (gpointer ce_device_base)
 {
   WindowsCEDeviceBase *device = (WindowsCEDeviceBase *) ce_device_base;
 
-  device->disconnect ();
+  /* called from the GLib thread, the device lives on one of the event loops */
+  DeviceManager::self ()->disconnectDevice (device);
 }
 
 gchar *
@@ -26,6 +26,7 @@
 #include <errno.h>
 #include <string.h>
 #include <tcpacceptedsocketfactory.h>
+#include <eventlooppool.h>
 
 using namespace std;
 using namespace synce;
@@ -69,13 +70,24 @@ void DccmServer::event(Descriptor::eventType /*et*/)
     SynceSocket *clientSocket = synce_socket_accept(socket, NULL);
 
     if (clientSocket != NULL) {
-        WindowsCEDevice *wced = dynamic_cast<WindowsCEDevice *>(tcpAcceptedSocketFactory->socket(
-                synce_socket_get_descriptor(clientSocket) , this));
-        if (wced != NULL) {
-            wced->init(clientSocket);
-        } else {
-            synce_warning("Device not accepted: %s", strerror(errno));
-        }
+        // The device is created on the loop it will live on
+        EventLoopPool::self()->next()->invoke(
+                new EventLoop::MethodCallback1<DccmServer, SynceSocket *>(this, &DccmServer::accepted, clientSocket));
+    } else {
+        synce_warning("Device not accepted: %s", strerror(errno));
+    }
+}
+
+
+/*!
+    \fn DccmServer::accepted(SynceSocket *clientSocket)
+ */
+void DccmServer::accepted(SynceSocket *clientSocket)
+{
+    WindowsCEDevice *wced = dynamic_cast<WindowsCEDevice *>(tcpAcceptedSocketFactory->socket(
+            synce_socket_get_descriptor(clientSocket) , this));
+    if (wced != NULL) {
+        wced->init(clientSocket);
     } else {
         synce_warning("Device not accepted: %s", strerror(errno));
     }
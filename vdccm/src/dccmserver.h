@@ -48,6 +48,9 @@ protected:
     virtual void event(Descriptor::eventType et);
 
     SynceSocket* socket;
+
+private:
+    void accepted(SynceSocket *clientSocket);
 };
 
 #endif
@@ -30,20 +30,97 @@
 #include "cmdlineargs.h"
 
 #include <algorithm>
+#include <vector>
 #include <synce_log.h>
 
 using namespace std;
 
+/* something to be done to a device on its own loop */
+class DeviceManager::DeviceCall : public EventLoop::Callback
+{
+public:
+    DeviceCall(DeviceManager *deviceManager, WindowsCEDeviceBase *windowsCEDevice, unsigned long serial,
+               enum DeviceCommand command, string password = "")
+        : deviceManager(deviceManager), windowsCEDevice(windowsCEDevice), serial(serial),
+          eventLoop(windowsCEDevice->getEventLoop()), command(command), password(password)
+    {
+    }
+
+    EventLoop *getEventLoop() const
+    {
+        return eventLoop;
+    }
+
+    virtual void run()
+    {
+        /* the device may have gone while the call was queued */
+        if (!deviceManager->isRegistered(windowsCEDevice, serial)) {
+            return;
+        }
+
+        switch (command) {
+        case PING:
+            windowsCEDevice->ping();
+            break;
+        case DISCONNECT:
+            windowsCEDevice->disconnect();
+            break;
+        case PASSWORD:
+            synce_trace("Sending Password to: %s", windowsCEDevice->getDeviceName().c_str());
+            if (!windowsCEDevice->sendPassword(password)) {
+                synce_trace("failed to send password to %s", windowsCEDevice->getDeviceName().c_str());
+                windowsCEDevice->disconnect();
+            }
+            break;
+        }
+    }
+
+private:
+    DeviceManager *deviceManager;
+    WindowsCEDeviceBase *windowsCEDevice;
+    unsigned long serial;
+    EventLoop *eventLoop;
+    enum DeviceCommand command;
+    string password;
+};
+
+
+/* something to be told to the clients on the main loop */
+class DeviceManager::ClientNotification : public EventLoop::Callback
+{
+public:
+    ClientNotification(DeviceManager *deviceManager, enum ClientEvent clientEvent, string deviceName)
+        : deviceManager(deviceManager), clientEvent(clientEvent), deviceName(deviceName)
+    {
+    }
+
+    virtual void run()
+    {
+        deviceManager->notifyClients(clientEvent, deviceName);
+    }
+
+private:
+    DeviceManager *deviceManager;
+    enum ClientEvent clientEvent;
+    string deviceName;
+};
+
+
 DeviceManager *DeviceManager::deviceManager = NULL;
 
 DeviceManager::DeviceManager()
  : ContinousNode(CmdLineArgs::getPingDelay(), 0)
 {
+    clientCount = 0;
+    nextSerial = 0;
+    mainLoop = EventLoop::current();
+    pthread_mutex_init(&mutex, NULL);
 }
 
 
 DeviceManager::~DeviceManager()
 {
+    pthread_mutex_destroy(&mutex);
 }
 
 void DeviceManager::init()
@@ -63,24 +140,125 @@ DeviceManager *DeviceManager::self()
 }
 
 
-void DeviceManager::addConnectedDevice(WindowsCEDeviceBase * windowsCEDevice)
+/*!
+    \fn DeviceManager::getName(const WindowsCEDeviceBase * windowsCEDevice) const
+ */
+string DeviceManager::getName(const WindowsCEDeviceBase * windowsCEDevice) const
+{
+    return (!CmdLineArgs::useIp()) ? windowsCEDevice->getDeviceName() : windowsCEDevice->getDeviceAddress();
+}
+
+
+/*!
+    \fn DeviceManager::isRegistered(const WindowsCEDeviceBase * windowsCEDevice, unsigned long serial)
+ */
+bool DeviceManager::isRegistered(const WindowsCEDeviceBase * windowsCEDevice, unsigned long serial)
+{
+    list<WindowsCEDeviceBase *>::iterator it;
+    bool registered = false;
+
+    pthread_mutex_lock(&mutex);
+    it = find(connectedDevices.begin(), connectedDevices.end(), windowsCEDevice);
+    if (it == connectedDevices.end()) {
+        it = find(passwordPendingDevices.begin(), passwordPendingDevices.end(), windowsCEDevice);
+        registered = it != passwordPendingDevices.end() && (*it)->serial == serial;
+    } else {
+        registered = (*it)->serial == serial;
+    }
+    pthread_mutex_unlock(&mutex);
+
+    return registered;
+}
+
+
+/*!
+    \fn DeviceManager::dispatch(DeviceCall *deviceCall)
+ */
+void DeviceManager::dispatch(DeviceCall *deviceCall)
+{
+    if (deviceCall->getEventLoop() != NULL) {
+        deviceCall->getEventLoop()->invoke(deviceCall);
+    } else {
+        deviceCall->run();
+        delete deviceCall;
+    }
+}
+
+
+/*!
+    \fn DeviceManager::runOnMainLoop(EventLoop::Callback *callback)
+ */
+void DeviceManager::runOnMainLoop(EventLoop::Callback *callback)
+{
+    if (mainLoop != NULL) {
+        mainLoop->invoke(callback);
+    } else {
+        callback->run();
+        delete callback;
+    }
+}
+
+
+/*!
+    \fn DeviceManager::notifyClients(enum ClientEvent clientEvent, string deviceName)
+ */
+void DeviceManager::notifyClients(enum ClientEvent clientEvent, string deviceName)
 {
     list<SynCEClient *>::iterator it;
 
-    string deviceName = (!CmdLineArgs::useIp()) ? windowsCEDevice->getDeviceName() : windowsCEDevice->getDeviceAddress();
+    if (clientEvent == DEVICE_CONNECTED) {
+        announcedDevices.push_back(deviceName);
+    } else if (clientEvent == DEVICE_DISCONNECTED) {
+        announcedDevices.remove(deviceName);
+    }
+
+    for (it = connectedClients.begin(); it != connectedClients.end(); ++it) {
+        bool written = false;
+
+        switch (clientEvent) {
+        case DEVICE_CONNECTED:
+            written = (*it)->deviceConnected(deviceName);
+            break;
+        case DEVICE_DISCONNECTED:
+            written = (*it)->deviceDisconnected(deviceName);
+            break;
+        case PASSWORD_REQUESTED:
+            written = (*it)->deviceRequestsPassword(deviceName);
+            break;
+        case PASSWORD_REJECTED:
+            written = (*it)->passwordRejected(deviceName);
+            break;
+        }
+
+        if (!written) {
+            break;
+        }
+    }
+}
+
 
-    if (find_if(connectedDevices.begin(), connectedDevices.end(), WindowsCEDeviceBase::EqualsTo(windowsCEDevice)) == connectedDevices.end()) {
+void DeviceManager::addConnectedDevice(WindowsCEDeviceBase * windowsCEDevice)
+{
+    string deviceName = getName(windowsCEDevice);
+    bool known;
+
+    pthread_mutex_lock(&mutex);
+    known = find_if(connectedDevices.begin(), connectedDevices.end(), WindowsCEDeviceBase::EqualsTo(windowsCEDevice)) != connectedDevices.end();
+    if (!known) {
+        if (windowsCEDevice->serial == 0) {
+            windowsCEDevice->serial = ++nextSerial;
+        }
+        connectedDevices.push_back(windowsCEDevice);
+        connectionFileManager.writeConnectionFile(windowsCEDevice);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    if (!known) {
 #ifdef ENABLE_DESKTOP_INTEGRATION
         _vdccm_event_manager_device_connected(eventManager, windowsCEDevice);
 #endif
 
-        connectedDevices.push_back(windowsCEDevice);
-        connectionFileManager.writeConnectionFile(windowsCEDevice);
-        for (it = connectedClients.begin(); it != connectedClients.end(); ++it) {
-            if (!(*it)->deviceConnected(deviceName)) {
-                break;
-            }
-        }
+        runOnMainLoop(new ClientNotification(this, DEVICE_CONNECTED, deviceName));
         synce_info("Device connected: %s", deviceName.c_str());
     } else {
         // A device with same name is already known here!
@@ -91,21 +269,24 @@ void DeviceManager::addConnectedDevice(WindowsCEDeviceBase * windowsCEDevice)
 
 void DeviceManager::removeConnectedDevice(WindowsCEDeviceBase * windowsCEDevice)
 {
-    list<SynCEClient *>::iterator it;
+    bool known;
 
-    if (find_if(connectedDevices.begin(), connectedDevices.end(), WindowsCEDeviceBase::EqualsTo(windowsCEDevice)) != connectedDevices.end()) {
-        string deviceName = (!CmdLineArgs::useIp()) ? windowsCEDevice->getDeviceName() : windowsCEDevice->getDeviceAddress();
-        for (it = connectedClients.begin(); it != connectedClients.end(); ++it) {
-            if (!(*it)->deviceDisconnected(deviceName)) {
-                break;
-            }
-        }
+    pthread_mutex_lock(&mutex);
+    known = find_if(connectedDevices.begin(), connectedDevices.end(), WindowsCEDeviceBase::EqualsTo(windowsCEDevice)) != connectedDevices.end();
+    if (known) {
+        connectionFileManager.removeConnectionFile(windowsCEDevice);
+        connectedDevices.remove(windowsCEDevice);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    if (known) {
+        string deviceName = getName(windowsCEDevice);
+
+        runOnMainLoop(new ClientNotification(this, DEVICE_DISCONNECTED, deviceName));
 #ifdef ENABLE_DESKTOP_INTEGRATION
         _vdccm_event_manager_device_disconnected(eventManager, windowsCEDevice);
 #endif
 
-        connectionFileManager.removeConnectionFile(windowsCEDevice);
-        connectedDevices.remove(windowsCEDevice);
         synce_info("Device disconnected: %s", deviceName.c_str());
     }
 }
@@ -113,21 +294,27 @@ void DeviceManager::removeConnectedDevice(WindowsCEDeviceBase * windowsCEDevice)
 
 bool DeviceManager::addPasswordPendingDevice(WindowsCEDeviceBase * windowsCEDevice)
 {
-    list<SynCEClient *>::iterator it;
+    bool known;
 
-    if (connectedClients.size() == 0) {
+    pthread_mutex_lock(&mutex);
+    if (clientCount == 0) {
+        pthread_mutex_unlock(&mutex);
         return false;
     }
 
-    if (find_if(passwordPendingDevices.begin(), passwordPendingDevices.end(), WindowsCEDeviceBase::EqualsTo(windowsCEDevice)) == passwordPendingDevices.end()) {
-        string deviceName = (!CmdLineArgs::useIp()) ? windowsCEDevice->getDeviceName() : windowsCEDevice->getDeviceAddress();
-        for (it = connectedClients.begin(); it != connectedClients.end(); ++it) {
-            if (!(*it)->deviceRequestsPassword(deviceName)) {
-                break;
-            }
+    known = find_if(passwordPendingDevices.begin(), passwordPendingDevices.end(), WindowsCEDeviceBase::EqualsTo(windowsCEDevice)) != passwordPendingDevices.end();
+    if (!known) {
+        if (windowsCEDevice->serial == 0) {
+            windowsCEDevice->serial = ++nextSerial;
         }
-        synce_info("Device pending for password: %s", deviceName.c_str());
         passwordPendingDevices.push_back(windowsCEDevice);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    if (!known) {
+        string deviceName = getName(windowsCEDevice);
+        runOnMainLoop(new ClientNotification(this, PASSWORD_REQUESTED, deviceName));
+        synce_info("Device pending for password: %s", deviceName.c_str());
     } else {
         windowsCEDevice->disconnect();
         return false;
@@ -139,8 +326,16 @@ bool DeviceManager::addPasswordPendingDevice(WindowsCEDeviceBase * windowsCEDevi
 
 void DeviceManager::removePasswordPendingDevice(WindowsCEDeviceBase * windowsCEDevice)
 {
-    if (find_if(passwordPendingDevices.begin(), passwordPendingDevices.end(), WindowsCEDeviceBase::EqualsTo(windowsCEDevice)) != passwordPendingDevices.end()) {
+    bool known;
+
+    pthread_mutex_lock(&mutex);
+    known = find_if(passwordPendingDevices.begin(), passwordPendingDevices.end(), WindowsCEDeviceBase::EqualsTo(windowsCEDevice)) != passwordPendingDevices.end();
+    if (known) {
         passwordPendingDevices.remove(windowsCEDevice);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    if (known) {
         synce_info("Device no longer pending for password: %s", windowsCEDevice->getDeviceName().c_str());
     }
 }
@@ -148,14 +343,9 @@ void DeviceManager::removePasswordPendingDevice(WindowsCEDeviceBase * windowsCED
 
 void DeviceManager::passwordRejected(WindowsCEDeviceBase * windowsCEDevice)
 {
-    list<SynCEClient *>::iterator it;
+    string deviceName = getName(windowsCEDevice);
 
-    string deviceName = (!CmdLineArgs::useIp()) ? windowsCEDevice->getDeviceName() : windowsCEDevice->getDeviceAddress();
-    for (it = connectedClients.begin(); it != connectedClients.end(); ++it) {
-        if (!(*it)->passwordRejected(deviceName)) {
-            break;
-        }
-    }
+    runOnMainLoop(new ClientNotification(this, PASSWORD_REJECTED, deviceName));
     synce_info("Passord rejected: %s", deviceName.c_str());
 }
 
@@ -164,10 +354,13 @@ void DeviceManager::addClient(SynCEClient * synCEClient)
 {
     connectedClients.push_back(synCEClient);
 
-    list<WindowsCEDeviceBase *>::iterator it;
-    for (it = connectedDevices.begin(); it != connectedDevices.end(); ++it) {
-        string deviceName = (!CmdLineArgs::useIp()) ? (*it)->getDeviceName() : (*it)->getDeviceAddress();
-        if (!synCEClient->deviceConnected(deviceName)) {
+    pthread_mutex_lock(&mutex);
+    clientCount = connectedClients.size();
+    pthread_mutex_unlock(&mutex);
+
+    list<string>::iterator it;
+    for (it = announcedDevices.begin(); it != announcedDevices.end(); ++it) {
+        if (!synCEClient->deviceConnected(*it)) {
             break;
         }
     }
@@ -178,48 +371,103 @@ void DeviceManager::addClient(SynCEClient * synCEClient)
 void DeviceManager::removeClient(SynCEClient * synCEClient)
 {
     connectedClients.remove(synCEClient);
+
+    pthread_mutex_lock(&mutex);
+    clientCount = connectedClients.size();
+    pthread_mutex_unlock(&mutex);
+
     synce_info("SynCE-Client disconnected");
 }
 
-#include <iostream>
-using namespace std;
-WindowsCEDeviceBase *DeviceManager::getConnectedDevice(string name)
+
+/*!
+    \fn DeviceManager::sendPassword(string name, string password)
+ */
+bool DeviceManager::sendPassword(string name, string password)
 {
     list<WindowsCEDeviceBase *>::iterator it;
-    for (it = connectedDevices.begin(); it != connectedDevices.end(); ++it) {
-        string deviceName = (!CmdLineArgs::useIp()) ? (*it)->getDeviceName() : (*it)->getDeviceAddress();
-        if (deviceName == name) {
-            return *it;
+    DeviceCall *deviceCall = NULL;
+
+    pthread_mutex_lock(&mutex);
+    for (it = passwordPendingDevices.begin(); it != passwordPendingDevices.end(); ++it) {
+        if (getName(*it) == name) {
+            deviceCall = new DeviceCall(this, *it, (*it)->serial, PASSWORD, password);
+            break;
         }
     }
+    pthread_mutex_unlock(&mutex);
+
+    if (deviceCall == NULL) {
+        return false;
+    }
 
-    return NULL;
+    dispatch(deviceCall);
+
+    return true;
 }
 
 
-WindowsCEDeviceBase *DeviceManager::getPasswordPendingDevice(string name)
+/*!
+    \fn DeviceManager::disconnectDevice(string name)
+ */
+bool DeviceManager::disconnectDevice(string name)
 {
     list<WindowsCEDeviceBase *>::iterator it;
+    DeviceCall *deviceCall = NULL;
 
-    for (it = passwordPendingDevices.begin(); it != passwordPendingDevices.end(); ++it) {
-        string deviceName = (!CmdLineArgs::useIp()) ? (*it)->getDeviceName() : (*it)->getDeviceAddress();
-        if (deviceName == name) {
-            return *it;
+    pthread_mutex_lock(&mutex);
+    for (it = connectedDevices.begin(); it != connectedDevices.end(); ++it) {
+        if (getName(*it) == name) {
+            deviceCall = new DeviceCall(this, *it, (*it)->serial, DISCONNECT);
+            break;
         }
     }
+    pthread_mutex_unlock(&mutex);
+
+    if (deviceCall == NULL) {
+        return false;
+    }
 
-    return NULL;
+    dispatch(deviceCall);
+
+    return true;
+}
+
+
+/*!
+    \fn DeviceManager::disconnectDevice(WindowsCEDeviceBase * windowsCEDevice)
+ */
+void DeviceManager::disconnectDevice(WindowsCEDeviceBase * windowsCEDevice)
+{
+    list<WindowsCEDeviceBase *>::iterator it;
+    DeviceCall *deviceCall = NULL;
+
+    pthread_mutex_lock(&mutex);
+    it = find(connectedDevices.begin(), connectedDevices.end(), windowsCEDevice);
+    if (it != connectedDevices.end()) {
+        deviceCall = new DeviceCall(this, *it, (*it)->serial, DISCONNECT);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    if (deviceCall != NULL) {
+        dispatch(deviceCall);
+    }
 }
 
 
 void DeviceManager::shot()
 {
-    list<WindowsCEDeviceBase *>::iterator it = connectedDevices.begin();
+    list<WindowsCEDeviceBase *>::iterator it;
+    vector<DeviceCall *> deviceCalls;
 
-    while(it != connectedDevices.end()) {
-        WindowsCEDeviceBase *wced = *it;
-        ++it;
-        wced->ping();
+    pthread_mutex_lock(&mutex);
+    for (it = connectedDevices.begin(); it != connectedDevices.end(); ++it) {
+        deviceCalls.push_back(new DeviceCall(this, *it, (*it)->serial, PING));
+    }
+    pthread_mutex_unlock(&mutex);
+
+    for (unsigned int i = 0; i < deviceCalls.size(); i++) {
+        dispatch(deviceCalls[i]);
     }
 }
 
@@ -229,12 +477,17 @@ void DeviceManager::shot()
  */
 void DeviceManager::shutdownDevices()
 {
-    list<WindowsCEDeviceBase *>::iterator it = connectedDevices.begin();
+    list<WindowsCEDeviceBase *>::iterator it;
+    vector<DeviceCall *> deviceCalls;
 
-    while(it != connectedDevices.end()) {
-        WindowsCEDeviceBase *windowsCEDevice = *it;
-        ++it;
-        windowsCEDevice->disconnect();
+    pthread_mutex_lock(&mutex);
+    for (it = connectedDevices.begin(); it != connectedDevices.end(); ++it) {
+        deviceCalls.push_back(new DeviceCall(this, *it, (*it)->serial, DISCONNECT));
+    }
+    pthread_mutex_unlock(&mutex);
+
+    for (unsigned int i = 0; i < deviceCalls.size(); i++) {
+        dispatch(deviceCalls[i]);
     }
 }
 
@@ -262,12 +515,13 @@ void DeviceManager::shutdown()
  */
 void DeviceManager::setAsDefaultDevice(string name)
 {
+    pthread_mutex_lock(&mutex);
     for (list<WindowsCEDeviceBase *>::iterator it = connectedDevices.begin(); it != connectedDevices.end(); ++it) {
-        string deviceName = (!CmdLineArgs::useIp()) ? (*it)->getDeviceName() : (*it)->getDeviceAddress();
-        if (deviceName == name) {
+        if (getName(*it) == name) {
             connectionFileManager.writeDefaultConnectionFile(*it);
             break;
         }
     }
+    pthread_mutex_unlock(&mutex);
     synce_info("Set as default device: %s", name.c_str());
 }
@@ -27,8 +27,10 @@
 
 #include <list>
 #include <string>
+#include <pthread.h>
 
 #include <continousnode.h>
+#include <eventloop.h>
 #include "connectionfilemanager.h"
 
 #ifdef ENABLE_DESKTOP_INTEGRATION
@@ -40,6 +42,10 @@ class SynCEClient;
 
 /**
 @author Volker Christian
+
+Devices live on the EventLoop they were accepted on, clients on the main loop. The
+device lists are shared and guarded by a mutex; everything done to a device is posted
+to its loop and everything written to the clients is posted to the main loop.
 */
 class DeviceManager : public ContinousNode {
 public:
@@ -56,8 +62,9 @@ public:
     void passwordRejected(WindowsCEDeviceBase * windowsCEDevice);
     void addClient(SynCEClient * synCEClient);
     void removeClient(SynCEClient * synCEClient);
-    WindowsCEDeviceBase *getConnectedDevice(std::string name);
-    WindowsCEDeviceBase *getPasswordPendingDevice(std::string name);
+    bool sendPassword(std::string name, std::string password);
+    bool disconnectDevice(std::string name);
+    void disconnectDevice(WindowsCEDeviceBase * windowsCEDevice);
     void shutdownDevices();
     void shutdownClients();
     void shutdown();
@@ -67,10 +74,36 @@ protected:
     virtual void shot();
 
 private:
+    enum DeviceCommand {
+        PING = 0,
+        DISCONNECT,
+        PASSWORD
+    };
+
+    enum ClientEvent {
+        DEVICE_CONNECTED = 0,
+        DEVICE_DISCONNECTED,
+        PASSWORD_REQUESTED,
+        PASSWORD_REJECTED
+    };
+
+    class DeviceCall;
+    class ClientNotification;
+
     DeviceManager();
+    std::string getName(const WindowsCEDeviceBase * windowsCEDevice) const;
+    bool isRegistered(const WindowsCEDeviceBase * windowsCEDevice, unsigned long serial);
+    void dispatch(DeviceCall *deviceCall);
+    void notifyClients(enum ClientEvent clientEvent, std::string deviceName);
+    void runOnMainLoop(EventLoop::Callback *callback);
     std::list<WindowsCEDeviceBase *> connectedDevices;
     std::list<WindowsCEDeviceBase *> passwordPendingDevices;
     std::list<SynCEClient *> connectedClients;
+    std::list<std::string> announcedDevices;
+    size_t clientCount;
+    unsigned long nextSerial;
+    pthread_mutex_t mutex;
+    EventLoop *mainLoop;
     static DeviceManager *deviceManager;
 #ifdef ENABLE_DESKTOP_INTEGRATION
     VDCCMEventManager *eventManager;
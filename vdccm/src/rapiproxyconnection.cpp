@@ -15,11 +15,20 @@
 #include "rapiprovisioningclient.h"
 #include "cmdlineargs.h"
 #include <multiplexer.h>
+#include <forwarder.h>
+#include <capturefile.h>
+#include <capturewriter.h>
 #include <synce_log.h>
 
 #include <iostream>
 
-#include <string.h>
+/*
+ * Bytes moved per forward(), the capacity of a pipe. splice() saves little over
+ * read() and write() in MTU sized pieces, the TCP stack segments larger writes anyway.
+ */
+#define FORWARD_CHUNK_SIZE 65536
+
+CaptureWriter *RapiProxyConnection::captureWriter = NULL;
 
 RapiProxyConnection::RapiProxyConnection(RapiConnection *rapiConnection, RapiProxy *rapiProxy,
                                          RapiProvisioningClient *rapiProvisioningClient)
@@ -30,9 +39,27 @@ RapiProxyConnection::RapiProxyConnection(RapiConnection *rapiConnection, RapiPro
     rapiProxy->setRapiProxyConnection(this);
     rapiProvisioningClient->setRapiProxyConnection(this);
     Multiplexer::self()->getReadManager()->add(rapiProvisioningClient);
-    mtuWH = rapiProvisioningClient->getMTU() - 40;
 
-    forwardBuffer = new unsigned char[mtuWH];
+    /* the packets are only looked at when they are dumped or captured */
+    bool parse = CmdLineArgs::getLogLevel() > 3 || captureWriter != NULL;
+
+    toDevice = new Forwarder(rapiProxy, rapiProvisioningClient, FORWARD_CHUNK_SIZE, !parse);
+    toApplication = new Forwarder(rapiProvisioningClient, rapiProxy, FORWARD_CHUNK_SIZE, !parse);
+    toDeviceParser = NULL;
+    toApplicationParser = NULL;
+    capture = captureWriter;
+    stream = 0;
+
+    if (parse) {
+        toDeviceParser = new FrameParser(this, RAPI_SNAP_LENGTH);
+        toApplicationParser = new FrameParser(this, RAPI_SNAP_LENGTH);
+        toDevice->setTap(toDeviceParser);
+        toApplication->setTap(toApplicationParser);
+    }
+
+    if (capture != NULL) {
+        stream = capture->newStream();
+    }
 }
 
 
@@ -47,12 +74,27 @@ RapiProxyConnection::~RapiProxyConnection()
 
     delete rapiProvisioningClient;
     delete rapiProxy;
-    delete[] forwardBuffer;
+    delete toDevice;
+    delete toApplication;
+    delete toDeviceParser;
+    delete toApplicationParser;
+}
+
+
+/*!
+    \fn RapiProxyConnection::setCaptureWriter(CaptureWriter *captureWriter)
+ */
+void RapiProxyConnection::setCaptureWriter(CaptureWriter *captureWriter)
+{
+    RapiProxyConnection::captureWriter = captureWriter;
 }
 
 
 void RapiProxyConnection::provisioningClientInitialized()
 {
+    /* the forwarders need both sides non-blocking */
+    rapiProxy->setNonBlocking();
+    rapiProvisioningClient->setNonBlocking();
     Multiplexer::self()->getReadManager()->add(rapiProxy);
 }
 
@@ -65,50 +107,44 @@ void RapiProxyConnection::provisioningClientNotInitialized()
 
 void RapiProxyConnection::forwardMessage(NetSocket *from, NetSocket *to)
 {
-    if ( CmdLineArgs::getLogLevel() <= 3 ) {
-        ssize_t r;
-
-        if (to->writable( 0, 0)) {
-            if ((r = read(from->getDescriptor(), forwardBuffer, mtuWH)) > 0) {
-                write(to->getDescriptor(), forwardBuffer, r);
-            } else {
-                rapiConnection->proxyConnectionClosed(this);
-                return ;
-            }
-        } else {
-            Multiplexer::self()->getWriteManager()->add(to);
-            Multiplexer::self()->getReadManager()->remove(from);
-        }
-    } else {
-        uint32_t leLength;
+    Forwarder *forwarder = (from == rapiProxy) ? toDevice : toApplication;
+
+    switch(forwarder->forward()) {
+    case Forwarder::DONE:
+        break;
+    case Forwarder::BLOCKED:
+        Multiplexer::self()->getWriteManager()->add(to);
+        Multiplexer::self()->getReadManager()->remove(from);
+        break;
+    case Forwarder::CLOSED:
+        rapiConnection->proxyConnectionClosed(this);
+        break;
+    }
+}
 
-        if ( read( from->getDescriptor(), &leLength, 4 ) <= 0 ) {
-            rapiConnection->proxyConnectionClosed(this);
-            return;
-        }
-        size_t length = letoh32(leLength);
 
-        unsigned char *buf = new unsigned char[ length + 4 ];
+/*!
+    \fn RapiProxyConnection::frameParsed(FrameParser *frameParser, const unsigned char *frame, size_t capturedLength, size_t length)
+ */
+void RapiProxyConnection::frameParsed(FrameParser *frameParser, const unsigned char *frame,
+                                      size_t capturedLength, size_t length)
+{
+    bool applicationToDevice = (frameParser == toDeviceParser);
 
-        memcpy( buf, ( char * ) & length, 4 );
-        if ( from->readNumBytes( buf + 4, length ) < (ssize_t) length ) {
-            delete[] buf;
-            rapiConnection->proxyConnectionClosed(this);
-            return;
-        }
+    if (capture != NULL) {
+        capture->write(stream, applicationToDevice ? RAPI_CAPTURE_TO_DEVICE : RAPI_CAPTURE_TO_APPLICATION,
+                       frame, capturedLength, length);
+    }
 
-        if (dynamic_cast<RapiProxy *>(from)) {
+    if ( CmdLineArgs::getLogLevel() > 3 ) {
+        if (applicationToDevice) {
             std::cout << "Application --> Device" << std::endl;
             std::cout << "======================" << std::endl;
         } else {
             std::cout << "Device --> Application" << std::endl;
             std::cout << "======================" << std::endl;
         }
-        rapiProvisioningClient->printPackage( "RapiProxy", buf );
-
-        write( to->getDescriptor(), buf, length + 4 );
-
-        delete[] buf;
+        rapiProvisioningClient->printPackage( "RapiProxy", ( unsigned char * ) frame, capturedLength );
     }
 }
 
@@ -127,6 +163,18 @@ void RapiProxyConnection::messageToApplication()
 
 void RapiProxyConnection::writeEnabled(NetSocket *where)
 {
+    Forwarder *forwarder = (where == rapiProvisioningClient) ? toDevice : toApplication;
+
+    switch(forwarder->flush()) {
+    case Forwarder::DONE:
+        break;
+    case Forwarder::BLOCKED:
+        return;
+    case Forwarder::CLOSED:
+        rapiConnection->proxyConnectionClosed(this);
+        return;
+    }
+
     if (dynamic_cast<RapiProvisioningClient *>(where)) {
         synce_info("Write again enabled on RapiProvisioningClient");
         Multiplexer::self()->getReadManager()->add(rapiProxy);
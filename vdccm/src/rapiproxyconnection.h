@@ -15,12 +15,20 @@
 /**
 	@author Volker Christian <voc@users.sourceforge.net>
 */
+#include <frameparser.h>
+#include <stdint.h>
+
 class RapiConnection;
 class RapiProxy;
 class RapiProvisioningClient;
 class NetSocket;
+class Forwarder;
+class CaptureWriter;
+
+/* bytes of a packet that are printed and captured, RAPI packets are rarely longer */
+#define RAPI_SNAP_LENGTH 65536
 
-class RapiProxyConnection{
+class RapiProxyConnection : public FrameParser::Listener {
 public:
     RapiProxyConnection(RapiConnection *rapiConnection, RapiProxy *rapiProxy, RapiProvisioningClient *rapiProvisioningClient);
 
@@ -34,12 +42,25 @@ public:
     void provisioningClientInitialized();
     void provisioningClientNotInitialized();
 
+    virtual void frameParsed(FrameParser *frameParser, const unsigned char *frame,
+                             size_t capturedLength, size_t length);
+
+    /**
+     * @brief Captures the packets of all connections created from now on.
+     */
+    static void setCaptureWriter(CaptureWriter *captureWriter);
+
     private:
         RapiConnection *rapiConnection;
         RapiProxy *rapiProxy;
         RapiProvisioningClient *rapiProvisioningClient;
-        unsigned int mtuWH;
-        unsigned char *forwardBuffer;
+        Forwarder *toDevice;
+        Forwarder *toApplication;
+        FrameParser *toDeviceParser;
+        FrameParser *toApplicationParser;
+        CaptureWriter *capture;
+        uint32_t stream;
+        static CaptureWriter *captureWriter;
 };
 
 #endif
@@ -16,6 +16,7 @@
 #include "rapihandshakeclient.h"
 #include "rapiprovisioningclient.h"
 #include "rapiproxyfactory.h"
+#include <eventlooppool.h>
 #include <synce_log.h>
 #include <synce.h>
 #include <cstdlib>
@@ -25,28 +26,66 @@
 
 using namespace std;
 
+// Hands an accepted connection to the loop of the device it comes from
+class RapiServer::ClientAccepted : public EventLoop::Callback
+{
+public:
+    ClientAccepted(RapiServer *rapiServer, int fd, string deviceIpAddress, bool handshake)
+        : rapiServer(rapiServer), fd(fd), deviceIpAddress(deviceIpAddress), handshake(handshake)
+    {
+    }
+
+    virtual void run()
+    {
+        if (handshake) {
+            rapiServer->handshakeClientAccepted(fd, deviceIpAddress);
+        } else {
+            rapiServer->provisioningClientAccepted(fd, deviceIpAddress);
+        }
+    }
+
+private:
+    RapiServer *rapiServer;
+    int fd;
+    string deviceIpAddress;
+    bool handshake;
+};
+
+
 RapiServer::RapiServer(RapiHandshakeClientFactory *rhcf, RapiProvisioningClientFactory *rpcf, u_int16_t port, string interfaceName)
     : TCPServerSocket(NULL, port, interfaceName)
 {
     rapiHandshakeClientFactory = rhcf;
     rapiProvisioningClientFactory = rpcf;
+    pthread_mutex_init(&mutex, NULL);
 }
 
 
 RapiServer::~RapiServer()
 {
+    map<string, RapiConnection*> connections;
+
+    // Each RapiConnection takes itself out of the map when it is deleted
+    pthread_mutex_lock(&mutex);
+    connections.swap(rapiConnection);
+    pthread_mutex_unlock(&mutex);
+
     map<string, RapiConnection*>::iterator it;
-    for (it = rapiConnection.begin(); it != rapiConnection.end(); ++it) {
+    for (it = connections.begin(); it != connections.end(); ++it) {
         RapiConnection *rc = (*it).second;
         delete rc;
     }
+
+    pthread_mutex_destroy(&mutex);
 }
 
 
 void RapiServer::disconnect(string deviceIpAddress)
 {
-    map<string, RapiConnection*>::iterator it = rapiConnection.find(deviceIpAddress);
-    rapiConnection.erase(it);
+    pthread_mutex_lock(&mutex);
+    rapiConnection.erase(deviceIpAddress);
+    connectionLoop.erase(deviceIpAddress);
+    pthread_mutex_unlock(&mutex);
 }
 
 
@@ -74,24 +113,74 @@ void RapiServer::event(Descriptor::eventType /*et*/)
         remoteIpAddress[0] = '\0';
     }
 
-    if (rapiConnection[remoteIpAddress] == NULL) {
-        char *path;
-
-        if (!synce::synce_get_subdirectory("rapi2", &path)) {
-            return;
-        }
-        string socketPath = string(path) + "/" + remoteIpAddress;
-        free(path);
-        synce_info("RapiHandshakeClient for device with ip %s", remoteIpAddress);
-        // Rapi Handshake Client
-        rapiConnection[remoteIpAddress] =
-                new RapiConnection(new RapiProxyFactory(), socketPath, this, remoteIpAddress);
-        rapiConnection[remoteIpAddress]->setHandshakeClient(
-                dynamic_cast<RapiHandshakeClient *>(rapiHandshakeClientFactory->socket(fd, this)));
+    // The first connection of a device is its handshake client, the later ones are
+    // provisioning clients and go to the loop the handshake client was put on
+    EventLoop *eventLoop;
+    bool handshake;
+
+    pthread_mutex_lock(&mutex);
+    map<string, EventLoop*>::iterator it = connectionLoop.find(remoteIpAddress);
+    handshake = it == connectionLoop.end();
+    if (handshake) {
+        eventLoop = EventLoopPool::self()->next();
+        connectionLoop[remoteIpAddress] = eventLoop;
     } else {
-        synce_info("RapiProvisioningClient for device with ip %s", remoteIpAddress);
-        // Rapi Provisioning Client
-        rapiConnection[remoteIpAddress]->addProvisioningClient(
-                dynamic_cast<RapiProvisioningClient *>(rapiProvisioningClientFactory->socket(fd, this)));
+        eventLoop = (*it).second;
+    }
+    pthread_mutex_unlock(&mutex);
+
+    eventLoop->invoke(new ClientAccepted(this, fd, remoteIpAddress, handshake));
+}
+
+
+/*!
+    \fn RapiServer::handshakeClientAccepted(int fd, string deviceIpAddress)
+ */
+void RapiServer::handshakeClientAccepted(int fd, string deviceIpAddress)
+{
+    char *path;
+
+    if (!synce::synce_get_subdirectory("rapi2", &path)) {
+        disconnect(deviceIpAddress);
+        ::close(fd);
+        return;
+    }
+    string socketPath = string(path) + "/" + deviceIpAddress;
+    free(path);
+    synce_info("RapiHandshakeClient for device with ip %s", deviceIpAddress.c_str());
+    // Rapi Handshake Client
+    RapiConnection *rc = new RapiConnection(new RapiProxyFactory(), socketPath, this, deviceIpAddress);
+
+    pthread_mutex_lock(&mutex);
+    rapiConnection[deviceIpAddress] = rc;
+    pthread_mutex_unlock(&mutex);
+
+    rc->setHandshakeClient(dynamic_cast<RapiHandshakeClient *>(rapiHandshakeClientFactory->socket(fd, this)));
+}
+
+
+/*!
+    \fn RapiServer::provisioningClientAccepted(int fd, string deviceIpAddress)
+ */
+void RapiServer::provisioningClientAccepted(int fd, string deviceIpAddress)
+{
+    RapiConnection *rc = NULL;
+
+    // Only this loop deletes the connection, but it may be gone already
+    pthread_mutex_lock(&mutex);
+    map<string, RapiConnection*>::iterator it = rapiConnection.find(deviceIpAddress);
+    if (it != rapiConnection.end()) {
+        rc = (*it).second;
     }
+    pthread_mutex_unlock(&mutex);
+
+    if (rc == NULL) {
+        ::close(fd);
+        return;
+    }
+
+    synce_info("RapiProvisioningClient for device with ip %s", deviceIpAddress.c_str());
+    // Rapi Provisioning Client
+    rc->addProvisioningClient(
+            dynamic_cast<RapiProvisioningClient *>(rapiProvisioningClientFactory->socket(fd, this)));
 }
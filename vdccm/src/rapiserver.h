@@ -15,6 +15,7 @@
 #include <tcpserversocket.h>
 #include <string.h>
 #include <map>
+#include <pthread.h>
 
 /**
 	@author Volker Christian <voc@users.sourceforge.net>
@@ -24,6 +25,7 @@ class RapiHandshakeClientFactory;
 class RapiProvisioningClientFactory;
 
 class RapiConnection;
+class EventLoop;
 
 class RapiServer : public TCPServerSocket
 {
@@ -36,10 +38,18 @@ public:
     void disconnect(std::string deviceIpAddress);
 
 private:
+    class ClientAccepted;
+
+    void handshakeClientAccepted(int fd, std::string deviceIpAddress);
+    void provisioningClientAccepted(int fd, std::string deviceIpAddress);
+
     RapiHandshakeClientFactory *rapiHandshakeClientFactory;
     RapiProvisioningClientFactory *rapiProvisioningClientFactory;
 
+    // Both maps are shared by the event loops and guarded by mutex
     std::map<std::string, RapiConnection*> rapiConnection;
+    std::map<std::string, EventLoop*> connectionLoop;
+    pthread_mutex_t mutex;
 };
 
 #endif
@@ -69,14 +69,7 @@ void SynCEClient::event(Descriptor::eventType /*et*/)
         case 'R': {
                 char * password = &buffer[ 1 ];
                 char *name = strsep( &password, "=" );
-                WindowsCEDeviceBase *windowsCEDevice = DeviceManager::self()->getPasswordPendingDevice( name );
-                if ( windowsCEDevice != NULL ) {
-                    synce_trace( "Sending Password to: %s", name );
-                    if ( !windowsCEDevice->sendPassword( password ) ) {
-                        synce_trace( "failed to send password to %s", name );
-                        windowsCEDevice->disconnect();
-                    }
-                } else {
+                if ( password == NULL || !DeviceManager::self()->sendPassword( name, password ) ) {
                     synce_trace( "Got Password for %s from SynCEClient but no device waiting", name );
                 }
             }
@@ -88,10 +81,7 @@ void SynCEClient::event(Descriptor::eventType /*et*/)
         case 'D': {
                 synce_trace( "Disconnecting %s", &buffer[ 1 ] );
                 char *name = &buffer[ 1 ];
-                WindowsCEDeviceBase *windowsCEDevice = DeviceManager::self()->getConnectedDevice(name);
-                if ( windowsCEDevice != NULL ) {
-                    windowsCEDevice->disconnect();
-                } else {
+                if ( !DeviceManager::self()->disconnectDevice( name ) ) {
                     synce_trace( "Got deisconnect command for %s from SynCEClient but no device connected", name );
                 }
             }
@@ -28,9 +28,12 @@
 #include "rapihandshakeclientfactory.h"
 #include "rapiprovisioningclientfactory.h"
 #include "devicemanager.h"
+#include "rapiproxyconnection.h"
 #include "multiplexer.h"
+#include "eventlooppool.h"
 #include "cmdlineargs.h"
 #include "utils.h"
+#include <capturewriter.h>
 #include <localserversocket.h>
 #include <synce_log.h>
 #include <cstdlib>
@@ -63,7 +66,27 @@ int main(int argc, char *argv[])
 
     Utils::setupSignals();
 
-    Multiplexer* mux = Multiplexer::self();
+    Multiplexer* mux = Multiplexer::self(CmdLineArgs::useEpoll() ? Multiplexer::EPOLL : Multiplexer::SELECT);
+
+    if (CmdLineArgs::useEpoll() && mux->getBackend() != Multiplexer::EPOLL) {
+        synce_warning("epoll is not available, using select");
+    }
+
+    // Devices are spread over the loops of the pool, servers and clients stay on the main loop
+    EventLoop *mainLoop = new EventLoop(mux);
+    EventLoopPool *eventLoopPool = new EventLoopPool(CmdLineArgs::getLoopThreads(), mux->getBackend(), mainLoop);
+
+    // Opened before daemon() changes to / so a relative path works
+    CaptureWriter *captureWriter = NULL;
+
+    if (!CmdLineArgs::getCaptureFile().empty()) {
+        captureWriter = new CaptureWriter();
+        if (!captureWriter->open(CmdLineArgs::getCaptureFile().c_str(), RAPI_SNAP_LENGTH)) {
+            synce_error("Could not open capture file %s", CmdLineArgs::getCaptureFile().c_str());
+            exit(1);
+        }
+        RapiProxyConnection::setCaptureWriter(captureWriter);
+    }
 
     Utils::acquireRootPrivileg();
 
@@ -160,6 +183,15 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (!eventLoopPool->start()) {
+        synce_error("Could not start the event-loop threads");
+        exit(1);
+    }
+
+    if (captureWriter != NULL && !captureWriter->start()) {
+        synce_warning("Could not start the capture thread - packets are written at exit as far as they fit");
+    }
+
     deviceManager->init();
 
     Utils::runScripts("start");
@@ -177,6 +209,22 @@ int main(int argc, char *argv[])
 
     mux->getTimerNodeManager()->remove(deviceManager);
 
+    // The loops run the disconnects posted to them before they stop
+    deviceManager->shutdownDevices();
+    eventLoopPool->stop();
+
+    // The disconnect notifications the loops posted to the clients are only run now
+    mainLoop->runPending();
+
+    if (captureWriter != NULL) {
+        captureWriter->close();
+        if (captureWriter->getDropped() > 0) {
+            synce_warning("%lu packets could not be captured", captureWriter->getDropped());
+        }
+        RapiProxyConnection::setCaptureWriter(NULL);
+        delete captureWriter;
+    }
+
     dccmServer.shutdown();
     localServer.shutdown();
     rapiServer.shutdown();
@@ -184,6 +232,8 @@ int main(int argc, char *argv[])
     deviceManager->shutdown();
 
     delete deviceManager;
+    delete eventLoopPool;
+    delete mainLoop;
     delete mux;
 
     Utils::removePidFile();
@@ -13,6 +13,7 @@
 #define WINDOWSCEDEVICEBASE_H
 
 #include <synce.h>
+#include <eventloop.h>
 #include <string>
 
 using namespace std;
@@ -37,7 +38,18 @@ public:
             const WindowsCEDeviceBase *device;
     };
 
+    WindowsCEDeviceBase() : eventLoop(EventLoop::current()), serial(0) {};
+
     virtual ~WindowsCEDeviceBase(){};
+
+/*!
+    \fn WindowsCEDevice::getEventLoop() const
+
+    The loop the device was created on, all its descriptors belong to it.
+ */
+    EventLoop *getEventLoop() const {
+        return eventLoop;
+    }
 /*!
     \fn WindowsCEDevice::isLocked() const
  */
@@ -127,6 +139,12 @@ public:
     {
         return true;
     }
+
+private:
+    EventLoop *eventLoop;
+    unsigned long serial;
+
+friend class DeviceManager;
 };
 
 #endif
@@ -0,0 +1,335 @@
+//
+// C++ Implementation: forwardbench
+//
+// Description: CPU time the Forwarder spends per MB passed between two
+// loopback TCP connections, copying through a buffer and with splice().
+//
+// Usage: forwardbench [-c CHUNK[,CHUNK...]] [-s MB] [-f FRAME] [-C FILE]
+//
+// A child process writes MB megabytes into the first connection, a second
+// one reads them from the other end of the second connection. This process
+// only forwards, so its CPU time is the cost of forwarding. The bytes are
+// RAPI-like frames of FRAME bytes with their length prefix. With -C the
+// copying forwarder is run once more with the frames split by a FrameParser
+// and written to FILE by a CaptureWriter, as vdccm -c does.
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+
+#include <capturefile.h>
+#include <capturewriter.h>
+#include <descriptor.h>
+#include <forwarder.h>
+#include <frameparser.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+class BenchDescriptor : public Descriptor {
+public:
+    BenchDescriptor(int descriptor)
+    {
+        setDescriptor(descriptor);
+        fcntl(descriptor, F_SETFL, fcntl(descriptor, F_GETFL) | O_NONBLOCK);
+    }
+
+    virtual ~BenchDescriptor()
+    {
+        ::close(getDescriptor());
+    }
+
+protected:
+    virtual void event(enum eventType et)
+    {
+    }
+};
+
+
+class BenchCapture : public FrameParser::Listener {
+public:
+    BenchCapture(CaptureWriter *captureWriter)
+    {
+        this->captureWriter = captureWriter;
+        frames = 0;
+    }
+
+    virtual void frameParsed(FrameParser *frameParser, const unsigned char *frame,
+                             size_t capturedLength, size_t length)
+    {
+        captureWriter->write(1, RAPI_CAPTURE_TO_DEVICE, frame, capturedLength, length);
+        frames++;
+    }
+
+    unsigned long frames;
+
+private:
+    CaptureWriter *captureWriter;
+};
+
+
+enum Mode {
+    COPY = 0,
+    SPLICE,
+    CAPTURE
+};
+
+
+/* connects a pair of TCP sockets over the loopback interface */
+static bool tcpPair(int sv[2])
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (server < 0 || bind(server, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+            listen(server, 1) < 0 || getsockname(server, (struct sockaddr *) &addr, &len) < 0) {
+        perror("listen");
+        return false;
+    }
+
+    sv[0] = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(sv[0], (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror("connect");
+        return false;
+    }
+    sv[1] = accept(server, NULL, NULL);
+    ::close(server);
+
+    return sv[1] >= 0;
+}
+
+
+static double seconds(const struct timeval &tv)
+{
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+
+static bool run(enum Mode mode, size_t chunk, unsigned int megabytes, size_t frame, const char *captureFile)
+{
+    int in[2];
+    int out[2];
+    unsigned long long total = (unsigned long long) megabytes << 20;
+
+    if (!tcpPair(in) || !tcpPair(out)) {
+        return false;
+    }
+
+    CaptureWriter *captureWriter = NULL;
+
+    if (mode == CAPTURE) {
+        captureWriter = new CaptureWriter();
+        if (!captureWriter->open(captureFile, 65536)) {
+            perror(captureFile);
+            delete captureWriter;
+            return false;
+        }
+    }
+
+    pid_t writer = fork();
+
+    if (writer == 0) {
+        unsigned char buffer[65536];
+        size_t length = sizeof(buffer) - sizeof(buffer) % frame;
+        unsigned long long written = 0;
+
+        ::close(in[1]);
+        ::close(out[0]);
+        ::close(out[1]);
+
+        memset(buffer, 'x', sizeof(buffer));
+        for (size_t i = 0; i < length; i += frame) {
+            buffer[i] = (frame - 4) & 0xff;
+            buffer[i + 1] = ((frame - 4) >> 8) & 0xff;
+            buffer[i + 2] = 0;
+            buffer[i + 3] = 0;
+        }
+
+        while (written < total) {
+            size_t left = (total - written < length) ? total - written : length;
+            ssize_t n = write(in[0], buffer, left);
+            if (n <= 0) {
+                _exit(1);
+            }
+            written += n;
+        }
+        _exit(0);
+    }
+
+    pid_t reader = fork();
+
+    if (reader == 0) {
+        char buffer[65536];
+        unsigned long long received = 0;
+        ssize_t n;
+
+        ::close(in[0]);
+        ::close(in[1]);
+        ::close(out[0]);
+
+        while ((n = read(out[1], buffer, sizeof(buffer))) > 0) {
+            received += n;
+        }
+        _exit(received == total ? 0 : 1);
+    }
+
+    ::close(in[0]);
+    ::close(out[1]);
+
+    BenchDescriptor *from = new BenchDescriptor(in[1]);
+    BenchDescriptor *to = new BenchDescriptor(out[0]);
+    Forwarder forwarder(from, to, chunk, mode == SPLICE);
+    Forwarder::Result result = Forwarder::DONE;
+    BenchCapture *benchCapture = NULL;
+    FrameParser *frameParser = NULL;
+    struct rusage start;
+    struct rusage end;
+    struct timeval wallStart;
+    struct timeval wallEnd;
+
+    getrusage(RUSAGE_SELF, &start);
+    gettimeofday(&wallStart, NULL);
+
+    if (captureWriter != NULL) {
+        /* without its thread the writer drops what does not fit, and close() writes the rest */
+        captureWriter->start();
+        benchCapture = new BenchCapture(captureWriter);
+        frameParser = new FrameParser(benchCapture, 65536);
+        forwarder.setTap(frameParser);
+    }
+
+    while (result != Forwarder::CLOSED) {
+        struct pollfd pfd;
+
+        /* like the multiplexer: wait for the source, or for the destination while blocked */
+        if (forwarder.isPending()) {
+            pfd.fd = to->getDescriptor();
+            pfd.events = POLLOUT;
+        } else {
+            pfd.fd = from->getDescriptor();
+            pfd.events = POLLIN;
+        }
+
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+            break;
+        }
+
+        result = forwarder.isPending() ? forwarder.flush() : forwarder.forward();
+    }
+
+    unsigned long frames = 0;
+    unsigned long dropped = 0;
+
+    /* the capture thread is timed too, it has to write out what is left */
+    if (captureWriter != NULL) {
+        captureWriter->close();
+        frames = benchCapture->frames;
+        dropped = captureWriter->getDropped();
+        delete frameParser;
+        delete benchCapture;
+        delete captureWriter;
+    }
+
+    gettimeofday(&wallEnd, NULL);
+    getrusage(RUSAGE_SELF, &end);
+
+    bool zeroCopied = forwarder.isZeroCopy();
+
+    delete from;
+    delete to;
+
+    int writerStatus;
+    int readerStatus;
+
+    waitpid(writer, &writerStatus, 0);
+    waitpid(reader, &readerStatus, 0);
+
+    double cpu = seconds(end.ru_utime) - seconds(start.ru_utime) +
+                 seconds(end.ru_stime) - seconds(start.ru_stime);
+    double wall = seconds(wallEnd) - seconds(wallStart);
+
+    printf("%-7s %6lu bytes/chunk: %8.1f us CPU/MB, %7.1f MB/s\n",
+           mode == CAPTURE ? "capture" : zeroCopied ? "splice" : "copy", (unsigned long) chunk,
+           cpu * 1000000 / megabytes, megabytes / wall);
+
+    if (mode == SPLICE && !zeroCopied) {
+        printf("        splice() not available\n");
+    }
+
+    if (mode == CAPTURE) {
+        printf("        %lu frames, %lu not captured\n", frames, dropped);
+    }
+
+    return WIFEXITED(readerStatus) && WEXITSTATUS(readerStatus) == 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char *chunkList = "1460,16384,65536";
+    const char *captureFile = NULL;
+    unsigned int megabytes = 512;
+    size_t frame = 512;
+    int result = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "c:s:f:C:h")) != -1) {
+        switch (c) {
+        case 'c':
+            chunkList = optarg;
+            break;
+
+        case 's':
+            megabytes = atoi(optarg);
+            break;
+
+        case 'f':
+            frame = atoi(optarg);
+            break;
+
+        case 'C':
+            captureFile = optarg;
+            break;
+
+        case 'h':
+        default:
+            fprintf(stderr, "Usage: %s [-c CHUNK[,CHUNK...]] [-s MB] [-f FRAME] [-C FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (frame < 4 || frame > 65536) {
+        fprintf(stderr, "FRAME has to be between 4 and 65536 bytes\n");
+        return 1;
+    }
+
+    char *list = strdup(chunkList);
+
+    for (char *item = strtok(list, ","); item != NULL; item = strtok(NULL, ",")) {
+        size_t chunk = atoi(item);
+
+        if (!run(COPY, chunk, megabytes, frame, captureFile) || !run(SPLICE, chunk, megabytes, frame, captureFile) ||
+                (captureFile != NULL && !run(CAPTURE, chunk, megabytes, frame, captureFile))) {
+            printf("        bytes lost\n");
+            result = 1;
+        }
+    }
+
+    free(list);
+
+    return result;
+}
@@ -0,0 +1,247 @@
+//
+// C++ Implementation: multiplexerbench
+//
+// Description: Cost of Multiplexer::multiplex() with many idle and a few
+// busy descriptors, for the select and the epoll backend.
+//
+// Usage: multiplexerbench [-i IDLE[,IDLE...]] [-b BUSY] [-t TIMERS] [-n ROUNDS]
+//
+// Each busy descriptor has a byte waiting that its event() reads and
+// writes back through the other end of its socketpair, so it is ready
+// in every round. The idle descriptors are never ready. select() cannot
+// watch descriptors above FD_SETSIZE, so runs with more idle
+// descriptors than fit are done with epoll only. The TIMERS timer nodes
+// are pending during the whole run, as keep-alive timers of many devices
+// would be.
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+
+#include <continousnode.h>
+#include <descriptor.h>
+#include <multiplexer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <vector>
+
+using namespace std;
+
+class BenchDescriptor : public Descriptor {
+public:
+    BenchDescriptor(int descriptor, int peer)
+    {
+        setDescriptor(descriptor);
+        this->peer = peer;
+        events = 0;
+    }
+
+    virtual ~BenchDescriptor()
+    {
+        ::close(getDescriptor());
+        ::close(peer);
+    }
+
+    unsigned long events;
+
+protected:
+    virtual void event(enum eventType et)
+    {
+        unsigned char byte;
+
+        if (read(getDescriptor(), &byte, 1) == 1) {
+            events++;
+            if (write(peer, &byte, 1) != 1) {
+                fprintf(stderr, "write failed\n");
+            }
+        }
+    }
+
+private:
+    int peer;
+};
+
+
+class BenchTimer : public ContinousNode {
+public:
+    BenchTimer(int sec)
+     : ContinousNode(sec, 0)
+    {
+    }
+
+protected:
+    virtual void shot()
+    {
+    }
+};
+
+
+static BenchDescriptor *newDescriptor(bool busy)
+{
+    int sv[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        perror("socketpair");
+        return NULL;
+    }
+
+    if (busy && write(sv[1], "x", 1) != 1) {
+        perror("write");
+    }
+
+    return new BenchDescriptor(sv[0], sv[1]);
+}
+
+
+static double elapsed(const struct timeval &start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+
+    return (now.tv_sec - start.tv_sec) + (now.tv_usec - start.tv_usec) / 1000000.0;
+}
+
+
+static bool run(enum Multiplexer::Backend backend, int idle, int busy, int timers, int rounds)
+{
+    Multiplexer *mux = Multiplexer::self(backend);
+    vector<BenchDescriptor *> idleDescriptors;
+    vector<BenchDescriptor *> busyDescriptors;
+    vector<BenchTimer *> timerNodes;
+    bool ret = true;
+
+    if (mux->getBackend() != backend) {
+        printf("%-7s not available\n", backend == Multiplexer::EPOLL ? "epoll" : "select");
+        delete mux;
+        return false;
+    }
+
+    for (int i = 0; i < idle + busy; i++) {
+        BenchDescriptor *descriptor = newDescriptor(i >= idle);
+
+        if (descriptor == NULL) {
+            ret = false;
+            break;
+        }
+
+        if (i < idle) {
+            idleDescriptors.push_back(descriptor);
+        } else {
+            busyDescriptors.push_back(descriptor);
+        }
+
+        mux->getReadManager()->add(descriptor);
+    }
+
+    for (int i = 0; i < timers; i++) {
+        BenchTimer *timer = new BenchTimer(3600 + i % 600);
+
+        timerNodes.push_back(timer);
+        mux->getTimerNodeManager()->add(timer);
+    }
+
+    if (ret) {
+        struct timeval start;
+        unsigned long events = 0;
+
+        gettimeofday(&start, NULL);
+        for (int i = 0; i < rounds; i++) {
+            mux->multiplex();
+        }
+        double seconds = elapsed(start);
+
+        for (unsigned int i = 0; i < busyDescriptors.size(); i++) {
+            events += busyDescriptors[i]->events;
+        }
+
+        printf("%-7s %6d idle %3d busy %6d timers: %8.2f us/round, %9.0f events/s\n",
+               backend == Multiplexer::EPOLL ? "epoll" : "select", idle, busy, timers,
+               seconds * 1000000 / rounds, events / seconds);
+
+        if (events != (unsigned long) rounds * busy) {
+            printf("        expected %lu events, got %lu\n", (unsigned long) rounds * busy, events);
+            ret = false;
+        }
+    }
+
+    for (unsigned int i = 0; i < timerNodes.size(); i++) {
+        mux->getTimerNodeManager()->remove(timerNodes[i]);
+        delete timerNodes[i];
+    }
+
+    for (unsigned int i = 0; i < idleDescriptors.size(); i++) {
+        mux->getReadManager()->remove(idleDescriptors[i]);
+        delete idleDescriptors[i];
+    }
+
+    for (unsigned int i = 0; i < busyDescriptors.size(); i++) {
+        mux->getReadManager()->remove(busyDescriptors[i]);
+        delete busyDescriptors[i];
+    }
+
+    delete mux;
+
+    return ret;
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char *idleList = "0,100,400,2000";
+    int busy = 4;
+    int timers = 0;
+    int rounds = 20000;
+    int result = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "b:i:t:n:h")) != -1) {
+        switch (c) {
+        case 'b':
+            busy = atoi(optarg);
+            break;
+
+        case 'i':
+            idleList = optarg;
+            break;
+
+        case 't':
+            timers = atoi(optarg);
+            break;
+
+        case 'n':
+            rounds = atoi(optarg);
+            break;
+
+        case 'h':
+        default:
+            fprintf(stderr, "Usage: %s [-i IDLE[,IDLE...]] [-b BUSY] [-t TIMERS] [-n ROUNDS]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    char *list = strdup(idleList);
+
+    for (char *item = strtok(list, ","); item != NULL; item = strtok(NULL, ",")) {
+        int idle = atoi(item);
+
+        /* each descriptor takes two numbers, with its peer */
+        if (2 * (idle + busy) + 10 < FD_SETSIZE) {
+            if (!run(Multiplexer::SELECT, idle, busy, timers, rounds)) {
+                result = 1;
+            }
+        }
+
+        if (!run(Multiplexer::EPOLL, idle, busy, timers, rounds)) {
+            result = 1;
+        }
+    }
+
+    free(list);
+
+    return result;
+}
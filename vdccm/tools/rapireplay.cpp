@@ -0,0 +1,266 @@
+//
+// C++ Implementation: rapireplay
+//
+// Description: Lists the RAPI packets captured by vdccm -c, or sends the
+// packets an application sent to a device again.
+//
+// Usage: rapireplay [-x] [-n STREAM] [-s SOCKET] FILE
+//
+// Without -s every packet is listed with the time since the first one, its
+// stream (one per proxied connection) and direction, -x adds a hex dump.
+// With -s the packets the application sent on STREAM, by default the first
+// stream in the file, are sent to the RAPI socket SOCKET of a connected
+// device (~/.synce/rapi2/IP-ADDRESS) one after the other, each after the
+// replies captured before it have been read, and replies of a different
+// length than the captured ones are reported.
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+
+#include <capturefile.h>
+#include <capturereader.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#define REPLY_TIMEOUT   10      /* seconds */
+
+
+static void hexDump(const unsigned char *data, size_t length)
+{
+    for (size_t line = 0; line < length; line += 16) {
+        printf("    %08lx ", (unsigned long) line);
+        for (size_t i = line; i < line + 16; i++) {
+            if (i < length) {
+                printf(" %02x", data[i]);
+            } else {
+                printf("   ");
+            }
+        }
+        printf("  ");
+        for (size_t i = line; i < line + 16 && i < length; i++) {
+            putchar(isprint(data[i]) ? data[i] : '.');
+        }
+        putchar('\n');
+    }
+}
+
+
+static int list(CaptureReader &reader, bool allStreams, uint32_t stream, bool hex)
+{
+    CaptureReader::Record record;
+    const unsigned char *data;
+    double start = -1;
+
+    while ((data = reader.next(record)) != NULL) {
+        double time = record.seconds + record.microseconds / 1000000.0;
+
+        if (!allStreams && record.stream != stream) {
+            continue;
+        }
+
+        if (start < 0) {
+            start = time;
+        }
+
+        printf("%12.6f  stream %-4u %s  %6u bytes", time - start, record.stream,
+               record.direction == RAPI_CAPTURE_TO_DEVICE ? "Application --> Device" : "Device --> Application",
+               record.length);
+        if (record.capturedLength < record.length) {
+            printf(" (%u captured)", record.capturedLength);
+        }
+        putchar('\n');
+
+        if (hex) {
+            hexDump(data, record.capturedLength);
+        }
+    }
+
+    return 0;
+}
+
+
+static bool writeAll(int fd, const unsigned char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        length -= n;
+    }
+
+    return true;
+}
+
+
+static bool readAll(int fd, unsigned char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t n = read(fd, data, length);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        length -= n;
+    }
+
+    return true;
+}
+
+
+/* reads one packet, returns its length with the length prefix or 0 */
+static size_t readReply(int fd)
+{
+    unsigned char buffer[4096];
+
+    if (!readAll(fd, buffer, 4)) {
+        return 0;
+    }
+
+    size_t length = buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((size_t) buffer[3] << 24);
+
+    for (size_t left = length; left > 0; ) {
+        size_t n = (left < sizeof(buffer)) ? left : sizeof(buffer);
+
+        if (!readAll(fd, buffer, n)) {
+            return 0;
+        }
+        left -= n;
+    }
+
+    return length + 4;
+}
+
+
+static int replay(CaptureReader &reader, bool allStreams, uint32_t stream, const char *path)
+{
+    CaptureReader::Record record;
+    const unsigned char *data;
+    struct sockaddr_un addr;
+    struct timeval timeout;
+    unsigned int sent = 0;
+    unsigned int replies = 0;
+    unsigned int different = 0;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror(path);
+        return 1;
+    }
+
+    timeout.tv_sec = REPLY_TIMEOUT;
+    timeout.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    while ((data = reader.next(record)) != NULL) {
+        if (allStreams) {
+            stream = record.stream;
+            allStreams = false;
+        }
+
+        if (record.stream != stream) {
+            continue;
+        }
+
+        if (record.direction == RAPI_CAPTURE_TO_DEVICE) {
+            if (record.capturedLength < record.length) {
+                fprintf(stderr, "packet %u is cut short in the capture, stopping\n", sent + 1);
+                break;
+            }
+            if (!writeAll(fd, data, record.length)) {
+                perror("write");
+                break;
+            }
+            sent++;
+        } else {
+            size_t length = readReply(fd);
+
+            if (length == 0) {
+                fprintf(stderr, "no reply %u from the device\n", replies + 1);
+                break;
+            }
+            replies++;
+
+            if (length != record.length) {
+                printf("reply %u: %lu bytes, %u captured\n", replies, (unsigned long) length, record.length);
+                different++;
+            }
+        }
+    }
+
+    close(fd);
+
+    printf("stream %u: %u packets sent, %u replies, %u of a different length\n",
+           stream, sent, replies, different);
+
+    return different > 0 ? 1 : 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    CaptureReader reader;
+    const char *socketPath = NULL;
+    bool allStreams = true;
+    uint32_t stream = 0;
+    bool hex = false;
+    int c;
+
+    while ((c = getopt(argc, argv, "xn:s:h")) != -1) {
+        switch (c) {
+        case 'x':
+            hex = true;
+            break;
+
+        case 'n':
+            stream = strtoul(optarg, NULL, 0);
+            allStreams = false;
+            break;
+
+        case 's':
+            socketPath = optarg;
+            break;
+
+        case 'h':
+        default:
+            fprintf(stderr, "Usage: %s [-x] [-n STREAM] [-s SOCKET] FILE\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: %s [-x] [-n STREAM] [-s SOCKET] FILE\n", argv[0]);
+        return 1;
+    }
+
+    if (!reader.open(argv[optind])) {
+        fprintf(stderr, "%s: not a capture file\n", argv[optind]);
+        return 1;
+    }
+
+    if (socketPath != NULL) {
+        return replay(reader, allStreams, stream, socketPath);
+    }
+
+    return list(reader, allStreams, stream, hex);
+}